@@ -0,0 +1,180 @@
+// MIT License
+
+// Copyright (c) 2023 nastyapple
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+
+// CPU cost of moving a large response body through ProxyServer, zero-copy
+// (splice through a pooled pipe) vs. copying through the relay buffer.
+//
+// An in-process upstream answers each request with a Content-Length body of
+// the requested size; a client downloads it through the proxy and discards
+// it. The upstream and client do identical work in both runs, so the
+// difference in process CPU time is the proxy's relay cost.
+//
+//   ./bench_proxy_relay [mebibytes=2048]
+
+#include "muses/net_components/proxy.hpp"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+constexpr std::size_t kIoChunk = 1 << 20;
+
+int listen_loopback(unsigned short* port) {
+    int fd = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    sockaddr_in a{};
+    a.sin_family = AF_INET;
+    a.sin_addr.s_addr = ::inet_addr("127.0.0.1");
+    int opt = 1;
+    ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    ::bind(fd, reinterpret_cast<sockaddr*>(&a), sizeof(a));
+    ::listen(fd, 16);
+    socklen_t l = sizeof(a);
+    ::getsockname(fd, reinterpret_cast<sockaddr*>(&a), &l);
+    *port = ntohs(a.sin_port);
+    return fd;
+}
+
+double cpu_seconds() {
+    rusage ru{};
+    ::getrusage(RUSAGE_SELF, &ru);
+    auto secs = [](const timeval& tv) { return tv.tv_sec + tv.tv_usec / 1e6; };
+    return secs(ru.ru_utime) + secs(ru.ru_stime);
+}
+
+bool write_all(int fd, const char* p, std::size_t n) {
+    while (n > 0) {
+        ssize_t w = ::write(fd, p, n);
+        if (w <= 0) return false;
+        p += w;
+        n -= static_cast<std::size_t>(w);
+    }
+    return true;
+}
+
+// Upstream: for each request on a connection, reply with `body` bytes.
+void serve_upstream(int listen_fd, std::size_t body) {
+    std::vector<char> data(kIoChunk, 'x');
+    char req[4096];
+    for (;;) {
+        int c = ::accept(listen_fd, nullptr, nullptr);
+        if (c < 0) return;
+        for (;;) {
+            std::string head;
+            while (head.find("\r\n\r\n") == std::string::npos) {
+                ssize_t r = ::read(c, req, sizeof(req));
+                if (r <= 0) break;
+                head.append(req, static_cast<std::size_t>(r));
+            }
+            if (head.find("\r\n\r\n") == std::string::npos) break;
+            std::string resp = "HTTP/1.1 200 OK\r\nContent-Length: " + std::to_string(body) +
+                               "\r\nConnection: keep-alive\r\n\r\n";
+            if (!write_all(c, resp.data(), resp.size())) break;
+            std::size_t left = body;
+            while (left > 0) {
+                std::size_t n = left < data.size() ? left : data.size();
+                if (!write_all(c, data.data(), n)) break;
+                left -= n;
+            }
+        }
+        ::close(c);
+    }
+}
+
+// One download through a fresh proxy. Returns false on a short transfer.
+bool run(bool zero_copy, unsigned short up_port, std::size_t body) {
+    unsigned short proxy_port = 0;
+    int proxy_fd = listen_loopback(&proxy_port);
+    muses::ProxyOptions opts;
+    opts.max_retries = 0;
+    opts.zero_copy = zero_copy;
+    muses::ProxyServer proxy(proxy_fd, {{"/", "127.0.0.1", up_port}}, opts);
+    proxy.start();
+
+    int client = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    sockaddr_in a{};
+    a.sin_family = AF_INET;
+    a.sin_addr.s_addr = ::inet_addr("127.0.0.1");
+    a.sin_port = htons(proxy_port);
+    if (::connect(client, reinterpret_cast<sockaddr*>(&a), sizeof(a)) != 0) return false;
+
+    static const char kRequest[] = "GET /blob HTTP/1.1\r\nHost: bench\r\nConnection: close\r\n\r\n";
+    std::vector<char> buf(kIoChunk);
+    double cpu0 = cpu_seconds();
+    auto t0 = std::chrono::steady_clock::now();
+    write_all(client, kRequest, sizeof(kRequest) - 1);
+    std::size_t got = 0;
+    for (;;) {
+        ssize_t r = ::read(client, buf.data(), buf.size());
+        if (r <= 0) break;
+        got += static_cast<std::size_t>(r);
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    double cpu = cpu_seconds() - cpu0;
+
+    double secs = std::chrono::duration<double>(t1 - t0).count();
+    double gib = static_cast<double>(body) / (1 << 30);
+    std::printf("%-10s %8.2f GiB/s   %6.3f CPU-s/GiB (process)\n",
+                zero_copy ? "splice" : "copy", gib / secs, cpu / gib);
+
+    ::close(client);
+    proxy.stop();
+    ::close(proxy_fd);
+    return got > body;  // head + body
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    std::size_t mib = 2048;
+    if (argc > 1) mib = static_cast<std::size_t>(std::strtoull(argv[1], nullptr, 10));
+    std::size_t body = mib << 20;
+
+    unsigned short up_port = 0;
+    int up_fd = listen_loopback(&up_port);
+    std::thread upstream(serve_upstream, up_fd, body);
+
+    std::printf("body: %zu MiB\n", mib);
+    bool ok = run(false, up_port, body) && run(true, up_port, body);
+
+    ::shutdown(up_fd, SHUT_RDWR);
+    ::close(up_fd);
+    upstream.join();
+    if (!ok) {
+        std::fprintf(stderr, "short transfer\n");
+        return 1;
+    }
+    return 0;
+}
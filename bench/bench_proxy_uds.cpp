@@ -0,0 +1,245 @@
+// MIT License
+
+// Copyright (c) 2023 nastyapple
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+
+// Request rate and throughput through ProxyServer with loopback TCP vs.
+// Unix-domain sockets on both legs (client → proxy and proxy → upstream).
+//
+// An in-process upstream answers each request with a Content-Length body of
+// the given size; one client sends `requests` GETs back to back on a
+// keep-alive connection and reads each response in full. Both runs move the
+// same bytes through the same proxy code, so the difference is what the
+// kernel's TCP path costs over a Unix socket's.
+//
+//   ./bench_proxy_uds [requests=20000] [body_bytes=1024]
+
+#include "muses/net_components/proxy.hpp"
+#include "muses/net/reactor.hpp"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// Where a socket listens: a unix: path, or 127.0.0.1:port.
+struct Address {
+    std::string path;  // empty: TCP
+    unsigned short port = 0;
+};
+
+// A listening socket for `addr` (a TCP port of 0 is filled in).
+int listen_on(Address& addr) {
+    if (!addr.path.empty()) {
+        int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        sockaddr_un u{};
+        u.sun_family = AF_UNIX;
+        std::strncpy(u.sun_path, addr.path.c_str(), sizeof(u.sun_path) - 1);
+        ::unlink(addr.path.c_str());
+        ::bind(fd, reinterpret_cast<sockaddr*>(&u), sizeof(u));
+        ::listen(fd, 16);
+        return fd;
+    }
+    int fd = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    sockaddr_in a{};
+    a.sin_family = AF_INET;
+    a.sin_addr.s_addr = ::inet_addr("127.0.0.1");
+    int opt = 1;
+    ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    ::bind(fd, reinterpret_cast<sockaddr*>(&a), sizeof(a));
+    ::listen(fd, 16);
+    socklen_t l = sizeof(a);
+    ::getsockname(fd, reinterpret_cast<sockaddr*>(&a), &l);
+    addr.port = ntohs(a.sin_port);
+    return fd;
+}
+
+int connect_to(const Address& addr) {
+    if (!addr.path.empty()) {
+        int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        sockaddr_un u{};
+        u.sun_family = AF_UNIX;
+        std::strncpy(u.sun_path, addr.path.c_str(), sizeof(u.sun_path) - 1);
+        if (::connect(fd, reinterpret_cast<sockaddr*>(&u), sizeof(u)) != 0) {
+            ::close(fd);
+            return -1;
+        }
+        return fd;
+    }
+    int fd = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    int ok = 1;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &ok, sizeof(ok));
+    sockaddr_in a{};
+    a.sin_family = AF_INET;
+    a.sin_addr.s_addr = ::inet_addr("127.0.0.1");
+    a.sin_port = htons(addr.port);
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&a), sizeof(a)) != 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+bool write_all(int fd, const char* p, std::size_t n) {
+    while (n > 0) {
+        ssize_t w = ::write(fd, p, n);
+        if (w <= 0) return false;
+        p += w;
+        n -= static_cast<std::size_t>(w);
+    }
+    return true;
+}
+
+// Reads one response with a Content-Length body from `fd`; `buf` keeps
+// whatever arrived past it. Returns false on EOF or a malformed head.
+bool read_response(int fd, std::string& buf) {
+    char chunk[16384];
+    std::size_t end;
+    while ((end = buf.find("\r\n\r\n")) == std::string::npos) {
+        ssize_t r = ::read(fd, chunk, sizeof(chunk));
+        if (r <= 0) return false;
+        buf.append(chunk, static_cast<std::size_t>(r));
+    }
+    std::size_t cl = buf.find("Content-Length: ");
+    if (cl == std::string::npos || cl > end) return false;
+    std::size_t total = end + 4 + std::strtoull(buf.c_str() + cl + 16, nullptr, 10);
+    while (buf.size() < total) {
+        ssize_t r = ::read(fd, chunk, sizeof(chunk));
+        if (r <= 0) return false;
+        buf.append(chunk, static_cast<std::size_t>(r));
+    }
+    buf.erase(0, total);
+    return true;
+}
+
+// Upstream: every connection gets its own thread, which answers each
+// request on it with `body` bytes until the proxy hangs up.
+void serve_upstream(int listen_fd, std::size_t body) {
+    const std::string resp = "HTTP/1.1 200 OK\r\nContent-Length: " + std::to_string(body) +
+                             "\r\nConnection: keep-alive\r\n\r\n" + std::string(body, 'x');
+    std::vector<std::thread> conns;
+    for (;;) {
+        int c = ::accept(listen_fd, nullptr, nullptr);
+        if (c < 0) break;
+        conns.emplace_back([c, &resp] {
+            char req[4096];
+            std::string head;
+            for (;;) {
+                std::size_t end;
+                while ((end = head.find("\r\n\r\n")) == std::string::npos) {
+                    ssize_t r = ::read(c, req, sizeof(req));
+                    if (r <= 0) {
+                        ::close(c);
+                        return;
+                    }
+                    head.append(req, static_cast<std::size_t>(r));
+                }
+                head.erase(0, end + 4);
+                if (!write_all(c, resp.data(), resp.size())) break;
+            }
+            ::close(c);
+        });
+    }
+    for (auto& t : conns) t.join();
+}
+
+// `requests` GETs through a fresh proxy listening on `front` and forwarding
+// to `back`. Returns false if a response went missing.
+bool run(const char* label, Address front, const Address& back, std::size_t requests,
+         std::size_t body) {
+    int proxy_fd = listen_on(front);
+    muses::ProxyOptions opts;
+    opts.max_retries = 0;
+    std::string host = back.path.empty() ? "127.0.0.1" : "unix:" + back.path;
+    muses::ProxyServer proxy(proxy_fd, {{"/", host, back.port}}, opts);
+    proxy.start();
+
+    int client = connect_to(front);
+    if (client < 0) return false;
+    static const char kRequest[] = "GET /item HTTP/1.1\r\nHost: bench\r\n\r\n";
+    std::string buf;
+    // One warm-up round trip opens the upstream connection.
+    bool ok = write_all(client, kRequest, sizeof(kRequest) - 1) && read_response(client, buf);
+    auto t0 = std::chrono::steady_clock::now();
+    std::size_t done = 0;
+    for (; ok && done < requests; ++done) {
+        ok = write_all(client, kRequest, sizeof(kRequest) - 1) && read_response(client, buf);
+    }
+    auto t1 = std::chrono::steady_clock::now();
+
+    double secs = std::chrono::duration<double>(t1 - t0).count();
+    double mib = static_cast<double>(done * body) / (1 << 20);
+    std::printf("%-5s %10.0f req/s   %8.1f MiB/s   %6.2f us/req\n", label, done / secs,
+                mib / secs, secs * 1e6 / static_cast<double>(done));
+
+    ::close(client);
+    proxy.stop();
+    ::close(proxy_fd);
+    if (!front.path.empty()) ::unlink(front.path.c_str());
+    return ok;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    std::size_t requests = 20000;
+    std::size_t body = 1024;
+    if (argc > 1) requests = static_cast<std::size_t>(std::strtoull(argv[1], nullptr, 10));
+    if (argc > 2) body = static_cast<std::size_t>(std::strtoull(argv[2], nullptr, 10));
+
+    const std::string base = "/tmp/bench_proxy_uds_" + std::to_string(::getpid());
+    Address tcp_up;
+    Address uds_up{base + "_up.sock"};
+    int tcp_fd = listen_on(tcp_up);
+    int uds_fd = listen_on(uds_up);
+    std::thread tcp_upstream(serve_upstream, tcp_fd, body);
+    std::thread uds_upstream(serve_upstream, uds_fd, body);
+
+    std::printf("requests: %zu, body: %zu bytes, one keep-alive client\n", requests, body);
+    bool ok = run("tcp", Address{}, tcp_up, requests, body) &&
+              run("unix", Address{base + "_in.sock"}, uds_up, requests, body);
+
+    for (int fd : {tcp_fd, uds_fd}) {
+        ::shutdown(fd, SHUT_RDWR);
+        ::close(fd);
+    }
+    tcp_upstream.join();
+    uds_upstream.join();
+    ::unlink(uds_up.path.c_str());
+    if (!ok) {
+        std::fprintf(stderr, "missing response\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,189 @@
+// MIT License
+
+// Copyright (c) 2023 nastyapple
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+// Heap allocations per proxied request, with and without the coroutine frame
+// pool. Built twice by CMake:
+//   bench_task_frames         (MUSES_TASK_FRAME_POOL=1, the default)
+//   bench_task_frames_nopool  (MUSES_TASK_FRAME_POOL=0)
+//
+// A keep-alive client sends N requests through a ProxyServer to an in-process
+// keep-alive upstream. Global operator new is replaced with a counting
+// version; the client and upstream threads only use stack buffers, so the
+// count is (almost entirely) the proxy's own allocations.
+//
+//   ./bench_task_frames [requests=20000]
+
+#include "muses/frame_pool.hpp"
+#include "muses/net_components/proxy.hpp"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <thread>
+
+namespace {
+std::atomic<std::size_t> g_news{0};
+}
+
+void* operator new(std::size_t n) {
+    g_news.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(n ? n : 1)) return p;
+    throw std::bad_alloc();
+}
+// GCC cannot see that operator new above is the replacement and flags the
+// free() as mismatched once it inlines both ends.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+namespace {
+
+constexpr char kRequest[] = "GET /bench HTTP/1.1\r\nHost: bench\r\n\r\n";
+constexpr char kResponse[] =
+    "HTTP/1.1 200 OK\r\nContent-Length: 2\r\nConnection: keep-alive\r\n\r\nok";
+
+int listen_loopback(unsigned short* port) {
+    int fd = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    sockaddr_in a{};
+    a.sin_family = AF_INET;
+    a.sin_addr.s_addr = ::inet_addr("127.0.0.1");
+    int opt = 1;
+    ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    ::bind(fd, reinterpret_cast<sockaddr*>(&a), sizeof(a));
+    ::listen(fd, 16);
+    socklen_t l = sizeof(a);
+    ::getsockname(fd, reinterpret_cast<sockaddr*>(&a), &l);
+    *port = ntohs(a.sin_port);
+    return fd;
+}
+
+// Reads until the end of one header block (no bodies in this benchmark).
+bool read_headers(int fd, char* buf, std::size_t cap) {
+    std::size_t have = 0;
+    while (have < cap) {
+        ssize_t r = ::read(fd, buf + have, cap - have);
+        if (r <= 0) return false;
+        have += static_cast<std::size_t>(r);
+        buf[have < cap ? have : cap - 1] = '\0';
+        if (std::strstr(buf, "\r\n\r\n") != nullptr) return true;
+    }
+    return false;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    std::size_t requests = 20000;
+    if (argc > 1) requests = static_cast<std::size_t>(std::strtoull(argv[1], nullptr, 10));
+
+    unsigned short up_port = 0;
+    int up_fd = listen_loopback(&up_port);
+    std::thread upstream([up_fd] {
+        char buf[2048];
+        for (;;) {
+            int c = ::accept(up_fd, nullptr, nullptr);
+            if (c < 0) return;
+            while (read_headers(c, buf, sizeof(buf))) {
+                if (::write(c, kResponse, sizeof(kResponse) - 1) < 0) break;
+            }
+            ::close(c);
+        }
+    });
+
+    unsigned short proxy_port = 0;
+    int proxy_fd = listen_loopback(&proxy_port);
+    muses::ProxyServer proxy(proxy_fd, {{"/", "127.0.0.1", up_port}}, /*max_retries=*/0);
+    proxy.start();
+
+    int client = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    sockaddr_in a{};
+    a.sin_family = AF_INET;
+    a.sin_addr.s_addr = ::inet_addr("127.0.0.1");
+    a.sin_port = htons(proxy_port);
+    if (::connect(client, reinterpret_cast<sockaddr*>(&a), sizeof(a)) != 0) {
+        std::fprintf(stderr, "connect to proxy failed\n");
+        return 1;
+    }
+
+    char buf[2048];
+    auto roundtrip = [&] {
+        return ::write(client, kRequest, sizeof(kRequest) - 1) > 0 &&
+               read_headers(client, buf, sizeof(buf));
+    };
+    // Warm up: upstream connection pooled, frame caches populated.
+    for (int i = 0; i < 100; ++i) {
+        if (!roundtrip()) {
+            std::fprintf(stderr, "warm-up request failed\n");
+            return 1;
+        }
+    }
+
+    auto frames_before = muses::FramePool::stats();
+    std::size_t news_before = g_news.load();
+    auto t0 = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < requests; ++i) {
+        if (!roundtrip()) {
+            std::fprintf(stderr, "request %zu failed\n", i);
+            return 1;
+        }
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    std::size_t news = g_news.load() - news_before;
+    auto frames_after = muses::FramePool::stats();
+
+    double secs = std::chrono::duration<double>(t1 - t0).count();
+    double n = static_cast<double>(requests);
+    std::printf("frame pool:            %s\n", MUSES_TASK_FRAME_POOL ? "on" : "off");
+    std::printf("requests:              %zu in %.3f s (%.0f req/s)\n", requests, secs, n / secs);
+    std::printf("operator new/request:  %.2f\n", static_cast<double>(news) / n);
+#if MUSES_FRAME_POOL_STATS
+    std::printf("frames/request:        %.2f (%.2f from heap)\n",
+                static_cast<double>(frames_after.allocations - frames_before.allocations) / n,
+                static_cast<double>(frames_after.heap - frames_before.heap) / n);
+#else
+    (void)frames_before;
+    (void)frames_after;
+#endif
+
+    ::close(client);
+    proxy.stop();
+    ::close(proxy_fd);
+    ::shutdown(up_fd, SHUT_RDWR);
+    ::close(up_fd);
+    upstream.join();
+    return 0;
+}
@@ -6,6 +6,8 @@
 //   MUSES_REACTORS  number of reactor shards (default: hardware_concurrency())
 //   MUSES_WORKERS   worker threads PER shard (default 4)
 //   MUSES_PORT      listen port (default 8864)
+//   MUSES_WORKER_QUEUE  max requests waiting per shard's worker pool; excess
+//                       requests get an immediate 503 (default 0 = unbounded)
 // Then: curl http://127.0.0.1:8864/
 //
 // Multi-reactor: each shard is an independent reactor thread with its own
@@ -47,6 +49,8 @@ int main() {
     if (const char* m = std::getenv("MUSES_MAX_CONNECTIONS")) max_connections = static_cast<std::size_t>(std::strtoull(m, nullptr, 10));
     std::size_t ip_rate_per_sec = 0;  // off by default (localhost benchmarks share one IP)
     if (const char* ir = std::getenv("MUSES_IP_RATE")) ip_rate_per_sec = static_cast<std::size_t>(std::strtoull(ir, nullptr, 10));
+    std::size_t worker_queue = 0;  // unbounded by default
+    if (const char* q = std::getenv("MUSES_WORKER_QUEUE")) worker_queue = static_cast<std::size_t>(std::strtoull(q, nullptr, 10));
 
     muses::TCPListener listener("127.0.0.1", port);
     auto lfd_result = listener.get_listener();
@@ -60,7 +64,8 @@ int main() {
         auto hr = muses::HttpContext::handle_request(req);
         return muses::HandlerResult{std::move(hr.response), hr.keep_alive};
     }, reactors, workers_per_shard, 1024,
-       std::chrono::seconds(idle_timeout_s), max_connections, ip_rate_per_sec);
+       std::chrono::seconds(idle_timeout_s), max_connections, ip_rate_per_sec,
+       worker_queue, muses::OverflowPolicy::DropNew);
     pool.start();
 
     std::cout << "serving ./statics on http://127.0.0.1:" << port
@@ -69,6 +74,7 @@ int main() {
               << ", idle_timeout=" << idle_timeout_s << "s"
               << ", max_conn=" << max_connections
               << ", ip_rate=" << ip_rate_per_sec << "/s"
+              << ", worker_queue=" << worker_queue
               << ", Ctrl-C to quit)\n";
     while (!g_stop.load()) {
         sleep(1);
@@ -3,22 +3,26 @@
 // Hardcoded routing table (edit and rebuild to change). Each client connection
 // is a coroutine that forwards requests to the matched upstream, reusing pooled
 // keep-alive upstream connections. Upstream I/O suspends on the poller instead
-// of blocking a worker — this is what muses/task.hpp enables.
+// of blocking a worker — this is what muses/task.hpp enables. A ProxyPool runs
+// one such event loop per shard, each on its own SO_REUSEPORT listener.
 //
 // Run from the build directory:
 //   ./muses_reverse_proxy
 // Env vars:
-//   MUSES_PROXY_PORT   listen port (default 8865)
+//   MUSES_PROXY_PORT     listen port (default 8865)
+//   MUSES_PROXY_SHARDS   event-loop threads (default: hardware concurrency)
 // Then point a client at it: curl http://127.0.0.1:8865/
 
 #include "muses/logging.hpp"
-#include "muses/net/reactor.hpp"   // for TCPListener (SO_REUSEPORT)
 #include "muses/net_components/proxy.hpp"
 
 #include <csignal>
 #include <atomic>
 #include <cstdlib>
 #include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <thread>
 
 static std::atomic<bool> g_stop{false};
 
@@ -27,8 +31,12 @@ int main() {
 
     unsigned short port = 8865;
     if (const char* p = std::getenv("MUSES_PROXY_PORT")) port = static_cast<unsigned short>(std::atoi(p));
+    unsigned shards = std::thread::hardware_concurrency();
+    if (shards == 0) shards = 4;
+    if (const char* s = std::getenv("MUSES_PROXY_SHARDS")) shards = static_cast<unsigned>(std::atoi(s));
 
-    // Hardcoded routing table. First matching prefix wins; "/" is the catch-all.
+    // Hardcoded routing table. The longest matching prefix wins; "/" is the
+    // catch-all.
     // Edit these and rebuild to route to your backends.
     std::vector<muses::ProxyRoute> routes = {
         {"/api/", "127.0.0.1", 8081},
@@ -36,27 +44,28 @@ int main() {
     };
 
     // Print the route table BEFORE moving it into the proxy.
-    std::cout << "reverse proxy on http://127.0.0.1:" << port << "/\n";
+    std::cout << "reverse proxy on http://127.0.0.1:" << port << "/ (" << shards << " shards)\n";
     std::cout << "routes:\n";
     for (const auto& r : routes) {
         std::cout << "  " << r.prefix << " -> " << r.host << ":" << r.port << "\n";
     }
     std::cout << "(Ctrl-C to quit)\n";
 
-    muses::TCPListener listener("127.0.0.1", port);
-    auto lfd_result = listener.get_listener();
-    if (!lfd_result) {
-        std::cerr << "failed to listen: " << lfd_result.error() << "\n";
+    // Health is shared: an upstream one shard sees failing is skipped by all.
+    std::unique_ptr<muses::ProxyPool> proxy;
+    try {
+        proxy = std::make_unique<muses::ProxyPool>("127.0.0.1", port, std::move(routes),
+                                                   muses::ProxyOptions{}, shards,
+                                                   /*share_health=*/true);
+    } catch (const std::runtime_error& e) {
+        std::cerr << "failed to listen: " << e.what() << "\n";
         return 1;
     }
-    int lfd = *lfd_result;
-
-    muses::ProxyServer proxy(lfd, std::move(routes), /*max_retries=*/2);
-    proxy.start();
+    proxy->start();
     while (!g_stop.load()) {
         sleep(1);
     }
 
-    proxy.stop();
+    proxy->stop();
     return 0;
 }
@@ -45,6 +45,8 @@ enum class OverflowPolicy {
     DropNew,     // reject the new item (push returns false)
     DropOldest,  // evict the front to make room (never blocks producers)
     Block,       // block the producer until space is available
+    CallerRuns,  // reject like DropNew; the producer handles the item itself
+                 // (ThreadPool runs the task inline on the submitting thread)
 };
 
 // A thread-safe bounded queue with a configurable overflow policy.
@@ -53,10 +55,10 @@ enum class OverflowPolicy {
 // and as the reactor outbox (worker→reactor handoff).
 //
 // Implementation strategy is chosen once at construction by OverflowPolicy:
-//   - DropNew / DropOldest → lock-free Vyukov MPMC bounded ring (the hot path
-//     for both logger and reactor). Each slot carries an atomic sequence
-//     counter; producer/consumer cursors each live on their own cache line to
-//     avoid false sharing. Blocking consumers (wait_pop) are parked on a
+//   - DropNew / DropOldest / CallerRuns → lock-free Vyukov MPMC bounded ring
+//     (the hot path for both logger and reactor). Each slot carries an atomic
+//     sequence counter; producer/consumer cursors each live on their own cache
+//     line to avoid false sharing. Blocking consumers (wait_pop) are parked on a
 //     counting_semaphore that is decoupled from the data path, so try_push /
 //     try_pop stay fully lock-free.
 //   - Block → a proven mutex + std::deque + two condition variables (the
@@ -92,6 +94,16 @@ public:
         return ring_->push(std::move(item));
     }
 
+    // Non-blocking, non-evicting enqueue: moves from `item` only on success.
+    // A full queue leaves `item` intact and is not counted as a drop, so the
+    // caller can park and retry later (AsyncChannel's Block mode does).
+    bool try_push(T& item) {
+        if (policy_ == OverflowPolicy::Block) {
+            return blocking_->try_push(item);
+        }
+        return ring_->try_push(item);
+    }
+
     bool try_pop(T& out) {
         if (policy_ == OverflowPolicy::Block) {
             return blocking_->try_pop(out);
@@ -158,7 +170,9 @@ private:
     struct RingImpl {
         RingImpl(std::size_t cap, OverflowPolicy policy) : policy_(policy) {
             // Round capacity up to a power of two for cheap mask-based wrap.
-            std::size_t p = 1;
+            // At least two cells: with one, a full slot's sequence (pos + 1)
+            // reads as "empty" for the next lap and the push overwrites it.
+            std::size_t p = 2;
             while (p < cap) p <<= 1;
             mask_ = p - 1;
             // Default-construct p cells in place (no relocation: Cell isn't
@@ -193,8 +207,9 @@ private:
                     }
                     // Lost the CAS; retry with the refreshed pos.
                 } else if (diff < 0) {
-                    // Queue is full.
-                    if (policy_ == OverflowPolicy::DropNew) {
+                    // Queue is full. DropNew and CallerRuns both reject here;
+                    // for CallerRuns the producer owns the fallback.
+                    if (policy_ != OverflowPolicy::DropOldest) {
                         dropped_.fetch_add(1, std::memory_order_relaxed);
                         return false;
                     }
@@ -211,6 +226,28 @@ private:
             }
         }
 
+        bool try_push(T& item) {
+            if (stopped_.load(std::memory_order_acquire)) return false;
+            for (;;) {
+                std::size_t pos = enqueue_pos_.value.load(std::memory_order_relaxed);
+                Cell& c = ring_[pos & mask_];
+                std::size_t seq = c.sequence.load(std::memory_order_acquire);
+                std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(seq) -
+                                      static_cast<std::ptrdiff_t>(pos);
+                if (diff == 0) {
+                    if (enqueue_pos_.value.compare_exchange_weak(
+                            pos, pos + 1, std::memory_order_relaxed)) {
+                        c.data.emplace(std::move(item));
+                        c.sequence.store(pos + 1, std::memory_order_release);
+                        sem_.release();
+                        return true;
+                    }
+                } else if (diff < 0) {
+                    return false;  // full
+                }
+            }
+        }
+
         // Remove and discard the front item (DropOldest overflow). Returns
         // true on success, false if the queue was empty.
         bool evict_one() {
@@ -340,6 +377,14 @@ private:
             return true;
         }
 
+        bool try_push(T& item) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (stopped_ || buffer_.size() >= capacity_) return false;
+            buffer_.push_back(std::move(item));
+            not_empty_.notify_one();
+            return true;
+        }
+
         bool try_pop(T& out) {
             std::lock_guard<std::mutex> lock(mutex_);
             if (buffer_.empty()) return false;
@@ -49,4 +49,17 @@
     #define MUSES_ASSERT(expr, msg) assert(((void)(msg), (expr)))
 #endif
 
+// --- Coroutine frames -----------------------------------------------------
+// MUSES_TASK_FRAME_POOL: Task promise types allocate their coroutine frames
+// from the thread-local FramePool (frame_pool.hpp). Set to 0 to fall back to
+// global operator new (e.g. to compare allocation counts, or to let ASan see
+// every frame individually).
+// MUSES_FRAME_POOL_STATS: maintain FramePool::stats() counters.
+#ifndef MUSES_TASK_FRAME_POOL
+    #define MUSES_TASK_FRAME_POOL 1
+#endif
+#ifndef MUSES_FRAME_POOL_STATS
+    #define MUSES_FRAME_POOL_STATS 0
+#endif
+
 #endif // MUSES_CONFIG_HPP
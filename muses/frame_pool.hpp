@@ -0,0 +1,179 @@
+// MIT License
+
+// Copyright (c) 2023 nastyapple
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <new>
+
+#include "muses/config.hpp"
+
+#ifndef MUSES_FRAME_POOL_HPP
+#define MUSES_FRAME_POOL_HPP
+
+namespace muses {
+
+// Thread-local, size-classed free-lists for coroutine frames.
+//
+// Every Task coroutine call allocates a frame; the proxy creates several per
+// request (read_until, read_n, write_all_async, acquire_upstream, ...), each of
+// which used to be a malloc/free pair. Frames of one call site always have the
+// same size, so a per-thread cache of recently freed blocks per size class
+// turns almost all of them into a pointer pop.
+//
+// Design points:
+//   - Sized deallocation: the promise's operator delete receives the frame
+//     size, so the class is recomputed on free and blocks need no header.
+//   - Lock-free by construction: each thread only touches its own lists. A
+//     frame freed on a different thread than it was allocated on (after a
+//     ThreadPool::schedule() hop) simply joins the freeing thread's cache.
+//     Blocks come from ::operator new individually, so migrating is safe —
+//     this is why the cache does not sit on MemoryPool, whose arena belongs to
+//     one pool instance and would dangle if that thread exited first.
+//   - Bounded: at most kMaxCachedPerClass blocks per class per thread (about
+//     1 MiB worst case); the rest go back to ::operator delete. The 8 KiB class
+//     exists for frames holding a 4 KiB read buffer (read_until); anything
+//     larger bypasses the cache.
+//   - MUSES_FRAME_POOL_STATS=1 enables process-wide relaxed counters (used by
+//     bench/bench_task_frames.cpp); off by default to keep the hot path free
+//     of shared cache lines.
+class FramePool {
+public:
+    static constexpr std::size_t kClassSizes[] = {64, 128, 256, 512, 1024, 2048, 4096, 8192};
+    static constexpr std::size_t kClassCount = sizeof(kClassSizes) / sizeof(kClassSizes[0]);
+    static constexpr std::size_t kMaxCachedPerClass = 64;
+
+    struct Stats {
+        std::size_t allocations;  // frames requested
+        std::size_t cache_hits;   // served from a thread-local free-list
+        std::size_t heap;         // served by ::operator new
+    };
+
+    static void* allocate(std::size_t bytes) {
+        count(stats_slots().allocations);
+        std::size_t idx = class_of(bytes);
+        if (idx < kClassCount && !thread_dead()) {
+            Cache& c = cache();
+            if (void* p = c.pop(idx)) {
+                count(stats_slots().cache_hits);
+                return p;
+            }
+            count(stats_slots().heap);
+            return ::operator new(kClassSizes[idx]);
+        }
+        count(stats_slots().heap);
+        return ::operator new(bytes);
+    }
+
+    static void deallocate(void* p, std::size_t bytes) noexcept {
+        if (p == nullptr) return;
+        std::size_t idx = class_of(bytes);
+        if (idx < kClassCount && !thread_dead() && cache().push(idx, p)) return;
+        ::operator delete(p);
+    }
+
+    static Stats stats() noexcept {
+        auto& s = stats_slots();
+        return Stats{s.allocations.load(std::memory_order_relaxed),
+                     s.cache_hits.load(std::memory_order_relaxed),
+                     s.heap.load(std::memory_order_relaxed)};
+    }
+
+private:
+    struct FreeNode {
+        FreeNode* next;
+    };
+
+    struct Cache {
+        FreeNode* heads[kClassCount] = {};
+        std::size_t counts[kClassCount] = {};
+
+        void* pop(std::size_t idx) noexcept {
+            FreeNode* n = heads[idx];
+            if (n == nullptr) return nullptr;
+            heads[idx] = n->next;
+            --counts[idx];
+            return n;
+        }
+
+        bool push(std::size_t idx, void* p) noexcept {
+            if (counts[idx] >= kMaxCachedPerClass) return false;
+            FreeNode* n = static_cast<FreeNode*>(p);
+            n->next = heads[idx];
+            heads[idx] = n;
+            ++counts[idx];
+            return true;
+        }
+
+        ~Cache() {
+            // Frames freed by later thread_local destructors must not touch
+            // the lists we are about to release.
+            thread_dead() = true;
+            for (std::size_t i = 0; i < kClassCount; ++i) {
+                while (void* p = pop(i)) ::operator delete(p);
+            }
+        }
+    };
+
+    struct StatSlots {
+        std::atomic<std::size_t> allocations{0};
+        std::atomic<std::size_t> cache_hits{0};
+        std::atomic<std::size_t> heap{0};
+    };
+
+    static std::size_t class_of(std::size_t bytes) noexcept {
+        for (std::size_t i = 0; i < kClassCount; ++i) {
+            if (bytes <= kClassSizes[i]) return i;
+        }
+        return kClassCount;
+    }
+
+    static Cache& cache() noexcept {
+        thread_local Cache c;
+        return c;
+    }
+
+    // Trivially destructible, so it stays readable for the whole thread exit.
+    static bool& thread_dead() noexcept {
+        thread_local bool dead = false;
+        return dead;
+    }
+
+    static StatSlots& stats_slots() noexcept {
+        static StatSlots slots;
+        return slots;
+    }
+
+    static void count(std::atomic<std::size_t>& slot) noexcept {
+#if MUSES_FRAME_POOL_STATS
+        slot.fetch_add(1, std::memory_order_relaxed);
+#else
+        (void)slot;
+#endif
+    }
+};
+
+}  // namespace muses
+
+#endif  // MUSES_FRAME_POOL_HPP
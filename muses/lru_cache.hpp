@@ -44,14 +44,20 @@ namespace muses {
 // acceptable performance trade-off. A compute_if_absent variant can be added
 // later if stampede protection is needed.
 //
+// Optionally also bounded by total charge: give max_charge and a per-entry
+// charge to put() (e.g. its size in bytes), and least-recently-used entries
+// are evicted until the total fits. An entry charged more than max_charge on
+// its own is not cached.
+//
 // Implementation: a doubly-linked list (std::list) ordered MRU-front .. LRU-back
 // paired with an unordered_map from key to list iterator. Both splice/erase on
 // std::list and iterator stability are O(1), so get/put/erase are all O(1).
 template <typename K, typename V>
 class LruCache {
 public:
-    explicit LruCache(std::size_t max_entries)
-    : max_entries_(max_entries) {}
+    // max_charge 0 = bounded by entry count only.
+    explicit LruCache(std::size_t max_entries, std::size_t max_charge = 0)
+    : max_entries_(max_entries), max_charge_(max_charge) {}
 
     LruCache(const LruCache&) = delete;
     LruCache& operator=(const LruCache&) = delete;
@@ -62,7 +68,7 @@ public:
         auto it = index_.find(key);
         if (it == index_.end()) return std::nullopt;
         promote(it->second);
-        return it->second->second;
+        return it->second->value;
     }
 
     // Insert or update. Updating an existing key replaces its value and
@@ -71,7 +77,13 @@ public:
     // move into the parameter, avoiding a large copy for e.g. file contents).
     void put(const K& key, V value) {
         std::lock_guard<std::mutex> lock(mutex_);
-        put_locked(key, std::move(value));
+        put_locked(key, std::move(value), 0);
+    }
+
+    // put() counting `charge` toward max_charge.
+    void put(const K& key, V value, std::size_t charge) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        put_locked(key, std::move(value), charge);
     }
 
     // Same as put(key, value) but does not cache anything when capacity is 0.
@@ -88,6 +100,7 @@ public:
         std::lock_guard<std::mutex> lock(mutex_);
         auto it = index_.find(key);
         if (it == index_.end()) return false;
+        charge_ -= it->second->charge;
         entries_.erase(it->second);
         index_.erase(it);
         return true;
@@ -97,6 +110,7 @@ public:
         std::lock_guard<std::mutex> lock(mutex_);
         entries_.clear();
         index_.clear();
+        charge_ = 0;
     }
 
     std::size_t size() const {
@@ -105,9 +119,21 @@ public:
     }
 
     std::size_t capacity() const { return max_entries_; }
+    std::size_t max_charge() const { return max_charge_; }
+
+    // Sum of the charges of the cached entries.
+    std::size_t charge() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return charge_;
+    }
 
 private:
-    using ListIt = typename std::list<std::pair<K, V>>::iterator;
+    struct Entry {
+        K key;
+        V value;
+        std::size_t charge;
+    };
+    using ListIt = typename std::list<Entry>::iterator;
 
     // Caller must hold mutex_.
     void promote(ListIt it) {
@@ -116,34 +142,54 @@ private:
     }
 
     // Caller must hold mutex_.
-    void put_locked(const K& key, V value) {
+    void put_locked(const K& key, V value, std::size_t charge) {
         if (max_entries_ == 0) return;  // caching disabled
         auto it = index_.find(key);
+        if (max_charge_ != 0 && charge > max_charge_) {
+            // Too big to ever fit; drop any older value rather than keep it.
+            if (it != index_.end()) {
+                charge_ -= it->second->charge;
+                entries_.erase(it->second);
+                index_.erase(it);
+            }
+            return;
+        }
         if (it != index_.end()) {
             // Update in place and promote.
-            it->second->second = std::move(value);
+            charge_ = charge_ - it->second->charge + charge;
+            it->second->value = std::move(value);
+            it->second->charge = charge;
             promote(it->second);
-            return;
+        } else {
+            // New entry. Evict LRU if at capacity.
+            if (entries_.size() >= max_entries_) {
+                evict_lru_locked();
+            }
+            entries_.push_front(Entry{key, std::move(value), charge});
+            index_[key] = entries_.begin();
+            charge_ += charge;
         }
-        // New entry. Evict LRU if at capacity.
-        if (entries_.size() >= max_entries_) {
+        // Over the charge bound: evict from the LRU end (never the new entry,
+        // which fits on its own).
+        while (max_charge_ != 0 && charge_ > max_charge_ && entries_.size() > 1) {
             evict_lru_locked();
         }
-        entries_.emplace_front(key, std::move(value));
-        index_[key] = entries_.begin();
     }
 
     // Caller must hold mutex_.
     void evict_lru_locked() {
         if (entries_.empty()) return;
-        index_.erase(entries_.back().first);
+        charge_ -= entries_.back().charge;
+        index_.erase(entries_.back().key);
         entries_.pop_back();
     }
 
     mutable std::mutex mutex_;
-    std::list<std::pair<K, V>> entries_;   // front = MRU, back = LRU
+    std::list<Entry> entries_;   // front = MRU, back = LRU
     std::unordered_map<K, ListIt> index_;
     std::size_t max_entries_;
+    std::size_t max_charge_;
+    std::size_t charge_ = 0;
 };
 
 }  // namespace muses
@@ -0,0 +1,401 @@
+// MIT License
+
+// Copyright (c) 2023 nastyapple
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include <atomic>
+#include <coroutine>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "muses/bounded_queue.hpp"
+#include "muses/config.hpp"
+#include "muses/net/event_loop.hpp"
+
+#ifndef MUSES_NET_CHANNEL_HPP
+#define MUSES_NET_CHANNEL_HPP
+
+namespace muses {
+
+// A bounded MPMC channel whose push/pop suspend the calling coroutine instead
+// of the OS thread. Producers and consumers may be coroutines on any event
+// loop (or Runtime worker) or plain threads (try_push / try_pop).
+//
+//     AsyncChannel<Job> jobs(256);                      // Block: producers wait
+//     co_await jobs.push(job);                           // false once closed
+//     while (auto j = co_await jobs.pop()) handle(*j);   // nullopt: closed + drained
+//     auto batch = co_await jobs.pop_batch(32);          // 1..32 items, empty if closed
+//
+// Storage is a BoundedQueue ring (lock-free; DropOldest for that policy,
+// DropNew otherwise), so an uncontended push/pop never takes a lock. Waiters
+// park on mutex-guarded lists; counters published with seq_cst fences let the
+// other side skip the lock when nobody is waiting. A side that makes progress
+// hands items (or space) to parked waiters under the lock and resumes them:
+// inline if the waiter belongs to the current thread's loop, otherwise via
+// that loop's post(), which wakes its poller. Waiters suspended outside any
+// event loop are resumed inline on the notifying thread.
+//
+// Overflow policies when the ring is full:
+//   Block      — push() suspends until space frees up (try_push returns false);
+//   DropNew    — push() completes with false, the item is discarded;
+//   DropOldest — the oldest queued item is evicted to make room.
+// CallerRuns is not supported: push() moves the item into the awaiter, so a
+// rejected one could not go back to the caller to run. It asserts in debug
+// builds and is taken as DropNew otherwise.
+//
+// Cancellation: destroying a suspended pop/push (with_timeout, when_any)
+// unregisters the waiter. Safe as long as the party that would wake it runs
+// on the same loop; a delivery racing in from another thread may already
+// have posted the resume, so cross-thread waiters should not be cancelled.
+template <typename T>
+class AsyncChannel {
+public:
+    explicit AsyncChannel(std::size_t capacity, OverflowPolicy policy = OverflowPolicy::Block)
+    : policy_(policy == OverflowPolicy::CallerRuns ? OverflowPolicy::DropNew : policy),
+      ring_(capacity, policy == OverflowPolicy::DropOldest ? OverflowPolicy::DropOldest
+                                                           : OverflowPolicy::DropNew) {
+        MUSES_ASSERT(policy != OverflowPolicy::CallerRuns,
+                     "AsyncChannel: CallerRuns is not supported");
+    }
+
+    AsyncChannel(const AsyncChannel&) = delete;
+    AsyncChannel& operator=(const AsyncChannel&) = delete;
+
+    // Wakes every waiter: poppers drain what is left and then see the end,
+    // pushers complete with false. Further pushes fail.
+    void close() {
+        std::vector<Waiter*> wake;
+        {
+            std::lock_guard<std::mutex> lock(mu_);
+            if (closed_.exchange(true)) return;
+            for (Waiter* w : consumers_) wake.push_back(w);
+            for (Waiter* w : producers_) wake.push_back(w);
+            consumers_.clear();
+            producers_.clear();
+            consumers_waiting_.store(0);
+            producers_waiting_.store(0);
+        }
+        // Consumers get whatever is still queued before seeing the close.
+        for (Waiter* w : wake) {
+            if (w->kind != Waiter::Kind::Push) fill(*w);
+            w->registered = false;
+            resume(*w);
+        }
+    }
+
+    bool closed() const noexcept { return closed_.load(std::memory_order_acquire); }
+    std::size_t size() const { return ring_.size(); }
+    std::size_t capacity() const { return ring_.capacity(); }
+    OverflowPolicy policy() const noexcept { return policy_; }
+    // Items rejected (DropNew) or evicted (DropOldest).
+    std::size_t dropped() const { return ring_.dropped() + rejected_.load(std::memory_order_relaxed); }
+
+    // Non-suspending; safe from any thread. Applies the policy, except that a
+    // full Block channel rejects instead of waiting.
+    bool try_push(T value) {
+        if (closed()) return false;
+        bool ok = policy_ == OverflowPolicy::DropOldest ? ring_.push(std::move(value))
+                                                          : ring_.try_push(value);
+        if (!ok) {
+            if (policy_ != OverflowPolicy::Block && !closed()) {
+                rejected_.fetch_add(1, std::memory_order_relaxed);
+            }
+            return false;
+        }
+        wake_consumers();
+        return true;
+    }
+
+    bool try_pop(T& out) {
+        if (!ring_.try_pop(out)) return false;
+        wake_producers();
+        return true;
+    }
+
+private:
+    // One parked coroutine. Lives inside its awaiter (in the coroutine frame).
+    struct Waiter {
+        enum class Kind { Pop, Batch, Push };
+        Kind kind;
+        std::coroutine_handle<> handle;
+        EventLoop* loop = nullptr;
+        bool registered = false;
+        // Pop / Batch
+        std::optional<T>* slot = nullptr;
+        std::vector<T>* batch = nullptr;
+        std::size_t max = 1;
+        // Push
+        T* value = nullptr;
+        bool* accepted = nullptr;
+    };
+
+public:
+    class PopAwaiter {
+    public:
+        explicit PopAwaiter(AsyncChannel* ch) noexcept : ch_(ch) {}
+        PopAwaiter(const PopAwaiter&) = delete;
+        PopAwaiter& operator=(const PopAwaiter&) = delete;
+        ~PopAwaiter() { ch_->cancel(waiter_); }
+
+        bool await_ready() { return ch_->take_one(slot_) || ch_->closed(); }
+        bool await_suspend(std::coroutine_handle<> h) {
+            waiter_.kind = Waiter::Kind::Pop;
+            waiter_.slot = &slot_;
+            return ch_->park_consumer(waiter_, h);
+        }
+        std::optional<T> await_resume() { return std::move(slot_); }
+
+    private:
+        AsyncChannel* ch_;
+        std::optional<T> slot_;
+        Waiter waiter_{};
+    };
+
+    class BatchAwaiter {
+    public:
+        BatchAwaiter(AsyncChannel* ch, std::size_t max) noexcept
+        : ch_(ch), max_(max == 0 ? 1 : max) {}
+        BatchAwaiter(const BatchAwaiter&) = delete;
+        BatchAwaiter& operator=(const BatchAwaiter&) = delete;
+        ~BatchAwaiter() { ch_->cancel(waiter_); }
+
+        bool await_ready() {
+            ch_->take_many(items_, max_);
+            return !items_.empty() || ch_->closed();
+        }
+        bool await_suspend(std::coroutine_handle<> h) {
+            waiter_.kind = Waiter::Kind::Batch;
+            waiter_.batch = &items_;
+            waiter_.max = max_;
+            return ch_->park_consumer(waiter_, h);
+        }
+        std::vector<T> await_resume() { return std::move(items_); }
+
+    private:
+        AsyncChannel* ch_;
+        std::size_t max_;
+        std::vector<T> items_;
+        Waiter waiter_{};
+    };
+
+    class PushAwaiter {
+    public:
+        PushAwaiter(AsyncChannel* ch, T value) : ch_(ch), value_(std::move(value)) {}
+        PushAwaiter(const PushAwaiter&) = delete;
+        PushAwaiter& operator=(const PushAwaiter&) = delete;
+        ~PushAwaiter() { ch_->cancel(waiter_); }
+
+        bool await_ready() {
+            if (ch_->closed()) return true;
+            if (ch_->policy_ != OverflowPolicy::Block) {
+                accepted_ = ch_->try_push(std::move(value_));
+                return true;
+            }
+            if (ch_->ring_.try_push(value_)) {
+                accepted_ = true;
+                ch_->wake_consumers();
+                return true;
+            }
+            return false;
+        }
+        bool await_suspend(std::coroutine_handle<> h) {
+            waiter_.kind = Waiter::Kind::Push;
+            waiter_.value = &value_;
+            waiter_.accepted = &accepted_;
+            return ch_->park_producer(waiter_, h);
+        }
+        // True if the item is now in the channel.
+        bool await_resume() const noexcept { return accepted_; }
+
+    private:
+        AsyncChannel* ch_;
+        T value_;
+        bool accepted_ = false;
+        Waiter waiter_{};
+    };
+
+    // co_await: the next item, or nullopt once closed and drained.
+    PopAwaiter pop() noexcept { return PopAwaiter{this}; }
+    // co_await: between 1 and max items, or empty once closed and drained.
+    BatchAwaiter pop_batch(std::size_t max) noexcept { return BatchAwaiter{this, max}; }
+    // co_await: true if enqueued; false if dropped by policy or closed.
+    PushAwaiter push(T value) { return PushAwaiter{this, std::move(value)}; }
+
+private:
+    bool take_one(std::optional<T>& slot) {
+        T item;
+        if (!ring_.try_pop(item)) return false;
+        slot.emplace(std::move(item));
+        wake_producers();
+        return true;
+    }
+
+    void take_many(std::vector<T>& out, std::size_t max) {
+        std::size_t before = out.size();
+        T item;
+        while (out.size() < max && ring_.try_pop(item)) out.push_back(std::move(item));
+        if (out.size() != before) wake_producers();
+    }
+
+    // Moves queued items into a consumer waiter. True if it got anything.
+    bool fill(Waiter& w) {
+        if (w.kind == Waiter::Kind::Pop) {
+            T item;
+            if (!ring_.try_pop(item)) return false;
+            w.slot->emplace(std::move(item));
+            return true;
+        }
+        std::size_t before = w.batch->size();
+        T item;
+        while (w.batch->size() < w.max && ring_.try_pop(item)) w.batch->push_back(std::move(item));
+        return w.batch->size() != before;
+    }
+
+    // Returns false (don't suspend) if an item or the close turned up while
+    // registering.
+    bool park_consumer(Waiter& w, std::coroutine_handle<> h) {
+        {
+            std::lock_guard<std::mutex> lock(mu_);
+            consumers_waiting_.fetch_add(1);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (fill(w) || closed()) {
+                consumers_waiting_.fetch_sub(1);
+                // Taking items may have made room for a parked producer.
+            } else {
+                w.handle = h;
+                w.loop = EventLoop::current();
+                w.registered = true;
+                consumers_.push_back(&w);
+                return true;
+            }
+        }
+        wake_producers();
+        return false;
+    }
+
+    bool park_producer(Waiter& w, std::coroutine_handle<> h) {
+        {
+            std::lock_guard<std::mutex> lock(mu_);
+            producers_waiting_.fetch_add(1);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (closed()) {
+                producers_waiting_.fetch_sub(1);
+                return false;
+            }
+            if (!ring_.try_push(*w.value)) {
+                w.handle = h;
+                w.loop = EventLoop::current();
+                w.registered = true;
+                producers_.push_back(&w);
+                return true;
+            }
+            producers_waiting_.fetch_sub(1);
+            *w.accepted = true;
+        }
+        wake_consumers();
+        return false;
+    }
+
+    // After items were added: hand them to parked consumers.
+    void wake_consumers() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (consumers_waiting_.load(std::memory_order_relaxed) == 0) return;
+        std::vector<Waiter*> ready;
+        {
+            std::lock_guard<std::mutex> lock(mu_);
+            while (!consumers_.empty() && fill(*consumers_.front())) {
+                Waiter* w = consumers_.front();
+                consumers_.pop_front();
+                consumers_waiting_.fetch_sub(1);
+                w->registered = false;
+                ready.push_back(w);
+            }
+        }
+        for (Waiter* w : ready) resume(*w);
+        // Filled consumers drained the ring: parked producers may fit now.
+        if (!ready.empty()) wake_producers();
+    }
+
+    // After space was freed: move parked producers' items into the ring.
+    void wake_producers() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (producers_waiting_.load(std::memory_order_relaxed) == 0) return;
+        std::vector<Waiter*> ready;
+        {
+            std::lock_guard<std::mutex> lock(mu_);
+            while (!producers_.empty() && ring_.try_push(*producers_.front()->value)) {
+                Waiter* w = producers_.front();
+                producers_.pop_front();
+                producers_waiting_.fetch_sub(1);
+                w->registered = false;
+                *w->accepted = true;
+                ready.push_back(w);
+            }
+        }
+        for (Waiter* w : ready) resume(*w);
+        if (!ready.empty()) wake_consumers();
+    }
+
+    // A suspended awaiter is being destroyed: drop its registration.
+    void cancel(Waiter& w) {
+        if (!w.registered) return;
+        std::lock_guard<std::mutex> lock(mu_);
+        if (!w.registered) return;
+        auto& list = w.kind == Waiter::Kind::Push ? producers_ : consumers_;
+        for (auto it = list.begin(); it != list.end(); ++it) {
+            if (*it == &w) {
+                list.erase(it);
+                (w.kind == Waiter::Kind::Push ? producers_waiting_ : consumers_waiting_)
+                    .fetch_sub(1);
+                break;
+            }
+        }
+        w.registered = false;
+    }
+
+    static void resume(Waiter& w) {
+        if (w.loop == nullptr || w.loop->in_loop_thread()) {
+            w.handle.resume();
+        } else {
+            w.loop->post(w.handle);
+        }
+    }
+
+    OverflowPolicy policy_;
+    BoundedQueue<T> ring_;
+    std::atomic<bool> closed_{false};
+    std::atomic<std::size_t> rejected_{0};
+    std::mutex mu_;
+    std::deque<Waiter*> consumers_;
+    std::deque<Waiter*> producers_;
+    std::atomic<std::size_t> consumers_waiting_{0};
+    std::atomic<std::size_t> producers_waiting_{0};
+};
+
+}  // namespace muses
+
+#endif  // MUSES_NET_CHANNEL_HPP
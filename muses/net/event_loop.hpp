@@ -0,0 +1,472 @@
+// MIT License
+
+// Copyright (c) 2023 nastyapple
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <coroutine>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <thread>
+#include <utility>
+
+#include "muses/bounded_queue.hpp"
+#include "muses/net/poller_factory.hpp"
+#include "muses/net/timer_queue.hpp"
+#include "muses/task.hpp"
+
+#ifndef MUSES_NET_EVENT_LOOP_HPP
+#define MUSES_NET_EVENT_LOOP_HPP
+
+namespace muses {
+
+// The single-threaded driver for Task coroutines: a Poller plus a run queue of
+// coroutine handles posted from other threads.
+//
+// I/O readiness: an event whose userdata is a coroutine handle (registered by
+// IoAwaiter) is deregistered and the handle resumed on the loop thread. Events
+// with null userdata (listen sockets, anything the owner registered itself)
+// are handed to the owner's callback instead.
+//
+// Cross-thread handoff: post(h) pushes a handle onto a lock-free MPMC ring
+// (BoundedQueue, DropNew) and wakes the poller; the loop resumes it on its
+// next iteration. If the ring is full the handle spills into a mutex-guarded
+// deque rather than being dropped — a lost handle would leak a suspended
+// coroutine. resume_here() wraps this as an awaitable, the return half of
+// ThreadPool::schedule():
+//
+//     co_await pool.schedule();       // now on a worker thread
+//     auto digest = expensive(body);  // off the event loop
+//     co_await loop.resume_here();    // back on the loop thread
+//
+// A coroutine must be back on its loop before it touches loop-owned state
+// (IoAwaiter registration, the owner's maps) or completes, and the owner must
+// not destroy a coroutine while it is running elsewhere.
+//
+// Timers: an intrusive TimerQueue whose nodes live in the awaiters that wait
+// on them. run_once shortens its poll timeout to the earliest deadline and
+// resumes expired handles after I/O and posted work. sleep_for / sleep_until,
+// Deadline and with_timeout below build on it.
+class EventLoop {
+public:
+    using Clock = TimerQueue::Clock;
+    using Timer = TimerQueue::Node;
+
+    explicit EventLoop(std::size_t remote_capacity = 1024)
+    : poller_(make_poller()),
+      remote_(remote_capacity, OverflowPolicy::DropNew) {}
+
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+
+    bool valid() const noexcept { return poller_ != nullptr; }
+    Poller* poller() const noexcept { return poller_.get(); }
+
+    // The loop currently running on this thread (inside run_once), or null.
+    static EventLoop* current() noexcept { return current_slot(); }
+    bool in_loop_thread() const noexcept { return current_slot() == this; }
+
+    // Thread-safe. Queue `h` to be resumed on the loop thread and wake it.
+    void post(std::coroutine_handle<> h) {
+        if (!remote_.push(h)) {
+            std::lock_guard<std::mutex> lock(overflow_mu_);
+            overflow_.push_back(h);
+            has_overflow_.store(true, std::memory_order_release);
+        }
+        poller_->wakeup();
+    }
+
+    // Awaitable that suspends the caller and resumes it on this loop's thread.
+    // Completes inline if the caller is already on it.
+    class ResumeAwaiter {
+    public:
+        explicit ResumeAwaiter(EventLoop* loop) noexcept : loop_(loop) {}
+        bool await_ready() const noexcept { return loop_->in_loop_thread(); }
+        void await_suspend(std::coroutine_handle<> h) { loop_->post(h); }
+        void await_resume() const noexcept {}
+
+    private:
+        EventLoop* loop_;
+    };
+
+    ResumeAwaiter resume_here() noexcept { return ResumeAwaiter{this}; }
+
+    // Binds a loop (and its poller, for IoAwaiter{fd, mask}) as the calling
+    // thread's current one while alive. run_once opens one itself; a thread
+    // that also resumes coroutines outside run_once (Runtime workers) holds
+    // one for its whole lifetime, and ProxyServer opens one around spawning
+    // health probes. Restores the previous binding on exit, so nested loops
+    // in tests work.
+    class CurrentScope {
+    public:
+        explicit CurrentScope(EventLoop* loop)
+        : prev_(current_slot()), prev_poller_(detail::current_poller()) {
+            current_slot() = loop;
+            detail::current_poller() = loop ? loop->poller() : nullptr;
+        }
+        ~CurrentScope() {
+            current_slot() = prev_;
+            detail::current_poller() = prev_poller_;
+        }
+        CurrentScope(const CurrentScope&) = delete;
+        CurrentScope& operator=(const CurrentScope&) = delete;
+
+    private:
+        EventLoop* prev_;
+        Poller* prev_poller_;
+    };
+
+    // Loop thread only. Arm the unarmed `timer` to resume `h` once `deadline`
+    // has passed; cancel_timer returns false if it is not armed (fired,
+    // cancelled, or never added). An armed timer must not move.
+    void add_timer(Timer& timer, Clock::time_point deadline, std::coroutine_handle<> h) {
+        timers_.add(timer, deadline, h);
+    }
+    bool cancel_timer(Timer& timer) { return timers_.cancel(timer); }
+    std::size_t pending_timers() const noexcept { return timers_.size(); }
+
+    // One loop iteration, on the owning thread: wait up to timeout_ms for I/O
+    // (less if a timer is due, 0 if handles are already queued), resume ready
+    // coroutines, call on_event(const PollEvent&) for events without a
+    // coroutine handle, resume posted handles, then fire expired timers.
+    // Returns the poller's event count (-1 on error).
+    template <typename OnEvent>
+    int run_once(int timeout_ms, OnEvent&& on_event) {
+        CurrentScope scope(this);
+        if (remote_.size() > 0 || has_overflow_.load(std::memory_order_acquire)) {
+            timeout_ms = 0;
+        } else {
+            timeout_ms = timers_.timeout_ms(timeout_ms, Clock::now());
+        }
+        PollEvent events[kMaxEvents];
+        int n = poller_->wait(events, timeout_ms);
+        detail::DispatchBatch batch{
+            std::span<PollEvent>(events, n > 0 ? static_cast<std::size_t>(n) : 0)};
+        DispatchScope dispatch(&batch);
+        for (int i = 0; i < n; ++i) {
+            batch.next = static_cast<std::size_t>(i) + 1;
+            const PollEvent& ev = events[i];
+            if (ev.fd < 0) continue;  // voided: its coroutine was destroyed
+            if (ev.userdata == nullptr) {
+                on_event(ev);
+                continue;
+            }
+            // Deregister BEFORE resuming: this readiness edge is consumed, and
+            // the coroutine re-registers (via IoAwaiter) on its next co_await —
+            // possibly for the same fd with a different mask. A post-resume
+            // del would wipe that fresh registration and stall the coroutine.
+            auto h = handle_from_event(ev);
+            poller_->del(ev.fd);
+            if (h) h.resume();
+        }
+        drain_posted();
+        fire_timers();
+        return n;
+    }
+
+private:
+    static constexpr int kMaxEvents = 128;
+
+    static EventLoop*& current_slot() noexcept {
+        thread_local EventLoop* loop = nullptr;
+        return loop;
+    }
+
+
+    struct DispatchScope {
+        explicit DispatchScope(detail::DispatchBatch* b) : prev(detail::current_dispatch()) {
+            detail::current_dispatch() = b;
+        }
+        ~DispatchScope() { detail::current_dispatch() = prev; }
+        detail::DispatchBatch* prev;
+    };
+
+    void drain_posted() {
+        // Bounded to what is queued now: a handle that re-posts itself runs
+        // again next iteration instead of starving I/O.
+        std::size_t budget = remote_.size();
+        std::coroutine_handle<> h;
+        while (budget-- > 0 && remote_.try_pop(h)) {
+            h.resume();
+        }
+        if (has_overflow_.load(std::memory_order_acquire)) {
+            std::deque<std::coroutine_handle<>> spilled;
+            {
+                std::lock_guard<std::mutex> lock(overflow_mu_);
+                spilled.swap(overflow_);
+                has_overflow_.store(false, std::memory_order_release);
+            }
+            for (auto sh : spilled) sh.resume();
+        }
+    }
+
+    void fire_timers() {
+        // Same budget rule as drain_posted: a zero-length timer added while
+        // firing waits for the next iteration.
+        std::size_t budget = timers_.size();
+        auto now = Clock::now();
+        while (budget-- > 0) {
+            Timer* timer = timers_.pop_expired(now);
+            if (timer == nullptr) break;
+            if (auto h = timer->handle) h.resume();  // the node may die in there
+        }
+    }
+
+    std::unique_ptr<Poller> poller_;
+    BoundedQueue<std::coroutine_handle<>> remote_;
+    std::mutex overflow_mu_;
+    std::deque<std::coroutine_handle<>> overflow_;
+    std::atomic<bool> has_overflow_{false};
+    TimerQueue timers_;
+};
+
+// Awaitable returned by sleep_for / sleep_until. On an event loop thread it
+// suspends on the loop's TimerQueue; destroying a suspended sleeper (its frame
+// torn down by with_timeout or an owner) cancels the timer. Anywhere else (a
+// ThreadPool worker after schedule(), a plain thread) it blocks the thread.
+class SleepAwaiter {
+public:
+    using Clock = EventLoop::Clock;
+
+    SleepAwaiter(EventLoop* loop, Clock::time_point deadline) noexcept
+    : loop_(loop), deadline_(deadline) {}
+
+    SleepAwaiter(const SleepAwaiter&) = delete;
+    SleepAwaiter& operator=(const SleepAwaiter&) = delete;
+
+    ~SleepAwaiter() {
+        if (timer_.armed()) loop_->cancel_timer(timer_);
+    }
+
+    bool await_ready() const {
+        if (Clock::now() >= deadline_) return true;
+        if (loop_ == nullptr) {
+            std::this_thread::sleep_until(deadline_);
+            return true;
+        }
+        return false;
+    }
+    void await_suspend(std::coroutine_handle<> h) { loop_->add_timer(timer_, deadline_, h); }
+    void await_resume() const noexcept {}
+
+private:
+    EventLoop* loop_;
+    Clock::time_point deadline_;
+    EventLoop::Timer timer_;
+};
+
+inline SleepAwaiter sleep_until(EventLoop::Clock::time_point deadline) noexcept {
+    return SleepAwaiter{EventLoop::current(), deadline};
+}
+
+template <typename Rep, typename Period>
+SleepAwaiter sleep_for(std::chrono::duration<Rep, Period> d) noexcept {
+    return SleepAwaiter{EventLoop::current(),
+                        EventLoop::Clock::now() +
+                            std::chrono::duration_cast<EventLoop::Clock::duration>(d)};
+}
+
+// A timeout shared by a run of I/O waits (one request phase, or every read of
+// a relay) that costs one timer for the run instead of one per wait. The
+// window opens on construction and again at each restart(), which only moves
+// the due time. A TimedIoAwaiter arms the timer when it suspends and leaves it
+// armed when the I/O wins, so the next wait reuses it; if it fires before a
+// due time that has since moved on, the waiter re-arms it for the rest of the
+// window and has its caller retry the syscall. A relay that keeps moving thus
+// costs about one timer operation per window.
+//
+// A zero window never expires, nor does a Deadline off an event loop thread,
+// where there is no timer to wait on. Loop thread only, one wait at a time,
+// and it must outlive its waits; destroying it cancels the timer.
+class Deadline {
+public:
+    using Clock = EventLoop::Clock;
+
+    Deadline() noexcept = default;
+    explicit Deadline(Clock::duration window) : window_(window) { restart(); }
+
+    Deadline(const Deadline&) = delete;
+    Deadline& operator=(const Deadline&) = delete;
+
+    ~Deadline() {
+        if (timer_.armed()) loop_->cancel_timer(timer_);
+    }
+
+    // A fresh window from now.
+    void restart() {
+        if (limited()) due_ = Clock::now() + window_;
+    }
+
+    bool limited() const noexcept { return window_ > Clock::duration::zero(); }
+    bool expired() const { return limited() && Clock::now() >= due_; }
+
+private:
+    friend class TimedIoAwaiter;
+
+    // Arms the timer for the due time, to resume `h` (null: nobody, yet).
+    // False off an event loop thread.
+    bool arm(std::coroutine_handle<> h) {
+        if (loop_ == nullptr) loop_ = EventLoop::current();
+        if (loop_ == nullptr) return false;
+        if (timer_.armed() && timer_.deadline() > due_) loop_->cancel_timer(timer_);
+        if (timer_.armed()) {
+            timer_.handle = h;
+        } else {
+            loop_->add_timer(timer_, due_, h);
+        }
+        return true;
+    }
+
+    Clock::duration window_{};
+    Clock::time_point due_{};
+    EventLoop* loop_ = nullptr;
+    EventLoop::Timer timer_;
+};
+
+// IoAwaiter{fd, mask} under a Deadline (null: none). co_await yields false
+// once the deadline has passed, with the fd deregistered by the time the
+// awaiter goes; true otherwise, when the caller should retry its syscall
+// (the fd may be ready, or the timer woke it early to re-arm). Await it as a
+// named local.
+class TimedIoAwaiter {
+public:
+    TimedIoAwaiter(Deadline* deadline, int fd, EventMask mask) noexcept
+    : deadline_(deadline), io_(fd, mask) {}
+
+    TimedIoAwaiter(const TimedIoAwaiter&) = delete;
+    TimedIoAwaiter& operator=(const TimedIoAwaiter&) = delete;
+
+    ~TimedIoAwaiter() {
+        if (timed_) deadline_->timer_.handle = nullptr;  // destroyed while suspended
+    }
+
+    bool await_ready() const { return deadline_ != nullptr && deadline_->expired(); }
+    void await_suspend(std::coroutine_handle<> h) {
+        suspended_ = true;
+        io_.await_suspend(h);
+        timed_ = deadline_ != nullptr && deadline_->limited() && deadline_->arm(h);
+    }
+    bool await_resume() {
+        if (!suspended_) return false;  // expired before the wait began
+        if (!std::exchange(timed_, false)) {
+            io_.await_resume();
+            return true;
+        }
+        EventLoop::Timer& timer = deadline_->timer_;
+        if (timer.armed()) {  // the fd won; the timer stays for the next wait
+            timer.handle = nullptr;
+            io_.await_resume();
+            return true;
+        }
+        if (deadline_->expired()) return false;
+        deadline_->arm(nullptr);
+        return true;
+    }
+
+private:
+    Deadline* deadline_;
+    IoAwaiter io_;
+    bool suspended_ = false;
+    bool timed_ = false;
+};
+
+namespace detail {
+// Starts `child` with the awaiting coroutine as its continuation and arms a
+// timer on the same handle; whichever comes first resumes the awaiter.
+// await_resume reports whether the child finished (and drops the timer).
+template <typename Promise>
+class DeadlineAwaiter {
+public:
+    DeadlineAwaiter(EventLoop* loop, std::coroutine_handle<Promise> child,
+                    EventLoop::Clock::time_point deadline) noexcept
+    : loop_(loop), child_(child), deadline_(deadline) {}
+
+    DeadlineAwaiter(const DeadlineAwaiter&) = delete;
+    DeadlineAwaiter& operator=(const DeadlineAwaiter&) = delete;
+
+    ~DeadlineAwaiter() {
+        if (timer_.armed()) loop_->cancel_timer(timer_);
+    }
+
+    bool await_ready() const noexcept { return child_.done(); }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> h) {
+        child_.promise().continuation_ = h;
+        loop_->add_timer(timer_, deadline_, h);
+        return child_;
+    }
+    bool await_resume() {
+        loop_->cancel_timer(timer_);
+        return child_.done();
+    }
+
+private:
+    EventLoop* loop_;
+    std::coroutine_handle<Promise> child_;
+    EventLoop::Clock::time_point deadline_;
+    EventLoop::Timer timer_;
+};
+}  // namespace detail
+
+// Run `task` with a deadline on the current event loop. Returns its result, or
+// nullopt if `timeout` elapsed first — in which case the child frame is
+// destroyed before with_timeout returns, which deregisters any IoAwaiter it
+// was suspended on and cancels its nested timers, so the caller may close the
+// fds it was using right away. The child must stay on the loop thread (no
+// schedule() hop) across the deadline. Off a loop thread there is no timer to
+// race against, so the task simply runs to completion.
+template <typename T>
+Task<std::optional<T>> with_timeout(Task<T> task, EventLoop::Clock::duration timeout) {
+    EventLoop* loop = EventLoop::current();
+    if (loop != nullptr) {
+        bool finished = co_await detail::DeadlineAwaiter<typename Task<T>::promise_type>{
+            loop, task.handle(), EventLoop::Clock::now() + timeout};
+        if (!finished) {
+            task = Task<T>{};  // destroy the child now, not with our frame
+            co_return std::nullopt;
+        }
+    }
+    co_return co_await task;
+}
+
+// Task<void> flavour: true if the task completed, false on timeout.
+inline Task<bool> with_timeout(Task<void> task, EventLoop::Clock::duration timeout) {
+    EventLoop* loop = EventLoop::current();
+    if (loop != nullptr) {
+        bool finished = co_await detail::DeadlineAwaiter<Task<void>::promise_type>{
+            loop, task.handle(), EventLoop::Clock::now() + timeout};
+        if (!finished) {
+            task = Task<void>{};
+            co_return false;
+        }
+    }
+    co_await task;
+    co_return true;
+}
+
+}  // namespace muses
+
+#endif  // MUSES_NET_EVENT_LOOP_HPP
@@ -0,0 +1,131 @@
+// MIT License
+
+// Copyright (c) 2023 nastyapple
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include "muses/config.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#ifndef MUSES_NET_PIPE_POOL_HPP
+#define MUSES_NET_PIPE_POOL_HPP
+
+namespace muses {
+
+// A non-blocking pipe pair used as the in-kernel buffer of a splice(2) relay
+// (socket → pipe → socket). Creating one costs two fds and a syscall, so
+// relays borrow them from a PipePool instead.
+struct PipePair {
+    int read_fd = -1;
+    int write_fd = -1;
+    explicit operator bool() const noexcept { return read_fd >= 0; }
+};
+
+// Recycles clean (empty) pipe pairs. Single-threaded: owned by one event loop
+// (ProxyServer keeps one), used only from coroutines running on it.
+class PipePool {
+public:
+    explicit PipePool(std::size_t max_idle = 64) : max_idle_(max_idle) {}
+    ~PipePool() { clear(); }
+
+    PipePool(const PipePool&) = delete;
+    PipePool& operator=(const PipePool&) = delete;
+
+    // A pooled pair, or a fresh one; an empty PipePair if pipes are
+    // unavailable (fd limit, non-Linux), in which case callers copy instead.
+    PipePair acquire() {
+        if (!idle_.empty()) {
+            PipePair p = idle_.back();
+            idle_.pop_back();
+            return p;
+        }
+#if defined(MUSES_PLATFORM_LINUX)
+        int fds[2];
+        if (::pipe2(fds, O_NONBLOCK | O_CLOEXEC) != 0) return {};
+        ++created_;
+        return PipePair{fds[0], fds[1]};
+#else
+        return {};
+#endif
+    }
+
+    // Returns a pair. Only an empty pipe may be reused; one that still holds
+    // bytes from an aborted relay (dirty) is closed.
+    void release(PipePair p, bool dirty) {
+        if (!p) return;
+        if (dirty || idle_.size() >= max_idle_) {
+            close_pair(p);
+            return;
+        }
+        idle_.push_back(p);
+    }
+
+    void clear() {
+        for (PipePair& p : idle_) close_pair(p);
+        idle_.clear();
+    }
+
+    std::size_t idle() const noexcept { return idle_.size(); }
+    // Pairs opened over the pool's lifetime (reuse keeps this flat).
+    std::size_t created() const noexcept { return created_; }
+
+    // RAII borrow: returns the pair on destruction, closing it if mark_dirty()
+    // was called and not undone by mark_clean().
+    class Lease {
+    public:
+        explicit Lease(PipePool& pool) : pool_(&pool), pair_(pool.acquire()) {}
+        ~Lease() { pool_->release(pair_, dirty_); }
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+
+        explicit operator bool() const noexcept { return static_cast<bool>(pair_); }
+        const PipePair& pipe() const noexcept { return pair_; }
+        void mark_dirty() noexcept { dirty_ = true; }
+        void mark_clean() noexcept { dirty_ = false; }
+
+    private:
+        PipePool* pool_;
+        PipePair pair_;
+        bool dirty_ = false;
+    };
+
+private:
+    static void close_pair(PipePair& p) {
+        ::close(p.read_fd);
+        ::close(p.write_fd);
+        p = {};
+    }
+
+    std::size_t max_idle_;
+    std::vector<PipePair> idle_;
+    std::size_t created_ = 0;
+};
+
+}  // namespace muses
+
+#endif  // MUSES_NET_PIPE_POOL_HPP
@@ -26,8 +26,11 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
 #include <unistd.h>
 
+#include <array>
 #include <atomic>
 #include <chrono>
 #include <cstdint>
@@ -38,8 +41,10 @@
 #include <functional>
 #include <memory>
 #include <string>
+#include <string_view>
 #include <thread>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include "muses/bloom_filter.hpp"
@@ -95,6 +100,12 @@ struct HandlerResult {
 
 using RequestHandler = std::function<HandlerResult(const std::string& request)>;
 
+// Optional per-request scheduling hint: runs on the reactor thread before
+// dispatch and picks the worker-pool lane for the request (e.g. High for
+// health checks and cached assets, Background for bulk exports). Must be
+// cheap — it sits on the I/O loop. Without a hint every request is Normal.
+using PriorityHint = std::function<TaskPriority(const std::string& request)>;
+
 // What a worker hands back to the reactor via the outbox. The worker computes
 // the response and returns it; the reactor (which owns the fd and the poller)
 // does the actual non-blocking write. This keeps the write on the reactor
@@ -116,15 +127,25 @@ public:
     //   ip_rate_per_sec    — max new connections per source IP per second before it
     //                        is blacklisted (connection-flood defense). 0 disables.
     //                        Default 0 (off) so localhost benchmarks aren't tripped.
+    //   worker_queue_capacity / worker_overflow
+    //                      — bound on requests waiting for a worker, and what to do
+    //                        when it is reached (see ThreadPool). A request the pool
+    //                        rejects or evicts is answered with a 503 by the reactor
+    //                        itself. 0 = unbounded (the default). Block and
+    //                        CallerRuns are taken as DropNew: either would run
+    //                        or wait on the reactor thread and stall every
+    //                        connection on the shard.
     Reactor(int listen_fd, RequestHandler handler,
             unsigned worker_threads = 4,
             std::size_t outbox_capacity = 1024,
             std::chrono::seconds idle_timeout = std::chrono::seconds(30),
             std::size_t max_connections = 10000,
-            std::size_t ip_rate_per_sec = 0)
+            std::size_t ip_rate_per_sec = 0,
+            std::size_t worker_queue_capacity = 0,
+            OverflowPolicy worker_overflow = OverflowPolicy::DropNew)
     : listen_fd_(listen_fd),
       handler_(std::move(handler)),
-      workers_(worker_threads),
+      workers_(worker_threads, worker_queue_capacity, worker_overflow_policy(worker_overflow)),
       outbox_(outbox_capacity, OverflowPolicy::DropNew),
       running_(false),
       idle_timeout_(idle_timeout),
@@ -135,6 +156,12 @@ public:
 
     ~Reactor() { stop(); }
 
+    // The policy the worker pool really gets: only those that never hold
+    // up the submitting (reactor) thread.
+    static constexpr OverflowPolicy worker_overflow_policy(OverflowPolicy p) noexcept {
+        return p == OverflowPolicy::DropOldest ? p : OverflowPolicy::DropNew;
+    }
+
     Reactor(const Reactor&) = delete;
     Reactor& operator=(const Reactor&) = delete;
 
@@ -150,6 +177,17 @@ public:
         MUSES_INFO("Reactor started");
     }
 
+    // Install the lane classifier. Call before start(); the reactor thread
+    // reads it without locking.
+    void set_priority_hint(PriorityHint hint) { priority_hint_ = std::move(hint); }
+
+    // Lane weights / aging for this reactor's worker pool (see ThreadPool).
+    void configure_worker_lanes(LaneScheduling mode,
+                                std::array<unsigned, ThreadPool::kLaneCount> weights = {8, 4, 1},
+                                std::chrono::milliseconds aging = std::chrono::milliseconds(100)) {
+        workers_.configure_lanes(mode, weights, aging);
+    }
+
     void stop() {
         if (!running_.exchange(false)) return;
         if (poller_) poller_->wakeup();
@@ -249,7 +287,7 @@ private:
             if (max_connections_ != 0 && connections_.size() >= max_connections_) {
                 break;
             }
-            sockaddr_in addr{};
+            sockaddr_storage addr{};
             socklen_t len = sizeof(addr);
             int fd = ::accept(listen_fd_, reinterpret_cast<sockaddr*>(&addr), &len);
             if (fd < 0) {
@@ -259,7 +297,10 @@ private:
                 break;
             }
             // Capture the client IPv4 (host order) for rate-limit accounting.
-            std::uint32_t ip = ntohl(addr.sin_addr.s_addr);
+            // A Unix-domain peer has none and is left out of it (ip 0).
+            std::uint32_t ip = addr.ss_family == AF_INET
+                ? ntohl(reinterpret_cast<const sockaddr_in*>(&addr)->sin_addr.s_addr)
+                : 0;
             // DoS gate 2: per-IP connection-rate limit. A blacklisted IP (one
             // that previously exceeded the rate) is rejected without further
             // work. The blacklist ages out via sweep_ip_rate's decay.
@@ -450,8 +491,13 @@ private:
         }
         conn.read_buf.set_size(leftover);
         conn.read_buf.set_scan_pos(0);
+        TaskPriority lane = priority_hint_ ? priority_hint_(request) : TaskPriority::Normal;
         // Capture handler_ by reference (stable for the reactor's lifetime).
-        workers_.enqueue([this, fd, request = std::move(request)]() mutable {
+        // The guard answers 503 if the worker pool rejects or evicts the task
+        // (bounded queue overload); running the task disarms it.
+        workers_.enqueue(lane, [this, fd, request = std::move(request),
+                          guard = OverloadGuard(this, fd)]() mutable {
+            guard.disarm();
             HandlerResult hr;
             bool handler_ok = true;
             try {
@@ -486,6 +532,49 @@ private:
         });
     }
 
+    // Fast-path reply for a request the worker pool refused under overload.
+    // Sent by the reactor without touching a worker; the connection is closed
+    // afterwards so the client backs off instead of pipelining into the queue.
+    static constexpr std::string_view kOverloadedResponse =
+        "HTTP/1.1 503 Service Unavailable\r\n"
+        "Content-Type: text/plain\r\n"
+        "Content-Length: 23\r\n"
+        "Connection: close\r\n"
+        "Retry-After: 1\r\n"
+        "\r\n"
+        "503 Service Unavailable";
+
+    // Travels inside a dispatched worker task. If the task is destroyed without
+    // running (DropNew rejection, DropOldest eviction, or enqueue after stop)
+    // the destructor hands a 503 back through the outbox, so an overloaded pool
+    // never leaves a client hanging. Move-only; the moved-from guard is inert.
+    class OverloadGuard {
+    public:
+        OverloadGuard(Reactor* reactor, int fd) : reactor_(reactor), fd_(fd) {}
+        OverloadGuard(OverloadGuard&& o) noexcept
+        : reactor_(std::exchange(o.reactor_, nullptr)), fd_(o.fd_) {}
+        OverloadGuard& operator=(OverloadGuard&&) = delete;
+        ~OverloadGuard() {
+            if (reactor_ != nullptr) reactor_->reject_overloaded(fd_);
+        }
+        void disarm() { reactor_ = nullptr; }
+
+    private:
+        Reactor* reactor_;
+        int fd_;
+    };
+
+    // May run on the reactor thread (rejection inside enqueue) or on a worker
+    // (a Block producer racing stop), so it only uses the outbox.
+    void reject_overloaded(int fd) {
+        if (!outbox_.push(WorkerHandback{fd, false, std::string(kOverloadedResponse)})) {
+            // Same fallback as a worker facing a full outbox.
+            ::close(fd);
+            return;
+        }
+        if (poller_) poller_->wakeup();
+    }
+
     // Attempt a non-blocking write of [data.data()+off, data.data()+size).
     // Returns the number of bytes written (>=0), or SIZE_MAX on a hard error
     // (caller closes the fd). Does NOT busy-spin on EAGAIN — returns the count
@@ -665,6 +754,7 @@ private:
 
     int listen_fd_;
     RequestHandler handler_;
+    PriorityHint priority_hint_;
     ThreadPool workers_;
     BoundedQueue<WorkerHandback> outbox_;
     std::unique_ptr<Poller> poller_;
@@ -692,9 +782,9 @@ private:
     std::chrono::steady_clock::time_point last_ip_decay_;
 };
 
-// A pool of independent Reactor shards sharing one listen fd. SO_REUSEPORT
-// (set in TCPListener) lets the kernel hand each incoming connection to exactly
-// one shard; that shard owns the fd for its whole lifetime — it appears in that
+// A pool of independent Reactor shards sharing one listen fd (a TCPListener's
+// or a UnixListener's). Each incoming connection is accepted by exactly one
+// shard; that shard owns the fd for its whole lifetime — it appears in that
 // shard's connections_, is served by that shard's worker pool, and its response
 // handback routes back through that shard's outbox. No cross-shard routing or
 // locking is needed.
@@ -707,14 +797,16 @@ private:
 class ReactorPool {
 public:
     // shard_count reactors; each runs workers_per_shard worker threads. The
-    // DoS-hardening knobs are forwarded to every shard (each enforces them
-    // independently against the connections it owns).
+    // DoS-hardening and worker-queue knobs are forwarded to every shard (each
+    // enforces them independently against the connections it owns).
     ReactorPool(int listen_fd, RequestHandler handler,
                 unsigned shard_count, unsigned workers_per_shard,
                 std::size_t outbox_capacity = 1024,
                 std::chrono::seconds idle_timeout = std::chrono::seconds(30),
                 std::size_t max_connections = 10000,
-                std::size_t ip_rate_per_sec = 0)
+                std::size_t ip_rate_per_sec = 0,
+                std::size_t worker_queue_capacity = 0,
+                OverflowPolicy worker_overflow = OverflowPolicy::DropNew)
     : listen_fd_(listen_fd),
       handler_(std::move(handler)),
       workers_per_shard_(workers_per_shard == 0 ? 1 : workers_per_shard),
@@ -728,7 +820,8 @@ public:
             // to long-lived state, so copying is cheap and safe).
             shards_.push_back(std::make_unique<Reactor>(
                 listen_fd_, handler_, workers_per_shard_, outbox_capacity_,
-                idle_timeout, max_connections, ip_rate_per_sec));
+                idle_timeout, max_connections, ip_rate_per_sec,
+                worker_queue_capacity, worker_overflow));
         }
     }
 
@@ -752,6 +845,17 @@ public:
         }
     }
 
+    // Forwarded to every shard; call before start().
+    void set_priority_hint(const PriorityHint& hint) {
+        for (auto& shard : shards_) shard->set_priority_hint(hint);
+    }
+
+    void configure_worker_lanes(LaneScheduling mode,
+                                std::array<unsigned, ThreadPool::kLaneCount> weights = {8, 4, 1},
+                                std::chrono::milliseconds aging = std::chrono::milliseconds(100)) {
+        for (auto& shard : shards_) shard->configure_worker_lanes(mode, weights, aging);
+    }
+
     std::size_t shard_count() const { return shards_.size(); }
 
 private:
@@ -825,6 +929,85 @@ private:
     int listen_fd_;
 };
 
+// Convenience: a listener on a Unix-domain stream socket at `path`, for
+// clients on the same host. Its fd goes wherever a TCPListener's does
+// (Reactor, ReactorPool, ProxyServer). A socket left at `path` by an earlier
+// run is removed before binding, once a connect() to it is refused; one a
+// live server still accepts on is an error, and anything else there is left
+// for bind() to refuse. The one bound here is removed on destruction. Peers
+// have no IP address, so the reactor's per-IP rate limit does not apply to
+// them.
+class UnixListener {
+public:
+    explicit UnixListener(std::string path) : path_(std::move(path)), listen_fd_(-1) {}
+
+    ~UnixListener() {
+        if (listen_fd_ != -1) {
+            ::close(listen_fd_);
+            ::unlink(path_.c_str());
+        }
+    }
+
+    UnixListener(const UnixListener&) = delete;
+    UnixListener& operator=(const UnixListener&) = delete;
+
+    const std::string& path() const { return path_; }
+
+    // Returns the listen fd, creating it on first call; see TCPListener.
+    std::expected<int, std::string> get_listener() {
+        if (listen_fd_ != -1) return listen_fd_;
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        if (path_.empty() || path_.size() >= sizeof(addr.sun_path)) {
+            return std::unexpected(std::format("UnixListener: bad socket path '{}'", path_));
+        }
+        std::memcpy(addr.sun_path, path_.data(), path_.size());
+        listen_fd_ = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listen_fd_ < 0) {
+            return std::unexpected(std::format("UnixListener: socket() failed: {}", std::strerror(errno)));
+        }
+        struct stat st{};
+        if (::lstat(path_.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) {
+            // Only a refused connect marks it stale; EAGAIN is a live server
+            // with a full backlog.
+            int probe = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+            int err = ECONNREFUSED;
+            if (probe >= 0) {
+                err = ::connect(probe, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0 ? 0 : errno;
+                ::close(probe);
+            }
+            if (err == ECONNREFUSED) {
+                ::unlink(path_.c_str());
+            } else if (err == 0 || err == EAGAIN) {
+                ::close(listen_fd_);
+                listen_fd_ = -1;
+                return std::unexpected(std::format("UnixListener: {} is in use by another server", path_));
+            }
+        }
+        if (::bind(listen_fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+            std::string why = std::format("UnixListener: bind({}) failed: {}", path_, std::strerror(errno));
+            ::close(listen_fd_);
+            listen_fd_ = -1;
+            return std::unexpected(why);
+        }
+        if (::listen(listen_fd_, SOMAXCONN) < 0) {
+            std::string why = std::format("UnixListener: listen() failed: {}", std::strerror(errno));
+            ::close(listen_fd_);
+            ::unlink(path_.c_str());
+            listen_fd_ = -1;
+            return std::unexpected(why);
+        }
+        int flags = ::fcntl(listen_fd_, F_GETFL, 0);
+        ::fcntl(listen_fd_, F_SETFL, flags | O_NONBLOCK);
+        MUSES_INFO("UnixListener listening");
+        return listen_fd_;
+    }
+
+private:
+    std::string path_;
+    int listen_fd_;
+};
+
 }  // namespace muses
 
 #endif  // MUSES_NET_REACTOR_HPP
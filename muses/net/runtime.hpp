@@ -0,0 +1,347 @@
+// MIT License
+
+// Copyright (c) 2023 nastyapple
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include <atomic>
+#include <coroutine>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include "muses/bounded_queue.hpp"
+#include "muses/frame_pool.hpp"
+#include "muses/logging.hpp"
+#include "muses/net/event_loop.hpp"
+#include "muses/task.hpp"
+
+#ifndef MUSES_NET_RUNTIME_HPP
+#define MUSES_NET_RUNTIME_HPP
+
+namespace muses {
+
+// N event-loop threads sharing the work of many detached Task<void>s.
+//
+// Each worker owns an EventLoop (poller + timers + pinned post() queue) and a
+// ready ring of coroutine handles. spawn() and yield() put handles on a ready
+// ring; a worker drains its own ring first and, when that is empty, steals
+// from the other workers' rings (BoundedQueue is MPMC, so a thief pops
+// straight from the victim's ring — no separate deque protocol). I/O readiness
+// and timers are NOT stolen: a coroutine suspended on IoAwaiter{fd, mask} is
+// registered with the poller of the worker it suspended on and is resumed
+// there, which keeps connection state on one core while it is busy. Work moves
+// at spawn and yield points.
+//
+//     muses::Runtime rt(4);
+//     rt.spawn(serve(conn));           // from any thread
+//     ... inside a task:
+//     co_await IoAwaiter{fd, EventMask::Readable};   // this worker's poller
+//     co_await Runtime::yield();        // let other ready work (or a thief) run
+//
+// Wakeups: spawning onto a sleeping worker wakes it; spawning onto a busy one
+// wakes one sleeping worker instead so it can steal. A full ring spills into a
+// mutex-guarded injector queue that every worker checks.
+//
+// Spawned tasks are owned by the runtime: their frames are freed when they
+// finish, and stop() destroys the ones still suspended (after joining the
+// workers, while their pollers still exist). Tasks on different workers run in
+// parallel — anything they share must be thread-safe. A task may still use
+// EventLoop::resume_here()/post() to pin itself to one particular loop.
+class Runtime {
+public:
+    explicit Runtime(unsigned threads = std::thread::hardware_concurrency(),
+                     std::size_t ready_capacity = 4096) {
+        if (threads == 0) threads = 1;
+        workers_.reserve(threads);
+        for (unsigned i = 0; i < threads; ++i) {
+            workers_.push_back(std::make_unique<Worker>(this, i, ready_capacity));
+        }
+        running_.store(true);
+        for (auto& w : workers_) {
+            w->thread = std::thread(&Runtime::run, this, w.get());
+        }
+    }
+
+    ~Runtime() { stop(); }
+
+    Runtime(const Runtime&) = delete;
+    Runtime& operator=(const Runtime&) = delete;
+
+    // Thread-safe. Takes ownership of `task` and schedules its first resume.
+    // From a worker thread it lands on that worker's ring (locality; idle
+    // workers steal it if this one stays busy), otherwise round-robin.
+    // Returns false (and destroys the task) if the runtime is stopped.
+    bool spawn(Task<void> task) {
+        if (!task.valid()) return false;
+        auto h = detached(std::move(task)).handle;
+        {
+            // Checked under the lock stop() swaps the set under: a task is
+            // either refused here or guaranteed to be destroyed by stop().
+            std::lock_guard<std::mutex> lock(live_mu_);
+            if (!running_.load(std::memory_order_acquire)) {
+                h.destroy();
+                return false;
+            }
+            h.promise().runtime = this;
+            live_.insert(h.address());
+        }
+        Worker* self = current_worker();
+        Worker* target = (self != nullptr && self->runtime == this)
+            ? self
+            : workers_[next_.fetch_add(1, std::memory_order_relaxed) % workers_.size()].get();
+        enqueue(target, h);
+        return true;
+    }
+
+    // Awaitable: requeue the calling task on its worker's ready ring (where an
+    // idle worker may steal it). No-op outside a runtime worker.
+    struct YieldAwaiter {
+        bool await_ready() const noexcept { return current_worker() == nullptr; }
+        void await_suspend(std::coroutine_handle<> h) {
+            Worker* w = current_worker();
+            w->runtime->enqueue(w, h);
+        }
+        void await_resume() const noexcept {}
+    };
+    static YieldAwaiter yield() noexcept { return {}; }
+
+    // The runtime whose worker is running on this thread, or null.
+    static Runtime* current() noexcept {
+        Worker* w = current_worker();
+        return w != nullptr ? w->runtime : nullptr;
+    }
+
+    unsigned size() const noexcept { return static_cast<unsigned>(workers_.size()); }
+    EventLoop& loop(unsigned i) { return *workers_[i]->loop; }
+    // Spawned tasks not yet finished.
+    std::size_t live() const {
+        std::lock_guard<std::mutex> lock(live_mu_);
+        return live_.size();
+    }
+    // Handles a worker took from another worker's ring.
+    std::size_t steals() const noexcept { return steals_.load(std::memory_order_relaxed); }
+
+    // Idempotent. Joins the workers, then destroys still-suspended tasks.
+    void stop() {
+        if (!running_.exchange(false)) return;
+        for (auto& w : workers_) w->loop->poller()->wakeup();
+        for (auto& w : workers_) {
+            if (w->thread.joinable()) w->thread.join();
+        }
+        std::unordered_set<void*> leftover;
+        {
+            std::lock_guard<std::mutex> lock(live_mu_);
+            leftover.swap(live_);
+        }
+        // Destroy with each frame's awaiters able to reach their (still
+        // alive) loops; the retire hook is skipped since we own the set now.
+        for (void* addr : leftover) {
+            auto h = std::coroutine_handle<DetachedPromise>::from_address(addr);
+            h.promise().runtime = nullptr;
+            h.destroy();
+        }
+    }
+
+private:
+    static constexpr std::size_t kReadyBudget = 64;   // ready handles per turn
+    static constexpr std::size_t kStealBatch = 16;    // max handles per steal
+    static constexpr int kIdlePollMs = 100;
+
+    struct Worker {
+        Worker(Runtime* rt, unsigned idx, std::size_t capacity)
+        : index(idx),
+          runtime(rt),
+          loop(std::make_unique<EventLoop>()),
+          ready(capacity, OverflowPolicy::DropNew) {}
+
+        unsigned index;
+        Runtime* runtime;
+        std::unique_ptr<EventLoop> loop;
+        BoundedQueue<std::coroutine_handle<>> ready;
+        std::atomic<bool> sleeping{false};
+        std::thread thread;
+    };
+
+    // --- Detached driver: owns one spawned task, frees itself when done ----
+
+    struct DetachedPromise;
+    struct Detached {
+        using promise_type = DetachedPromise;
+        std::coroutine_handle<DetachedPromise> handle;
+    };
+    struct DetachedPromise : detail::PooledFrame {
+        Runtime* runtime = nullptr;
+
+        Detached get_return_object() {
+            return Detached{std::coroutine_handle<DetachedPromise>::from_promise(*this)};
+        }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        struct Final {
+            bool await_ready() const noexcept { return false; }
+            void await_suspend(std::coroutine_handle<DetachedPromise> h) noexcept {
+                if (Runtime* rt = h.promise().runtime) rt->retire(h.address());
+                h.destroy();
+            }
+            void await_resume() const noexcept {}
+        };
+        Final final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept {}
+    };
+    friend struct DetachedPromise;
+
+    static Detached detached(Task<void> task) {
+        try {
+            co_await task;
+        } catch (const std::exception& e) {
+            MUSES_ERROR(std::string("Runtime: spawned task threw: ") + e.what());
+        } catch (...) {
+            MUSES_ERROR("Runtime: spawned task threw");
+        }
+    }
+
+    void retire(void* addr) {
+        std::lock_guard<std::mutex> lock(live_mu_);
+        live_.erase(addr);
+    }
+
+    // --- Scheduling --------------------------------------------------------
+
+    static Worker*& current_worker() noexcept {
+        thread_local Worker* worker = nullptr;
+        return worker;
+    }
+
+    void enqueue(Worker* target, std::coroutine_handle<> h) {
+        if (!target->ready.push(h)) {
+            std::lock_guard<std::mutex> lock(injector_mu_);
+            injector_.push_back(h);
+            has_injected_.store(true, std::memory_order_release);
+        }
+        queued_.fetch_add(1, std::memory_order_seq_cst);
+        if (target->sleeping.load(std::memory_order_seq_cst)) {
+            target->loop->poller()->wakeup();
+            return;
+        }
+        // Target is busy: nudge one sleeper so it can steal.
+        for (auto& w : workers_) {
+            if (w.get() != target && w->sleeping.load(std::memory_order_seq_cst)) {
+                w->loop->poller()->wakeup();
+                return;
+            }
+        }
+    }
+
+    bool pop_ready(Worker* w, std::coroutine_handle<>& out) {
+        if (w->ready.try_pop(out)) return true;
+        if (has_injected_.load(std::memory_order_acquire)) {
+            std::lock_guard<std::mutex> lock(injector_mu_);
+            if (!injector_.empty()) {
+                out = injector_.front();
+                injector_.pop_front();
+                if (injector_.empty()) has_injected_.store(false, std::memory_order_release);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Move up to half of the fullest victim's ring (at most kStealBatch) onto
+    // our own ring. Returns how many were taken.
+    std::size_t steal_into(Worker* thief) {
+        Worker* victim = nullptr;
+        std::size_t most = 0;
+        for (auto& w : workers_) {
+            if (w.get() == thief) continue;
+            std::size_t n = w->ready.size();
+            if (n > most) {
+                most = n;
+                victim = w.get();
+            }
+        }
+        if (victim == nullptr) return 0;
+        std::size_t want = (most + 1) / 2;
+        if (want > kStealBatch) want = kStealBatch;
+        std::size_t taken = 0;
+        std::coroutine_handle<> h;
+        while (taken < want && victim->ready.try_pop(h)) {
+            if (!thief->ready.push(h)) {
+                h.resume();  // our ring is full; just run it
+                queued_.fetch_sub(1, std::memory_order_relaxed);
+            }
+            ++taken;
+        }
+        if (taken > 0) steals_.fetch_add(taken, std::memory_order_relaxed);
+        return taken;
+    }
+
+    void run(Worker* w) {
+        current_worker() = w;
+        EventLoop::CurrentScope scope(w->loop.get());
+        auto ignore = [](const PollEvent&) {};
+        while (running_.load(std::memory_order_acquire)) {
+            std::size_t ran = 0;
+            std::coroutine_handle<> h;
+            while (ran < kReadyBudget && pop_ready(w, h)) {
+                queued_.fetch_sub(1, std::memory_order_relaxed);
+                h.resume();
+                ++ran;
+            }
+            if (ran == 0 && queued_.load(std::memory_order_relaxed) > 0) {
+                ran = steal_into(w);
+            }
+            int timeout = 0;
+            if (ran == 0) {
+                // Announce sleep, then re-check: a spawner that pushed before
+                // seeing `sleeping` is caught here; one that pushes after sees
+                // it and wakes us.
+                w->sleeping.store(true, std::memory_order_seq_cst);
+                if (queued_.load(std::memory_order_seq_cst) == 0) timeout = kIdlePollMs;
+            }
+            w->loop->run_once(timeout, ignore);
+            w->sleeping.store(false, std::memory_order_relaxed);
+        }
+        current_worker() = nullptr;
+    }
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::atomic<bool> running_{false};
+    std::atomic<std::size_t> next_{0};
+    std::atomic<std::size_t> queued_{0};
+    std::atomic<std::size_t> steals_{0};
+    std::mutex injector_mu_;
+    std::deque<std::coroutine_handle<>> injector_;
+    std::atomic<bool> has_injected_{false};
+    mutable std::mutex live_mu_;
+    std::unordered_set<void*> live_;
+};
+
+}  // namespace muses
+
+#endif  // MUSES_NET_RUNTIME_HPP
@@ -0,0 +1,166 @@
+// MIT License
+
+// Copyright (c) 2023 nastyapple
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include <chrono>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#ifndef MUSES_NET_TIMER_QUEUE_HPP
+#define MUSES_NET_TIMER_QUEUE_HPP
+
+namespace muses {
+
+// Deadline-ordered timers for one EventLoop (single-threaded; only the loop
+// thread touches it).
+//
+// Intrusive: a timer is a Node owned by whoever waits on it (SleepAwaiter,
+// Deadline), and the queue is a binary min-heap of pointers to them, so
+// arming one allocates nothing once the heap has grown to its working size.
+// Each node remembers its heap slot, which makes cancel — the common case,
+// since most timers guard I/O that completes first — an O(log n) removal
+// instead of a search or a tombstone. Ties on the deadline go to the node
+// armed first. An armed node must not move or be destroyed; its owner
+// cancels it first.
+class TimerQueue {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    class Node {
+    public:
+        Node() noexcept = default;
+        Node(const Node&) = delete;
+        Node& operator=(const Node&) = delete;
+
+        bool armed() const noexcept { return slot_ != kUnarmed; }
+        Clock::time_point deadline() const noexcept { return deadline_; }
+
+        // Resumed when the node fires; null fires it without resuming anyone.
+        std::coroutine_handle<> handle;
+
+    private:
+        friend class TimerQueue;
+        static constexpr std::size_t kUnarmed = std::numeric_limits<std::size_t>::max();
+
+        Clock::time_point deadline_{};
+        std::uint64_t seq_ = 0;
+        std::size_t slot_ = kUnarmed;
+    };
+
+    // Arms an unarmed `node` to resume `h` at `deadline`.
+    void add(Node& node, Clock::time_point deadline, std::coroutine_handle<> h) {
+        node.deadline_ = deadline;
+        node.seq_ = ++next_seq_;
+        node.handle = h;
+        node.slot_ = heap_.size();
+        heap_.push_back(&node);
+        sift_up(node.slot_);
+    }
+
+    // Returns false if the node is not armed (never was, fired, or cancelled).
+    bool cancel(Node& node) {
+        if (!node.armed()) return false;
+        remove(node.slot_);
+        return true;
+    }
+
+    bool empty() const noexcept { return heap_.empty(); }
+    std::size_t size() const noexcept { return heap_.size(); }
+
+    // Poll timeout honoring the earliest deadline: `cap_ms` (-1 = forever) if
+    // there is no timer, otherwise the time left rounded UP to whole
+    // milliseconds so the loop does not spin on 0 ms waits before a deadline.
+    int timeout_ms(int cap_ms, Clock::time_point now) const {
+        if (heap_.empty()) return cap_ms;
+        auto left = heap_.front()->deadline_ - now;
+        if (left <= Clock::duration::zero()) return 0;
+        auto ms = std::chrono::ceil<std::chrono::milliseconds>(left).count();
+        if (ms > std::numeric_limits<int>::max()) ms = std::numeric_limits<int>::max();
+        int bound = static_cast<int>(ms);
+        return cap_ms < 0 ? bound : (bound < cap_ms ? bound : cap_ms);
+    }
+
+    // Disarm and return the earliest node whose deadline is <= now, or null.
+    // One at a time on purpose: resuming its handle may cancel later timers.
+    Node* pop_expired(Clock::time_point now) {
+        if (heap_.empty() || heap_.front()->deadline_ > now) return nullptr;
+        Node* node = heap_.front();
+        remove(0);
+        return node;
+    }
+
+private:
+    static bool before(const Node* a, const Node* b) noexcept {
+        return a->deadline_ != b->deadline_ ? a->deadline_ < b->deadline_ : a->seq_ < b->seq_;
+    }
+
+    void place(Node* node, std::size_t slot) noexcept {
+        heap_[slot] = node;
+        node->slot_ = slot;
+    }
+
+    void remove(std::size_t slot) {
+        heap_[slot]->slot_ = Node::kUnarmed;
+        Node* last = heap_.back();
+        heap_.pop_back();
+        if (slot == heap_.size()) return;
+        place(last, slot);
+        sift_up(slot);
+        sift_down(last->slot_);
+    }
+
+    void sift_up(std::size_t slot) noexcept {
+        Node* node = heap_[slot];
+        while (slot > 0) {
+            std::size_t parent = (slot - 1) / 2;
+            if (!before(node, heap_[parent])) break;
+            place(heap_[parent], slot);
+            slot = parent;
+        }
+        place(node, slot);
+    }
+
+    void sift_down(std::size_t slot) noexcept {
+        Node* node = heap_[slot];
+        for (;;) {
+            std::size_t child = 2 * slot + 1;
+            if (child >= heap_.size()) break;
+            if (child + 1 < heap_.size() && before(heap_[child + 1], heap_[child])) ++child;
+            if (!before(heap_[child], node)) break;
+            place(heap_[child], slot);
+            slot = child;
+        }
+        place(node, slot);
+    }
+
+    std::vector<Node*> heap_;
+    std::uint64_t next_seq_ = 0;
+};
+
+}  // namespace muses
+
+#endif  // MUSES_NET_TIMER_QUEUE_HPP
@@ -0,0 +1,285 @@
+// MIT License
+
+// Copyright (c) 2023 nastyapple
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "muses/net_components/maglev.hpp"
+
+#ifndef MUSES_NET_BALANCER_HPP
+#define MUSES_NET_BALANCER_HPP
+
+namespace muses {
+
+// How a route spreads requests over its endpoints.
+enum class BalancePolicy {
+    RoundRobin,        // smooth weighted round-robin (nginx-style)
+    LeastOutstanding,  // fewest in-flight requests per unit of weight
+    PowerOfTwoEwma,    // two weighted-random candidates; lower EWMA latency × load
+    ConsistentHash,    // Maglev table over a request key; round-robin without one
+};
+
+// Per-endpoint load picture a Balancer keeps.
+struct EndpointLoad {
+    unsigned weight = 1;
+    std::size_t outstanding = 0;   // picked and not yet finished
+    std::uint64_t picks = 0;
+    double ewma_us = 0.0;          // decayed latency average; 0 until sampled
+    std::chrono::steady_clock::time_point sampled_at{};
+};
+
+// Chooses one of N weighted endpoints per request. Single-threaded: one per
+// route per event loop. Callers pass a predicate that vetoes endpoints (e.g.
+// unhealthy ones); pick() returns nullopt if it vetoes all of them.
+//
+//     auto i = balancer.pick([&](std::size_t e) { return healthy(e); });
+//     Balancer::Ticket t = balancer.start(*i);   // counts as outstanding
+//     ... t.observe(latency) once the upstream answers ...
+//     // ~Ticket: no longer outstanding
+//
+// ConsistentHash keeps a key (path, client address, ...) on one endpoint for
+// as long as that endpoint is usable: pick_for(stable_hash(key), usable).
+class Balancer {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // `names` are stable endpoint identities for ConsistentHash (e.g.
+    // "host:port"); they decide which keys an endpoint owns, so reordering
+    // the endpoints does not remap keys. Defaults to the positions.
+    Balancer(std::vector<unsigned> weights, BalancePolicy policy,
+             std::chrono::milliseconds decay = std::chrono::seconds(10),
+             std::vector<std::string> names = {})
+    : policy_(policy),
+      decay_us_(static_cast<double>(
+          std::chrono::duration_cast<std::chrono::microseconds>(decay).count())),
+      current_(weights.size(), 0),
+      rng_(static_cast<std::uint32_t>(reinterpret_cast<std::uintptr_t>(this))) {
+        load_.reserve(weights.size());
+        for (unsigned w : weights) load_.push_back(EndpointLoad{w == 0 ? 1 : w});
+        if (policy_ == BalancePolicy::ConsistentHash) {
+            if (names.size() != load_.size()) {
+                names.clear();
+                for (std::size_t i = 0; i < load_.size(); ++i) names.push_back(std::to_string(i));
+            }
+            std::vector<unsigned> w;
+            for (const auto& l : load_) w.push_back(l.weight);
+            table_ = MaglevTable(names, w);
+        }
+    }
+
+    template <typename Usable>
+    std::optional<std::size_t> pick(Usable&& usable) {
+        std::optional<std::size_t> chosen;
+        switch (policy_) {
+        case BalancePolicy::RoundRobin:
+        case BalancePolicy::ConsistentHash:  // no key to hash
+            chosen = pick_round_robin(usable);
+            break;
+        case BalancePolicy::LeastOutstanding:
+            chosen = pick_least_outstanding(usable);
+            break;
+        case BalancePolicy::PowerOfTwoEwma:
+            chosen = pick_p2c(usable);
+            break;
+        }
+        if (chosen) ++load_[*chosen].picks;
+        return chosen;
+    }
+
+    std::optional<std::size_t> pick() {
+        return pick([](std::size_t) { return true; });
+    }
+
+    // Like pick(), but under ConsistentHash the endpoint is the one owning
+    // `key_hash`; when that one is vetoed, the key moves to the next usable
+    // owner in the table and the other endpoints' keys stay put. Other
+    // policies ignore the key.
+    template <typename Usable>
+    std::optional<std::size_t> pick_for(std::uint64_t key_hash, Usable&& usable) {
+        if (policy_ != BalancePolicy::ConsistentHash) return pick(usable);
+        auto chosen = table_.lookup(key_hash, usable);
+        if (chosen) ++load_[*chosen].picks;
+        return chosen;
+    }
+
+    // One in-flight request on an endpoint. Movable; finishing (destruction)
+    // drops the outstanding count even if the request's coroutine is torn
+    // down mid-flight.
+    class Ticket {
+    public:
+        Ticket() = default;
+        Ticket(Balancer* b, std::size_t i) noexcept : balancer_(b), index_(i) {}
+        Ticket(Ticket&& o) noexcept
+        : balancer_(std::exchange(o.balancer_, nullptr)), index_(o.index_) {}
+        Ticket& operator=(Ticket&& o) noexcept {
+            if (this != &o) {
+                finish();
+                balancer_ = std::exchange(o.balancer_, nullptr);
+                index_ = o.index_;
+            }
+            return *this;
+        }
+        Ticket(const Ticket&) = delete;
+        Ticket& operator=(const Ticket&) = delete;
+        ~Ticket() { finish(); }
+
+        std::size_t index() const noexcept { return index_; }
+        explicit operator bool() const noexcept { return balancer_ != nullptr; }
+
+        // Feeds one latency sample into the endpoint's EWMA.
+        void observe(Clock::duration latency) {
+            if (balancer_) balancer_->observe(index_, latency);
+        }
+
+        void finish() noexcept {
+            if (balancer_) {
+                --balancer_->load_[index_].outstanding;
+                balancer_ = nullptr;
+            }
+        }
+
+    private:
+        Balancer* balancer_ = nullptr;
+        std::size_t index_ = 0;
+    };
+
+    Ticket start(std::size_t i) {
+        ++load_[i].outstanding;
+        return Ticket{this, i};
+    }
+
+    void observe(std::size_t i, Clock::duration latency, Clock::time_point now = Clock::now()) {
+        EndpointLoad& l = load_[i];
+        double sample = static_cast<double>(
+            std::chrono::duration_cast<std::chrono::microseconds>(latency).count());
+        if (l.ewma_us == 0.0) {
+            l.ewma_us = sample;
+        } else {
+            // Time-decayed with time constant decay_us_ (the old average
+            // keeps e^(-dt/decay) of its weight): a sample after a long quiet
+            // spell outweighs the stale average; a burst of samples moves it
+            // gradually.
+            double dt = static_cast<double>(
+                std::chrono::duration_cast<std::chrono::microseconds>(now - l.sampled_at).count());
+            double keep = std::exp(-std::max(dt, 0.0) / decay_us_);
+            l.ewma_us = l.ewma_us * keep + sample * (1.0 - keep);
+        }
+        l.sampled_at = now;
+    }
+
+    std::size_t size() const noexcept { return load_.size(); }
+    BalancePolicy policy() const noexcept { return policy_; }
+    const EndpointLoad& load(std::size_t i) const noexcept { return load_[i]; }
+
+private:
+    template <typename Usable>
+    std::optional<std::size_t> pick_round_robin(Usable& usable) {
+        // Every usable endpoint gains its weight; the leader is picked and
+        // pays back the total. Spreads a 5:1:1 split as a,a,b,a,c,a,a rather
+        // than a,a,a,a,a,b,c.
+        long total = 0;
+        std::optional<std::size_t> best;
+        for (std::size_t i = 0; i < load_.size(); ++i) {
+            if (!usable(i)) continue;
+            current_[i] += load_[i].weight;
+            total += load_[i].weight;
+            if (!best || current_[i] > current_[*best]) best = i;
+        }
+        if (best) current_[*best] -= total;
+        return best;
+    }
+
+    template <typename Usable>
+    std::optional<std::size_t> pick_least_outstanding(Usable& usable) {
+        // Scan from a rotating start so ties don't all land on endpoint 0.
+        const std::size_t n = load_.size();
+        std::optional<std::size_t> best;
+        double best_score = 0.0;
+        for (std::size_t k = 0; k < n; ++k) {
+            std::size_t i = (cursor_ + k) % n;
+            if (!usable(i)) continue;
+            double score = static_cast<double>(load_[i].outstanding + 1) / load_[i].weight;
+            if (!best || score < best_score) {
+                best = i;
+                best_score = score;
+            }
+        }
+        cursor_ = n == 0 ? 0 : (cursor_ + 1) % n;
+        return best;
+    }
+
+    template <typename Usable>
+    std::optional<std::size_t> pick_p2c(Usable& usable) {
+        auto a = weighted_random(usable, load_.size());
+        if (!a) return std::nullopt;
+        auto b = weighted_random(usable, *a);
+        if (!b) return a;  // the only usable endpoint
+        return cost(*a) <= cost(*b) ? a : b;
+    }
+
+    // Weighted random pick among usable endpoints other than `skip`.
+    template <typename Usable>
+    std::optional<std::size_t> weighted_random(Usable& usable, std::size_t skip) {
+        unsigned long total = 0;
+        for (std::size_t i = 0; i < load_.size(); ++i) {
+            if (i != skip && usable(i)) total += load_[i].weight;
+        }
+        if (total == 0) return std::nullopt;
+        unsigned long r = std::uniform_int_distribution<unsigned long>(0, total - 1)(rng_);
+        for (std::size_t i = 0; i < load_.size(); ++i) {
+            if (i == skip || !usable(i)) continue;
+            if (r < load_[i].weight) return i;
+            r -= load_[i].weight;
+        }
+        return std::nullopt;
+    }
+
+    // Expected wait: latency scaled by queue depth, per unit of weight. An
+    // unsampled endpoint costs nothing, so new endpoints get tried at once.
+    double cost(std::size_t i) const {
+        const EndpointLoad& l = load_[i];
+        return l.ewma_us * static_cast<double>(l.outstanding + 1) / l.weight;
+    }
+
+    BalancePolicy policy_;
+    double decay_us_;
+    std::vector<EndpointLoad> load_;
+    std::vector<long> current_;  // smooth WRR state
+    std::size_t cursor_ = 0;     // least-outstanding tie breaker
+    std::minstd_rand rng_;
+    MaglevTable table_;          // ConsistentHash only
+};
+
+}  // namespace muses
+
+#endif  // MUSES_NET_BALANCER_HPP
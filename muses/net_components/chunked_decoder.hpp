@@ -0,0 +1,224 @@
+// MIT License
+
+// Copyright (c) 2023 nastyapple
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+#ifndef MUSES_NET_CHUNKED_DECODER_HPP
+#define MUSES_NET_CHUNKED_DECODER_HPP
+
+namespace muses {
+
+// Resumable decoder for an HTTP/1.1 chunked body (RFC 9112 §7.1): chunk-size
+// lines with optional extensions, chunk data, the zero-size last chunk, and
+// trailer fields. Input may be split anywhere — mid size line, mid CRLF, mid
+// data — and every byte is examined at most once, so a body costs O(bytes)
+// however it arrives.
+//
+//     ChunkedDecoder dec(ChunkedDecoder::Mode::Dechunk);
+//     auto r = dec.feed(bytes, [&](std::string_view data) { body += data; });
+//     // r.consumed bytes belong to the body; r.status says whether it ended.
+//
+// PassThrough hands the sink the raw consumed bytes (sizes, CRLFs, trailers
+// and all), for relaying a chunked body verbatim; only the framing is
+// checked. Dechunk hands it only chunk data; extensions and trailers are
+// validated and dropped. Bytes after the end of the body are not consumed —
+// they belong to whatever follows on the connection.
+class ChunkedDecoder {
+public:
+    enum class Mode { PassThrough, Dechunk };
+    enum class Status { NeedMore, Done, Error };
+
+    struct Result {
+        std::size_t consumed = 0;
+        Status status = Status::NeedMore;
+    };
+
+    struct Limits {
+        std::uint64_t max_chunk_size = std::uint64_t{1} << 40;
+        std::size_t max_line = 4096;       // one size line, extensions included
+        std::size_t max_trailers = 8192;   // all trailer lines together
+    };
+
+    explicit ChunkedDecoder(Mode mode = Mode::PassThrough) : mode_(mode) {}
+    ChunkedDecoder(Mode mode, Limits limits) : mode_(mode), limits_(limits) {}
+
+    // Framing only: how much of `in` is body, and whether it ended.
+    Result feed(std::string_view in) {
+        return feed(in, [](std::string_view) {});
+    }
+
+    template <typename Sink>
+    Result feed(std::string_view in, Sink&& sink) {
+        if (state_ == State::Done) return {0, Status::Done};
+        if (state_ == State::Error) return {0, Status::Error};
+        const char* p = in.data();
+        const char* const end = p + in.size();
+        while (p < end && state_ != State::Done && state_ != State::Error) {
+            if (state_ == State::Data) {
+                std::size_t avail = static_cast<std::size_t>(end - p);
+                std::size_t take = remaining_ < avail ? static_cast<std::size_t>(remaining_) : avail;
+                if (mode_ == Mode::Dechunk) sink(std::string_view(p, take));
+                p += take;
+                remaining_ -= take;
+                decoded_ += take;
+                if (remaining_ == 0) state_ = State::DataCR;
+                continue;
+            }
+            step(*p++);
+        }
+        std::size_t consumed = static_cast<std::size_t>(p - in.data());
+        if (mode_ == Mode::PassThrough && consumed > 0) sink(in.substr(0, consumed));
+        if (state_ == State::Error) return {consumed, Status::Error};
+        return {consumed, state_ == State::Done ? Status::Done : Status::NeedMore};
+    }
+
+    bool done() const noexcept { return state_ == State::Done; }
+    bool failed() const noexcept { return state_ == State::Error; }
+    // Chunk data bytes seen so far (excluding framing).
+    std::uint64_t decoded_bytes() const noexcept { return decoded_; }
+
+    // Ready for the next body (keep-alive).
+    void reset() noexcept {
+        state_ = State::Size;
+        size_ = 0;
+        remaining_ = 0;
+        digits_ = 0;
+        line_ = 0;
+        trailers_ = 0;
+        decoded_ = 0;
+    }
+
+private:
+    enum class State {
+        Size,        // hex digits of the chunk size
+        SizeBWS,     // whitespace after the size, before ';' or CR
+        Ext,         // ";name=value" extensions up to CR
+        SizeLF,      // LF ending the size line
+        Data,        // chunk data
+        DataCR,      // CRLF after chunk data
+        DataLF,
+        TrailerStart,  // a trailer field, or CR of the final CRLF
+        Trailer,       // inside a trailer field line
+        TrailerLF,
+        EndLF,       // LF of the final CRLF
+        Done,
+        Error,
+    };
+
+    static int hex_value(char c) noexcept {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    }
+
+    // A byte past the size digits. Only BWS may follow them, then an
+    // extension or the end of the line: anything else an upstream might read
+    // differently.
+    void after_size(char c) noexcept {
+        if (c == '\r') state_ = State::SizeLF;
+        else if (c == ';') state_ = State::Ext;
+        else if (c == ' ' || c == '\t') state_ = State::SizeBWS;
+        else state_ = State::Error;
+    }
+
+    void step(char c) {
+        switch (state_) {
+        case State::Size: {
+            if (++line_ > limits_.max_line) { state_ = State::Error; return; }
+            int v = hex_value(c);
+            if (v >= 0) {
+                if (size_ > (limits_.max_chunk_size >> 4)) { state_ = State::Error; return; }
+                size_ = (size_ << 4) | static_cast<std::uint64_t>(v);
+                ++digits_;
+                return;
+            }
+            if (digits_ == 0) { state_ = State::Error; return; }
+            after_size(c);
+            return;
+        }
+        case State::SizeBWS:
+            if (++line_ > limits_.max_line) { state_ = State::Error; return; }
+            after_size(c);
+            return;
+        case State::Ext:
+            if (++line_ > limits_.max_line) { state_ = State::Error; return; }
+            if (c == '\r') state_ = State::SizeLF;
+            else if (c == '\n') state_ = State::Error;
+            return;
+        case State::SizeLF:
+            if (c != '\n' || size_ > limits_.max_chunk_size) { state_ = State::Error; return; }
+            line_ = 0;
+            digits_ = 0;
+            if (size_ == 0) {
+                state_ = State::TrailerStart;
+            } else {
+                remaining_ = size_;
+                size_ = 0;
+                state_ = State::Data;
+            }
+            return;
+        case State::DataCR:
+            state_ = c == '\r' ? State::DataLF : State::Error;
+            return;
+        case State::DataLF:
+            state_ = c == '\n' ? State::Size : State::Error;
+            return;
+        case State::TrailerStart:
+            if (c == '\r') { state_ = State::EndLF; return; }
+            [[fallthrough]];
+        case State::Trailer:
+            if (++trailers_ > limits_.max_trailers || c == '\n') { state_ = State::Error; return; }
+            state_ = c == '\r' ? State::TrailerLF : State::Trailer;
+            return;
+        case State::TrailerLF:
+            state_ = c == '\n' ? State::TrailerStart : State::Error;
+            return;
+        case State::EndLF:
+            state_ = c == '\n' ? State::Done : State::Error;
+            return;
+        case State::Data:
+        case State::Done:
+        case State::Error:
+            return;
+        }
+    }
+
+    Mode mode_;
+    Limits limits_{};
+    State state_ = State::Size;
+    std::uint64_t size_ = 0;
+    std::uint64_t remaining_ = 0;
+    std::size_t digits_ = 0;
+    std::size_t line_ = 0;
+    std::size_t trailers_ = 0;
+    std::uint64_t decoded_ = 0;
+};
+
+}  // namespace muses
+
+#endif  // MUSES_NET_CHUNKED_DECODER_HPP
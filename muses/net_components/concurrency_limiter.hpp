@@ -0,0 +1,190 @@
+// MIT License
+
+// Copyright (c) 2023 nastyapple
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <coroutine>
+#include <cstddef>
+#include <deque>
+
+#ifndef MUSES_NET_CONCURRENCY_LIMITER_HPP
+#define MUSES_NET_CONCURRENCY_LIMITER_HPP
+
+namespace muses {
+
+// How a ConcurrencyLimiter moves its limit (after Netflix's
+// concurrency-limits).
+enum class LimitAlgorithm {
+    // +1 per sample while the limit is in use; × backoff_ratio on a failure
+    // or a response slower than slow_rtt.
+    Aimd,
+    // Limit × (tolerance × long-term RTT / this RTT, clamped to [0.5, 1]) +
+    // √limit, smoothed: shrinks as soon as RTT rises over its long-term
+    // average (queueing in the upstream), grows while it does not.
+    Gradient,
+};
+
+struct ConcurrencyLimitOptions {
+    LimitAlgorithm algorithm = LimitAlgorithm::Gradient;
+    unsigned initial_limit = 0;  // zero: no limiting
+    unsigned min_limit = 1;
+    unsigned max_limit = 1000;
+    // Requests over the limit wait, first come first served, in a queue of
+    // at most max_queue for at most queue_timeout; past either they fail
+    // fast. Zero: never wait.
+    std::size_t max_queue = 0;
+    std::chrono::milliseconds queue_timeout{1000};
+    double backoff_ratio = 0.9;
+    std::chrono::milliseconds slow_rtt{5000};  // Aimd
+    double tolerance = 1.5;                    // Gradient
+    double smoothing = 0.2;                    // Gradient
+    unsigned long_window = 600;                // Gradient: samples in the long-term RTT
+};
+
+// Caps the requests in flight to one upstream endpoint at a limit that it
+// keeps adjusting from their round-trip times, so the upstream stays near
+// its throughput knee instead of queueing internally. Single-threaded: one
+// per endpoint per event loop.
+//
+//     if (!limiter.try_acquire()) {
+//         ... co_await limiter.wait() (bounded), or reject ...
+//     }
+//     ... request ...
+//     limiter.finish(rtt, failed);
+//     while (auto h = limiter.admit_next()) h.resume();
+class ConcurrencyLimiter {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit ConcurrencyLimiter(ConcurrencyLimitOptions opts = {})
+    : opts_(opts),
+      limit_(std::clamp<double>(opts.initial_limit, std::max(opts.min_limit, 1u),
+                                std::max(opts.max_limit, std::max(opts.min_limit, 1u)))) {}
+
+    bool enabled() const noexcept { return opts_.initial_limit > 0; }
+    const ConcurrencyLimitOptions& options() const noexcept { return opts_; }
+    unsigned limit() const noexcept { return static_cast<unsigned>(limit_); }
+    unsigned inflight() const noexcept { return inflight_; }
+    std::size_t queued() const noexcept { return waiters_.size(); }
+    bool has_capacity() const noexcept { return !enabled() || inflight_ < limit(); }
+    bool queue_full() const noexcept { return waiters_.size() >= opts_.max_queue; }
+
+    // Takes a slot if one is free (and nobody is queued ahead).
+    bool try_acquire() noexcept {
+        if (enabled() && (inflight_ >= limit() || !waiters_.empty())) return false;
+        ++inflight_;
+        return true;
+    }
+
+    // `co_await limiter.wait()` queues for a slot; it holds one on resuming.
+    // Destroying a suspended waiter (a timeout) leaves the queue.
+    class Waiter {
+    public:
+        explicit Waiter(ConcurrencyLimiter* l) noexcept : limiter_(l) {}
+        Waiter(const Waiter&) = delete;
+        Waiter& operator=(const Waiter&) = delete;
+        ~Waiter() {
+            if (queued_) std::erase(limiter_->waiters_, this);
+        }
+
+        bool await_ready() noexcept { return limiter_->try_acquire(); }
+        void await_suspend(std::coroutine_handle<> h) {
+            handle_ = h;
+            queued_ = true;
+            limiter_->waiters_.push_back(this);
+        }
+        void await_resume() const noexcept {}
+
+    private:
+        friend class ConcurrencyLimiter;
+        ConcurrencyLimiter* limiter_;
+        std::coroutine_handle<> handle_{};
+        bool queued_ = false;
+    };
+
+    Waiter wait() noexcept { return Waiter{this}; }
+
+    // Gives a slot to the longest waiter if one is free; the caller resumes
+    // the handle. Null when nobody can go.
+    std::coroutine_handle<> admit_next() noexcept {
+        if (waiters_.empty() || (enabled() && inflight_ >= limit())) return {};
+        Waiter* w = waiters_.front();
+        waiters_.pop_front();
+        w->queued_ = false;
+        ++inflight_;
+        return w->handle_;
+    }
+
+    // Ends a request holding a slot, with its round-trip time and whether it
+    // failed (connect or upstream error, timeout). Adjusts the limit.
+    void finish(Clock::duration rtt, bool failed) {
+        const unsigned was_inflight = inflight_;
+        release();
+        if (!enabled()) return;
+        const double min = std::max(opts_.min_limit, 1u);
+        const double max = std::max<double>(opts_.max_limit, min);
+        if (failed) {
+            limit_ = std::max(min, limit_ * opts_.backoff_ratio);
+            return;
+        }
+        double sample = std::max(
+            1.0, static_cast<double>(std::chrono::duration_cast<std::chrono::microseconds>(rtt).count()));
+        if (opts_.algorithm == LimitAlgorithm::Aimd) {
+            if (rtt > opts_.slow_rtt) {
+                limit_ = std::max(min, limit_ * opts_.backoff_ratio);
+            } else if (2.0 * was_inflight >= limit_) {
+                limit_ = std::min(max, limit_ + 1.0);
+            }
+            return;
+        }
+        const double n = std::max(opts_.long_window, 1u);
+        long_rtt_us_ = long_rtt_us_ == 0.0 ? sample : long_rtt_us_ + (sample - long_rtt_us_) / n;
+        // Well below the long-term average: the backlog has drained, so let
+        // the average catch up faster than the window alone would.
+        if (long_rtt_us_ / sample > 2.0) long_rtt_us_ *= 0.95;
+        if (2.0 * was_inflight < limit_) return;  // not using the limit: no signal
+        double gradient = std::clamp(opts_.tolerance * long_rtt_us_ / sample, 0.5, 1.0);
+        double target = limit_ * gradient + std::sqrt(limit_);
+        limit_ = std::clamp(limit_ * (1.0 - opts_.smoothing) + target * opts_.smoothing, min, max);
+    }
+
+    // Ends a request holding a slot without a sample (the client left).
+    void release() noexcept {
+        if (inflight_ > 0) --inflight_;
+    }
+
+private:
+    ConcurrencyLimitOptions opts_;
+    double limit_;
+    unsigned inflight_ = 0;
+    double long_rtt_us_ = 0.0;
+    std::deque<Waiter*> waiters_;
+};
+
+}  // namespace muses
+
+#endif  // MUSES_NET_CONCURRENCY_LIMITER_HPP
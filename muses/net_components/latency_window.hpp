@@ -0,0 +1,162 @@
+// MIT License
+
+// Copyright (c) 2023 nastyapple
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#ifndef MUSES_NET_LATENCY_WINDOW_HPP
+#define MUSES_NET_LATENCY_WINDOW_HPP
+
+namespace muses {
+
+// Latencies and errors over the last `window`, for percentiles (p95, p99)
+// and error rates of one upstream endpoint or route. The window is `slots`
+// time slices; a slice older than the window is cleared when its turn comes
+// round again, so memory is fixed and recording is O(1). Latencies go into
+// log-scale buckets (four per doubling, from 50 µs), so a percentile is
+// exact to within one bucket, about 19%. Single-threaded.
+class LatencyWindow {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit LatencyWindow(std::chrono::milliseconds window = std::chrono::seconds(10),
+                           std::size_t slots = 10)
+    : slot_width_(std::max<Clock::rep>(
+          std::chrono::duration_cast<Clock::duration>(window).count() /
+              static_cast<Clock::rep>(std::max<std::size_t>(slots, 1)),
+          1)),
+      slots_(std::max<std::size_t>(slots, 1)) {}
+
+    void record(Clock::duration latency, bool error, Clock::time_point now = Clock::now()) {
+        Slot& s = slot_at(now);
+        ++s.count;
+        if (error) ++s.errors;
+        ++s.buckets[bucket_of(latency)];
+    }
+
+    std::uint64_t count(Clock::time_point now = Clock::now()) const {
+        std::uint64_t n = 0;
+        for_each_live(now, [&n](const Slot& s) { n += s.count; });
+        return n;
+    }
+
+    std::uint64_t errors(Clock::time_point now = Clock::now()) const {
+        std::uint64_t n = 0;
+        for_each_live(now, [&n](const Slot& s) { n += s.errors; });
+        return n;
+    }
+
+    double error_rate(Clock::time_point now = Clock::now()) const {
+        std::uint64_t n = count(now);
+        return n == 0 ? 0.0 : static_cast<double>(errors(now)) / static_cast<double>(n);
+    }
+
+    // The latency under which a fraction `q` (0..1) of the window's samples
+    // fall, as the upper bound of its bucket; zero with no samples.
+    Clock::duration percentile(double q, Clock::time_point now = Clock::now()) const {
+        std::array<std::uint64_t, kBuckets> merged{};
+        std::uint64_t total = 0;
+        for_each_live(now, [&](const Slot& s) {
+            for (std::size_t b = 0; b < kBuckets; ++b) merged[b] += s.buckets[b];
+            total += s.count;
+        });
+        if (total == 0) return Clock::duration::zero();
+        auto rank = static_cast<std::uint64_t>(std::ceil(std::clamp(q, 0.0, 1.0) *
+                                                         static_cast<double>(total)));
+        rank = std::max<std::uint64_t>(rank, 1);
+        std::uint64_t seen = 0;
+        for (std::size_t b = 0; b < kBuckets; ++b) {
+            seen += merged[b];
+            if (seen >= rank) return upper_bound(b);
+        }
+        return upper_bound(kBuckets - 1);
+    }
+
+    void clear() {
+        for (Slot& s : slots_) s = Slot{};
+    }
+
+private:
+    static constexpr std::size_t kBuckets = 96;  // 50 µs .. ~14 min
+    static constexpr double kBaseUs = 50.0;
+    static constexpr double kPerDoubling = 4.0;
+
+    struct Slot {
+        std::int64_t epoch = -1;  // which slot_width_-long slice it holds
+        std::uint32_t count = 0;
+        std::uint32_t errors = 0;
+        std::array<std::uint32_t, kBuckets> buckets{};
+    };
+
+    static std::size_t bucket_of(Clock::duration latency) {
+        double us = static_cast<double>(
+            std::chrono::duration_cast<std::chrono::microseconds>(latency).count());
+        if (us <= kBaseUs) return 0;
+        auto b = static_cast<std::size_t>(std::ceil(kPerDoubling * std::log2(us / kBaseUs)));
+        return std::min(b, kBuckets - 1);
+    }
+
+    static Clock::duration upper_bound(std::size_t bucket) {
+        double us = kBaseUs * std::exp2(static_cast<double>(bucket) / kPerDoubling);
+        return std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double, std::micro>(us));
+    }
+
+    std::int64_t epoch_of(Clock::time_point now) const {
+        return now.time_since_epoch().count() / slot_width_;
+    }
+
+    Slot& slot_at(Clock::time_point now) {
+        std::int64_t epoch = epoch_of(now);
+        Slot& s = slots_[static_cast<std::size_t>(epoch) % slots_.size()];
+        if (s.epoch != epoch) {
+            s = Slot{};
+            s.epoch = epoch;
+        }
+        return s;
+    }
+
+    template <typename F>
+    void for_each_live(Clock::time_point now, F&& f) const {
+        std::int64_t newest = epoch_of(now);
+        auto oldest = newest - static_cast<std::int64_t>(slots_.size()) + 1;
+        for (const Slot& s : slots_) {
+            if (s.epoch >= oldest && s.epoch <= newest) f(s);
+        }
+    }
+
+    Clock::rep slot_width_;
+    std::vector<Slot> slots_;
+};
+
+}  // namespace muses
+
+#endif  // MUSES_NET_LATENCY_WINDOW_HPP
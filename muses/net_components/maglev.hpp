@@ -0,0 +1,156 @@
+// MIT License
+
+// Copyright (c) 2023 nastyapple
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#ifndef MUSES_NET_MAGLEV_HPP
+#define MUSES_NET_MAGLEV_HPP
+
+namespace muses {
+
+// 64-bit FNV-1a, finished with the splitmix64 mixer so that nearby keys
+// ("/a", "/b") land far apart. Stable across runs and platforms, unlike
+// std::hash, so a key keeps its backend when the proxy restarts.
+inline std::uint64_t stable_hash(std::string_view s, std::uint64_t seed = 0) {
+    std::uint64_t h = 0xcbf29ce484222325ULL ^ seed;
+    for (unsigned char c : s) {
+        h ^= c;
+        h *= 0x100000001b3ULL;
+    }
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9ULL;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebULL;
+    h ^= h >> 31;
+    return h;
+}
+
+// Maglev consistent-hash lookup table (Eisenbud et al., NSDI '16). Each
+// backend walks its own permutation of the M slots, derived from its name,
+// and the backends take turns claiming their next free slot — `weight`
+// slots per turn — until the table is full. A lookup is one modulo and one
+// load. Adding or removing one of N backends moves about 1/N of the slots,
+// and the slots that move mostly go to (or come from) that backend.
+//
+//     MaglevTable t({"10.0.0.1:80", "10.0.0.2:80"}, {1, 1});
+//     std::size_t backend = t.lookup(stable_hash(path));
+class MaglevTable {
+public:
+    static constexpr std::size_t kDefaultSize = 65537;
+
+    MaglevTable() = default;
+
+    // `names` identify the backends (keep them stable: they, not the
+    // positions, decide the permutations). `size` is rounded up to a prime.
+    MaglevTable(const std::vector<std::string>& names, const std::vector<unsigned>& weights,
+                std::size_t size = kDefaultSize)
+    : table_(next_prime(std::max<std::size_t>(size, names.size())), 0) {
+        populate(names, weights);
+    }
+
+    bool empty() const noexcept { return backends_ == 0; }
+    std::size_t size() const noexcept { return table_.size(); }
+    std::size_t backends() const noexcept { return backends_; }
+
+    // Backend owning `hash`. Table must not be empty.
+    std::size_t lookup(std::uint64_t hash) const noexcept {
+        return table_[hash % table_.size()];
+    }
+
+    // Backend owning `hash`, or if `usable` vetoes it, the owner of the next
+    // slot it accepts — keys of the vetoed backend scatter over the others
+    // while every other key stays put. nullopt if all are vetoed.
+    template <typename Usable>
+    std::optional<std::size_t> lookup(std::uint64_t hash, Usable&& usable) const {
+        bool any = false;
+        for (std::size_t b = 0; b < backends_ && !any; ++b) any = usable(b);
+        if (!any) return std::nullopt;
+        // Slots are spread evenly, so a usable one turns up within a few
+        // steps unless almost every backend is vetoed.
+        const std::size_t m = table_.size();
+        for (std::size_t slot = hash % m;; slot = slot + 1 == m ? 0 : slot + 1) {
+            if (usable(table_[slot])) return table_[slot];
+        }
+    }
+
+private:
+    void populate(const std::vector<std::string>& names, const std::vector<unsigned>& weights) {
+        const std::size_t n = names.size();
+        const std::size_t m = table_.size();
+        backends_ = n;
+        if (n == 0) return;
+        std::vector<std::size_t> offset(n), skip(n), next(n, 0);
+        for (std::size_t i = 0; i < n; ++i) {
+            offset[i] = stable_hash(names[i], 0x6d61676c6576ULL) % m;
+            skip[i] = stable_hash(names[i], 0x736b6970ULL) % (m - 1) + 1;
+        }
+        constexpr std::size_t kEmpty = static_cast<std::size_t>(-1);
+        std::vector<std::size_t> owner(m, kEmpty);
+        std::size_t filled = 0;
+        while (filled < m) {
+            for (std::size_t i = 0; i < n && filled < m; ++i) {
+                unsigned turns = i < weights.size() && weights[i] > 0 ? weights[i] : 1;
+                for (unsigned t = 0; t < turns && filled < m; ++t) {
+                    // m is prime, so the permutation visits every slot.
+                    std::size_t c;
+                    do {
+                        c = (offset[i] + next[i] * skip[i]) % m;
+                        ++next[i];
+                    } while (owner[c] != kEmpty);
+                    owner[c] = i;
+                    ++filled;
+                }
+            }
+        }
+        for (std::size_t s = 0; s < m; ++s) table_[s] = static_cast<std::uint32_t>(owner[s]);
+    }
+
+    static bool is_prime(std::size_t v) noexcept {
+        if (v < 2) return false;
+        for (std::size_t d = 2; d * d <= v; ++d) {
+            if (v % d == 0) return false;
+        }
+        return true;
+    }
+
+    static std::size_t next_prime(std::size_t v) noexcept {
+        if (v < 3) v = 3;
+        while (!is_prime(v)) ++v;
+        return v;
+    }
+
+    std::vector<std::uint32_t> table_;
+    std::size_t backends_ = 0;
+};
+
+}  // namespace muses
+
+#endif  // MUSES_NET_MAGLEV_HPP
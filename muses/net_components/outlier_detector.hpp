@@ -0,0 +1,241 @@
+// MIT License
+
+// Copyright (c) 2023 nastyapple
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include "muses/net_components/latency_window.hpp"
+
+#ifndef MUSES_NET_OUTLIER_DETECTOR_HPP
+#define MUSES_NET_OUTLIER_DETECTOR_HPP
+
+namespace muses {
+
+// Tunables for OutlierDetector. An endpoint with at least min_requests in
+// the window is an outlier if its p99 exceeds latency_factor × the median
+// p99 of its route's endpoints, or its error rate exceeds theirs by
+// error_rate_margin. No more than max_ejection_percent of the endpoints are
+// out at once.
+struct OutlierOptions {
+    std::chrono::milliseconds interval{0};  // how often to judge; zero: off
+    std::chrono::milliseconds window{10000};
+    std::uint64_t min_requests = 20;
+    double latency_factor = 5.0;
+    double error_rate_margin = 0.2;
+    unsigned max_ejection_percent = 50;
+    // An ejection lasts base_ejection × the times ejected recently (each
+    // clean interval forgives one), at most max_ejection. Then the circuit
+    // is half-open: half_open_requests trial requests are let through, and
+    // it closes if all of them answer in time without a 5xx.
+    std::chrono::milliseconds base_ejection{5000};
+    std::chrono::milliseconds max_ejection{300000};
+    unsigned half_open_requests = 3;
+};
+
+enum class CircuitState { Closed, Open, HalfOpen };
+
+// Per-route outlier ejection and circuit breaking over N endpoints, the
+// companion of a Balancer with the same indices. Judges endpoints against
+// their own fleet rather than fixed thresholds, so a uniformly slow route
+// is left alone while one slow member of a fast one is taken out:
+//
+//     auto i = balancer.pick([&](std::size_t e) { return od.usable(e); });
+//     od.picked(*i);                       // counts half-open trials
+//     ... od.record(*i, latency, status >= 500) ...
+//     od.evaluate();                       // every options().interval
+//
+// Single-threaded, like Balancer.
+class OutlierDetector {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    OutlierDetector(std::size_t endpoints, OutlierOptions opts)
+    : opts_(opts), endpoints_(endpoints, Endpoint{LatencyWindow(opts.window)}) {}
+
+    bool enabled() const noexcept { return opts_.interval.count() > 0; }
+    const OutlierOptions& options() const noexcept { return opts_; }
+    std::size_t size() const noexcept { return endpoints_.size(); }
+
+    // Whether a request may go to endpoint `i` now: always when closed;
+    // when half-open, while trial requests are left; never while open.
+    bool usable(std::size_t i, Clock::time_point now = Clock::now()) const {
+        if (!enabled()) return true;
+        const Endpoint& e = endpoints_[i];
+        switch (e.state) {
+        case CircuitState::Closed:
+            return true;
+        case CircuitState::Open:
+            return now >= e.open_until;
+        case CircuitState::HalfOpen:
+            return e.trials_started < opts_.half_open_requests || trials_stale(e, now);
+        }
+        return true;
+    }
+
+    // A request was sent to `i` (after usable(i)).
+    void picked(std::size_t i, Clock::time_point now = Clock::now()) {
+        if (!enabled()) return;
+        Endpoint& e = endpoints_[i];
+        if (e.state == CircuitState::Open && now >= e.open_until) {
+            e.state = CircuitState::HalfOpen;
+            e.trials_started = e.trials_passed = 0;
+            e.half_open_since = now;
+        }
+        if (e.state != CircuitState::HalfOpen) return;
+        if (trials_stale(e, now)) {  // trials that never reported back
+            e.trials_started = e.trials_passed = 0;
+            e.half_open_since = now;
+        }
+        ++e.trials_started;
+    }
+
+    // One request's outcome: time to the response head (or to the failure)
+    // and whether it failed (connect/upstream error, 5xx).
+    void record(std::size_t i, Clock::duration latency, bool error,
+                Clock::time_point now = Clock::now()) {
+        if (!enabled()) return;
+        Endpoint& e = endpoints_[i];
+        e.window.record(latency, error, now);
+        if (e.state != CircuitState::HalfOpen) return;
+        bool slow = fleet_p99_ > Clock::duration::zero() &&
+                    latency > std::chrono::duration_cast<Clock::duration>(
+                                  fleet_p99_ * opts_.latency_factor);
+        if (error || slow) {
+            eject(e, now);
+        } else if (++e.trials_passed >= opts_.half_open_requests) {
+            e.state = CircuitState::Closed;
+        }
+    }
+
+    // Judges the closed endpoints against the fleet and ejects the worst
+    // outliers within max_ejection_percent. Returns the newly ejected.
+    std::vector<std::size_t> evaluate(Clock::time_point now = Clock::now()) {
+        std::vector<std::size_t> ejected_now;
+        if (!enabled()) return ejected_now;
+        struct Sample {
+            std::size_t index;
+            Clock::duration p99;
+            double error_rate;
+        };
+        std::vector<Sample> samples;
+        std::size_t out = 0;
+        for (std::size_t i = 0; i < endpoints_.size(); ++i) {
+            const Endpoint& e = endpoints_[i];
+            if (e.state != CircuitState::Closed) {
+                ++out;
+            } else if (e.window.count(now) >= opts_.min_requests) {
+                samples.push_back({i, e.window.percentile(0.99, now), e.window.error_rate(now)});
+            }
+        }
+        if (samples.size() < 2) return ejected_now;  // no fleet to compare against
+
+        // Lower medians: with two endpoints the better one is the reference.
+        std::vector<Clock::duration> p99s;
+        std::vector<double> rates;
+        for (const Sample& s : samples) {
+            p99s.push_back(s.p99);
+            rates.push_back(s.error_rate);
+        }
+        auto mid = (samples.size() - 1) / 2;
+        std::nth_element(p99s.begin(), p99s.begin() + static_cast<std::ptrdiff_t>(mid), p99s.end());
+        std::nth_element(rates.begin(), rates.begin() + static_cast<std::ptrdiff_t>(mid), rates.end());
+        fleet_p99_ = p99s[mid];
+        const double fleet_rate = rates[mid];
+        const double p99_limit = static_cast<double>(fleet_p99_.count()) * opts_.latency_factor;
+
+        // Severity: how far past its limit an endpoint is; > 1 is an outlier.
+        std::vector<std::pair<double, std::size_t>> outliers;
+        for (const Sample& s : samples) {
+            double latency_score = p99_limit > 0 ? static_cast<double>(s.p99.count()) / p99_limit : 0;
+            double error_score = (s.error_rate - fleet_rate) / std::max(opts_.error_rate_margin, 1e-9);
+            double score = std::max(latency_score, error_score);
+            if (score > 1.0) {
+                outliers.push_back({score, s.index});
+            } else if (endpoints_[s.index].times_ejected > 0) {
+                --endpoints_[s.index].times_ejected;  // a clean interval forgives one
+            }
+        }
+        std::sort(outliers.begin(), outliers.end(), std::greater<>());
+        const std::size_t max_out = endpoints_.size() * opts_.max_ejection_percent / 100;
+        for (const auto& [score, i] : outliers) {
+            if (out >= max_out) break;
+            eject(endpoints_[i], now);
+            ejected_now.push_back(i);
+            ++out;
+        }
+        return ejected_now;
+    }
+
+    CircuitState state(std::size_t i) const noexcept { return endpoints_[i].state; }
+    const LatencyWindow& window(std::size_t i) const noexcept { return endpoints_[i].window; }
+    // The fleet's median p99 at the last evaluate(); zero before one.
+    Clock::duration fleet_p99() const noexcept { return fleet_p99_; }
+
+    std::size_t ejected() const noexcept {
+        return static_cast<std::size_t>(std::count_if(
+            endpoints_.begin(), endpoints_.end(),
+            [](const Endpoint& e) { return e.state != CircuitState::Closed; }));
+    }
+
+private:
+    struct Endpoint {
+        LatencyWindow window;
+        CircuitState state = CircuitState::Closed;
+        unsigned times_ejected = 0;
+        Clock::time_point open_until{};
+        Clock::time_point half_open_since{};
+        unsigned trials_started = 0;
+        unsigned trials_passed = 0;
+    };
+
+    void eject(Endpoint& e, Clock::time_point now) {
+        ++e.times_ejected;
+        auto length = std::min<std::chrono::milliseconds>(opts_.base_ejection * e.times_ejected,
+                                                          opts_.max_ejection);
+        e.state = CircuitState::Open;
+        e.open_until = now + length;
+        e.window.clear();  // judged afresh once back
+    }
+
+    // Half-open trials are abandoned if they have not all reported back
+    // within a window (their clients went away).
+    bool trials_stale(const Endpoint& e, Clock::time_point now) const {
+        return now - e.half_open_since >= opts_.window;
+    }
+
+    OutlierOptions opts_;
+    std::vector<Endpoint> endpoints_;
+    Clock::duration fleet_p99_{};
+};
+
+}  // namespace muses
+
+#endif  // MUSES_NET_OUTLIER_DETECTOR_HPP
@@ -27,77 +27,385 @@
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
 #include <unistd.h>
 
 #include <algorithm>
 #include <atomic>
 #include <cctype>
+#include <charconv>
+#include <climits>
 #include <chrono>
 #include <cstdint>
+#include <coroutine>
 #include <cstring>
-#include <deque>
 #include <format>
+#include <functional>
 #include <map>
 #include <memory>
+#include <optional>
+#include <random>
+#include <shared_mutex>
+#include <span>
+#include <stdexcept>
 #include <string>
+#include <string_view>
 #include <thread>
 #include <unordered_map>
 #include <vector>
 
 #include "muses/logging.hpp"
-#include "muses/net/poller_factory.hpp"
+#include "muses/net/event_loop.hpp"
+#include "muses/net/pipe_pool.hpp"
+#include "muses/net/reactor.hpp"
+#include "muses/net/runtime.hpp"
+#include "muses/net_components/balancer.hpp"
+#include "muses/net_components/chunked_decoder.hpp"
+#include "muses/net_components/concurrency_limiter.hpp"
 #include "muses/net_components/http_handler.hpp"
+#include "muses/net_components/latency_window.hpp"
+#include "muses/net_components/outlier_detector.hpp"
+#include "muses/net_components/request_budget.hpp"
+#include "muses/net_components/response_cache.hpp"
+#include "muses/net_components/router.hpp"
+#include "muses/net_components/upstream_pool.hpp"
 #include "muses/task.hpp"
+#include "muses/when.hpp"
 
 #ifndef MUSES_NET_PROXY_HPP
 #define MUSES_NET_PROXY_HPP
 
 namespace muses {
 
-// An upstream backend: host:port plus prefix that routes to it. The first
-// matching prefix (in declaration order) wins.
+// One backend server of a route. Weight is relative to the route's other
+// endpoints. A host written "unix:/run/app.sock" is a Unix-domain stream
+// socket on this machine; its port is ignored.
+struct UpstreamEndpoint {
+    std::string host;     // e.g. "127.0.0.1" or "unix:/run/app.sock"
+    unsigned short port;
+    unsigned weight = 1;
+};
+
+// What BalancePolicy::ConsistentHash hashes to keep requests on one endpoint.
+enum class HashKey {
+    Path,           // URL path, without the query string
+    Header,         // value of ProxyRoute::hash_header; round-robin if absent
+    ClientAddress,  // the client's IP address; round-robin if none (Unix socket)
+};
+
+// Requests that route to a set of upstream endpoints. The longest matching
+// prefix wins (see RadixRouter); a route may be limited to one virtual host
+// (the request's Host header) and to a set of methods. `host`/`port` is the
+// single-endpoint shorthand; when `endpoints` is non-empty it is ignored and
+// `balance` spreads requests over the list.
 struct ProxyRoute {
     std::string prefix;   // URL path prefix, e.g. "/" or "/api/"
-    std::string host;     // upstream host, e.g. "127.0.0.1"
-    unsigned short port;  // upstream port
+    std::string host;     // upstream host, e.g. "127.0.0.1" or "unix:/run/app.sock"
+    unsigned short port;  // upstream port (ignored for a unix: host)
+    std::string vhost{};                  // Host header to match; empty = any
+    std::vector<std::string> methods{};   // e.g. {"GET", "HEAD"}; empty = any
+    std::vector<UpstreamEndpoint> endpoints{};
+    BalancePolicy balance = BalancePolicy::RoundRobin;
+    HashKey hash_key = HashKey::Path;      // ConsistentHash only
+    std::string hash_header{};             // for HashKey::Header
 };
 
-// Health state for one upstream (identified by host:port). A failed connect or
-// upstream error marks it unhealthy for a cooldown period so the proxy stops
-// hammering a dead backend.
-struct UpstreamHealth {
-    bool healthy = true;
-    std::chrono::steady_clock::time_point unhealthy_since{};
+// Active health checks: each upstream endpoint gets `GET path` on a fresh
+// connection every interval (plus up to `jitter`, so endpoints and proxies do
+// not probe in lockstep). `fall` failed probes in a row take an endpoint out,
+// `rise` passing ones put it back. A probe passes if the status line arrives
+// within `timeout` with `expected_status` (0: any 2xx or 3xx).
+struct HealthCheckOptions {
+    std::chrono::milliseconds interval{0};  // zero: no probes, passive health only
+    std::chrono::milliseconds timeout{2000};
+    std::chrono::milliseconds jitter{0};
+    std::string path = "/health";
+    int expected_status = 0;
+    unsigned rise = 2;
+    unsigned fall = 3;
+};
+
+// Retries after a failed attempt. Each waits a full-jitter exponential
+// backoff (uniform up to backoff_base × 2^(retry - 1), at most backoff_max)
+// on the loop's timers, then spends a token from a per-route RequestBudget.
+// The budget earns `budget_ratio` of a retry per request, plus
+// `min_per_second`, and holds at most `budget_burst`, which is also its
+// starting balance. When a partial outage fails many requests, retries stop
+// once the budget is spent, instead of multiplying the load on the
+// endpoints that are left.
+struct RetryOptions {
+    double budget_ratio = 0.2;
+    double min_per_second = 10.0;
+    double budget_burst = 20.0;
+    std::chrono::milliseconds backoff_base{10};  // zero: retry at once
+    std::chrono::milliseconds backoff_max{500};
+};
+
+// Hedged requests ("The Tail at Scale"): a GET or HEAD without a body, on a
+// route with more than one endpoint, that has no response head after the
+// route's `quantile` latency goes out again to another endpoint. The first
+// head wins and the other request is cancelled (its connection closed).
+// Hedges spend from a per-route RequestBudget that earns `budget_ratio` of a
+// hedge per request, so they stay within that share of the route's traffic.
+// Consistent-hash requests with a key stay on their endpoint and are never
+// hedged.
+struct HedgeOptions {
+    bool enabled = false;
+    double quantile = 0.95;
+    std::uint64_t min_samples = 20;  // route latencies seen before hedging starts
+    std::chrono::milliseconds window{10000};  // ... over this window
+    double budget_ratio = 0.05;
+};
+
+// Tunables for ProxyServer. Timeouts bound how long one client coroutine can
+// be pinned by a peer that stops talking; zero disables a timeout.
+struct ProxyOptions {
+    // Retries per request at most. A retry also needs the route's retry
+    // budget (see RetryOptions). It is attempted only if it is safe: the
+    // request never reached an upstream, or its method is idempotent.
+    unsigned max_retries = 2;
+    RetryOptions retry{};
+    std::chrono::seconds upstream_cooldown{10};  // unhealthy upstream is skipped this long
+    // Non-blocking connect to an upstream; a timeout counts as a failed
+    // attempt (upstream marked unhealthy, next attempt tried).
+    std::chrono::milliseconds connect_timeout{3000};
+    // Per attempt on an upstream connection, for sending the request and
+    // reading the response head; then per read/write while a body streams
+    // (idle gap, not the whole response). On expiry the client gets 504 and
+    // the connection is closed.
+    std::chrono::milliseconds upstream_timeout{30000};
+    // For each request on the client connection, from the wait for it on a
+    // keep-alive connection to its last buffered body byte; for writing each
+    // response head; and per read/write while a body streams. On expiry the
+    // connection is closed.
+    std::chrono::milliseconds client_timeout{60000};
+    // Time constant of the per-endpoint latency EWMA that
+    // BalancePolicy::PowerOfTwoEwma compares (time to response head): after
+    // this long an old average keeps 1/e of its weight (half of it after
+    // ~0.69 of this).
+    std::chrono::milliseconds latency_decay{10000};
+    // Body bytes in both directions stream through one buffer of this size per
+    // client connection, so memory per connection does not grow with the body.
+    std::size_t relay_buffer = 16 * 1024;
+    // Request bodies up to this size are buffered so a failed attempt can be
+    // replayed; larger ones stream to the upstream and are sent only once.
+    std::size_t max_replay_body = 64 * 1024;
+    // A request or response head larger than this is rejected (431 / 502).
+    std::size_t max_header_bytes = 64 * 1024;
+    // Linux: bodies of at least zero_copy_min_body bytes with a known length
+    // (or read until close) move socket → pipe → socket with splice(2), never
+    // entering user space. Chunked bodies, which the proxy has to inspect, are
+    // always copied through relay_buffer. Ignored on other platforms.
+    bool zero_copy = true;
+    std::size_t zero_copy_min_body = 64 * 1024;
+    // Keep-alive connections parked per upstream endpoint. Ones idle longer
+    // than upstream_idle_timeout are closed (upstreams drop idle keep-alive
+    // connections too; keep this below theirs). min_idle_per_upstream
+    // connections are opened ahead of demand and replenished as requests
+    // take them, so requests rarely wait for a connect.
+    std::size_t max_idle_per_upstream = 64;
+    std::size_t min_idle_per_upstream = 0;
+    std::chrono::milliseconds upstream_idle_timeout{30000};
+    // Shared response cache (see ResponseCache); null = no caching. Hits are
+    // answered on the event loop without an upstream; the shards of a
+    // ProxyPool share the one given here.
+    std::shared_ptr<ResponseCache> cache{};
+    // Request coalescing: while a GET/HEAD is waiting on its upstream,
+    // identical requests on the same shard wait for its response instead of
+    // sending their own. Requests only count as identical with the same
+    // Cookie header. The response is shared if it carries nothing per-user
+    // (no Set-Cookie, private, no-store) and its body is at most
+    // coalesce_max_body; otherwise the waiters go upstream themselves. Off by
+    // default: an origin that personalizes on something the proxy cannot
+    // see would have its answers handed to the wrong clients.
+    bool coalesce = false;
+    std::size_t coalesce_max_body = 1024 * 1024;
+    // With probes on, an endpoint a request failed on stays out until it
+    // passes `rise` probes, instead of coming back after upstream_cooldown.
+    HealthCheckOptions health_check{};
+    // Latency/error outlier ejection per route (see OutlierDetector); off
+    // unless outlier_detection.interval is set. Unlike health, it is per
+    // shard: each loop judges the traffic it sends.
+    OutlierOptions outlier_detection{};
+    // Adaptive cap on requests in flight per upstream endpoint (see
+    // ConcurrencyLimiter); off unless concurrency_limit.initial_limit is set.
+    // Per shard. A request over every endpoint's limit queues on one, or gets
+    // 503 when that queue is full or it waited queue_timeout.
+    ConcurrencyLimitOptions concurrency_limit{};
+    // Off unless hedge.enabled. Per shard, like the latencies it goes by.
+    HedgeOptions hedge{};
+};
+
+// Health of each upstream endpoint, indexed by EndpointId. A failed connect
+// or upstream error marks an endpoint down for a cooldown period so the proxy
+// stops hammering a dead backend; with active health checks it stays down
+// until probes bring it back. Each entry is a few atomics ("down until", the
+// probe streak, the next probe time), so shards of a ProxyPool can share a
+// table: reads are a relaxed load, a shard that sees a failure takes the
+// endpoint out for all, and only the shard that claims a probe runs it.
+class HealthTable {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit HealthTable(std::size_t endpoints)
+    : size_(endpoints), entries_(new Entry[endpoints]) {}
+
+    std::size_t size() const noexcept { return size_; }
+
+    bool healthy(EndpointId id, Clock::time_point now = Clock::now()) const noexcept {
+        return now.time_since_epoch().count() >=
+               entries_[id].down_until.load(std::memory_order_relaxed);
+    }
+
+    // Takes `id` out until `until` (Clock::time_point::max(): until probes
+    // pass) and restarts its probe streak. True if it was up (first to
+    // notice).
+    bool mark_down(EndpointId id, Clock::time_point until, Clock::time_point now = Clock::now()) noexcept {
+        entries_[id].streak.store(0, std::memory_order_relaxed);
+        Clock::rep prev = entries_[id].down_until.exchange(until.time_since_epoch().count(),
+                                                           std::memory_order_relaxed);
+        return now.time_since_epoch().count() >= prev;
+    }
+
+    // Whether the probe of `id` is due by `now` (a cheap pre-check; only
+    // claim_probe settles who runs it).
+    bool probe_due(EndpointId id, Clock::time_point now) const noexcept {
+        return now.time_since_epoch().count() >=
+               entries_[id].next_probe.load(std::memory_order_relaxed);
+    }
+
+    // Claims the probe of `id` due by `now`, scheduling the next one at
+    // `next`. False if it is not due or another caller claimed it first.
+    bool claim_probe(EndpointId id, Clock::time_point now, Clock::time_point next) noexcept {
+        Clock::rep due = entries_[id].next_probe.load(std::memory_order_relaxed);
+        if (now.time_since_epoch().count() < due) return false;
+        return entries_[id].next_probe.compare_exchange_strong(
+            due, next.time_since_epoch().count(), std::memory_order_relaxed);
+    }
+
+    enum class Verdict { Unchanged, Up, Down };
+
+    // Counts one probe result: `rise` passes in a row bring a down endpoint
+    // back, `fall` failures in a row take an up one out until probes pass.
+    Verdict record_probe(EndpointId id, bool passed, unsigned rise, unsigned fall,
+                         Clock::time_point now = Clock::now()) noexcept {
+        Entry& e = entries_[id];
+        int prev = e.streak.load(std::memory_order_relaxed);
+        int streak = passed ? std::max(prev, 0) + 1 : std::min(prev, 0) - 1;
+        e.streak.store(streak, std::memory_order_relaxed);
+        const bool up = healthy(id, now);
+        if (passed && !up && streak >= static_cast<int>(std::max(rise, 1u))) {
+            e.down_until.store(0, std::memory_order_relaxed);
+            return Verdict::Up;
+        }
+        if (!passed && up && -streak >= static_cast<int>(std::max(fall, 1u))) {
+            e.down_until.store(Clock::time_point::max().time_since_epoch().count(),
+                               std::memory_order_relaxed);
+            return Verdict::Down;
+        }
+        return Verdict::Unchanged;
+    }
+
+private:
+    struct Entry {
+        std::atomic<Clock::rep> down_until{0};
+        std::atomic<int> streak{0};  // > 0: probes passed in a row; < 0: failed
+        std::atomic<Clock::rep> next_probe{0};
+    };
+
+    std::size_t size_;
+    std::unique_ptr<Entry[]> entries_;
 };
 
 // A coroutine-driven reverse proxy. Each client connection is a coroutine that
 // reads the request, matches a route, forwards to the upstream (reusing a
-// pooled keep-alive connection), reads the response, and writes it back to the
-// client. Upstream I/O suspends on the poller instead of blocking a worker —
-// this is what the muses/task.hpp coroutine infrastructure enables.
+// pooled keep-alive connection), and streams the response back: the head as
+// soon as it is parsed, the body through a fixed-size buffer. Upstream I/O
+// suspends on the poller instead of blocking a worker — this is what the
+// muses/task.hpp coroutine infrastructure enables.
 //
 // Not a generalization of the static-file Reactor: a dedicated event loop here
 // treats both client and upstream fds as first-class connections driven by
 // coroutines. The static-file Reactor is untouched.
 class ProxyServer {
 public:
-    // routes: prefix → upstream, evaluated in order. listen_fd must already be
-    // bound/listening (use TCPListener). max_retries: attempts per request
-    // before giving up with 502. upstream_keepalive: pool idle connections?
-    ProxyServer(int listen_fd, std::vector<ProxyRoute> routes,
-                unsigned max_retries = 2,
-                std::chrono::seconds upstream_cooldown = std::chrono::seconds(10))
+    // routes: compiled into a RadixRouter once, here; requests no route
+    // matches get 502. listen_fd must already be bound/listening (use
+    // TCPListener or UnixListener). Throws std::invalid_argument for an
+    // unknown method name.
+    //
+    // `shared_health` lets several servers with the same routes (the shards
+    // of a ProxyPool) see each other's health verdicts; by default each
+    // server keeps its own.
+    ProxyServer(int listen_fd, std::vector<ProxyRoute> routes, ProxyOptions options,
+                std::shared_ptr<HealthTable> shared_health = nullptr)
     : listen_fd_(listen_fd),
       routes_(std::move(routes)),
-      max_retries_(max_retries),
-      upstream_cooldown_(upstream_cooldown) {
+      router_(build_router(routes_)),
+      options_(options),
+      pool_(UpstreamPool::Options{options_.max_idle_per_upstream,
+                                  options_.min_idle_per_upstream,
+                                  options_.upstream_idle_timeout}) {
         set_nonblocking(listen_fd_);
-        // Seed health state for each distinct upstream.
+        upstreams_.reserve(routes_.size());
         for (const auto& r : routes_) {
-            health_[upstream_key(r.host, r.port)];
+            std::vector<UpstreamEndpoint> eps = r.endpoints;
+            if (eps.empty()) eps.push_back({r.host, r.port, 1});
+            std::vector<EndpointId> ids;
+            std::vector<unsigned> weights;
+            std::vector<std::string> names;
+            for (const auto& e : eps) {
+                ids.push_back(pool_.intern(e.host, e.port));
+                weights.push_back(e.weight);
+                names.push_back(pool_.name(ids.back()));
+            }
+            std::size_t n = ids.size();
+            upstreams_.push_back(RouteUpstreams{
+                std::move(ids), Balancer(std::move(weights), r.balance, options_.latency_decay,
+                                         std::move(names)),
+                OutlierDetector(n, options_.outlier_detection),
+                LatencyWindow(options_.hedge.window),
+                RequestBudget(options_.hedge.budget_ratio),
+                RequestBudget(options_.retry.budget_ratio, options_.retry.min_per_second,
+                              options_.retry.budget_burst, options_.retry.budget_burst)});
+        }
+        if (shared_health && shared_health->size() != pool_.size()) {
+            throw std::invalid_argument("ProxyServer: shared health table does not match routes");
+        }
+        health_ = shared_health ? std::move(shared_health)
+                                : std::make_shared<HealthTable>(pool_.size());
+        probing_.assign(pool_.size(), 0);
+        limiters_.assign(pool_.size(), ConcurrencyLimiter(options_.concurrency_limit));
+    }
+
+    // This server's health table, to share with servers on the same routes.
+    std::shared_ptr<HealthTable> health_table() const { return health_; }
+
+    // Connection-pool counters for upstream host:port (zeros if no route
+    // uses it; the port is ignored for a unix: host). Safe to call from any
+    // thread.
+    UpstreamStats upstream_stats(const std::string& host, unsigned short port) const {
+        if (unix_socket_path(host)) port = 0;  // as interned
+        for (EndpointId id = 0; id < pool_.size(); ++id) {
+            if (pool_.port(id) == port && pool_.host(id) == host) return pool_.stats(id);
         }
+        return {};
     }
 
+    // Balancer state of route `route` (index into the routes passed in), for
+    // inspection.
+    const Balancer& balancer(std::size_t route) const { return upstreams_[route].balancer; }
+
+    // max_retries: retries per request before giving up with 502. Other
+    // options keep their ProxyOptions defaults.
+    ProxyServer(int listen_fd, std::vector<ProxyRoute> routes,
+                unsigned max_retries = 2,
+                std::chrono::seconds upstream_cooldown = std::chrono::seconds(10))
+    : ProxyServer(listen_fd, std::move(routes),
+                  ProxyOptions{.max_retries = max_retries,
+                               .upstream_cooldown = upstream_cooldown}) {}
+
     ~ProxyServer() { stop(); }
 
     ProxyServer(const ProxyServer&) = delete;
@@ -105,8 +413,9 @@ public:
 
     void start() {
         if (running_.exchange(true)) return;
-        poller_ = make_poller();
-        if (!poller_ || !poller_->add(listen_fd_, EventMask::Readable, nullptr)) {
+        own_loop_ = std::make_unique<EventLoop>();
+        loop_ = own_loop_.get();
+        if (!loop_->valid() || !loop_->poller()->add(listen_fd_, EventMask::Readable, nullptr)) {
             MUSES_ERROR("Proxy: failed to add listen fd");
             running_.store(false);
             return;
@@ -115,80 +424,139 @@ public:
         MUSES_INFO("ProxyServer started");
     }
 
+    // Run on worker `worker` (modulo its size) of `runtime` instead of on a
+    // thread of its own: accepting, housekeeping and every client coroutine
+    // stay on that worker's loop. The runtime must outlive the server, and
+    // stop() must not be called from one of its workers.
+    void start(Runtime& runtime, unsigned worker) {
+        if (running_.exchange(true)) return;
+        runtime_ = &runtime;
+        loop_ = &runtime.loop(worker % runtime.size());
+        exited_ = std::make_shared<std::atomic<bool>>(false);
+        if (!runtime.spawn(drive(this, Driver{this, exited_}))) {
+            MUSES_ERROR("Proxy: runtime is stopped");
+            running_.store(false);
+            runtime_ = nullptr;
+            loop_ = nullptr;
+            return;
+        }
+        MUSES_INFO("ProxyServer started on a runtime worker");
+    }
+
     void stop() {
         if (!running_.exchange(false)) return;
-        if (poller_) poller_->wakeup();
-        if (loop_thread_.joinable()) loop_thread_.join();
-        // Destroy all live client coroutines (they may be suspended).
-        for (auto& [fd, task] : live_tasks_) {
-            (void)fd;
-        }
-        live_tasks_.clear();
-        // Close any pooled upstream fds.
-        for (auto& [key, pool] : pools_) {
-            for (int fd : pool) ::close(fd);
+        if (loop_) loop_->poller()->wakeup();
+        if (runtime_) {
+            // The driver shuts the server down on its worker within a tick.
+            exited_->wait(false);
+            runtime_ = nullptr;
+            loop_ = nullptr;
+            return;
         }
-        pools_.clear();
-        if (poller_) poller_->del(listen_fd_);
-        poller_.reset();
+        if (loop_thread_.joinable()) loop_thread_.join();
+        shut_down();
+        if (loop_) loop_->poller()->del(listen_fd_);
+        loop_ = nullptr;
+        own_loop_.reset();
     }
 
+    // Awaitable for client coroutines that hopped off the loop (e.g.
+    // `co_await pool.schedule()` for compression or auth): resumes them back
+    // on the proxy's event-loop thread. Must be awaited before the coroutine
+    // touches the proxy again (I/O, pools, health) or finishes.
+    EventLoop::ResumeAwaiter resume_here() noexcept { return loop_->resume_here(); }
+
 private:
     static void set_nonblocking(int fd) {
         int flags = ::fcntl(fd, F_GETFL, 0);
         if (flags >= 0) ::fcntl(fd, F_SETFL, flags | O_NONBLOCK);
     }
 
-    static std::string upstream_key(const std::string& host, unsigned short port) {
-        return std::format("{}:{}", host, port);
+    static RadixRouter<std::size_t> build_router(const std::vector<ProxyRoute>& routes) {
+        std::vector<RadixRouter<std::size_t>::Route> table;
+        table.reserve(routes.size());
+        for (std::size_t i = 0; i < routes.size(); ++i) {
+            table.push_back({routes[i].vhost, routes[i].prefix, routes[i].methods, i});
+        }
+        return RadixRouter<std::size_t>(std::move(table));
     }
 
     // --- Event loop (single thread; coroutines resume here only) -----------
 
+    static constexpr std::chrono::milliseconds kTick{100};  // longest wait between chores
+
     void loop() {
-        constexpr int kMaxEvents = 128;
-        PollEvent events[kMaxEvents];
         while (running_.load(std::memory_order_acquire)) {
-            int n = poller_->wait(events, 100);
-            if (n < 0) {
-                if (errno == EINTR) continue;
+            // Coroutine handles are resumed by the EventLoop itself; only the
+            // listen socket (null userdata) comes back to us.
+            int n = loop_->run_once(static_cast<int>(kTick.count()), [this](const PollEvent& ev) {
+                if (ev.fd == listen_fd_) accept_clients();
+            });
+            if (n < 0 && errno != EINTR) {
                 MUSES_ERROR("Proxy: poller wait failed");
-                continue;
             }
-            for (int i = 0; i < n; ++i) {
-                const PollEvent& ev = events[i];
-                if (ev.fd == listen_fd_ && ev.userdata == nullptr) {
-                    accept_clients();
-                    continue;
-                }
-                // A ready fd whose userdata is a coroutine handle: resume it.
-                if (ev.userdata != nullptr) {
-                    auto h = handle_from_event(ev);
-                    if (h) resume_handle(h, ev);
-                }
-            }
-            reap_finished_tasks();
+            chores();
         }
     }
 
-    // Resume a coroutine handle. The fd that fired is deregistered BEFORE
-    // resuming: we've consumed this readiness edge, and the coroutine will
-    // re-register interest (via IoAwaiter) on its next co_await. Deregistering
-    // before (not after) resume is critical — after resume the coroutine may
-    // already have re-registered the same fd for a different event (e.g.
-    // Writable→Readable on an upstream), and a post-resume del would wipe
-    // that fresh registration, deadlocking the request.
-    void resume_handle(std::coroutine_handle<> h, const PollEvent& ev) {
-        if (ev.fd != listen_fd_) {
-            poller_->del(ev.fd);
+    void chores() {
+        reap_finished_tasks();
+        maintain_pool();
+        check_health();
+        check_outliers();
+    }
+
+    // Destroy all live client coroutines (they may be suspended; their
+    // IoAwaiters and timers deregister from the still-alive loop), then close
+    // the client connections. On the loop's thread, or once it has stopped.
+    void shut_down() {
+        for (auto& [fd, task] : live_tasks_) {
+            task = Task<void>{};
+            ::close(fd);
+        }
+        live_tasks_.clear();
+        background_.clear();
+        pipes_.clear();
+        pool_.clear();  // close any pooled upstream fds
+    }
+
+    // Shuts the server down when the driver's frame goes, however it goes: on
+    // stop(), or destroyed by a runtime that stopped first (before it ever
+    // ran, even; a coroutine's parameters live in its frame).
+    // The flag is shared so that notifying it never touches a server that
+    // stop() has already returned from.
+    struct Driver {
+        ProxyServer* self;
+        std::shared_ptr<std::atomic<bool>> exited;
+        Driver(ProxyServer* s, std::shared_ptr<std::atomic<bool>> flag) noexcept
+        : self(s), exited(std::move(flag)) {}
+        Driver(Driver&& o) noexcept
+        : self(std::exchange(o.self, nullptr)), exited(std::move(o.exited)) {}
+        ~Driver() {
+            if (self == nullptr) return;
+            self->shut_down();
+            exited->store(true);
+            exited->notify_all();
+        }
+    };
+
+    // loop() for a server on a Runtime worker: pin to the worker's loop, then
+    // wait for clients at most a tick at a time and run the chores in between.
+    static Task<void> drive(ProxyServer* self, [[maybe_unused]] Driver driver) {
+        co_await self->loop_->resume_here();
+        Deadline tick(kTick);
+        while (self->running_.load(std::memory_order_acquire)) {
+            tick.restart();
+            TimedIoAwaiter ready{&tick, self->listen_fd_, EventMask::Readable};
+            if (co_await ready) self->accept_clients();
+            self->chores();
         }
-        h.resume();
     }
 
     // Accept new client connections and spawn a coroutine for each.
     void accept_clients() {
         for (int accepted = 0; accepted < 128; ++accepted) {
-            sockaddr_in addr{};
+            sockaddr_storage addr{};
             socklen_t len = sizeof(addr);
             int fd = ::accept(listen_fd_, reinterpret_cast<sockaddr*>(&addr), &len);
             if (fd < 0) {
@@ -197,58 +565,214 @@ private:
                 break;
             }
             set_nonblocking(fd);
-            int ok = 1;
-            ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &ok, sizeof(ok));
-            // Spawn the client coroutine. It will run until its first suspension
-            // (awaiting readable data), registering interest with the poller.
-            auto task = serve_client(this, fd);
-            // Initial resume: runs until first co_await.
-            bool done = task.resume();
-            int tfd = fd;
-            if (done) {
-                // Completed synchronously (e.g. immediate error); drop it.
-                ::close(fd);
+            if (addr.ss_family != AF_UNIX) {
+                int ok = 1;
+                ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &ok, sizeof(ok));
+            }
+            if (dispatch_) {
+                dispatch_(fd);  // a ProxyPool shard: whichever worker is free serves it
             } else {
-                live_tasks_[tfd] = std::move(task);
+                adopt(fd);
             }
         }
     }
 
-    // Remove finished coroutines (their frames are destroyed by the Task dtor).
+    // Serve accepted client `fd` on this server's loop, the calling thread's.
+    void adopt(int fd) {
+        // Spawn the client coroutine. It will run until its first suspension
+        // (awaiting readable data), registering interest with the poller.
+        auto task = runtime_ ? session(this, fd) : serve_client(this, fd);
+        // Initial resume: runs until first co_await.
+        bool done = task.resume();
+        if (done) {
+            // Completed synchronously (e.g. immediate error); drop it.
+            ::close(fd);
+        } else {
+            live_tasks_[fd] = std::move(task);
+        }
+    }
+
+    // A runtime worker reaps finished clients only once a tick, so give the
+    // peer its EOF as soon as serving ends; the fd closes on reaping.
+    static Task<void> session(ProxyServer* self, int fd) {
+        co_await serve_client(self, fd);
+        ::shutdown(fd, SHUT_RDWR);
+    }
+
+    // Remove finished coroutines (their frames are destroyed by the Task dtor)
+    // and close their client connections.
     void reap_finished_tasks() {
         for (auto it = live_tasks_.begin(); it != live_tasks_.end();) {
             if (it->second.done()) {
+                ::close(it->first);
                 it = live_tasks_.erase(it);
             } else {
                 ++it;
             }
         }
+        std::erase_if(background_, [](const Task<void>& t) { return t.done(); });
+    }
+
+    // Once a second: close expired and dead idle upstream connections, then
+    // top every healthy endpoint back up to min_idle_per_upstream.
+    void maintain_pool() {
+        auto now = std::chrono::steady_clock::now();
+        if (now < next_pool_sweep_) return;
+        next_pool_sweep_ = now + std::chrono::seconds(1);
+        EventLoop::CurrentScope scope(loop_);  // warmers await on this loop
+        pool_.sweep(now);
+        for (EndpointId id = 0; id < pool_.size(); ++id) prewarm(id);
+    }
+
+    // Start connections to `id` until it has min_idle_per_upstream idle or
+    // on the way. Each is a background coroutine that parks its fd in the pool.
+    void prewarm(EndpointId id) {
+        for (std::size_t n = pool_.deficit(id); n > 0 && is_healthy(id); --n) {
+            spawn(warm_upstream(this, id));
+        }
+    }
+
+    // Run `task` detached from any client: to its first suspension now, the
+    // rest on the loop; reaped when done, destroyed on stop().
+    void spawn(Task<void> task) {
+        if (!task.resume()) background_.push_back(std::move(task));
+    }
+
+    // Every loop turn: start the health probes that are due. With a shared
+    // HealthTable each probe is claimed by one shard.
+    void check_health() {
+        const HealthCheckOptions& hc = options_.health_check;
+        if (hc.interval.count() <= 0) return;
+        auto now = std::chrono::steady_clock::now();
+        std::optional<EventLoop::CurrentScope> scope;  // probes await on this loop
+        for (EndpointId id = 0; id < pool_.size(); ++id) {
+            // Most turns nothing is due: skip before drawing any jitter.
+            if (probing_[id] || !health_->probe_due(id, now)) continue;
+            auto jitter = std::chrono::milliseconds(
+                hc.jitter.count() > 0
+                    ? std::uniform_int_distribution<long long>(0, hc.jitter.count())(rng_)
+                    : 0);
+            if (!health_->claim_probe(id, now, now + hc.interval + jitter)) continue;
+            if (!scope) scope.emplace(loop_);
+            probing_[id] = 1;
+            spawn(probe(this, id));
+        }
+    }
+
+    // Every outlier_detection.interval: judge each route's endpoints.
+    void check_outliers() {
+        const OutlierOptions& od = options_.outlier_detection;
+        if (od.interval.count() <= 0) return;
+        auto now = std::chrono::steady_clock::now();
+        if (now < next_outlier_check_) return;
+        next_outlier_check_ = now + od.interval;
+        for (auto& ups : upstreams_) {
+            for (std::size_t i : ups.outliers.evaluate(now)) {
+                MUSES_WARNING(std::format("Proxy: upstream {} ejected as an outlier",
+                                          pool_.name(ups.endpoints[i])));
+            }
+        }
+    }
+
+    static Task<void> probe(ProxyServer* self, EndpointId id) {
+        const HealthCheckOptions& hc = self->options_.health_check;
+        int code = co_await probe_status(self, id);
+        self->probing_[id] = 0;
+        if (code == kUpstreamBusy) co_return;  // a full backlog is no verdict
+        bool passed = hc.expected_status != 0 ? code == hc.expected_status
+                                              : code >= 200 && code < 400;
+        switch (self->health_->record_probe(id, passed, hc.rise, hc.fall)) {
+        case HealthTable::Verdict::Up:
+            MUSES_INFO(std::format("Proxy: upstream {} passed health checks", self->pool_.name(id)));
+            break;
+        case HealthTable::Verdict::Down:
+            MUSES_WARNING(std::format("Proxy: upstream {} failed health checks (last status {})",
+                                      self->pool_.name(id), code));
+            break;
+        case HealthTable::Verdict::Unchanged:
+            break;
+        }
+    }
+
+    // Status code of `GET health_check.path` on a fresh connection; 0 if
+    // none arrived within health_check.timeout, kUpstreamBusy if the
+    // connection could not be queued.
+    static Task<int> probe_status(ProxyServer* self, EndpointId id) {
+        Deadline deadline(self->options_.health_check.timeout);
+        int fd = co_await connect_upstream(self, self->pool_.host(id), self->pool_.port(id),
+                                           &deadline);
+        if (fd < 0) co_return fd == kUpstreamBusy ? kUpstreamBusy : 0;
+        struct Closer {  // also if this frame is destroyed with the server
+            int fd;
+            ~Closer() { ::close(fd); }
+        } closer{fd};
+        const std::string& name = self->pool_.name(id);
+        std::string request = "GET " + self->options_.health_check.path + " HTTP/1.1\r\nHost: " +
+                              (unix_socket_path(name) ? std::string("localhost") : name) +
+                              "\r\nConnection: close\r\n\r\n";
+        if (!co_await write_all_async(self, fd, request, &deadline)) co_return 0;
+        std::string line = co_await read_until(self, fd, "\r\n", 1024, &deadline);
+        if (line.find("\r\n") == std::string::npos) co_return 0;
+        co_return status_code(line);
+    }
+
+    static Task<void> warm_upstream(ProxyServer* self, EndpointId id) {
+        int fd = co_await self->connect_pooled(id);
+        if (fd == kUpstreamBusy) co_return;  // overloaded, not down
+        if (fd < 0) {
+            self->mark_unhealthy(id);
+        } else {
+            self->pool_.put(id, fd);
+        }
     }
 
     // --- Coroutine I/O helpers (all suspend on the poller) ----------------
+    //
+    // Each waits under an optional Deadline and, once that passes, returns
+    // what it has as if the peer had stopped; callers tell a timeout from an
+    // EOF or error by asking the Deadline. One Deadline spans a request phase
+    // (or, restarted per read/write, a streaming relay), so the ops under it
+    // share a single timer.
+
+    // Await `task` under `limit` (zero = no limit). nullopt on timeout; the
+    // task has been destroyed by then. For waits that are not I/O (a queue
+    // slot); I/O goes under a Deadline.
+    template <typename T>
+    static Task<std::optional<T>> bounded(Task<T> task, std::chrono::milliseconds limit) {
+        if (limit.count() <= 0) co_return co_await task;
+        co_return co_await with_timeout(std::move(task), limit);
+    }
 
     // Read from `fd` until `delimiter` is found in the accumulated buffer.
-    // Returns the full buffer up to and including the delimiter. On EOF/error
-    // returns empty. The fd must be non-blocking; this drains to EAGAIN.
+    // Returns everything read so far (the delimiter plus whatever followed it
+    // in the same read). On EOF/error, or once `max_bytes` have accumulated
+    // without a delimiter, returns what it has; callers check for the
+    // delimiter. The fd must be non-blocking; this drains to EAGAIN.
     static Task<std::string> read_until(ProxyServer* self, int fd,
-                                        std::string delimiter) {
+                                        std::string delimiter,
+                                        std::size_t max_bytes = SIZE_MAX,
+                                        Deadline* deadline = nullptr) {
         std::string buf;
         char chunk[4096];
         for (;;) {
             // Try a non-blocking read first; only await if EAGAIN.
             ssize_t r = ::read(fd, chunk, sizeof(chunk));
             if (r > 0) {
+                // Only the tail can complete a delimiter split across reads.
+                std::size_t from = buf.size() >= delimiter.size()
+                    ? buf.size() - delimiter.size() + 1 : 0;
                 buf.append(chunk, static_cast<std::size_t>(r));
-                if (buf.find(delimiter) != std::string::npos) {
+                if (buf.find(delimiter, from) != std::string::npos) {
                     co_return buf;
                 }
+                if (buf.size() >= max_bytes) co_return buf;
                 continue;  // keep draining (ET)
             }
             if (r == 0) { co_return buf; }  // EOF
             if (errno == EAGAIN || errno == EWOULDBLOCK) {
                 // Need more data — await readable.
-                IoAwaiter aw{self->poller_.get(), fd, EventMask::Readable};
-                co_await aw;
+                TimedIoAwaiter aw{deadline, fd, EventMask::Readable};
+                if (!co_await aw) co_return buf;
                 continue;
             }
             if (errno == EINTR) continue;
@@ -257,7 +781,8 @@ private:
     }
 
     // Read exactly `n` bytes from `fd`. Returns the bytes (may be short on EOF).
-    static Task<std::string> read_n(ProxyServer* self, int fd, std::size_t n) {
+    static Task<std::string> read_n(ProxyServer* self, int fd, std::size_t n,
+                                    Deadline* deadline = nullptr) {
         std::string buf;
         buf.reserve(n);
         char chunk[4096];
@@ -270,8 +795,8 @@ private:
             }
             if (r == 0) { co_return buf; }  // EOF
             if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                IoAwaiter aw{self->poller_.get(), fd, EventMask::Readable};
-                co_await aw;
+                TimedIoAwaiter aw{deadline, fd, EventMask::Readable};
+                if (!co_await aw) co_return buf;
                 continue;
             }
             if (errno == EINTR) continue;
@@ -280,20 +805,102 @@ private:
         co_return buf;
     }
 
+    // Appends up to `n` bytes from `fd` to `buf`, read straight into its
+    // tail. Returns the count appended (short on EOF or error). `buf` must
+    // outlive the task.
+    static Task<std::size_t> read_append(ProxyServer* self, int fd, std::string& buf,
+                                         std::size_t n, Deadline* deadline = nullptr) {
+        std::size_t got = 0;
+        while (got < n) {
+            const std::size_t at = buf.size();
+            buf.resize(at + (n - got));
+            ssize_t r = ::read(fd, buf.data() + at, n - got);
+            buf.resize(at + static_cast<std::size_t>(std::max<ssize_t>(r, 0)));
+            if (r > 0) {
+                got += static_cast<std::size_t>(r);
+                continue;
+            }
+            if (r == 0) co_return got;  // EOF
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                TimedIoAwaiter aw{deadline, fd, EventMask::Readable};
+                if (!co_await aw) co_return got;
+                continue;
+            }
+            if (errno == EINTR) continue;
+            co_return got;  // hard error
+        }
+        co_return got;
+    }
+
+    // One read of up to `cap` bytes into `buf`, awaiting Readable on EAGAIN.
+    // Returns the byte count, 0 on EOF, -1 on hard error or timeout.
+    static Task<ssize_t> read_some(ProxyServer* self, int fd, char* buf, std::size_t cap,
+                                   Deadline* deadline = nullptr) {
+        for (;;) {
+            ssize_t r = ::read(fd, buf, cap);
+            if (r >= 0) co_return r;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                TimedIoAwaiter aw{deadline, fd, EventMask::Readable};
+                if (!co_await aw) co_return -1;
+                continue;
+            }
+            if (errno == EINTR) continue;
+            co_return -1;
+        }
+    }
+
     // Write all of `data` to `fd`, awaiting Writable on EAGAIN. Returns true on
-    // full write, false on hard error.
+    // full write, false on hard error or timeout. `data` must outlive the task.
+    static Task<bool> write_all_async(ProxyServer* self, int fd,
+                                      const std::string& data,
+                                      Deadline* deadline = nullptr) {
+        return write_all_async(self, fd, data.data(), data.size(), deadline);
+    }
+
     static Task<bool> write_all_async(ProxyServer* self, int fd,
-                                      const std::string& data) {
+                                      const char* data, std::size_t len,
+                                      Deadline* deadline = nullptr) {
         std::size_t off = 0;
-        while (off < data.size()) {
-            ssize_t w = ::write(fd, data.data() + off, data.size() - off);
+        while (off < len) {
+            ssize_t w = ::write(fd, data + off, len - off);
             if (w > 0) {
                 off += static_cast<std::size_t>(w);
                 continue;
             }
             if (w < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
-                IoAwaiter aw{self->poller_.get(), fd, EventMask::Writable};
-                co_await aw;
+                TimedIoAwaiter aw{deadline, fd, EventMask::Writable};
+                if (!co_await aw) co_return false;
+                continue;
+            }
+            if (w < 0 && errno == EINTR) continue;
+            co_return false;  // hard error
+        }
+        co_return true;
+    }
+
+    // writev(2) all of `segments`, awaiting Writable on EAGAIN. The segments
+    // and the buffers they point into must outlive the task. Returns true on
+    // full write, false on hard error or timeout.
+    static Task<bool> writev_all_async(ProxyServer* self, int fd,
+                                       std::span<const iovec> segments,
+                                       Deadline* deadline = nullptr) {
+        std::vector<iovec> left(segments.begin(), segments.end());
+        std::size_t i = 0;
+        while (i < left.size()) {
+            const int count = static_cast<int>(std::min<std::size_t>(left.size() - i, IOV_MAX));
+            ssize_t w = ::writev(fd, left.data() + i, count);
+            if (w > 0) {
+                auto n = static_cast<std::size_t>(w);
+                while (i < left.size() && n >= left[i].iov_len) n -= left[i++].iov_len;
+                if (n > 0) {
+                    left[i].iov_base = static_cast<char*>(left[i].iov_base) + n;
+                    left[i].iov_len -= n;
+                }
+                continue;
+            }
+            if (w < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                TimedIoAwaiter aw{deadline, fd, EventMask::Writable};
+                if (!co_await aw) co_return false;
                 continue;
             }
             if (w < 0 && errno == EINTR) continue;
@@ -302,92 +909,642 @@ private:
         co_return true;
     }
 
-    // Open a non-blocking connection to host:port and await writability (which
-    // signals connect completion). Returns the fd (>=0) on success, -1 on
-    // failure/timeout.
+    // Where a relay stopped. Malformed: a chunked body broke its framing.
+    // Unsupported: the zero-copy path could not start (no pipe, or splice
+    // refused these fds) and moved nothing.
+    enum class RelayEnd {
+        Done, SourceClosed, SourceTimeout, SinkFailed, SinkTimeout, Malformed, Unsupported
+    };
+    static constexpr std::size_t kUntilEof = SIZE_MAX;
+
+    // A copy of a response body taken while it is relayed, for the cache.
+    // Gives up, freeing what it holds, past `limit` bytes.
+    struct Capture {
+        std::string bytes;
+        std::size_t limit = 0;
+        bool overflow = false;
+
+        void append(const char* p, std::size_t n) {
+            if (overflow) return;
+            if (bytes.size() + n > limit) {
+                overflow = true;
+                std::string().swap(bytes);
+                return;
+            }
+            bytes.append(p, n);
+        }
+    };
+
+    // Streams bytes from `from` to `to` through `buf`: `n` bytes, or until
+    // `from` reaches EOF (n == kUntilEof), or until the pass-through
+    // `chunked` decoder sees the end of the body (bytes past it are dropped).
+    // Each read is written out before the next one starts, so a slow
+    // receiver stalls the sender instead of growing a buffer. A `capture`
+    // gets a copy of every byte written. `source` and `sink` are the two
+    // connections' Deadlines, restarted before each read and write: a relay
+    // times out when one side stalls, not when a body is merely long.
+    static Task<RelayEnd> relay(ProxyServer* self, int from, int to, std::size_t n,
+                                std::span<char> buf, ChunkedDecoder* chunked,
+                                Deadline& source, Deadline& sink,
+                                Capture* capture = nullptr) {
+        const bool to_eof = n == kUntilEof && chunked == nullptr;
+        while (chunked != nullptr ? !chunked->done() : (to_eof || n > 0)) {
+            std::size_t want = chunked != nullptr || to_eof ? buf.size()
+                                                             : std::min(n, buf.size());
+            source.restart();
+            ssize_t got = co_await read_some(self, from, buf.data(), want, &source);
+            if (got < 0 && source.expired()) co_return RelayEnd::SourceTimeout;
+            if (got == 0 && to_eof) co_return RelayEnd::Done;
+            if (got <= 0) co_return RelayEnd::SourceClosed;
+            std::size_t len = static_cast<std::size_t>(got);
+            if (chunked != nullptr) {
+                auto framed = chunked->feed(std::string_view(buf.data(), len));
+                if (framed.status == ChunkedDecoder::Status::Error) co_return RelayEnd::Malformed;
+                len = framed.consumed;
+            }
+            if (capture != nullptr) capture->append(buf.data(), len);
+            sink.restart();
+            if (!co_await write_all_async(self, to, buf.data(), len, &sink)) {
+                co_return sink.expired() ? RelayEnd::SinkTimeout : RelayEnd::SinkFailed;
+            }
+            if (!to_eof && chunked == nullptr) n -= len;
+        }
+        co_return RelayEnd::Done;
+    }
+
+#if defined(MUSES_PLATFORM_LINUX)
+    // relay() without the copy: each round splices up to one pipe's worth of
+    // bytes from `from` into a pooled pipe, then from the pipe into `to`. The
+    // pipe is drained before the next fill, so an EAGAIN on the fill always
+    // means `from` has nothing to read.
+    static Task<RelayEnd> relay_spliced(ProxyServer* self, int from, int to, std::size_t n,
+                                        Deadline& source, Deadline& sink) {
+        constexpr std::size_t kPipeChunk = 64 * 1024;  // default pipe capacity
+        constexpr unsigned kFlags = SPLICE_F_MOVE | SPLICE_F_NONBLOCK;
+        PipePool::Lease lease(self->pipes_);
+        if (!lease) co_return RelayEnd::Unsupported;
+        const int pipe_r = lease.pipe().read_fd;
+        const int pipe_w = lease.pipe().write_fd;
+        const bool to_eof = n == kUntilEof;
+        bool moved = false;
+        while (to_eof || n > 0) {
+            std::size_t want = to_eof ? kPipeChunk : std::min(n, kPipeChunk);
+            source.restart();
+            ssize_t in = ::splice(from, nullptr, pipe_w, nullptr, want, kFlags);
+            if (in == 0) co_return to_eof ? RelayEnd::Done : RelayEnd::SourceClosed;
+            if (in < 0) {
+                if (errno == EINTR) continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    TimedIoAwaiter aw{&source, from, EventMask::Readable};
+                    if (!co_await aw) co_return RelayEnd::SourceTimeout;
+                    continue;
+                }
+                if (!moved && (errno == EINVAL || errno == ENOSYS)) {
+                    co_return RelayEnd::Unsupported;
+                }
+                co_return RelayEnd::SourceClosed;
+            }
+            moved = true;
+            lease.mark_dirty();  // until the pipe is empty again
+            std::size_t pending = static_cast<std::size_t>(in);
+            sink.restart();
+            while (pending > 0) {
+                ssize_t out = ::splice(pipe_r, nullptr, to, nullptr, pending, kFlags);
+                if (out > 0) {
+                    pending -= static_cast<std::size_t>(out);
+                    continue;
+                }
+                if (out < 0 && errno == EINTR) continue;
+                if (out < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                    TimedIoAwaiter aw{&sink, to, EventMask::Writable};
+                    if (!co_await aw) co_return RelayEnd::SinkTimeout;
+                    continue;
+                }
+                co_return RelayEnd::SinkFailed;
+            }
+            lease.mark_clean();
+            if (!to_eof) n -= static_cast<std::size_t>(in);
+        }
+        co_return RelayEnd::Done;
+    }
+#endif
+
+    // Relays a length-delimited (or read-until-close) body: spliced when
+    // zero_copy applies, otherwise — or if splicing can't start — copied
+    // through `buf`.
+    static Task<RelayEnd> relay_body(ProxyServer* self, int from, int to, std::size_t n,
+                                     std::span<char> buf, Deadline& source, Deadline& sink) {
+#if defined(MUSES_PLATFORM_LINUX)
+        const ProxyOptions& o = self->options_;
+        if (o.zero_copy && (n == kUntilEof || n >= o.zero_copy_min_body)) {
+            RelayEnd end = co_await relay_spliced(self, from, to, n, source, sink);
+            if (end != RelayEnd::Unsupported) co_return end;
+        }
+#endif
+        co_return co_await relay(self, from, to, n, buf, nullptr, source, sink);
+    }
+
+    // The peer's IP address as text, or "" if unknown.
+    static std::string peer_address(int fd) {
+        sockaddr_storage ss{};
+        socklen_t len = sizeof(ss);
+        if (::getpeername(fd, reinterpret_cast<sockaddr*>(&ss), &len) != 0) return {};
+        char buf[INET6_ADDRSTRLEN] = {};
+        const void* src = nullptr;
+        if (ss.ss_family == AF_INET) {
+            src = &reinterpret_cast<const sockaddr_in*>(&ss)->sin_addr;
+        } else if (ss.ss_family == AF_INET6) {
+            src = &reinterpret_cast<const sockaddr_in6*>(&ss)->sin6_addr;
+        } else {
+            return {};
+        }
+        return ::inet_ntop(ss.ss_family, src, buf, sizeof(buf)) ? std::string(buf) : std::string();
+    }
+
+    // Answers a request with a stored response: its head plus Age for a
+    // cache hit (and Connection: close if the client is leaving), then the
+    // body.
+    static Task<bool> write_stored(ProxyServer* self, int fd,
+                                   std::shared_ptr<const CachedResponse> stored,
+                                   std::optional<std::chrono::seconds> age, bool keep_alive,
+                                   Deadline* deadline) {
+        const CachedResponse& r = *stored;
+        std::string head;
+        head.reserve(r.head.size() + 48);
+        head += r.head;
+        if (age) head += "Age: " + std::to_string(age->count()) + "\r\n";
+        if (!keep_alive) head += "Connection: close\r\n";
+        head += "\r\n";
+        if (r.body.size() <= 4096) {  // one write, one segment
+            head += r.body;
+            co_return co_await write_all_async(self, fd, head, deadline);
+        }
+        if (!co_await write_all_async(self, fd, head, deadline)) co_return false;
+        co_return co_await write_all_async(self, fd, r.body.data(), r.body.size(), deadline);
+    }
+
+    // --- Request coalescing -------------------------------------------------
+
+    // One upstream fetch that identical requests wait on. In flights_ from
+    // the moment its leader goes upstream until the response is complete,
+    // or until its head shows that it will not be shared.
+    struct Flight {
+        ResponseCache::Headers request_headers;  // the leader's, for Vary
+        bool landed = false;
+        // The complete response, or null: the waiters fetch their own.
+        std::shared_ptr<const CachedResponse> response;
+        std::vector<std::coroutine_handle<>> waiters;
+    };
+
+    // `co_await JoinFlight{flight}` suspends until the flight lands. A
+    // waiter destroyed while suspended (stop()) takes itself off the list.
+    struct JoinFlight {
+        std::shared_ptr<Flight> flight;
+        std::coroutine_handle<> handle{};
+
+        bool await_ready() const noexcept { return flight->landed; }
+        void await_suspend(std::coroutine_handle<> h) {
+            handle = h;
+            flight->waiters.push_back(h);
+        }
+        std::shared_ptr<const CachedResponse> await_resume() noexcept {
+            handle = {};
+            return flight->response;
+        }
+        ~JoinFlight() {
+            if (handle) std::erase(flight->waiters, handle);
+        }
+    };
+
+    // The leader's side: lands the flight when the leader is done with it,
+    // with whatever it got — null if it never completed a shareable
+    // response, however its coroutine ended.
+    class FlightLease {
+    public:
+        FlightLease() = default;
+        FlightLease(ProxyServer* self, std::string key, std::shared_ptr<Flight> flight)
+        : self_(self), key_(std::move(key)), flight_(std::move(flight)) {}
+        FlightLease(const FlightLease&) = delete;
+        FlightLease& operator=(const FlightLease&) = delete;
+        ~FlightLease() { land(nullptr); }
+
+        explicit operator bool() const noexcept { return flight_ != nullptr; }
+        bool has_waiters() const noexcept { return flight_ && !flight_->waiters.empty(); }
+
+        // Waiters resume inline, on this loop, one after another, each up to
+        // its next suspension — as AsyncChannel wakes same-loop receivers.
+        // Not while stopping: stop() is destroying them.
+        void land(std::shared_ptr<const CachedResponse> response) {
+            if (!flight_) return;
+            std::shared_ptr<Flight> f = std::move(flight_);
+            auto it = self_->flights_.find(key_);
+            if (it != self_->flights_.end() && it->second == f) self_->flights_.erase(it);
+            f->landed = true;
+            f->response = std::move(response);
+            auto waiters = std::move(f->waiters);
+            if (!self_->running_.load(std::memory_order_acquire)) return;
+            for (auto h : waiters) h.resume();
+        }
+
+    private:
+        ProxyServer* self_ = nullptr;
+        std::string key_;
+        std::shared_ptr<Flight> flight_;
+    };
+
+    // --- Concurrency limits -------------------------------------------------
+
+    // A slot on an endpoint's ConcurrencyLimiter, held until the response has
+    // been relayed. Ending it feeds the limiter the request's sample (if one
+    // was observed) and lets queued requests in.
+    class Permit {
+    public:
+        Permit() = default;
+        Permit(ProxyServer* self, EndpointId id) noexcept : self_(self), id_(id) {}
+        Permit(Permit&& o) noexcept
+        : self_(std::exchange(o.self_, nullptr)), id_(o.id_), sample_(o.sample_) {}
+        Permit& operator=(Permit&& o) noexcept {
+            if (this != &o) {
+                finish();
+                self_ = std::exchange(o.self_, nullptr);
+                id_ = o.id_;
+                sample_ = o.sample_;
+            }
+            return *this;
+        }
+        Permit(const Permit&) = delete;
+        Permit& operator=(const Permit&) = delete;
+        ~Permit() { finish(); }
+
+        void observe(ConcurrencyLimiter::Clock::duration rtt, bool failed) noexcept {
+            sample_ = Sample{rtt, failed};
+        }
+
+        void finish() noexcept {
+            if (!self_) return;
+            ConcurrencyLimiter& limiter = self_->limiters_[id_];
+            if (sample_) {
+                limiter.finish(sample_->rtt, sample_->failed);
+            } else {
+                limiter.release();
+            }
+            std::exchange(self_, nullptr)->admit_waiters(id_);
+        }
+
+    private:
+        struct Sample {
+            ConcurrencyLimiter::Clock::duration rtt;
+            bool failed;
+        };
+        ProxyServer* self_ = nullptr;
+        EndpointId id_ = 0;
+        std::optional<Sample> sample_;
+    };
+
+    // Queued requests resume inline, each up to its next suspension (not
+    // while stopping: stop() is destroying them).
+    void admit_waiters(EndpointId id) noexcept {
+        if (!running_.load(std::memory_order_acquire)) return;
+        while (auto h = limiters_[id].admit_next()) h.resume();
+    }
+
+    // Queue for a slot on `limiter`; bounded by the caller.
+    static Task<bool> wait_for_slot(ConcurrencyLimiter* limiter) {
+        auto waiter = limiter->wait();  // named: it must outlive the suspension
+        co_await waiter;
+        co_return true;
+    }
+
+    // --- Hedged requests ----------------------------------------------------
+
+    // One racer of a hedged request: an upstream connection that has
+    // answered with a response head, or a failure (fd < 0). It holds the
+    // connection, balancer ticket and concurrency slot until serve_client
+    // takes them; a leg that lost the race closes its connection.
+    struct HedgeLeg {
+        int fd = -1;
+        std::string head;
+        std::size_t index = 0;  // endpoint within the route
+        bool hedge = false;     // the second leg
+        Balancer::Ticket ticket;
+        Permit permit;
+
+        HedgeLeg() = default;
+        HedgeLeg(HedgeLeg&& o) noexcept
+        : fd(std::exchange(o.fd, -1)), head(std::move(o.head)), index(o.index), hedge(o.hedge),
+          ticket(std::move(o.ticket)), permit(std::move(o.permit)) {}
+        HedgeLeg& operator=(HedgeLeg&&) = delete;
+        ~HedgeLeg() { drop(); }
+
+        bool answered() const noexcept { return fd >= 0; }
+        void drop() noexcept {
+            if (fd >= 0) ::close(std::exchange(fd, -1));
+        }
+    };
+
+    // What the legs of one race share with serve_client.
+    struct HedgeRace {
+        unsigned running = 2;
+        bool hedged = false;     // the second request went out
+        bool timed_out = false;  // an upstream stalled past upstream_timeout
+
+        // when_any's verdict on a finished leg: an answer wins; so does a
+        // failure nothing else can make up for any more.
+        bool settles(const HedgeLeg& leg) noexcept {
+            --running;
+            return leg.answered() || running == 0 || (!leg.hedge && !hedged);
+        }
+    };
+
+    // Sends `request` (no body; segments as forward_segments makes them) to
+    // endpoint `i` of `route` and reads the response head, booking the
+    // outcome as serve_client's retry loop does.
+    static Task<HedgeLeg> send_leg(ProxyServer* self, std::size_t route, std::size_t i,
+                                   std::span<const iovec> request, HedgeRace* race) {
+        const ProxyOptions& o = self->options_;
+        auto& ups = self->upstreams_[route];
+        const EndpointId ep = ups.endpoints[i];
+        HedgeLeg leg;
+        leg.index = i;
+        if (!self->limiters_[ep].try_acquire()) co_return leg;
+        leg.permit = Permit(self, ep);
+        leg.ticket = ups.balancer.start(i);
+        ups.outliers.picked(i);
+        const auto sent_at = Balancer::Clock::now();
+        auto failed = [&ups, &leg, i, sent_at] {
+            leg.drop();
+            auto elapsed = Balancer::Clock::now() - sent_at;
+            ups.outliers.record(i, elapsed, true);
+            leg.permit.observe(elapsed, true);
+        };
+        leg.fd = co_await self->acquire_upstream(ep);
+        if (leg.fd == kUpstreamBusy) {  // overloaded, not down: health untouched
+            leg.drop();
+            leg.permit.observe(Balancer::Clock::now() - sent_at, true);
+            co_return leg;
+        }
+        if (leg.fd < 0) {
+            failed();
+            self->mark_unhealthy(ep);
+            co_return leg;
+        }
+        Deadline deadline(o.upstream_timeout);
+        if (!co_await writev_all_async(self, leg.fd, request, &deadline)) {
+            failed();
+            if (deadline.expired()) race->timed_out = true;
+            else self->mark_unhealthy(ep);
+            co_return leg;
+        }
+        std::string head =
+            co_await read_until(self, leg.fd, "\r\n\r\n", o.max_header_bytes, &deadline);
+        const bool complete = head.find("\r\n\r\n") != std::string::npos;
+        if (!complete && deadline.expired()) {
+            leg.ticket.observe(Balancer::Clock::now() - sent_at);
+            failed();
+            race->timed_out = true;
+            co_return leg;
+        }
+        if (!complete) {
+            failed();
+            self->mark_unhealthy(ep);
+            co_return leg;
+        }
+        const auto rtt = Balancer::Clock::now() - sent_at;
+        const int status = status_code(head);
+        leg.ticket.observe(rtt);
+        ups.outliers.record(i, rtt, status >= 500);
+        leg.permit.observe(rtt, status == 503 || status == 429);
+        ups.latency.record(rtt, false);
+        leg.head = std::move(head);
+        co_return leg;
+    }
+
+    // The hedge: after `delay`, if the route's budget allows and an endpoint
+    // other than `primary` has room, the same request goes there. A leg
+    // destroyed while it waits (the primary answered) sends nothing.
+    static Task<HedgeLeg> hedge_after(ProxyServer* self, std::size_t route, std::size_t primary,
+                                      std::span<const iovec> request,
+                                      LatencyWindow::Clock::duration delay,
+                                      HedgeRace* race) {
+        auto nap = sleep_for(delay);  // named: it must outlive the suspension
+        co_await nap;
+        auto& ups = self->upstreams_[route];
+        HedgeLeg none;
+        none.hedge = true;
+        if (!ups.hedge_budget.can_withdraw()) co_return none;
+        auto pick = ups.balancer.pick([self, route, primary, &ups](std::size_t i) {
+            return i != primary && self->usable(route, i) &&
+                   self->limiters_[ups.endpoints[i]].has_capacity();
+        });
+        if (!pick) co_return none;
+        ups.hedge_budget.withdraw();
+        race->hedged = true;
+        HedgeLeg leg = co_await send_leg(self, route, *pick, request, race);
+        leg.hedge = true;
+        co_return leg;
+    }
+
+    // Background refresh of a stale cache entry (stale-while-revalidate):
+    // send `request` to one of the route's endpoints and store the response.
+    // Only Content-Length-framed responses are refreshed; for anything else,
+    // or on failure, the entry is left to expire and a later stale hit tries
+    // again.
+    static Task<void> revalidate(ProxyServer* self, std::size_t route, std::string request,
+                                 std::string key, ResponseCache::Headers req_headers) {
+        ResponseCache& cache = *self->options_.cache;
+        const ProxyOptions& o = self->options_;
+        auto& ups = self->upstreams_[route];
+        auto pick = ups.balancer.pick(
+            [self, route](std::size_t i) { return self->usable(route, i); });
+        int fd = -1;
+        EndpointId ep = 0;
+        Balancer::Ticket ticket;
+        if (pick) {
+            ticket = ups.balancer.start(*pick);
+            ep = ups.endpoints[*pick];
+            fd = co_await self->acquire_upstream(ep);
+        }
+        if (fd < 0) {
+            cache.abandon_revalidation(key);
+            co_return;
+        }
+        bool reusable = false;
+        std::string head;
+        Deadline deadline(o.upstream_timeout);
+        if (co_await write_all_async(self, fd, request, &deadline)) {
+            head = co_await read_until(self, fd, "\r\n\r\n", o.max_header_bytes, &deadline);
+        }
+        std::size_t hdr_end = head.find("\r\n\r\n");
+        std::string_view cl = hdr_end != std::string::npos
+            ? ResponseCache::header(std::string_view(head).substr(0, hdr_end), "Content-Length")
+            : std::string_view();
+        std::size_t len = 0;
+        if (!cl.empty() && std::from_chars(cl.data(), cl.data() + cl.size(), len).ec == std::errc() &&
+            len <= cache.options().max_object_bytes) {
+            hdr_end += 4;
+            std::string body = head.substr(hdr_end);
+            if (body.size() < len) body += co_await read_n(self, fd, len - body.size(), &deadline);
+            if (body.size() == len) {
+                std::string_view up_head = std::string_view(head).substr(0, hdr_end);
+                cache.store(key, req_headers, up_head, std::move(body));
+                reusable = ResponseCache::header(up_head, "Connection").find("close") ==
+                           std::string_view::npos;
+            }
+        }
+        cache.abandon_revalidation(key);
+        self->release_upstream(ep, fd, reusable);
+    }
+
+    // Status code from a response head ("HTTP/1.1 204 No Content"), or 0.
+    static int status_code(const std::string& head) {
+        std::size_t sp = head.find(' ');
+        if (sp == std::string::npos || sp + 4 > head.size()) return 0;
+        int code = 0;
+        for (std::size_t i = sp + 1; i < sp + 4; ++i) {
+            if (!std::isdigit(static_cast<unsigned char>(head[i]))) return 0;
+            code = code * 10 + (head[i] - '0');
+        }
+        return code;
+    }
+
+    // connect_upstream's result when a Unix-domain listener's backlog stayed
+    // full: the upstream is alive but overloaded, so not a health failure.
+    static constexpr int kUpstreamBusy = -2;
+
+    // Open a non-blocking connection to host:port (or to the socket of a
+    // unix: host) and await writability (which signals connect completion).
+    // Returns the fd (>=0) on success, kUpstreamBusy if a Unix socket's
+    // backlog stayed full, -1 on other failures and timeouts.
     static Task<int> connect_upstream(ProxyServer* self,
-                                      const std::string& host, unsigned short port) {
-        int fd = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+                                      const std::string& host, unsigned short port,
+                                      Deadline* deadline = nullptr) {
+        sockaddr_storage addr{};
+        socklen_t addr_len = 0;
+        const auto path = unix_socket_path(host);
+        if (path) {
+            auto* un = reinterpret_cast<sockaddr_un*>(&addr);
+            if (path->size() >= sizeof(un->sun_path)) co_return -1;
+            un->sun_family = AF_UNIX;
+            std::memcpy(un->sun_path, path->data(), path->size());
+            addr_len = sizeof(sockaddr_un);
+        } else {
+            auto* in = reinterpret_cast<sockaddr_in*>(&addr);
+            in->sin_family = AF_INET;
+            in->sin_addr.s_addr = ::inet_addr(host.c_str());
+            in->sin_port = htons(port);
+            addr_len = sizeof(sockaddr_in);
+        }
+        int fd = ::socket(addr.ss_family, SOCK_STREAM, 0);
         if (fd < 0) co_return -1;
+        // Closes the socket on timeout, or if this frame is destroyed mid-connect.
+        struct PendingFd {
+            int fd;
+            ~PendingFd() { if (fd >= 0) ::close(fd); }
+        } pending{fd};
         set_nonblocking(fd);
-        int ok = 1;
-        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &ok, sizeof(ok));
-        sockaddr_in addr{};
-        addr.sin_family = AF_INET;
-        addr.sin_addr.s_addr = ::inet_addr(host.c_str());
-        addr.sin_port = htons(port);
-        int rc = ::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+        if (!path) {
+            int ok = 1;
+            ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &ok, sizeof(ok));
+        }
+        int rc = ::connect(fd, reinterpret_cast<sockaddr*>(&addr), addr_len);
+        // A Unix-domain connect never goes in progress: it fails with EAGAIN
+        // while the listener's backlog is full. Back off briefly (1, 2, 4 ms)
+        // for the upstream to accept, then report it busy.
+        for (int attempt = 0; rc != 0 && path && errno == EAGAIN; ++attempt) {
+            if (attempt == 3 || (deadline && deadline->expired())) co_return kUpstreamBusy;
+            auto nap = sleep_for(std::chrono::milliseconds(1 << attempt));
+            co_await nap;
+            rc = ::connect(fd, reinterpret_cast<sockaddr*>(&addr), addr_len);
+        }
         if (rc == 0) {
-            co_return fd;  // immediate connect (localhost)
+            pending.fd = -1;
+            co_return fd;  // immediate connect (localhost, or a Unix socket)
         }
         if (errno != EINPROGRESS) {
-            ::close(fd);
             co_return -1;
         }
-        // Await writability, then check SO_ERROR for the connect result.
-        IoAwaiter aw{self->poller_.get(), fd, EventMask::Writable};
-        co_await aw;
-        int err = 0;
-        socklen_t sl = sizeof(err);
-        if (::getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &sl) < 0 || err != 0) {
-            ::close(fd);
-            co_return -1;
+        // Await writability, then ask connect() again for the result: EISCONN
+        // once it succeeded, EALREADY if the wake was early, else the error.
+        for (;;) {
+            TimedIoAwaiter aw{deadline, fd, EventMask::Writable};
+            if (!co_await aw) co_return -1;
+            rc = ::connect(fd, reinterpret_cast<sockaddr*>(&addr), addr_len);
+            if (rc == 0 || errno == EISCONN) break;
+            if (errno != EALREADY && errno != EINTR) co_return -1;
         }
+        pending.fd = -1;
         co_return fd;
     }
 
     // --- Connection pool ---------------------------------------------------
 
-    // Borrow a pooled keep-alive fd for an upstream, or open a new one.
-    Task<int> acquire_upstream(const std::string& host, unsigned short port) {
-        std::string key = upstream_key(host, port);
-        auto it = pools_.find(key);
-        if (it != pools_.end() && !it->second.empty()) {
-            int fd = it->second.front();
-            it->second.pop_front();
-            co_return fd;
-        }
-        co_return co_await connect_upstream(this, host, port);
+    // Open a connection to `id` under connect_timeout, counted in the pool's
+    // stats (and toward min_idle while it is in progress). -1 on failure.
+    Task<int> connect_pooled(EndpointId id) {
+        pool_.connect_started(id);
+        struct Attempt {  // finishes the count even if this frame is destroyed
+            UpstreamPool& pool;
+            EndpointId id;
+            bool ok = false;
+            ~Attempt() { pool.connect_finished(id, ok); }
+        } attempt{pool_, id};
+        Deadline deadline(options_.connect_timeout);
+        int fd = co_await connect_upstream(this, pool_.host(id), pool_.port(id), &deadline);
+        attempt.ok = fd >= 0;
+        co_return fd;
+    }
+
+    // Borrow a live pooled keep-alive fd for an upstream, or open a new one.
+    Task<int> acquire_upstream(EndpointId id) {
+        int fd = pool_.take(id);
+        if (pool_.deficit(id) > 0) prewarm(id);  // replace what was just taken
+        if (fd >= 0) co_return fd;
+        co_return co_await connect_pooled(id);
     }
 
-    // Return a still-open fd to the pool (or close it if the pool is full).
-    void release_upstream(const std::string& host, unsigned short port, int fd,
-                          bool reusable) {
+    // Return a still-open fd to the pool (or close it).
+    void release_upstream(EndpointId id, int fd, bool reusable) {
         if (fd < 0) return;
-        if (!reusable) {
-            ::close(fd);
-            return;
-        }
-        std::string key = upstream_key(host, port);
-        auto& pool = pools_[key];
-        if (pool.size() >= 64) {  // cap pool depth
-            ::close(fd);
+        if (reusable) {
+            pool_.put(id, fd);
         } else {
-            pool.push_back(fd);
+            ::close(fd);
         }
     }
 
     // --- Health ------------------------------------------------------------
 
-    bool is_healthy(const std::string& host, unsigned short port) {
-        std::string key = upstream_key(host, port);
-        auto it = health_.find(key);
-        if (it == health_.end()) return true;
-        if (it->second.healthy) return true;
-        // Cooldown expired → re-enable (optimistic; a new failure re-marks it).
-        if (std::chrono::steady_clock::now() - it->second.unhealthy_since > upstream_cooldown_) {
-            it->second.healthy = true;
-            return true;
-        }
-        return false;
+    // Down endpoints come back once the cooldown passes (optimistic; a new
+    // failure takes them out again) or, with health checks on, once probes
+    // pass.
+    bool is_healthy(EndpointId id) const { return health_->healthy(id); }
+
+    // Endpoint `i` of route `route` may take a request: healthy, and its
+    // circuit not open.
+    bool usable(std::size_t route, std::size_t i) const {
+        const auto& ups = upstreams_[route];
+        return is_healthy(ups.endpoints[i]) && ups.outliers.usable(i);
+    }
+
+    // How long retry `n` (1-based) waits: full jitter, uniform in
+    // [0, min(backoff_max, backoff_base × 2^(n - 1))].
+    std::chrono::milliseconds backoff(unsigned n) {
+        const RetryOptions& r = options_.retry;
+        if (r.backoff_base.count() <= 0 || n == 0) return std::chrono::milliseconds(0);
+        using Rep = std::chrono::milliseconds::rep;
+        Rep cap = r.backoff_base.count() << std::min(n - 1, 20u);
+        cap = std::min(cap, std::max(r.backoff_max.count(), r.backoff_base.count()));
+        return std::chrono::milliseconds(std::uniform_int_distribution<Rep>(0, cap)(rng_));
     }
 
-    void mark_unhealthy(const std::string& host, unsigned short port) {
-        std::string key = upstream_key(host, port);
-        auto& h = health_[key];
-        h.healthy = false;
-        h.unhealthy_since = std::chrono::steady_clock::now();
-        MUSES_WARNING(std::format("Proxy: upstream {} marked unhealthy", key));
+    void mark_unhealthy(EndpointId id) {
+        auto now = std::chrono::steady_clock::now();
+        auto until = options_.health_check.interval.count() > 0
+            ? std::chrono::steady_clock::time_point::max()
+            : now + options_.upstream_cooldown;
+        if (health_->mark_down(id, until, now)) {
+            MUSES_WARNING(std::format("Proxy: upstream {} marked unhealthy", pool_.name(id)));
+        }
     }
 
     // --- Header rewriting --------------------------------------------------
@@ -400,7 +1557,17 @@ private:
         }
         return "";
     }
-    static bool iequals(const std::string& a, const std::string& b) {
+    // `value` without the optional whitespace around a field value.
+    static std::string_view trim_ows(std::string_view value) {
+        while (!value.empty() && (value.front() == ' ' || value.front() == '\t')) {
+            value.remove_prefix(1);
+        }
+        while (!value.empty() && (value.back() == ' ' || value.back() == '\t')) {
+            value.remove_suffix(1);
+        }
+        return value;
+    }
+    static bool iequals(std::string_view a, std::string_view b) {
         if (a.size() != b.size()) return false;
         for (std::size_t i = 0; i < a.size(); ++i) {
             if (std::tolower(static_cast<unsigned char>(a[i])) !=
@@ -409,15 +1576,107 @@ private:
         return true;
     }
 
-    // Hop-by-hop headers that must not be forwarded (RFC 7230 §6.1).
-    static bool is_hop_by_hop(const std::string& name) {
-        static const char* const hop[] = {
-            "connection", "keep-alive", "proxy-authenticate", "proxy-authorization",
-            "te", "trailer", "transfer-encoding", "upgrade"};
-        for (const char* h : hop) {
-            if (iequals(name, h)) return true;
+    // Hop-by-hop headers that must not be forwarded (RFC 7230 §6.1). A
+    // perfect hash of length, first and last letter picks the one candidate
+    // a name can be, so classifying a header costs one compare at most.
+    static bool is_hop_by_hop(std::string_view name) {
+        static constexpr std::string_view kSlots[16] = {
+            {}, "te", "trailer", {}, {}, {}, "upgrade", {},
+            "keep-alive", "connection", "proxy-authorization", {},
+            {}, "proxy-authenticate", {}, "transfer-encoding"};
+        if (name.empty()) return false;
+        const std::size_t slot = (name.size() * 4 + (name.front() | 0x20) + (name.back() | 0x20)) & 15;
+        return kSlots[slot].size() == name.size() && iequals(name, kSlots[slot]);
+    }
+
+    // What the proxy adds to every forwarded head, blank line included.
+    // Transfer-Encoding is hop-by-hop, but a chunked body is relayed still
+    // chunked, so the framing goes with it.
+    static constexpr std::string_view kAddedHeaders = "X-Forwarded-Proto: http\r\n\r\n";
+    static constexpr std::string_view kAddedHeadersChunked =
+        "Transfer-Encoding: chunked\r\nX-Forwarded-Proto: http\r\n\r\n";
+
+    // How a request head frames its body: `error` is why the head (through
+    // its blank line) could be framed two ways, or "" if it cannot; `length`
+    // is its Content-Length, if it has one.
+    struct Framing {
+        std::string_view error;
+        std::optional<std::size_t> length;
+    };
+
+    // Errors: an obs-fold line (a header continued on the next line, which
+    // the parser and an upstream may join differently), whitespace between a
+    // field name and its colon (which some servers strip and others keep),
+    // or a Content-Length that is repeated or not a number that fits (which
+    // one wins differs between servers — the classic smuggling vector).
+    static Framing framing(std::string_view head) {
+        Framing result;
+        std::size_t pos = head.find("\r\n") + 2;
+        const std::size_t end = head.size() - 2;  // the blank line
+        while (pos < end) {
+            std::size_t eol = std::min(head.find("\r\n", pos), end);
+            std::string_view line = head.substr(pos, eol - pos);
+            pos = eol + 2;
+            if (line.empty()) continue;
+            if (line.front() == ' ' || line.front() == '\t') return {"folded header line", {}};
+            std::size_t colon = line.find(':');
+            if (colon == std::string_view::npos) continue;
+            if (colon > 0 && (line[colon - 1] == ' ' || line[colon - 1] == '\t')) {
+                return {"whitespace before a header colon", {}};
+            }
+            if (!iequals(line.substr(0, colon), "Content-Length")) continue;
+            if (result.length) return {"repeated Content-Length", {}};
+            std::string_view value = trim_ows(line.substr(colon + 1));
+            std::size_t length = 0;
+            auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), length);
+            if (value.empty() || ec != std::errc{} || ptr != value.data() + value.size()) {
+                return {"invalid Content-Length", {}};
+            }
+            result.length = length;
+        }
+        return result;
+    }
+
+    // The request as it goes upstream, as writev segments: the client's own
+    // request line and header bytes (`head`, through its blank line) less
+    // hop-by-hop header lines, then `added`, then the buffered `body`. The
+    // segments point into those buffers, which must outlive them; nothing is
+    // copied, and each run of kept lines is one segment. Duplicate headers
+    // and header order survive as the client sent them. The head has passed
+    // framing(), so there are no folded lines to carry along.
+    static std::vector<iovec> forward_segments(std::string_view head, std::string_view added,
+                                               std::string_view body) {
+        std::vector<iovec> segments;
+        auto keep = [&segments](std::string_view bytes) {
+            if (bytes.empty()) return;
+            if (!segments.empty()) {
+                iovec& last = segments.back();
+                if (static_cast<const char*>(last.iov_base) + last.iov_len == bytes.data()) {
+                    last.iov_len += bytes.size();
+                    return;
+                }
+            }
+            segments.push_back(iovec{const_cast<char*>(bytes.data()), bytes.size()});
+        };
+        std::size_t pos = head.find("\r\n") + 2;
+        keep(head.substr(0, pos));  // request line
+        const std::size_t end = head.size() - 2;  // the blank line
+        while (pos < end) {
+            std::size_t eol = std::min(head.find("\r\n", pos), end) + 2;
+            std::string_view line = head.substr(pos, eol - pos);
+            if (!is_hop_by_hop(line.substr(0, line.find(':')))) keep(line);
+            pos = eol;
         }
-        return false;
+        keep(added);
+        keep(body);
+        return segments;
+    }
+
+    // The bytes of `segments`, for a request that outlives their buffers.
+    static std::string flatten(std::span<const iovec> segments) {
+        std::string out;
+        for (const iovec& s : segments) out.append(static_cast<const char*>(s.iov_base), s.iov_len);
+        return out;
     }
 
     // --- The client coroutine ---------------------------------------------
@@ -425,172 +1684,577 @@ private:
     // Main per-connection coroutine. Defined as a free function friend so it
     // can be a coroutine returning Task<void>.
     friend Task<void> serve_client(ProxyServer* self, int client_fd);
+    friend class ProxyPool;  // hands connections between its shards
 
     int listen_fd_;
     std::vector<ProxyRoute> routes_;
-    unsigned max_retries_;
-    std::chrono::seconds upstream_cooldown_;
-    std::unique_ptr<Poller> poller_;
+    RadixRouter<std::size_t> router_;  // indices into routes_
+    ProxyOptions options_;
+    std::unique_ptr<EventLoop> own_loop_;  // started on a thread of its own
+    EventLoop* loop_ = nullptr;            // that, or a runtime worker's
     std::thread loop_thread_;
     std::atomic<bool> running_{false};
+    Runtime* runtime_ = nullptr;
+    std::shared_ptr<std::atomic<bool>> exited_;  // the runtime driver has shut down
+    // Set by a ProxyPool on a Runtime: hands accepted fds to the pool.
+    std::function<void(int)> dispatch_;
+    // Pipe pairs for zero-copy body relays, borrowed per relay. Declared
+    // before live_tasks_ so it outlives any coroutine still holding a lease.
+    PipePool pipes_;
+    // In-flight coalescable requests by cache key (see Flight). Declared
+    // before live_tasks_: leaders still in flight on stop() land here.
+    std::unordered_map<std::string, std::shared_ptr<Flight>> flights_;
+    // Per-endpoint concurrency limits, indexed by EndpointId. Before
+    // live_tasks_ too: queued requests leave their queue on destruction.
+    std::vector<ConcurrencyLimiter> limiters_;
     // Live client coroutines keyed by client fd. Destroyed when done or on stop.
     std::unordered_map<int, Task<void>> live_tasks_;
-    // Keep-alive upstream connection pools keyed by "host:port".
-    std::unordered_map<std::string, std::deque<int>> pools_;
-    // Health state per upstream.
-    std::unordered_map<std::string, UpstreamHealth> health_;
+    // Keep-alive upstream connections; interns every endpoint of every route.
+    UpstreamPool pool_;
+    // Coroutines not tied to a client: pool prewarming, cache revalidation.
+    std::vector<Task<void>> background_;
+    std::chrono::steady_clock::time_point next_pool_sweep_{};
+    std::chrono::steady_clock::time_point next_outlier_check_{};
+    // Health per upstream, indexed by EndpointId; possibly shared.
+    std::shared_ptr<HealthTable> health_;
+    std::vector<char> probing_;  // a probe of this endpoint is running here
+    std::minstd_rand rng_{static_cast<std::uint32_t>(  // probe and backoff jitter
+        reinterpret_cast<std::uintptr_t>(this))};
+    // Endpoint ids and balancer per route, parallel to routes_. Built once:
+    // the balancers must not move while requests hold tickets on them.
+    struct RouteUpstreams {
+        std::vector<EndpointId> endpoints;
+        Balancer balancer;
+        OutlierDetector outliers;
+        LatencyWindow latency;        // time to response head; hedging only
+        RequestBudget hedge_budget;
+        RequestBudget retry_budget;
+    };
+    std::vector<RouteUpstreams> upstreams_;
 };
 
-// The per-client coroutine: read request → route → forward to upstream → read
-// response → write back → (keep-alive) loop. Defined outside the class because
-// it's a coroutine and needs to return Task<void>.
+// The per-client coroutine: read request → route → forward to upstream →
+// stream the response back → (keep-alive) loop. Defined outside the class
+// because it's a coroutine and needs to return Task<void>. Every client and
+// upstream I/O step runs under a Deadline from the ProxyOptions timeouts;
+// returning ends the connection (reap_finished_tasks closes the client fd).
+//
+// Memory per connection is the request head, at most max_replay_body of
+// buffered request body, the response head, and one relay_buffer — bodies of
+// any size stream through the relay buffer.
 inline Task<void> serve_client(ProxyServer* self, int client_fd) {
+    using RelayEnd = ProxyServer::RelayEnd;
+    const ProxyOptions& opts = self->options_;
+    // One Deadline per side, restarted per phase: the client's to read each
+    // request and to write each response head, the upstream's for each
+    // attempt up to its response head. A streaming relay restarts both
+    // before every read and write.
+    Deadline client_io(opts.client_timeout);
+    Deadline upstream_io(opts.upstream_timeout);
+    std::vector<char> relay_storage(std::max<std::size_t>(opts.relay_buffer, 512));
+    const std::span<char> relay_buf{relay_storage};
+    std::optional<std::string> client_address;  // looked up on first use
     for (;;) {  // keep-alive loop
-        // Read the request headers (up to \r\n\r\n).
-        std::string head = co_await ProxyServer::read_until(self, client_fd, "\r\n\r\n");
+        // Read the request headers (up to \r\n\r\n). A client that does
+        // not get a request in within client_timeout (idle keep-alive,
+        // slowloris) is dropped.
+        client_io.restart();
+        std::string head = co_await ProxyServer::read_until(self, client_fd, "\r\n\r\n",
+                                                            opts.max_header_bytes, &client_io);
         if (head.empty() || head.find("\r\n\r\n") == std::string::npos) {
+            if (head.size() >= opts.max_header_bytes) {
+                std::string resp = muses::HttpContext::build_response(
+                    431, "Request Header Fields Too Large", "text/plain",
+                    "request head too large", false);
+                client_io.restart();
+                co_await ProxyServer::write_all_async(self, client_fd, resp, &client_io);
+            }
             co_return;  // client closed or malformed
         }
-        // Parse to find method/url and Content-Length for the body.
-        muses::HttpInfo info = muses::HttpContext::parse_request(head);
-        // Determine the body length (Content-Length; chunked bodies are forwarded
-        // as-is with the header — we don't de-chunk on the request side here).
-        std::string cl = ProxyServer::header_get(info.headers, "Content-Length");
-        std::size_t body_len = 0;
-        if (!cl.empty()) {
-            try { body_len = static_cast<std::size_t>(std::stoull(cl)); } catch (...) {}
-        }
-        // Read the request body if any (the head already includes any body bytes
-        // that arrived in the same read past \r\n\r\n).
-        std::size_t hdr_end = head.find("\r\n\r\n") + 4;
-        std::string body_in_head = head.substr(hdr_end);
-        head.resize(hdr_end);  // trim to headers only
-        std::string body = body_in_head;
-        if (body.size() < body_len) {
-            std::string rest = co_await ProxyServer::read_n(self, client_fd, body_len - body.size());
-            body += rest;
-        }
-
-        // Route by prefix (first match wins). Default to the last route (catch-all "/").
-        const ProxyRoute* route = nullptr;
-        for (const auto& r : self->routes_) {
-            if (info.url.rfind(r.prefix, 0) == 0) { route = &r; break; }
-        }
-        if (route == nullptr && !self->routes_.empty()) route = &self->routes_.back();
-        if (route == nullptr) {
+        // Parse to find method/url and the body framing. The head may
+        // already hold the first body bytes (read past \r\n\r\n).
+        const std::size_t hdr_end = head.find("\r\n\r\n") + 4;
+        muses::HttpInfo info = muses::HttpContext::parse_request(head.substr(0, hdr_end));
+        std::string te = ProxyServer::header_get(info.headers, "Transfer-Encoding");
+        const bool chunked_request = te.find("chunked") != std::string::npos;
+        ProxyServer::Framing framing =
+            ProxyServer::framing(std::string_view(head).substr(0, hdr_end));
+        if (framing.error.empty() && chunked_request && framing.length) {
+            framing.error = "conflicting body framing";
+        }
+        if (!framing.error.empty()) {
+            // A head that the parser here and the upstream could frame
+            // differently is how requests get smuggled; refuse.
             std::string resp = muses::HttpContext::build_response(
-                502, "Bad Gateway", "text/plain", "no route", false);
-            co_await ProxyServer::write_all_async(self, client_fd, resp);
+                400, "Bad Request", "text/plain", std::string(framing.error), false);
+            client_io.restart();
+            co_await ProxyServer::write_all_async(self, client_fd, resp, &client_io);
             co_return;
         }
+        const std::size_t body_len = framing.length.value_or(0);
+        // Body bytes stay in `head`, after the headers: those that came with
+        // it, and the rest of a small body, read in behind them. `body` views
+        // them there, so the forward path never copies the body.
+        std::size_t body_have = 0;
+        // A chunked body is relayed as-is; the decoder only tracks where it
+        // ends. If it ended within the head it can be replayed like any other
+        // buffered body, otherwise the rest streams.
+        ChunkedDecoder request_chunks;
+        if (chunked_request) {
+            auto framed = request_chunks.feed(std::string_view(head).substr(hdr_end));
+            if (framed.status == ChunkedDecoder::Status::Error) {
+                std::string resp = muses::HttpContext::build_response(
+                    400, "Bad Request", "text/plain", "malformed chunked body", false);
+                client_io.restart();
+                co_await ProxyServer::write_all_async(self, client_fd, resp, &client_io);
+                co_return;
+            }
+            body_have = framed.consumed;
+        } else {
+            body_have = std::min(head.size() - hdr_end, body_len);
+        }
+        const bool stream_chunks = chunked_request && !request_chunks.done();
+        head.resize(hdr_end + body_have);  // anything past the body is dropped
+        // A small body is read in full so a failed attempt can be replayed; a
+        // large one streams from the client once the upstream is connected.
+        std::size_t body_pending = chunked_request ? 0 : body_len - body_have;
+        if (body_pending > 0 && body_len <= opts.max_replay_body) {
+            // Same phase, same window: the whole request within client_timeout.
+            auto got = co_await ProxyServer::read_append(self, client_fd, head, body_pending,
+                                                         &client_io);
+            if (got < body_pending) co_return;
+            body_pending = 0;
+        }
+        const std::string_view body = std::string_view(head).substr(hdr_end);
 
-        // Health gate.
-        if (!self->is_healthy(route->host, route->port)) {
+        // Route: longest prefix for this Host and method.
+        const std::size_t* route_index = self->router_.match(
+            ProxyServer::header_get(info.headers, "Host"), info.url, info.method);
+        const ProxyRoute* route = route_index ? &self->routes_[*route_index] : nullptr;
+        if (route == nullptr) {
             std::string resp = muses::HttpContext::build_response(
-                502, "Bad Gateway", "text/plain", "upstream unavailable", false);
-            co_await ProxyServer::write_all_async(self, client_fd, resp);
+                502, "Bad Gateway", "text/plain", "no route", false);
+            client_io.restart();
+            co_await ProxyServer::write_all_async(self, client_fd, resp, &client_io);
             co_return;
         }
 
-        // Rewrite request headers: strip hop-by-hop, add X-Forwarded-For.
-        std::string fwd_request = info.method + " " + info.url + " " + info.version + "\r\n";
-        for (const auto& [k, v] : info.headers) {
-            if (ProxyServer::is_hop_by_hop(k)) continue;
-            if (ProxyServer::iequals(k, "Host")) {
-                // Keep the original Host (reverse proxy to the same vhost) or
-                // rewrite to upstream. Here we preserve it for transparency.
+        auto& upstreams = self->upstreams_[*route_index];
+        auto healthy = [self, &upstreams](std::size_t i) {
+            return self->is_healthy(upstreams.endpoints[i]);
+        };
+        auto usable = [self, route = *route_index](std::size_t i) {
+            return self->usable(route, i);
+        };
+        // Affinity key: the same key keeps reaching the same endpoint.
+        std::optional<std::uint64_t> affinity;
+        if (route->balance == BalancePolicy::ConsistentHash) {
+            switch (route->hash_key) {
+            case HashKey::Path: {
+                std::string_view path = info.url;
+                affinity = stable_hash(path.substr(0, path.find('?')));
+                break;
+            }
+            case HashKey::Header: {
+                std::string v = ProxyServer::header_get(info.headers, route->hash_header);
+                if (!v.empty()) affinity = stable_hash(v);
+                break;
+            }
+            case HashKey::ClientAddress:
+                if (!client_address) client_address = ProxyServer::peer_address(client_fd);
+                if (!client_address->empty()) affinity = stable_hash(*client_address);
+                break;
             }
-            fwd_request += k + ": " + v + "\r\n";
         }
-        fwd_request += "X-Forwarded-Proto: http\r\n";
-        fwd_request += "\r\n";
-        fwd_request += body;
 
-        // Forward with retries.
-        std::string upstream_response;
-        bool got_response = false;
-        for (unsigned attempt = 0; attempt <= self->max_retries_ && !got_response; ++attempt) {
-            int up_fd = co_await self->acquire_upstream(route->host, route->port);
-            if (up_fd < 0) {
-                self->mark_unhealthy(route->host, route->port);
-                continue;  // retry
+        // The forwarded request: the client's head less hop-by-hop headers
+        // (the original Host included, for transparency), the proxy's own
+        // headers and the buffered body, written with one writev.
+        const std::vector<iovec> fwd_request = ProxyServer::forward_segments(
+            std::string_view(head).substr(0, hdr_end),
+            chunked_request ? ProxyServer::kAddedHeadersChunked : ProxyServer::kAddedHeaders, body);
+
+        // Response cache. A fresh hit, or a stale one inside its
+        // stale-while-revalidate window, is answered here on the loop; the
+        // first stale hit also starts a background refresh. A miss goes
+        // upstream and may fill the entry on the way back.
+        ResponseCache* cache = opts.cache.get();
+        std::string cache_key;
+        if ((cache != nullptr || opts.coalesce) && body.empty() && body_pending == 0 &&
+            !chunked_request && ResponseCache::cacheable_request(info.method, info.headers)) {
+            cache_key = ResponseCache::key(info.method,
+                                           ProxyServer::header_get(info.headers, "Host"), info.url);
+        }
+        if (cache != nullptr && !cache_key.empty()) {
+            std::optional<ResponseCache::Hit> hit;
+            if (!ResponseCache::wants_fresh(info.headers)) {
+                hit = cache->lookup(cache_key, info.headers);
             }
-            bool wrote = co_await ProxyServer::write_all_async(self, up_fd, fwd_request);
-            if (!wrote) {
-                ::close(up_fd);
-                self->mark_unhealthy(route->host, route->port);
+            if (hit) {
+                if (hit->revalidate) {
+                    self->spawn(ProxyServer::revalidate(self, *route_index,
+                                                        ProxyServer::flatten(fwd_request),
+                                                        cache_key, info.headers));
+                }
+                const bool keep_alive = info.wants_keep_alive();
+                client_io.restart();
+                bool sent = co_await ProxyServer::write_stored(
+                    self, client_fd, std::move(hit->response), hit->age, keep_alive, &client_io);
+                if (!sent || !keep_alive) co_return;
                 continue;
             }
-            // Read the upstream response headers.
-            std::string up_head = co_await ProxyServer::read_until(self, up_fd, "\r\n\r\n");
-            if (up_head.empty() || up_head.find("\r\n\r\n") == std::string::npos) {
-                ::close(up_fd);
-                self->mark_unhealthy(route->host, route->port);
-                continue;
+        }
+
+        // Coalescing. The first request for a key leads a Flight; identical
+        // ones arriving while it is in flight wait for its response and write
+        // that, unless it comes back unshareable, for another variant, or not
+        // at all — then they go upstream themselves. The key takes in the
+        // Cookie: a response to one user's cookies is not handed to another
+        // even if it forgot to say private.
+        std::optional<ProxyServer::FlightLease> flight;
+        if (opts.coalesce && !cache_key.empty()) {
+            std::string flight_key = cache_key;
+            std::string cookie = ProxyServer::header_get(info.headers, "Cookie");
+            if (!cookie.empty()) (flight_key += '\0') += cookie;
+            std::shared_ptr<ProxyServer::Flight>& slot = self->flights_[flight_key];
+            if (slot) {
+                // A named awaiter: it must outlive the suspension.
+                ProxyServer::JoinFlight join{slot};
+                auto shared = co_await join;
+                if (shared && ResponseCache::same_variant(shared->head, join.flight->request_headers,
+                                                          info.headers)) {
+                    const bool keep_alive = info.wants_keep_alive();
+                    client_io.restart();
+                    bool sent = co_await ProxyServer::write_stored(
+                        self, client_fd, std::move(shared), std::nullopt, keep_alive, &client_io);
+                    if (!sent || !keep_alive) co_return;
+                    continue;
+                }
+            } else {
+                slot = std::make_shared<ProxyServer::Flight>();
+                slot->request_headers = info.headers;
+                flight.emplace(self, std::move(flight_key), slot);
             }
-            // Parse the response to find body length (Content-Length or chunked).
-            muses::HttpInfo up_info = muses::HttpContext::parse_request(up_head);
-            std::size_t uhdr_end = up_head.find("\r\n\r\n") + 4;
-            upstream_response = up_head;  // keep headers verbatim for now
-            std::string up_body_in_head = up_head.substr(uhdr_end);
-            upstream_response.resize(uhdr_end);
-            std::string up_te = ProxyServer::header_get(up_info.headers, "Transfer-Encoding");
-            std::string up_cl = ProxyServer::header_get(up_info.headers, "Content-Length");
-            bool chunked = up_te.find("chunked") != std::string::npos;
-            if (chunked) {
-                // Read chunks until the terminating "0\r\n\r\n".
-                std::string chunkbuf = up_body_in_head;
-                for (;;) {
-                    if (chunkbuf.find("0\r\n\r\n") != std::string::npos) break;
-                    // Need more data. Look for a complete chunk size line.
-                    if (chunkbuf.find("\r\n") == std::string::npos) {
-                        std::string more = co_await ProxyServer::read_until(self, up_fd, "\r\n");
-                        chunkbuf += more;
-                        continue;
-                    }
-                    // Parse hex size, read that many bytes + CRLF, repeat.
-                    // Simplified: just stream until we see the terminator.
-                    std::string more = co_await ProxyServer::read_n(self, up_fd, 4096);
-                    if (more.empty()) break;
-                    chunkbuf += more;
-                    if (chunkbuf.size() > 16 * 1024 * 1024) break;  // safety cap
+        }
+
+        // Forward with retries, up to the response head. Each attempt asks
+        // the route's balancer for a healthy endpoint; a failed one is marked
+        // unhealthy, so a retry lands elsewhere when it can. A connect failure
+        // or timeout is retried. An upstream that took the request and then
+        // failed is retried only for an idempotent method, and one that
+        // stalls past upstream_timeout not at all (the request may have had
+        // side effects) — the client gets 504 instead. Neither is a request
+        // whose body was streamed: those bytes are gone. Every retry backs
+        // off first and needs a token from the route's retry budget.
+        const bool idempotent = info.method == "GET" || info.method == "HEAD" ||
+                                info.method == "OPTIONS" || info.method == "TRACE" ||
+                                info.method == "PUT" || info.method == "DELETE";
+        upstreams.retry_budget.deposit();
+        auto has_capacity = [self, &upstreams, &usable](std::size_t i) {
+            return usable(i) && self->limiters_[upstreams.endpoints[i]].has_capacity();
+        };
+        auto choose = [&upstreams, &affinity](auto&& pred) {
+            return affinity ? upstreams.balancer.pick_for(*affinity, pred)
+                            : upstreams.balancer.pick(pred);
+        };
+        int up_fd = -1;
+        std::string up_head;
+        bool timed_out = false;
+        bool unavailable = false;
+        bool overloaded = false;
+        EndpointId ep = 0;
+        Balancer::Ticket ticket;  // in flight until the response is relayed
+        ProxyServer::Permit permit;  // likewise, a concurrency-limit slot
+        unsigned attempt = 0;
+
+        // Hedging: a replicated GET's first attempt races a second one that
+        // leaves after the route's usual latency unless the first has
+        // answered by then. A failure with no hedge out ends the race early;
+        // the retry loop carries on from there.
+        const HedgeOptions& hedging = opts.hedge;
+        if (hedging.enabled && !affinity && upstreams.endpoints.size() > 1 && body.empty() &&
+            body_pending == 0 && !chunked_request &&
+            (info.method == "GET" || info.method == "HEAD")) {
+            upstreams.hedge_budget.deposit();
+            std::optional<std::size_t> first;
+            if (upstreams.latency.count() >= std::max<std::uint64_t>(hedging.min_samples, 1)) {
+                first = choose(has_capacity);
+            }
+            if (first) {
+                ProxyServer::HedgeRace race;
+                std::vector<Task<ProxyServer::HedgeLeg>> legs;
+                legs.push_back(ProxyServer::send_leg(self, *route_index, *first, fwd_request,
+                                                     &race));
+                legs.push_back(ProxyServer::hedge_after(
+                    self, *route_index, *first, fwd_request,
+                    upstreams.latency.percentile(hedging.quantile), &race));
+                auto won = co_await when_any(std::move(legs),
+                                             [&race](const ProxyServer::HedgeLeg& leg) {
+                                                 return race.settles(leg);
+                                             });
+                attempt = race.hedged ? 2 : 1;
+                timed_out = race.timed_out;
+                if (won.value.answered()) {
+                    ep = upstreams.endpoints[won.value.index];
+                    ticket = std::move(won.value.ticket);
+                    permit = std::move(won.value.permit);
+                    up_head = std::move(won.value.head);
+                    up_fd = std::exchange(won.value.fd, -1);
                 }
-                upstream_response += chunkbuf;
-            } else if (!up_cl.empty()) {
-                std::size_t up_body_len = 0;
-                try { up_body_len = static_cast<std::size_t>(std::stoull(up_cl)); } catch (...) {}
-                std::string up_body = up_body_in_head;
-                if (up_body.size() < up_body_len) {
-                    std::string rest = co_await ProxyServer::read_n(self, up_fd, up_body_len - up_body.size());
-                    up_body += rest;
+            }
+        }
+
+        bool retryable = true;  // the last failure left the request safe to resend
+        for (; attempt <= self->options_.max_retries && up_fd < 0 && !timed_out && retryable;
+             ++attempt) {
+            if (attempt > 0) {
+                if (body_pending > 0 || stream_chunks) break;
+                if (!upstreams.retry_budget.withdraw()) break;
+                auto pause = self->backoff(attempt);
+                if (pause.count() > 0) {
+                    auto nap = sleep_for(pause);  // named: it must outlive the suspension
+                    co_await nap;
                 }
-                upstream_response += up_body;
-            } else {
-                // No length info: read to EOF (upstream closes).
-                std::string rest = up_body_in_head;
-                for (;;) {
-                    std::string more = co_await ProxyServer::read_n(self, up_fd, 4096);
-                    if (more.empty()) break;
-                    rest += more;
-                    if (rest.size() > 16 * 1024 * 1024) break;
+            }
+            // Prefer an endpoint under its concurrency limit; with all of
+            // them at it, queue on one. If every healthy endpoint has its
+            // circuit open, an outlier beats no answer.
+            auto pick = choose(has_capacity);
+            if (!pick) pick = choose(usable);
+            if (!pick && upstreams.outliers.ejected() > 0) pick = choose(healthy);
+            if (!pick) {
+                unavailable = attempt == 0;
+                break;
+            }
+            ep = upstreams.endpoints[*pick];
+            ConcurrencyLimiter& limiter = self->limiters_[ep];
+            if (!limiter.try_acquire()) {
+                bool admitted = false;
+                if (!limiter.queue_full()) {
+                    auto waited = co_await ProxyServer::bounded(
+                        ProxyServer::wait_for_slot(&limiter), limiter.options().queue_timeout);
+                    admitted = waited && *waited;
                 }
-                upstream_response += rest;
+                if (!admitted) {
+                    overloaded = true;
+                    break;
+                }
+            }
+            permit = ProxyServer::Permit(self, ep);
+            ticket = upstreams.balancer.start(*pick);
+            upstreams.outliers.picked(*pick);
+            const std::size_t picked = *pick;
+            const auto sent_at = Balancer::Clock::now();
+            auto failed = [&upstreams, &permit, picked, sent_at] {
+                auto elapsed = Balancer::Clock::now() - sent_at;
+                upstreams.outliers.record(picked, elapsed, true);
+                permit.observe(elapsed, true);
+            };
+            int fd = co_await self->acquire_upstream(ep);
+            if (fd == ProxyServer::kUpstreamBusy) {  // overloaded, not down
+                permit.observe(Balancer::Clock::now() - sent_at, true);
+                overloaded = true;
+                break;
+            }
+            if (fd < 0) {
+                failed();
+                self->mark_unhealthy(ep);
+                continue;  // retry
+            }
+            upstream_io.restart();
+            if (!co_await ProxyServer::writev_all_async(self, fd, fwd_request, &upstream_io)) {
+                ::close(fd);
+                failed();
+                if (upstream_io.expired()) { timed_out = true; break; }
+                self->mark_unhealthy(ep);
+                retryable = idempotent;  // some of it may have gone out
+                continue;
+            }
+            if (body_pending > 0 || stream_chunks) {
+                RelayEnd sent = stream_chunks
+                    ? co_await ProxyServer::relay(self, client_fd, fd, ProxyServer::kUntilEof,
+                                                  relay_buf, &request_chunks,
+                                                  client_io, upstream_io)
+                    : co_await ProxyServer::relay_body(self, client_fd, fd, body_pending,
+                                                       relay_buf, client_io, upstream_io);
+                upstream_io.restart();  // the response head gets a window of its own
+                if (sent != RelayEnd::Done) {
+                    ::close(fd);
+                    if (sent == RelayEnd::Malformed) {
+                        std::string resp = muses::HttpContext::build_response(
+                            400, "Bad Request", "text/plain", "malformed chunked body", false);
+                        client_io.restart();
+                        co_await ProxyServer::write_all_async(self, client_fd, resp, &client_io);
+                        co_return;
+                    }
+                    // The client left mid-body: nobody to answer.
+                    if (sent == RelayEnd::SourceClosed || sent == RelayEnd::SourceTimeout) {
+                        co_return;
+                    }
+                    failed();
+                    if (sent == RelayEnd::SinkTimeout) timed_out = true;
+                    else self->mark_unhealthy(ep);
+                    break;
+                }
+            }
+            // Read the upstream response headers.
+            std::string up_head_read = co_await ProxyServer::read_until(
+                self, fd, "\r\n\r\n", opts.max_header_bytes, &upstream_io);
+            const bool complete = up_head_read.find("\r\n\r\n") != std::string::npos;
+            if (!complete && upstream_io.expired()) {
+                ::close(fd);
+                ticket.observe(Balancer::Clock::now() - sent_at);  // a stall is a data point
+                failed();
+                timed_out = true;
+                break;
+            }
+            if (!complete) {
+                ::close(fd);
+                failed();
+                self->mark_unhealthy(ep);
+                retryable = idempotent;
+                continue;
             }
-            // Success: return the upstream fd to the pool.
-            self->release_upstream(route->host, route->port, up_fd, /*reusable=*/true);
-            got_response = true;
+            const auto rtt = Balancer::Clock::now() - sent_at;
+            const int head_status = ProxyServer::status_code(up_head_read);
+            ticket.observe(rtt);
+            upstreams.outliers.record(picked, rtt, head_status >= 500);
+            if (opts.hedge.enabled) upstreams.latency.record(rtt, false);
+            // 503 and 429 are the upstream saying it is over its limit.
+            permit.observe(rtt, head_status == 503 || head_status == 429);
+            up_head = std::move(up_head_read);
+            up_fd = fd;
         }
 
-        if (!got_response) {
-            std::string resp = muses::HttpContext::build_response(
-                502, "Bad Gateway", "text/plain", "upstream failed", false);
-            co_await ProxyServer::write_all_async(self, client_fd, resp);
+        if (up_fd < 0) {
+            std::string resp = overloaded
+                ? muses::HttpContext::build_response(
+                      503, "Service Unavailable", "text/plain", "upstream overloaded", false)
+                : unavailable
+                ? muses::HttpContext::build_response(
+                      502, "Bad Gateway", "text/plain", "upstream unavailable", false)
+                : timed_out
+                ? muses::HttpContext::build_response(
+                      504, "Gateway Timeout", "text/plain", "upstream timed out", false)
+                : muses::HttpContext::build_response(
+                      502, "Bad Gateway", "text/plain", "upstream failed", false);
+            client_io.restart();
+            co_await ProxyServer::write_all_async(self, client_fd, resp, &client_io);
             co_return;
         }
 
-        // Write the upstream response back to the client.
-        bool client_ok = co_await ProxyServer::write_all_async(self, client_fd, upstream_response);
-        if (!client_ok) co_return;
+        // Frame the response body: none (HEAD, 1xx/204/304), Content-Length,
+        // chunked, or until the upstream closes. Headers are forwarded
+        // verbatim.
+        muses::HttpInfo up_info = muses::HttpContext::parse_request(up_head);
+        std::size_t uhdr_end = up_head.find("\r\n\r\n") + 4;
+        int status = ProxyServer::status_code(up_head);
+        bool no_body = info.method == "HEAD" || (status >= 100 && status < 200) ||
+                       status == 204 || status == 304;
+        std::string up_te = ProxyServer::header_get(up_info.headers, "Transfer-Encoding");
+        std::string up_cl = ProxyServer::header_get(up_info.headers, "Content-Length");
+        std::string up_conn = ProxyServer::header_get(up_info.headers, "Connection");
+        bool chunked = !no_body && up_te.find("chunked") != std::string::npos;
+        bool until_eof = !no_body && !chunked && up_cl.empty();
+        std::size_t remaining = 0;
+        if (!no_body && !chunked && !until_eof) {
+            // A length that does not parse leaves the body's end unknown: the
+            // connection cannot be reused, nor the response stored or shared.
+            std::string_view value = ProxyServer::trim_ows(up_cl);
+            auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), remaining);
+            if (ec != std::errc{} || ptr != value.data() + value.size()) {
+                ::close(up_fd);
+                std::string resp = muses::HttpContext::build_response(
+                    502, "Bad Gateway", "text/plain", "malformed upstream response", false);
+                client_io.restart();
+                co_await ProxyServer::write_all_async(self, client_fd, resp, &client_io);
+                co_return;
+            }
+        }
+        // Copy the response as it goes by if the cache can store it or
+        // requests are waiting on this flight for it. Bodies read until close
+        // are neither stored nor shared; their end is not distinguishable
+        // from a cut.
+        const std::string_view head_view = std::string_view(up_head).substr(0, uhdr_end);
+        const bool store = cache != nullptr && !cache_key.empty() && !until_eof &&
+                           ResponseCache::storable(head_view);
+        const bool share = flight && !until_eof && ResponseCache::shareable(head_view) &&
+                           (store || flight->has_waiters());
+        std::optional<ProxyServer::Capture> capture;
+        if (store || share) {
+            std::size_t limit = store ? cache->options().max_object_bytes : 0;
+            if (share) limit = std::max(limit, opts.coalesce_max_body);
+            if (chunked || remaining <= limit) capture.emplace(ProxyServer::Capture{{}, limit});
+        }
+        // Nothing to hand over: release the waiters now, and let later
+        // requests lead flights of their own.
+        if (flight && !(share && capture)) flight->land(nullptr);
+        ChunkedDecoder response_chunks;
+        // Body bytes that arrived with the head go out with it.
+        std::size_t prefetched = up_head.size() - uhdr_end;
+        if (no_body) {
+            prefetched = 0;
+        } else if (chunked) {
+            auto framed = response_chunks.feed(std::string_view(up_head).substr(uhdr_end));
+            if (framed.status == ChunkedDecoder::Status::Error) {
+                ::close(up_fd);
+                std::string resp = muses::HttpContext::build_response(
+                    502, "Bad Gateway", "text/plain", "malformed upstream response", false);
+                client_io.restart();
+                co_await ProxyServer::write_all_async(self, client_fd, resp, &client_io);
+                co_return;
+            }
+            prefetched = framed.consumed;
+        } else if (!until_eof) {
+            prefetched = std::min(prefetched, remaining);
+            remaining -= prefetched;
+        }
+        if (capture) capture->append(up_head.data() + uhdr_end, prefetched);
+        client_io.restart();
+        if (!co_await ProxyServer::write_all_async(self, client_fd, up_head.data(),
+                                                   uhdr_end + prefetched, &client_io)) {
+            ::close(up_fd);
+            co_return;
+        }
+
+        RelayEnd end = RelayEnd::Done;
+        if (chunked && !response_chunks.done()) {
+            end = co_await ProxyServer::relay(self, up_fd, client_fd, ProxyServer::kUntilEof,
+                                              relay_buf, &response_chunks,
+                                              upstream_io, client_io,
+                                              capture ? &*capture : nullptr);
+        } else if (until_eof) {
+            end = co_await ProxyServer::relay_body(self, up_fd, client_fd, ProxyServer::kUntilEof,
+                                                   relay_buf, upstream_io, client_io);
+        } else if (remaining > 0 && capture) {
+            // Copying relay: a spliced body never passes through user space.
+            end = co_await ProxyServer::relay(self, up_fd, client_fd, remaining, relay_buf,
+                                              nullptr, upstream_io, client_io, &*capture);
+        } else if (remaining > 0) {
+            end = co_await ProxyServer::relay_body(self, up_fd, client_fd, remaining,
+                                                   relay_buf, upstream_io, client_io);
+        }
+        if (end != RelayEnd::Done) {
+            // The response is cut short; with the head already sent the only
+            // signal left for the client is closing the connection.
+            ::close(up_fd);
+            co_return;
+        }
+        std::shared_ptr<const CachedResponse> frozen;
+        if (capture && !capture->overflow) {
+            frozen = ResponseCache::freeze(head_view, std::move(capture->bytes));
+            if (store) cache->store(cache_key, info.headers, frozen);
+        } else if (cache != nullptr && info.method != "GET" && info.method != "HEAD" &&
+                   status >= 200 && status < 400) {
+            // A successful unsafe request may have changed the resource.
+            cache->invalidate(ProxyServer::header_get(info.headers, "Host"), info.url);
+        }
+        // Done: a framed response leaves the upstream connection reusable.
+        bool reusable = !until_eof && up_conn.find("close") == std::string::npos;
+        self->release_upstream(ep, up_fd, reusable);
+        if (flight) flight->land(std::move(frozen));
+        // An unframed body ends with the connection; so must ours.
+        if (until_eof) co_return;
 
         // keep-alive decision: if the client asked to close, stop.
         if (!info.wants_keep_alive()) co_return;
@@ -598,6 +2262,160 @@ inline Task<void> serve_client(ProxyServer* self, int client_fd) {
     }
 }
 
+// N ProxyServer shards, one event-loop thread each, for proxying on more than
+// one core. Unlike ReactorPool's shards, which share one listen fd, each shard
+// here binds its own SO_REUSEPORT listener on the same address. The kernel
+// then spreads connections over the shards' accept queues, and no two loops
+// wake for the same connection. A shard owns everything it touches: listener,
+// poller, upstream connection pool, balancers. Health is per shard too,
+// unless `share_health` is set. In that case all shards read one lock-free
+// HealthTable, so an upstream one shard sees failing is skipped by every shard.
+//
+// On a Runtime instead, there is one shard per worker, all accepting on one
+// listener. A shard does not serve what it accepts itself: it spawns a task
+// onto the runtime that picks up the connection. That task sits on the
+// accepting worker's ready ring, so a worker with nothing to do steals it and
+// the connection is served by the thief's shard; an overloaded shard sheds
+// new connections to idle ones. Once adopted, a connection stays on its shard.
+class ProxyPool {
+public:
+    // Binds `shard_count` listeners on ip:port (port 0 picks one port for
+    // all of them). Throws std::runtime_error if binding fails, and
+    // std::invalid_argument for bad routes (see ProxyServer).
+    ProxyPool(const std::string& ip, unsigned short port, std::vector<ProxyRoute> routes,
+              ProxyOptions options, unsigned shard_count, bool share_health = false) {
+        if (shard_count == 0) shard_count = 1;
+        std::shared_ptr<HealthTable> health;
+        for (unsigned i = 0; i < shard_count; ++i) {
+            listeners_.push_back(std::make_unique<TCPListener>(ip, port));
+            auto lfd = listeners_.back()->get_listener();
+            if (!lfd) throw std::runtime_error(lfd.error());
+            if (i == 0) {
+                sockaddr_in bound{};
+                socklen_t len = sizeof(bound);
+                if (::getsockname(*lfd, reinterpret_cast<sockaddr*>(&bound), &len) == 0) {
+                    port = ntohs(bound.sin_port);
+                }
+                port_ = port;
+            }
+            shards_.push_back(std::make_unique<ProxyServer>(*lfd, routes, options, health));
+            if (share_health && !health) health = shards_.back()->health_table();
+        }
+    }
+
+    // One shard per worker of `runtime`, on one listener at ip:port. The
+    // runtime must outlive the pool. Throws as above.
+    ProxyPool(Runtime& runtime, const std::string& ip, unsigned short port,
+              std::vector<ProxyRoute> routes, ProxyOptions options, bool share_health = false)
+    : runtime_(&runtime), hub_(std::make_shared<Hub>()) {
+        listeners_.push_back(std::make_unique<TCPListener>(ip, port));
+        auto lfd = listeners_.back()->get_listener();
+        if (!lfd) throw std::runtime_error(lfd.error());
+        sockaddr_in bound{};
+        socklen_t len = sizeof(bound);
+        if (::getsockname(*lfd, reinterpret_cast<sockaddr*>(&bound), &len) == 0) {
+            port = ntohs(bound.sin_port);
+        }
+        port_ = port;
+        std::shared_ptr<HealthTable> health;
+        for (unsigned i = 0; i < runtime.size(); ++i) {
+            shards_.push_back(std::make_unique<ProxyServer>(*lfd, routes, options, health));
+            if (share_health && !health) health = shards_.back()->health_table();
+            shards_.back()->dispatch_ = [rt = runtime_, hub = hub_](int fd) {
+                rt->spawn(claim(hub, Accepted(fd)));
+            };
+            hub_->shards.push_back({&runtime.loop(i), shards_.back().get()});
+        }
+    }
+
+    ~ProxyPool() { stop(); }
+
+    ProxyPool(const ProxyPool&) = delete;
+    ProxyPool& operator=(const ProxyPool&) = delete;
+
+    void start() {
+        if (started_.exchange(true)) return;
+        for (std::size_t i = 0; i < shards_.size(); ++i) {
+            if (runtime_) {
+                shards_[i]->start(*runtime_, static_cast<unsigned>(i));
+            } else {
+                shards_[i]->start();
+            }
+        }
+        MUSES_INFO(std::format("ProxyPool started: {} shards on port {}", shards_.size(), port_));
+    }
+
+    void stop() {
+        if (!started_.exchange(false)) return;
+        if (hub_) {
+            std::unique_lock lock(hub_->mu);  // waits out adoptions under way
+            hub_->open = false;
+        }
+        for (auto it = shards_.rbegin(); it != shards_.rend(); ++it) (*it)->stop();
+    }
+
+    std::size_t shard_count() const { return shards_.size(); }
+    unsigned short port() const { return port_; }
+    ProxyServer& shard(std::size_t i) { return *shards_[i]; }
+
+    // upstream_stats summed over the shards.
+    UpstreamStats upstream_stats(const std::string& host, unsigned short port) const {
+        UpstreamStats total;
+        for (const auto& shard : shards_) {
+            UpstreamStats s = shard->upstream_stats(host, port);
+            total.connects += s.connects;
+            total.connect_failures += s.connect_failures;
+            total.reused += s.reused;
+            total.stale_closed += s.stale_closed;
+            total.expired_closed += s.expired_closed;
+            total.overflow_closed += s.overflow_closed;
+            total.idle += s.idle;
+        }
+        return total;
+    }
+
+private:
+    // What a claim needs of the pool; it may still be queued on the runtime
+    // when the pool is gone, and then finds the hub closed.
+    struct Hub {
+        std::shared_mutex mu;  // held shared while a shard adopts
+        bool open = true;
+        std::vector<std::pair<EventLoop*, ProxyServer*>> shards;  // by worker
+    };
+
+    // An accepted connection on its way to a shard; closed if none takes it.
+    struct Accepted {
+        int fd;
+        explicit Accepted(int f) noexcept : fd(f) {}
+        Accepted(Accepted&& o) noexcept : fd(std::exchange(o.fd, -1)) {}
+        ~Accepted() {
+            if (fd >= 0) ::close(fd);
+        }
+    };
+
+    // Runs on whichever worker pops or steals it: serve `conn` there.
+    static Task<void> claim(std::shared_ptr<Hub> hub, Accepted conn) {
+        std::shared_lock lock(hub->mu);
+        if (!hub->open) co_return;
+        for (auto [loop, shard] : hub->shards) {
+            if (loop != EventLoop::current()) continue;
+            if (shard->running_.load(std::memory_order_acquire)) {
+                shard->adopt(std::exchange(conn.fd, -1));
+            }
+            break;
+        }
+    }
+
+    Runtime* runtime_ = nullptr;
+    std::shared_ptr<Hub> hub_;
+    // Listeners before shards: shards stop (and drop their fds from their
+    // pollers) before the listen sockets close.
+    std::vector<std::unique_ptr<TCPListener>> listeners_;
+    std::vector<std::unique_ptr<ProxyServer>> shards_;
+    unsigned short port_ = 0;
+    std::atomic<bool> started_{false};
+};
+
 }  // namespace muses
 
 #endif  // MUSES_NET_PROXY_HPP
@@ -0,0 +1,104 @@
+// MIT License
+
+// Copyright (c) 2023 nastyapple
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+
+#ifndef MUSES_NET_REQUEST_BUDGET_HPP
+#define MUSES_NET_REQUEST_BUDGET_HPP
+
+namespace muses {
+
+// Pays for extra requests (hedges, retries) out of the traffic they ride on,
+// after Finagle's RetryBudget. Every request deposits `ratio` of a token,
+// `per_second` tokens trickle in besides so a quiet route is not locked out,
+// and the balance is capped at `burst`. It starts at `reserve`, so the first
+// requests after a start are not left without. An extra request withdraws a
+// whole token or is not sent, so over any stretch longer than a burst the
+// extras stay within `ratio` of the requests. Single-threaded: one per route
+// per event loop.
+//
+//     budget.deposit();                  // every request
+//     if (budget.withdraw()) ... send the extra one ...
+class RequestBudget {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit RequestBudget(double ratio = 0.1, double per_second = 0.0, double burst = 10.0,
+                           double reserve = 0.0)
+    : ratio_(std::max(ratio, 0.0)),
+      per_second_(std::max(per_second, 0.0)),
+      burst_(std::max(burst, 1.0)),
+      balance_(std::clamp(reserve, 0.0, burst_)) {}
+
+    void deposit(Clock::time_point now = Clock::now()) {
+        refill(now);
+        balance_ = std::min(balance_ + ratio_, burst_);
+    }
+
+    // Whether withdraw() would succeed, without spending anything.
+    bool can_withdraw(Clock::time_point now = Clock::now()) {
+        refill(now);
+        return balance_ >= 1.0;
+    }
+
+    bool withdraw(Clock::time_point now = Clock::now()) {
+        if (!can_withdraw(now)) {
+            ++refused_;
+            return false;
+        }
+        balance_ -= 1.0;
+        ++spent_;
+        return true;
+    }
+
+    double balance() const noexcept { return balance_; }  // as of the last call
+    std::uint64_t spent() const noexcept { return spent_; }
+    std::uint64_t refused() const noexcept { return refused_; }
+
+private:
+    void refill(Clock::time_point now) {
+        if (per_second_ > 0.0 && last_ != Clock::time_point{} && now > last_) {
+            balance_ = std::min(
+                balance_ + per_second_ * std::chrono::duration<double>(now - last_).count(),
+                burst_);
+        }
+        if (now > last_) last_ = now;
+    }
+
+    double ratio_;
+    double per_second_;
+    double burst_;
+    double balance_;
+    Clock::time_point last_{};
+    std::uint64_t spent_ = 0;
+    std::uint64_t refused_ = 0;
+};
+
+}  // namespace muses
+
+#endif  // MUSES_NET_REQUEST_BUDGET_HPP
@@ -0,0 +1,445 @@
+// MIT License
+
+// Copyright (c) 2023 nastyapple
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <charconv>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+#include "muses/lru_cache.hpp"
+
+#ifndef MUSES_NET_RESPONSE_CACHE_HPP
+#define MUSES_NET_RESPONSE_CACHE_HPP
+
+namespace muses {
+
+// One cached upstream response. Immutable once stored and shared by
+// reference count: a hit hands out the same buffers to every client that is
+// still writing them, even after the entry is evicted or replaced.
+struct CachedResponse {
+    std::string head;  // status line and header lines (CRLF each), no blank line
+    std::string body;  // as framed on the wire (chunked stays chunked)
+    int status = 0;
+    std::chrono::steady_clock::time_point born;  // when its age was zero
+    std::chrono::seconds max_age{0};
+    std::chrono::seconds stale_while_revalidate{0};
+
+    std::size_t bytes() const noexcept { return head.size() + body.size(); }
+};
+
+// A shared HTTP response cache for a reverse proxy (RFC 9111, the parts a
+// shared cache in front of our own services needs):
+//
+//   - keyed by method + host + URL, plus the request's values for the
+//     response's Vary headers (a Vary-ing URL keeps one entry per variant);
+//   - stores only responses with an explicit s-maxage / max-age, and never
+//     ones marked no-store, no-cache, private, Vary: *, or with Set-Cookie;
+//   - requests with Authorization or no-store are neither served nor stored,
+//     and no-cache / max-age=0 requests skip the lookup but refresh the entry;
+//   - bounded by total bytes (LruCache with a byte charge);
+//   - stale-while-revalidate: within that window after max-age a stale hit
+//     is served, and exactly one caller is told to refresh it.
+//
+// Thread-safe: ProxyPool shards can share one cache.
+class ResponseCache {
+public:
+    using Clock = std::chrono::steady_clock;
+    using Headers = std::map<std::string, std::string>;  // as HttpInfo stores them
+
+    struct Options {
+        std::size_t max_bytes = 64 * 1024 * 1024;
+        std::size_t max_object_bytes = 1024 * 1024;  // larger responses are not stored
+        std::size_t max_entries = 100000;
+    };
+
+    struct Hit {
+        std::shared_ptr<const CachedResponse> response;
+        std::chrono::seconds age{0};
+        bool stale = false;       // past max-age, inside stale-while-revalidate
+        bool revalidate = false;  // this caller should refresh it (then store()
+                                  // or abandon_revalidation())
+    };
+
+    struct Stats {
+        std::uint64_t hits = 0;
+        std::uint64_t stale_hits = 0;
+        std::uint64_t misses = 0;
+        std::uint64_t stores = 0;
+        std::size_t bytes = 0;
+    };
+
+    ResponseCache() : ResponseCache(Options{}) {}
+    explicit ResponseCache(Options opts)
+    : opts_(opts),
+      entries_(opts.max_entries, opts.max_bytes),
+      vary_(opts.max_entries) {}
+
+    ResponseCache(const ResponseCache&) = delete;
+    ResponseCache& operator=(const ResponseCache&) = delete;
+
+    const Options& options() const noexcept { return opts_; }
+
+    // "GET example.com/path?q". The host is lowercased.
+    static std::string key(std::string_view method, std::string_view host, std::string_view url) {
+        std::string k;
+        k.reserve(method.size() + host.size() + url.size() + 1);
+        k.append(method);
+        k.push_back(' ');
+        for (char c : host) k.push_back(static_cast<char>(std::tolower(static_cast<unsigned char>(c))));
+        k.append(url);
+        return k;
+    }
+
+    // Whether a request may be answered from, or fill, the cache at all.
+    static bool cacheable_request(std::string_view method, const Headers& req) {
+        if (method != "GET" && method != "HEAD") return false;
+        if (!find(req, "Authorization").empty()) return false;
+        return !has_directive(find(req, "Cache-Control"), "no-store");
+    }
+
+    // Whether a request insists on a response from the origin (it may still
+    // refresh the cache).
+    static bool wants_fresh(const Headers& req) {
+        std::string_view cc = find(req, "Cache-Control");
+        if (has_directive(cc, "no-cache")) return true;
+        auto age = directive_seconds(cc, "max-age");
+        if (age && age->count() == 0) return true;
+        return find(req, "Pragma").find("no-cache") != std::string_view::npos;
+    }
+
+    std::optional<Hit> lookup(const std::string& key, const Headers& req,
+                              Clock::time_point now = Clock::now()) {
+        auto entry = entries_.get(variant_key(key, req));
+        if (!entry) {
+            misses_.fetch_add(1, std::memory_order_relaxed);
+            return std::nullopt;
+        }
+        const CachedResponse& r = **entry;
+        auto age = std::chrono::duration_cast<std::chrono::seconds>(now - r.born);
+        Hit hit{*entry, age};
+        if (age >= r.max_age) {
+            if (age >= r.max_age + r.stale_while_revalidate) {
+                misses_.fetch_add(1, std::memory_order_relaxed);
+                return std::nullopt;  // too stale; the refetch will replace it
+            }
+            hit.stale = true;
+            std::lock_guard<std::mutex> lock(revalidating_mu_);
+            hit.revalidate = revalidating_.insert(key).second;
+            stale_hits_.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            hits_.fetch_add(1, std::memory_order_relaxed);
+        }
+        return hit;
+    }
+
+    // The immutable copy of an upstream response that store() keeps and
+    // request coalescing hands to every waiter. `head` is the upstream's head
+    // (with or without the blank line); hop-by-hop headers and Age are
+    // dropped. Freshness fields are zero for a response that is not storable.
+    static std::shared_ptr<const CachedResponse> freeze(std::string_view head, std::string body,
+                                                        Clock::time_point now = Clock::now()) {
+        auto r = std::make_shared<CachedResponse>();
+        r->head = strip_head(head);
+        r->body = std::move(body);
+        r->status = status_of(head);
+        if (auto p = policy(head)) {
+            r->max_age = p->max_age;
+            r->stale_while_revalidate = p->stale_while_revalidate;
+        }
+        std::int64_t upstream_age = 0;
+        std::string_view age_header = header(head, "Age");
+        std::from_chars(age_header.data(), age_header.data() + age_header.size(), upstream_age);
+        r->born = now - std::chrono::seconds(std::max<std::int64_t>(upstream_age, 0));
+        return r;
+    }
+
+    // Store the response to the request `req` for `key`, if its status and
+    // headers allow. Ends a revalidation of `key` either way.
+    bool store(const std::string& key, const Headers& req, std::string_view head,
+               std::string body, Clock::time_point now = Clock::now()) {
+        return store(key, req, freeze(head, std::move(body), now));
+    }
+
+    bool store(const std::string& key, const Headers& req,
+               std::shared_ptr<const CachedResponse> r) {
+        abandon_revalidation(key);
+        auto p = policy(r->head);
+        if (!p || r->bytes() > opts_.max_object_bytes) return false;
+        std::vector<std::string> vary = std::move(p->vary);
+
+        if (vary.empty()) {
+            vary_.erase(key);
+        } else {
+            vary_.put(key, vary);
+        }
+        std::size_t charge = r->bytes() + key.size();
+        entries_.put(variant_key(key, req, vary), std::move(r), charge);
+        stores_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // Whether store() would keep a response with this head (size aside).
+    // Lets a caller skip copying bodies it could not store anyway.
+    static bool storable(std::string_view head) { return policy(head).has_value(); }
+
+    // Whether a response with this head may go to clients other than the one
+    // that asked for it while it is in flight (request coalescing): nothing
+    // per-user in it, freshness lifetime or not.
+    static bool shareable(std::string_view head) {
+        std::string_view cc = header(head, "Cache-Control");
+        if (has_directive(cc, "no-store") || has_directive(cc, "private") ||
+            !header(head, "Set-Cookie").empty()) {
+            return false;
+        }
+        for (std::string_view name : split_list(header(head, "Vary"))) {
+            if (name == "*") return false;
+        }
+        return true;
+    }
+
+    // Whether requests `a` and `b` select the same variant of a response
+    // with this head: equal values for every header its Vary names.
+    static bool same_variant(std::string_view head, const Headers& a, const Headers& b) {
+        for (std::string_view name : split_list(header(head, "Vary"))) {
+            if (name == "*" || find(a, name) != find(b, name)) return false;
+        }
+        return true;
+    }
+
+    // A revalidation handed out by lookup() failed; let the next stale hit try.
+    void abandon_revalidation(const std::string& key) {
+        std::lock_guard<std::mutex> lock(revalidating_mu_);
+        revalidating_.erase(key);
+    }
+
+    // Drop what is cached for host+url (after a successful unsafe request to
+    // it, RFC 9111 §4.4). Variants become unreachable and age out of the LRU.
+    void invalidate(std::string_view host, std::string_view url) {
+        for (std::string_view method : {"GET", "HEAD"}) {
+            std::string k = key(method, host, url);
+            entries_.erase(k);
+            vary_.erase(k);
+        }
+    }
+
+    Stats stats() const {
+        return Stats{hits_.load(std::memory_order_relaxed),
+                     stale_hits_.load(std::memory_order_relaxed),
+                     misses_.load(std::memory_order_relaxed),
+                     stores_.load(std::memory_order_relaxed),
+                     entries_.charge()};
+    }
+
+    // Header value in a response head, case-insensitively; "" if absent.
+    static std::string_view header(std::string_view head, std::string_view name) {
+        std::size_t pos = head.find("\r\n");
+        while (pos != std::string_view::npos && pos + 2 < head.size()) {
+            std::size_t start = pos + 2;
+            std::size_t end = head.find("\r\n", start);
+            std::string_view line = head.substr(start, end == std::string_view::npos
+                                                           ? std::string_view::npos
+                                                           : end - start);
+            std::size_t colon = line.find(':');
+            if (colon != std::string_view::npos && iequals(line.substr(0, colon), name)) {
+                return trim(line.substr(colon + 1));
+            }
+            pos = end;
+        }
+        return {};
+    }
+
+private:
+    struct Policy {
+        std::chrono::seconds max_age;
+        std::chrono::seconds stale_while_revalidate;
+        std::vector<std::string> vary;  // lowercase header names
+    };
+
+    static std::optional<Policy> policy(std::string_view head) {
+        if (!cacheable_status(status_of(head))) return std::nullopt;
+        std::string_view cc = header(head, "Cache-Control");
+        if (has_directive(cc, "no-store") || has_directive(cc, "no-cache") ||
+            has_directive(cc, "private") || !header(head, "Set-Cookie").empty()) {
+            return std::nullopt;
+        }
+        auto max_age = directive_seconds(cc, "s-maxage");
+        if (!max_age) max_age = directive_seconds(cc, "max-age");
+        if (!max_age || max_age->count() == 0) return std::nullopt;
+        Policy p{*max_age,
+                 directive_seconds(cc, "stale-while-revalidate").value_or(std::chrono::seconds(0)),
+                 {}};
+        for (std::string_view name : split_list(header(head, "Vary"))) {
+            if (name == "*") return std::nullopt;
+            p.vary.push_back(lower(name));
+        }
+        return p;
+    }
+
+    static bool cacheable_status(int status) {
+        switch (status) {
+        case 200: case 203: case 204: case 300: case 301: case 308:
+        case 404: case 405: case 410: case 414: case 501:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    static int status_of(std::string_view head) {
+        std::size_t sp = head.find(' ');
+        if (sp == std::string_view::npos) return 0;
+        int code = 0;
+        std::from_chars(head.data() + sp + 1, head.data() + std::min(head.size(), sp + 4), code);
+        return code;
+    }
+
+    // The head as stored: no hop-by-hop headers, no Age (recomputed per hit),
+    // no trailing blank line.
+    static std::string strip_head(std::string_view head) {
+        std::string out;
+        out.reserve(head.size());
+        std::size_t start = 0;
+        bool first = true;
+        while (start < head.size()) {
+            std::size_t end = head.find("\r\n", start);
+            if (end == std::string_view::npos) end = head.size();
+            std::string_view line = head.substr(start, end - start);
+            start = end + 2;
+            if (line.empty()) break;
+            if (!first) {
+                std::string_view name = line.substr(0, line.find(':'));
+                if (iequals(name, "Connection") || iequals(name, "Keep-Alive") ||
+                    iequals(name, "Proxy-Connection") || iequals(name, "Age")) {
+                    continue;
+                }
+            }
+            first = false;
+            out.append(line);
+            out.append("\r\n");
+        }
+        return out;
+    }
+
+    std::string variant_key(const std::string& key, const Headers& req) {
+        auto names = vary_.get(key);
+        return names ? variant_key(key, req, *names) : key;
+    }
+
+    static std::string variant_key(const std::string& key, const Headers& req,
+                                   const std::vector<std::string>& names) {
+        if (names.empty()) return key;
+        std::string k = key;
+        for (const auto& n : names) {
+            k.push_back('\n');
+            k.append(n);
+            k.push_back('=');
+            k.append(find(req, n));
+        }
+        return k;
+    }
+
+    static std::string_view find(const Headers& h, std::string_view name) {
+        for (const auto& [k, v] : h) {
+            if (iequals(k, name)) return v;
+        }
+        return {};
+    }
+
+    // Comma-separated list items, trimmed.
+    static std::vector<std::string_view> split_list(std::string_view v) {
+        std::vector<std::string_view> out;
+        while (!v.empty()) {
+            std::size_t comma = v.find(',');
+            std::string_view item = trim(v.substr(0, comma));
+            if (!item.empty()) out.push_back(item);
+            if (comma == std::string_view::npos) break;
+            v.remove_prefix(comma + 1);
+        }
+        return out;
+    }
+
+    static bool has_directive(std::string_view cc, std::string_view name) {
+        for (std::string_view d : split_list(cc)) {
+            if (iequals(d.substr(0, d.find('=')), name)) return true;
+        }
+        return false;
+    }
+
+    static std::optional<std::chrono::seconds> directive_seconds(std::string_view cc,
+                                                                 std::string_view name) {
+        for (std::string_view d : split_list(cc)) {
+            std::size_t eq = d.find('=');
+            if (eq == std::string_view::npos || !iequals(trim(d.substr(0, eq)), name)) continue;
+            std::string_view v = trim(d.substr(eq + 1));
+            if (!v.empty() && v.front() == '"' && v.size() >= 2) v = v.substr(1, v.size() - 2);
+            std::int64_t secs = 0;
+            auto [p, ec] = std::from_chars(v.data(), v.data() + v.size(), secs);
+            if (ec != std::errc() || secs < 0) return std::nullopt;
+            return std::chrono::seconds(secs);
+        }
+        return std::nullopt;
+    }
+
+    static std::string_view trim(std::string_view v) {
+        while (!v.empty() && (v.front() == ' ' || v.front() == '\t')) v.remove_prefix(1);
+        while (!v.empty() && (v.back() == ' ' || v.back() == '\t')) v.remove_suffix(1);
+        return v;
+    }
+
+    static std::string lower(std::string_view v) {
+        std::string out(v);
+        for (char& c : out) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        return out;
+    }
+
+    static bool iequals(std::string_view a, std::string_view b) {
+        return std::equal(a.begin(), a.end(), b.begin(), b.end(), [](char x, char y) {
+            return std::tolower(static_cast<unsigned char>(x)) ==
+                   std::tolower(static_cast<unsigned char>(y));
+        });
+    }
+
+    Options opts_;
+    LruCache<std::string, std::shared_ptr<const CachedResponse>> entries_;  // charged in bytes
+    LruCache<std::string, std::vector<std::string>> vary_;  // base key → Vary header names
+    std::mutex revalidating_mu_;
+    std::unordered_set<std::string> revalidating_;
+    std::atomic<std::uint64_t> hits_{0}, stale_hits_{0}, misses_{0}, stores_{0};
+};
+
+}  // namespace muses
+
+#endif  // MUSES_NET_RESPONSE_CACHE_HPP
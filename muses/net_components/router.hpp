@@ -0,0 +1,257 @@
+// MIT License
+
+// Copyright (c) 2023 nastyapple
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#ifndef MUSES_NET_ROUTER_HPP
+#define MUSES_NET_ROUTER_HPP
+
+namespace muses {
+
+// Longest-prefix route table over (Host, path, method), compiled once into
+// compressed radix trees — one per virtual host plus one for routes that
+// accept any host. Immutable after construction, so any number of threads
+// may call match() concurrently without locking.
+//
+//     RadixRouter<int> r({{"", "/api/", {}, 1},
+//                         {"", "/api/admin", {"GET"}, 2},
+//                         {"static.example", "/", {}, 3}});
+//     r.match("x", "/api/admin/users", "GET");   // → 2 (longest prefix)
+//     r.match("x", "/api/admin/users", "POST");  // → 1 (2 is GET-only)
+//     r.match("static.example:80", "/a", "GET"); // → 3 (host tree first)
+//
+// Prefixes are plain byte prefixes ("/api" also matches "/apis"). A lookup
+// tries the request's host tree, then the any-host tree; within a tree the
+// longest prefix whose method set admits the request wins, and among routes
+// with the same prefix the first declared. Host names compare
+// case-insensitively, ignoring a ":port" suffix.
+template <typename V>
+class RadixRouter {
+public:
+    struct Route {
+        std::string host;                  // virtual host; empty = any
+        std::string prefix;                // path prefix
+        std::vector<std::string> methods;  // allowed methods; empty = any
+        V value;
+    };
+
+    RadixRouter() = default;
+
+    // Throws std::invalid_argument for a method that isn't a standard HTTP
+    // method token.
+    explicit RadixRouter(std::vector<Route> routes) {
+        for (auto& r : routes) {
+            std::uint32_t mask = kAnyMethod;
+            if (!r.methods.empty()) {
+                mask = 0;
+                for (const auto& m : r.methods) {
+                    std::uint32_t bit = method_bit(m);
+                    if (bit == kUnknownMethod) {
+                        throw std::invalid_argument("RadixRouter: unknown method " + m);
+                    }
+                    mask |= bit;
+                }
+            }
+            std::string host(strip_port(r.host));
+            for (char& c : host) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+            Tree& tree = host.empty() ? any_host_ : hosts_[host];
+            tree.insert(r.prefix, static_cast<std::uint32_t>(entries_.size()));
+            entries_.push_back(Entry{mask, std::move(r.value)});
+        }
+    }
+
+    // The best route's value, or nullptr if none matches.
+    const V* match(std::string_view host, std::string_view path,
+                   std::string_view method) const {
+        std::uint32_t bit = method_bit(method);
+        if (bit == kUnknownMethod) bit = kOtherMethod;
+        host = strip_port(host);
+        if (!hosts_.empty() && host.size() <= kMaxHost) {
+            char buf[kMaxHost];
+            for (std::size_t i = 0; i < host.size(); ++i) {
+                buf[i] = static_cast<char>(std::tolower(static_cast<unsigned char>(host[i])));
+            }
+            if (auto it = hosts_.find(std::string_view(buf, host.size())); it != hosts_.end()) {
+                if (const Entry* e = it->second.longest(path, bit, entries_)) return &e->value;
+            }
+        }
+        if (const Entry* e = any_host_.longest(path, bit, entries_)) return &e->value;
+        return nullptr;
+    }
+
+    std::size_t size() const noexcept { return entries_.size(); }
+    bool empty() const noexcept { return entries_.empty(); }
+
+    // Radix nodes across all trees (compression keeps this near the route
+    // count, independent of prefix length).
+    std::size_t node_count() const noexcept {
+        std::size_t n = any_host_.nodes.size();
+        for (const auto& [h, t] : hosts_) n += t.nodes.size();
+        return n;
+    }
+
+private:
+    static constexpr std::uint32_t kAnyMethod = 0xFFFFFFFFu;
+    static constexpr std::uint32_t kUnknownMethod = 0;
+    // A request with a non-standard method gets a bit no constrained route
+    // has, so only unconstrained routes admit it.
+    static constexpr std::uint32_t kOtherMethod = std::uint32_t{1} << 31;
+    static constexpr std::size_t kMaxHost = 255;  // DNS name limit
+
+    static std::uint32_t method_bit(std::string_view m) noexcept {
+        static constexpr std::string_view kMethods[] = {
+            "GET", "HEAD", "POST", "PUT", "DELETE", "CONNECT", "OPTIONS", "TRACE", "PATCH"};
+        for (std::size_t i = 0; i < std::size(kMethods); ++i) {
+            if (m == kMethods[i]) return std::uint32_t{1} << i;
+        }
+        return kUnknownMethod;
+    }
+
+    struct Entry {
+        std::uint32_t methods;
+        V value;
+    };
+
+    // Nodes live in one vector and refer to each other by index. Each node's
+    // `label` is the edge from its parent; `first` holds the first byte of
+    // every child's label, parallel to `children`, so picking the next edge
+    // is one scan of a short string.
+    struct Node {
+        std::string label;
+        std::string first;
+        std::vector<std::uint32_t> children;
+        std::vector<std::uint32_t> entries;  // routes ending here, declaration order
+    };
+
+    struct Tree {
+        std::vector<Node> nodes{Node{}};  // nodes[0]: root, empty label
+
+        void insert(std::string_view key, std::uint32_t entry) {
+            std::uint32_t at = 0;
+            for (;;) {
+                if (key.empty()) {
+                    nodes[at].entries.push_back(entry);
+                    return;
+                }
+                std::size_t slot = nodes[at].first.find(key.front());
+                if (slot == std::string::npos) {
+                    std::uint32_t leaf = add(Node{std::string(key), {}, {}, {entry}});
+                    link(at, leaf);
+                    return;
+                }
+                std::uint32_t child = nodes[at].children[slot];
+                const std::string& label = nodes[child].label;
+                std::size_t common = 0;
+                while (common < label.size() && common < key.size() &&
+                       label[common] == key[common]) {
+                    ++common;
+                }
+                if (common < label.size()) {
+                    // Split the edge: at → mid(label[0, common)) → child(rest).
+                    std::uint32_t mid = add(Node{label.substr(0, common), {}, {}, {}});
+                    nodes[child].label.erase(0, common);
+                    nodes[at].children[slot] = mid;
+                    link(mid, child);
+                    child = mid;
+                }
+                key.remove_prefix(common);
+                at = child;
+            }
+        }
+
+        // Deepest node on `path`'s walk with an entry admitting `method`.
+        const Entry* longest(std::string_view path, std::uint32_t method,
+                             const std::vector<Entry>& all) const {
+            const Entry* best = nullptr;
+            std::uint32_t at = 0;
+            for (;;) {
+                for (std::uint32_t e : nodes[at].entries) {
+                    if (all[e].methods & method) {
+                        best = &all[e];
+                        break;
+                    }
+                }
+                if (path.empty()) return best;
+                std::size_t slot = nodes[at].first.find(path.front());
+                if (slot == std::string::npos) return best;
+                std::uint32_t child = nodes[at].children[slot];
+                const std::string& label = nodes[child].label;
+                if (path.size() < label.size() ||
+                    path.compare(0, label.size(), label) != 0) {
+                    return best;
+                }
+                path.remove_prefix(label.size());
+                at = child;
+            }
+        }
+
+    private:
+        std::uint32_t add(Node n) {
+            nodes.push_back(std::move(n));
+            return static_cast<std::uint32_t>(nodes.size() - 1);
+        }
+        void link(std::uint32_t parent, std::uint32_t child) {
+            nodes[parent].first.push_back(nodes[child].label.front());
+            nodes[parent].children.push_back(child);
+        }
+    };
+
+    // "Example.com:8080" → "Example.com"; "[::1]:80" → "[::1]".
+    static std::string_view strip_port(std::string_view host) noexcept {
+        auto colon = host.rfind(':');
+        if (colon == std::string_view::npos) return host;
+        if (host.front() == '[' && host.find(']', colon) != std::string_view::npos) return host;
+        if (host.front() != '[' && host.find(':') != colon) return host;  // bare IPv6
+        return host.substr(0, colon);
+    }
+
+    // Heterogeneous lookup: match() probes with a string_view into a stack
+    // buffer instead of building a std::string per request.
+    struct HostHash {
+        using is_transparent = void;
+        std::size_t operator()(std::string_view s) const noexcept {
+            return std::hash<std::string_view>{}(s);
+        }
+    };
+
+    std::vector<Entry> entries_;
+    Tree any_host_;
+    std::unordered_map<std::string, Tree, HostHash, std::equal_to<>> hosts_;
+};
+
+}  // namespace muses
+
+#endif  // MUSES_NET_ROUTER_HPP
@@ -27,9 +27,12 @@
 #include <cstdint>
 #include <exception>
 #include <optional>
+#include <span>
 #include <utility>
 #include <variant>
 
+#include "muses/config.hpp"
+#include "muses/frame_pool.hpp"
 #include "muses/net/poller.hpp"
 
 #ifndef MUSES_TASK_HPP
@@ -50,14 +53,51 @@ namespace muses {
 //     prevents the event loop from resuming a destroyed handle.
 //   - The Poller's per-fd `userdata` slot carries the coroutine_handle to
 //     resume on readiness. IoAwaiter::await_suspend stores the handle there.
-//   - Single-threaded: coroutines are created and resumed only on the event
-//     loop thread. No cross-thread handle.resume().
+//   - Single-threaded by default: coroutines are created and resumed on the
+//     event loop thread. The only sanctioned cross-thread hop is the explicit
+//     ThreadPool::schedule() / EventLoop::resume_here() pair (event_loop.hpp),
+//     which hands the handle over through a queue rather than resuming it
+//     from an arbitrary thread.
 //   - Task is move-only; the moved-from Task is inert (nullptr handle).
+//   - Frames come from the thread-local FramePool (promise operator new /
+//     sized operator delete) unless MUSES_TASK_FRAME_POOL is 0.
 
 template <typename T = void>
 class Task;
 
 namespace detail {
+// Base for promise types: routes coroutine frame allocation through FramePool.
+struct PooledFrame {
+#if MUSES_TASK_FRAME_POOL
+    static void* operator new(std::size_t bytes) { return FramePool::allocate(bytes); }
+    static void operator delete(void* p, std::size_t bytes) noexcept {
+        FramePool::deallocate(p, bytes);
+    }
+#endif
+};
+
+// The batch of poller events an event loop is dispatching on this thread, and
+// the index of the next one. Resuming one coroutine can destroy another (a
+// when_any loser, a with_timeout child) whose readiness is still queued later
+// in the same batch; its IoAwaiter uses this to void those entries (fd = -1)
+// so the loop never resumes the dead frame. Null outside dispatch.
+struct DispatchBatch {
+    std::span<PollEvent> events;
+    std::size_t next = 0;
+};
+
+inline DispatchBatch*& current_dispatch() noexcept {
+    thread_local DispatchBatch* batch = nullptr;
+    return batch;
+}
+
+// Poller of the event loop bound to this thread (EventLoop::CurrentScope sets
+// it), used by IoAwaiter's poller-less constructor.
+inline Poller*& current_poller() noexcept {
+    thread_local Poller* poller = nullptr;
+    return poller;
+}
+
 // final_suspend object: if a continuation (the awaiting coroutine's handle) was
 // registered, resume it when this coroutine finishes. Otherwise just suspend
 // (the owning Task will destroy the frame).
@@ -75,7 +115,7 @@ struct FinalAwaiter {
 template <typename T>
 class Task {
 public:
-    class promise_type {
+    class promise_type : public detail::PooledFrame {
     public:
         Task get_return_object() {
             return Task{std::coroutine_handle<promise_type>::from_promise(*this)};
@@ -97,6 +137,9 @@ public:
         bool has_result() const noexcept {
             return result_.index() != 0;
         }
+        void rethrow_if_exception() const {
+            if (result_.index() == 2) std::rethrow_exception(std::get<2>(result_));
+        }
         T& value() { return std::get<1>(result_); }
         const T& value() const { return std::get<1>(result_); }
 
@@ -161,6 +204,8 @@ public:
     }
     T await_resume() {
         // The inner task has completed (final_suspend ran, transferring back).
+        // An exception it threw propagates to the awaiter.
+        handle_.promise().rethrow_if_exception();
         return std::move(handle_.promise().value());
     }
 
@@ -172,7 +217,7 @@ private:
 template <>
 class Task<void> {
 public:
-    class promise_type {
+    class promise_type : public detail::PooledFrame {
     public:
         Task get_return_object() {
             return Task{std::coroutine_handle<promise_type>::from_promise(*this)};
@@ -181,6 +226,9 @@ public:
         detail::FinalAwaiter final_suspend() noexcept { return {continuation_}; }
         void return_void() noexcept {}
         void unhandled_exception() { ep_ = std::current_exception(); }
+        void rethrow_if_exception() const {
+            if (ep_) std::rethrow_exception(ep_);
+        }
         std::exception_ptr ep_;
         std::coroutine_handle<> continuation_;
     };
@@ -227,7 +275,9 @@ public:
         handle_.promise().continuation_ = caller;
         return handle_;
     }
-    void await_resume() noexcept {}
+    void await_resume() {
+        if (handle_) handle_.promise().rethrow_if_exception();
+    }
 
 private:
     std::coroutine_handle<promise_type> handle_;
@@ -240,10 +290,33 @@ private:
 //
 // Usage:  co_await IoAwaiter{poller, fd, EventMask::Readable};
 // The Poller must be the one driven by the event loop that owns this coroutine.
+// IoAwaiter{fd, mask} instead registers on the poller of whichever event loop
+// is running the coroutine when it suspends, so the same code works on any
+// EventLoop or Runtime worker (runtime.hpp).
+//
+// If the coroutine is destroyed while suspended here (e.g. with_timeout gave
+// up on it), the destructor removes the registration so the loop never
+// resumes a dead frame and the fd can be closed or re-registered.
 class IoAwaiter {
 public:
     IoAwaiter(Poller* poller, int fd, EventMask mask) noexcept
     : poller_(poller), fd_(fd), mask_(mask), result_(false) {}
+    IoAwaiter(int fd, EventMask mask) noexcept
+    : poller_(nullptr), fd_(fd), mask_(mask), result_(false) {}
+
+    IoAwaiter(const IoAwaiter&) = delete;
+    IoAwaiter& operator=(const IoAwaiter&) = delete;
+
+    ~IoAwaiter() {
+        if (!armed_) return;
+        poller_->del(fd_);
+        if (auto* batch = detail::current_dispatch()) {
+            for (std::size_t i = batch->next; i < batch->events.size(); ++i) {
+                PollEvent& ev = batch->events[i];
+                if (ev.fd == fd_ && ev.userdata == handle_.address()) ev.fd = -1;
+            }
+        }
+    }
 
     // Ready only if there's nothing to wait on (degenerate); otherwise suspend.
     bool await_ready() const noexcept { return false; }
@@ -254,12 +327,17 @@ public:
         // Store the handle so the event loop can find it. We register it as the
         // fd's userdata; the loop extracts it on readiness.
         handle_ = h;
-        poller_->add(fd_, mask_, h.address());
+        if (poller_ == nullptr) poller_ = detail::current_poller();
+        MUSES_ASSERT(poller_ != nullptr, "IoAwaiter: no event loop on this thread");
+        armed_ = poller_->add(fd_, mask_, h.address());
     }
 
     // Called when resumed. Returns true if the fd is still usable (the caller
     // should re-check via read/write which may still EAGAIN under ET).
-    bool await_resume() noexcept { return result_; }
+    bool await_resume() noexcept {
+        armed_ = false;
+        return result_;
+    }
 
     // Set by the event loop before resuming (e.g. false if the fd was closed).
     void set_result(bool ok) noexcept { result_ = ok; }
@@ -272,6 +350,7 @@ private:
     int fd_;
     EventMask mask_;
     bool result_;
+    bool armed_ = false;
     std::coroutine_handle<> handle_;
 };
 
@@ -25,42 +25,100 @@
 #ifndef MUSES_THREAD_POOL_HPP
 #define MUSES_THREAD_POOL_HPP
 
+#include <array>
 #include <vector>
-#include <queue>
+#include <deque>
 #include <thread>
 #include <functional>
 #include <mutex>
+#include <chrono>
 #include <condition_variable>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
 #include <future>
 #include <memory>
 #include <stdexcept>
 #include <type_traits>
 #include <atomic>
 
+#include "muses/bounded_queue.hpp"
+
 namespace muses {
 
+// Scheduling class of a pool task. Lower value = more latency-sensitive.
+enum class TaskPriority : std::uint8_t {
+    High,        // cheap, latency-sensitive (health checks, cached assets)
+    Normal,      // the default for enqueue() without a priority
+    Background,  // bulk / maintenance work that may wait
+};
+
+// How workers choose between non-empty priority lanes.
+enum class LaneScheduling {
+    Strict,    // always drain the highest non-empty lane first
+    Weighted,  // smooth weighted round-robin by per-lane weight
+};
+
 // A fixed-size pool of worker threads draining a task queue.
 //
 // Tasks are submitted via enqueue() and return a std::future of the result.
 // On shutdown (destruction or stop()) in-flight queued tasks are still
 // executed; new enqueue() calls after stop() return an invalid future instead
 // of throwing, so callers polling the future can detect rejection.
+//
+// Priority lanes: enqueue(TaskPriority, f, args...) puts a task on one of
+// three FIFO lanes (plain enqueue() uses Normal, so a pool that never passes
+// a priority behaves as a single FIFO). Workers pick a lane per
+// configure_lanes(): Strict, or Weighted (default weights 8:4:1 — under
+// contention High gets ~8/13 of the dispatches). Either way a head task that
+// has waited longer than the aging threshold moves up one lane, so Background
+// work cannot starve behind a steady stream of High tasks. Each lane promotes
+// at most one task per threshold, so a sustained backlog (every head old)
+// does not flatten the lanes into one FIFO.
+//
+// The queue is unbounded by default. With a non-zero queue_capacity the pool
+// pushes back on producers once that many tasks are waiting (across all
+// lanes), according to the OverflowPolicy (shared with BoundedQueue):
+//   - DropNew    → the new task is rejected; enqueue() returns an invalid future.
+//   - DropOldest → the oldest task of the least important non-empty lane is
+//                  discarded (its future reports
+//                  std::future_errc::broken_promise) and the new one queued.
+//   - Block      → enqueue() blocks until a worker frees a slot (or stop()).
+//   - CallerRuns → the task runs inline on the submitting thread, throttling
+//                  the producer to the pool's pace; the future is ready on
+//                  return.
+// Dropped tasks are destroyed without running, so a callable that must always
+// answer someone (e.g. a reactor request) can do so from its destructor.
+//
+// Coroutines: `co_await pool.schedule()` resumes the awaiting coroutine on a
+// worker thread (see EventLoop::resume_here for the way back). A resumption is
+// never evicted by DropOldest — dropping it would leak the suspended frame.
+// Nor does it wait for room: if the pool is stopped or its queue is full,
+// whatever the OverflowPolicy, the coroutine simply continues on the current
+// thread, so an event loop awaiting schedule() never blocks.
 class ThreadPool {
 public:
-    explicit ThreadPool(unsigned int num_threads) : stop(false) {
+    static constexpr std::size_t kLaneCount = 3;
+
+    explicit ThreadPool(unsigned int num_threads,
+                        std::size_t queue_capacity = 0,
+                        OverflowPolicy policy = OverflowPolicy::Block)
+    : capacity_(queue_capacity), policy_(policy), stop(false) {
+        configure_lanes(LaneScheduling::Weighted);
         for (unsigned int i = 0; i < num_threads; i++) {
             workers.emplace_back([this]() -> void {
                 while (true) {
                     std::function<void()> task;
                     {
                         std::unique_lock<std::mutex> lock(this->queue_mutex);
-                        this->condition.wait(lock, [this]{return this->stop.load() || !this->tasks.empty();});
-                        if (this->stop.load() && this->tasks.empty()) {
+                        this->condition.wait(lock, [this]{return this->stop.load() || this->queued != 0;});
+                        if (this->stop.load() && this->queued == 0) {
                             return;
                         }
-                        task = std::move(this->tasks.front());
-                        this->tasks.pop();
+                        task = this->take_next_locked();
                     }
+                    // A slot just opened up for a Block-policy producer.
+                    this->not_full_condition.notify_one();
                     task();
                     {
                         std::unique_lock<std::mutex> lock(this->queue_mutex);
@@ -75,24 +133,70 @@ public:
     ThreadPool(const ThreadPool&) = delete;
     ThreadPool& operator=(const ThreadPool&) = delete;
 
-    // Submit a callable. Returns an invalid future if the pool has been
-    // stopped (caller checks future.valid()).
+    // Submit a callable on the Normal lane. Returns an invalid future if the
+    // pool has been stopped or the task was rejected by a full DropNew queue
+    // (caller checks future.valid()).
     template <class F, class... Args>
     auto enqueue(F&& f, Args&&... args) -> std::future<typename std::invoke_result_t<F, Args...>> {
+        return enqueue(TaskPriority::Normal, std::forward<F>(f), std::forward<Args>(args)...);
+    }
+
+    // Submit a callable on the given priority lane.
+    template <class F, class... Args>
+    auto enqueue(TaskPriority priority, F&& f, Args&&... args)
+        -> std::future<typename std::invoke_result_t<F, Args...>> {
         using return_type = typename std::invoke_result_t<F, Args...>;
         auto task = std::make_shared<std::packaged_task<return_type()>>(
             std::bind(std::forward<F>(f), std::forward<Args>(args)...));
         std::future<return_type> res = task->get_future();
-        {
-            std::unique_lock<std::mutex> lock(queue_mutex);
-            if (stop.load()) {
-                return std::future<return_type>{};  // invalid → caller detects rejection
-            }
-            tasks.emplace([task]() { (*task)(); });
-            ++outstanding;
+        std::function<void()> fn = [task]() { (*task)(); };
+        switch (admit(fn, priority)) {
+            case Admission::Queued:
+                return res;
+            case Admission::CallerRuns:
+                fn();
+                return res;
+            case Admission::Rejected:
+                break;
         }
-        condition.notify_one();
-        return res;
+        return std::future<return_type>{};  // invalid → caller detects rejection
+    }
+
+    // Awaitable returned by schedule().
+    class ScheduleAwaiter {
+    public:
+        ScheduleAwaiter(ThreadPool* pool, TaskPriority priority) noexcept
+        : pool_(pool), priority_(priority) {}
+        bool await_ready() const noexcept { return false; }
+        // Returning false resumes the caller inline (the pool refused the hop).
+        bool await_suspend(std::coroutine_handle<> h) {
+            return pool_->try_admit_resumption(h, priority_);
+        }
+        void await_resume() const noexcept {}
+
+    private:
+        ThreadPool* pool_;
+        TaskPriority priority_;
+    };
+
+    // `co_await pool.schedule()` continues the coroutine on a worker thread.
+    ScheduleAwaiter schedule(TaskPriority priority = TaskPriority::Normal) noexcept {
+        return ScheduleAwaiter{this, priority};
+    }
+
+    // Choose the lane scheduling mode, per-lane weights (indexed by
+    // TaskPriority; only used by Weighted, 0 is treated as 1) and the aging
+    // threshold (0 disables aging). Safe to call while the pool is running.
+    void configure_lanes(LaneScheduling mode,
+                         std::array<unsigned, kLaneCount> weights = {8, 4, 1},
+                         std::chrono::milliseconds aging = std::chrono::milliseconds(100)) {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        scheduling_ = mode;
+        for (std::size_t i = 0; i < kLaneCount; ++i) {
+            lanes_[i].weight = weights[i] == 0 ? 1 : weights[i];
+            lanes_[i].credit = 0;
+        }
+        aging_ = aging;
     }
 
     // Block until the queue is drained. Mainly for tests.
@@ -107,9 +211,31 @@ public:
             stop.store(true);
         }
         condition.notify_all();
+        not_full_condition.notify_all();
         drained_condition.notify_all();
     }
 
+    // Tasks currently waiting for a worker (not counting running ones).
+    std::size_t size() const {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        return queued;
+    }
+
+    // Tasks waiting on one lane.
+    std::size_t size(TaskPriority priority) const {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        return lanes_[static_cast<std::size_t>(priority)].tasks.size();
+    }
+
+    // 0 = unbounded.
+    std::size_t capacity() const { return capacity_; }
+    OverflowPolicy policy() const { return policy_; }
+
+    // Tasks rejected (DropNew) or evicted (DropOldest) by the overflow policy.
+    std::size_t dropped() const {
+        return dropped_.load(std::memory_order_relaxed);
+    }
+
     ~ThreadPool() {
         stop_pool();
         for (std::thread& worker : workers) {
@@ -120,12 +246,162 @@ public:
     }
 
 private:
+    enum class Admission { Queued, Rejected, CallerRuns };
+
+    struct QueuedTask {
+        std::function<void()> fn;
+        std::chrono::steady_clock::time_point enqueued_at;
+        bool evictable;  // false for coroutine resumptions (schedule())
+    };
+
+    struct Lane {
+        std::deque<QueuedTask> tasks;
+        unsigned weight = 1;
+        long credit = 0;  // smooth weighted round-robin state
+        std::chrono::steady_clock::time_point last_promotion{};  // aging
+    };
+
+    // Apply the overflow policy and, if admitted, move `fn` onto its lane.
+    // An evicted task is destroyed after the lock is released so its
+    // destructor may safely re-enter the pool or wake another thread.
+    Admission admit(std::function<void()>& fn, TaskPriority priority) {
+        std::function<void()> evicted;
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            if (stop.load()) return Admission::Rejected;
+            if (capacity_ != 0 && queued >= capacity_) {
+                switch (policy_) {
+                    case OverflowPolicy::DropNew:
+                        dropped_.fetch_add(1, std::memory_order_relaxed);
+                        return Admission::Rejected;
+                    case OverflowPolicy::CallerRuns:
+                        return Admission::CallerRuns;
+                    case OverflowPolicy::DropOldest:
+                        // Only pinned tasks left → admit over capacity.
+                        evicted = evict_locked();
+                        if (evicted) {
+                            --outstanding;
+                            dropped_.fetch_add(1, std::memory_order_relaxed);
+                        }
+                        break;
+                    case OverflowPolicy::Block:
+                        not_full_condition.wait(lock, [this] {
+                            return stop.load() || queued < capacity_;
+                        });
+                        if (stop.load()) return Admission::Rejected;
+                        break;
+                }
+            }
+            lanes_[static_cast<std::size_t>(priority)].tasks.push_back(
+                QueuedTask{std::move(fn), std::chrono::steady_clock::now(), true});
+            ++queued;
+            ++outstanding;
+        }
+        condition.notify_one();
+        if (evicted) drained_condition.notify_all();
+        return Admission::Queued;
+    }
+
+    // Queue a coroutine resumption (schedule()) if there is room right now;
+    // false if the pool is stopped or full. Never waits, never evicts.
+    bool try_admit_resumption(std::coroutine_handle<> h, TaskPriority priority) {
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            if (stop.load() || (capacity_ != 0 && queued >= capacity_)) return false;
+            lanes_[static_cast<std::size_t>(priority)].tasks.push_back(
+                QueuedTask{[h]() { h.resume(); }, std::chrono::steady_clock::now(), false});
+            ++queued;
+            ++outstanding;
+        }
+        condition.notify_one();
+        return true;
+    }
+
+    // Caller must hold queue_mutex. Removes the oldest evictable task of the
+    // least important lane that has one (DropOldest overflow).
+    std::function<void()> evict_locked() {
+        for (std::size_t i = kLaneCount; i-- > 0;) {
+            auto& tasks = lanes_[i].tasks;
+            for (auto it = tasks.begin(); it != tasks.end(); ++it) {
+                if (!it->evictable) continue;
+                std::function<void()> fn = std::move(it->fn);
+                tasks.erase(it);
+                --queued;
+                return fn;
+            }
+        }
+        return {};
+    }
+
+    // Caller must hold queue_mutex and ensure queued != 0.
+    std::function<void()> take_next_locked() {
+        std::size_t lane = pick_lane_locked();
+        auto& tasks = lanes_[lane].tasks;
+        std::function<void()> fn = std::move(tasks.front().fn);
+        tasks.pop_front();
+        --queued;
+        return fn;
+    }
+
+    // Caller must hold queue_mutex and ensure queued != 0.
+    std::size_t pick_lane_locked() {
+        if (aging_.count() > 0) promote_aged_locked(std::chrono::steady_clock::now());
+        if (scheduling_ == LaneScheduling::Strict) {
+            for (std::size_t i = 0; i < kLaneCount; ++i) {
+                if (!lanes_[i].tasks.empty()) return i;
+            }
+        }
+        // Smooth weighted round-robin over the non-empty lanes (nginx-style):
+        // every candidate earns its weight, the richest is picked and pays the
+        // round's total. Spreads picks evenly instead of in bursts.
+        std::size_t best = kLaneCount;
+        long total = 0;
+        for (std::size_t i = 0; i < kLaneCount; ++i) {
+            Lane& l = lanes_[i];
+            if (l.tasks.empty()) continue;
+            l.credit += l.weight;
+            total += l.weight;
+            if (best == kLaneCount || l.credit > lanes_[best].credit) best = i;
+        }
+        lanes_[best].credit -= total;
+        return best;
+    }
+
+    // Caller must hold queue_mutex. Anti-starvation: a head task that has
+    // waited past the aging threshold moves to the back of the lane above,
+    // restamped, so it climbs one lane per threshold until it is served. A
+    // lane promotes at most once per threshold, which caps what the lanes
+    // above take on when every head is old.
+    void promote_aged_locked(std::chrono::steady_clock::time_point now) {
+        for (std::size_t i = 1; i < kLaneCount; ++i) {  // upward: one step per pass
+            Lane& l = lanes_[i];
+            if (l.tasks.empty() || now - l.tasks.front().enqueued_at < aging_ ||
+                now - l.last_promotion < aging_) {
+                continue;
+            }
+            QueuedTask task = std::move(l.tasks.front());
+            l.tasks.pop_front();
+            task.enqueued_at = now;
+            lanes_[i - 1].tasks.push_back(std::move(task));
+            l.last_promotion = now;
+        }
+    }
+
     std::vector<std::thread> workers;
-    std::queue<std::function<void()>> tasks;
-    std::mutex queue_mutex;
+    std::array<Lane, kLaneCount> lanes_;
+    mutable std::mutex queue_mutex;
     std::condition_variable condition;
     std::condition_variable drained_condition;
+    // Block-policy producers wait here for a free slot.
+    std::condition_variable not_full_condition;
+    std::size_t capacity_;
+    OverflowPolicy policy_;
+    LaneScheduling scheduling_ = LaneScheduling::Weighted;
+    std::chrono::milliseconds aging_{100};
     std::atomic<bool> stop;
+    std::atomic<std::size_t> dropped_{0};
+    // Tasks waiting across all lanes.
+    std::size_t queued = 0;
     // Number of tasks that have been enqueued but not yet finished.
     std::size_t outstanding = 0;
 };
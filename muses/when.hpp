@@ -0,0 +1,307 @@
+// MIT License
+
+// Copyright (c) 2023 nastyapple
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <optional>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "muses/task.hpp"
+
+#ifndef MUSES_WHEN_HPP
+#define MUSES_WHEN_HPP
+
+namespace muses {
+
+// Concurrent composition of Tasks on one event loop.
+//
+//   auto [a, b] = co_await when_all(fetch(x), fetch(y));   // max(), not sum
+//   auto first  = co_await when_any(std::move(attempts));  // min(); losers cancelled
+//
+// Each child is wrapped in a small driver coroutine that awaits it and then,
+// from its final_suspend, reports to a shared counter; the driver that
+// completes the combinator symmetric-transfers straight into the parent, so
+// the parent is resumed exactly once and never from inside a child's body.
+// Children are started one after another from the parent's await_suspend;
+// those that finish synchronously just count down, and the parent does not
+// suspend at all if everything is already decided.
+//
+// when_all waits for every child. If any throws, the first exception is
+// rethrown once all have finished. when_any returns the first child result
+// accepted by an optional predicate (default: any result) together with its
+// index, then cancels the rest by destroying their frames — their IoAwaiters
+// deregister and their timers are cancelled, so nothing resumes them later.
+// Children must stay on the loop thread: a child that hopped to a ThreadPool
+// cannot be cancelled safely.
+
+template <typename T>
+struct WhenAnyResult {
+    std::size_t index;
+    T value;
+};
+
+namespace detail {
+
+// void results are stored as std::monostate so tuples/vectors stay regular.
+template <typename T>
+using WhenValue = std::conditional_t<std::is_void_v<T>, std::monostate, T>;
+
+struct WhenState {
+    std::size_t remaining = 0;
+    bool starting = false;
+    bool decided = false;  // when_any: a winner has been chosen
+    bool resumed = false;
+    std::coroutine_handle<> parent;
+    std::exception_ptr error;
+
+    // Called by each finishing driver; true if the parent should run now.
+    bool arrive() noexcept {
+        --remaining;
+        if (starting || resumed) return false;
+        if (decided || remaining == 0) {
+            resumed = true;
+            return true;
+        }
+        return false;
+    }
+};
+
+// Driver coroutine: owns one child (as a frame parameter) and reports to a
+// WhenState when done. Exceptions are recorded in the state, never thrown.
+class WhenDriver {
+public:
+    class promise_type : public PooledFrame {
+    public:
+        WhenDriver get_return_object() {
+            return WhenDriver{std::coroutine_handle<promise_type>::from_promise(*this)};
+        }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+
+        struct Final {
+            bool await_ready() const noexcept { return false; }
+            std::coroutine_handle<> await_suspend(
+                std::coroutine_handle<promise_type> h) noexcept {
+                WhenState* s = h.promise().state;
+                if (s->arrive()) return s->parent;
+                return std::noop_coroutine();
+            }
+            void await_resume() const noexcept {}
+        };
+        Final final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept {
+            if (!state->error) state->error = std::current_exception();
+        }
+
+        WhenState* state = nullptr;
+    };
+
+    WhenDriver() noexcept = default;
+    explicit WhenDriver(std::coroutine_handle<promise_type> h) noexcept : handle_(h) {}
+    WhenDriver(const WhenDriver&) = delete;
+    WhenDriver& operator=(const WhenDriver&) = delete;
+    WhenDriver(WhenDriver&& o) noexcept : handle_(std::exchange(o.handle_, nullptr)) {}
+    WhenDriver& operator=(WhenDriver&& o) noexcept {
+        if (this != &o) {
+            if (handle_) handle_.destroy();
+            handle_ = std::exchange(o.handle_, nullptr);
+        }
+        return *this;
+    }
+    ~WhenDriver() {
+        if (handle_) handle_.destroy();
+    }
+
+    void bind(WhenState* s) noexcept { handle_.promise().state = s; }
+    void start() { handle_.resume(); }
+
+private:
+    std::coroutine_handle<promise_type> handle_;
+};
+
+// Starts the drivers and suspends the parent until WhenState says so.
+class WhenAwaiter {
+public:
+    WhenAwaiter(WhenState& state, std::vector<WhenDriver>& drivers) noexcept
+    : state_(state), drivers_(drivers) {}
+
+    bool await_ready() const noexcept { return drivers_.empty(); }
+    bool await_suspend(std::coroutine_handle<> parent) {
+        state_.parent = parent;
+        state_.remaining = drivers_.size();
+        state_.starting = true;
+        for (auto& d : drivers_) {
+            if (state_.decided) break;  // when_any already has a winner
+            d.start();
+        }
+        state_.starting = false;
+        if (state_.decided || state_.remaining == 0) {
+            state_.resumed = true;
+            return false;  // everything settled synchronously
+        }
+        return true;
+    }
+    void await_resume() const noexcept {}
+
+private:
+    WhenState& state_;
+    std::vector<WhenDriver>& drivers_;
+};
+
+template <typename T>
+WhenDriver drive_into(Task<T> child, std::optional<WhenValue<T>>& slot) {
+    if constexpr (std::is_void_v<T>) {
+        co_await child;
+        slot.emplace();
+    } else {
+        slot.emplace(co_await child);
+    }
+}
+
+template <typename T, typename Accept>
+WhenDriver drive_any(Task<T> child, std::size_t index, WhenState& state,
+                     std::optional<WhenAnyResult<WhenValue<T>>>& winner, Accept& accept) {
+    if constexpr (std::is_void_v<T>) {
+        co_await child;
+        if (!state.decided) {
+            winner.emplace(WhenAnyResult<std::monostate>{index, {}});
+            state.decided = true;
+        }
+    } else {
+        T value = co_await child;
+        if (!state.decided && accept(static_cast<const T&>(value))) {
+            winner.emplace(WhenAnyResult<T>{index, std::move(value)});
+            state.decided = true;
+        }
+    }
+}
+
+template <typename... Ts, std::size_t... I>
+Task<std::tuple<WhenValue<Ts>...>> when_all_impl(std::index_sequence<I...>,
+                                                 Task<Ts>... tasks) {
+    WhenState state;
+    std::tuple<std::optional<WhenValue<Ts>>...> slots;
+    std::vector<WhenDriver> drivers;
+    drivers.reserve(sizeof...(Ts));
+    (drivers.push_back(drive_into(std::move(tasks), std::get<I>(slots))), ...);
+    for (auto& d : drivers) d.bind(&state);
+    co_await WhenAwaiter{state, drivers};
+    drivers.clear();
+    if (state.error) std::rethrow_exception(state.error);
+    co_return std::tuple<WhenValue<Ts>...>{std::move(*std::get<I>(slots))...};
+}
+
+struct AcceptAny {
+    template <typename T>
+    bool operator()(const T&) const noexcept { return true; }
+};
+
+}  // namespace detail
+
+// Run all tasks concurrently; resumes once every one has finished. Results in
+// argument order (void tasks yield std::monostate).
+template <typename... Ts>
+Task<std::tuple<detail::WhenValue<Ts>...>> when_all(Task<Ts>... tasks) {
+    return detail::when_all_impl(std::index_sequence_for<Ts...>{}, std::move(tasks)...);
+}
+
+// Homogeneous fan-out; results in input order.
+template <typename T>
+Task<std::vector<T>> when_all(std::vector<Task<T>> tasks) {
+    detail::WhenState state;
+    std::vector<std::optional<T>> slots(tasks.size());
+    std::vector<detail::WhenDriver> drivers;
+    drivers.reserve(tasks.size());
+    for (std::size_t i = 0; i < tasks.size(); ++i) {
+        drivers.push_back(detail::drive_into(std::move(tasks[i]), slots[i]));
+        drivers.back().bind(&state);
+    }
+    co_await detail::WhenAwaiter{state, drivers};
+    drivers.clear();
+    if (state.error) std::rethrow_exception(state.error);
+    std::vector<T> out;
+    out.reserve(slots.size());
+    for (auto& s : slots) out.push_back(std::move(*s));
+    co_return out;
+}
+
+inline Task<void> when_all(std::vector<Task<void>> tasks) {
+    detail::WhenState state;
+    std::vector<std::optional<std::monostate>> slots(tasks.size());
+    std::vector<detail::WhenDriver> drivers;
+    drivers.reserve(tasks.size());
+    for (std::size_t i = 0; i < tasks.size(); ++i) {
+        drivers.push_back(detail::drive_into(std::move(tasks[i]), slots[i]));
+        drivers.back().bind(&state);
+    }
+    co_await detail::WhenAwaiter{state, drivers};
+    drivers.clear();
+    if (state.error) std::rethrow_exception(state.error);
+}
+
+// First result accepted by `accept(const T&)` wins; the other children are
+// cancelled. If no child produces an accepted result, rethrows the first
+// child exception if there was one, otherwise throws std::runtime_error.
+// An empty input throws std::invalid_argument.
+template <typename T, typename Accept = detail::AcceptAny>
+Task<WhenAnyResult<detail::WhenValue<T>>> when_any(std::vector<Task<T>> tasks,
+                                                   Accept accept = {}) {
+    if (tasks.empty()) throw std::invalid_argument("when_any: no tasks");
+    detail::WhenState state;
+    std::optional<WhenAnyResult<detail::WhenValue<T>>> winner;
+    std::vector<detail::WhenDriver> drivers;
+    drivers.reserve(tasks.size());
+    for (std::size_t i = 0; i < tasks.size(); ++i) {
+        drivers.push_back(detail::drive_any(std::move(tasks[i]), i, state, winner, accept));
+        drivers.back().bind(&state);
+    }
+    co_await detail::WhenAwaiter{state, drivers};
+    drivers.clear();  // cancel the losers now, not when our frame dies
+    if (!winner) {
+        if (state.error) std::rethrow_exception(state.error);
+        throw std::runtime_error("when_any: no child produced an accepted result");
+    }
+    co_return std::move(*winner);
+}
+
+template <typename T, typename... Rest>
+    requires(std::is_same_v<Task<T>, Rest> && ...)
+Task<WhenAnyResult<detail::WhenValue<T>>> when_any(Task<T> first, Rest... rest) {
+    std::vector<Task<T>> tasks;
+    tasks.reserve(1 + sizeof...(Rest));
+    tasks.push_back(std::move(first));
+    (tasks.push_back(std::move(rest)), ...);
+    return when_any(std::move(tasks));
+}
+
+}  // namespace muses
+
+#endif  // MUSES_WHEN_HPP
@@ -0,0 +1,121 @@
+#include <doctest.h>
+
+#include "muses/net_components/balancer.hpp"
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+using muses::BalancePolicy;
+using muses::Balancer;
+using namespace std::chrono_literals;
+
+TEST_CASE("Balancer: smooth weighted round-robin interleaves by weight") {
+    Balancer b({5, 1, 1}, BalancePolicy::RoundRobin);
+    std::string seq;
+    for (int i = 0; i < 7; ++i) seq += static_cast<char>('a' + *b.pick());
+    CHECK(seq == "aabacaa");
+    for (int i = 0; i < 700; ++i) b.pick();
+    CHECK(b.load(0).picks == 505);
+    CHECK(b.load(1).picks == 101);
+    CHECK(b.load(2).picks == 101);
+}
+
+TEST_CASE("Balancer: the veto predicate skips endpoints") {
+    Balancer b({1, 1, 1}, BalancePolicy::RoundRobin);
+    for (int i = 0; i < 6; ++i) {
+        auto p = b.pick([](std::size_t e) { return e != 1; });
+        REQUIRE(p);
+        CHECK(*p != 1);
+    }
+    CHECK_FALSE(b.pick([](std::size_t) { return false; }));
+
+    Balancer lo({1, 1}, BalancePolicy::LeastOutstanding);
+    CHECK(*lo.pick([](std::size_t e) { return e == 1; }) == 1);
+    Balancer p2c({1, 1}, BalancePolicy::PowerOfTwoEwma);
+    for (int i = 0; i < 20; ++i) CHECK(*p2c.pick([](std::size_t e) { return e == 0; }) == 0);
+    CHECK_FALSE(p2c.pick([](std::size_t) { return false; }));
+}
+
+TEST_CASE("Balancer: least-outstanding fills the idle endpoint first") {
+    Balancer b({1, 1, 2}, BalancePolicy::LeastOutstanding);
+    std::vector<Balancer::Ticket> held;
+    for (int i = 0; i < 4; ++i) held.push_back(b.start(*b.pick()));
+    // Endpoint 2 has twice the weight: it takes two before the others take one more.
+    CHECK(b.load(0).outstanding == 1);
+    CHECK(b.load(1).outstanding == 1);
+    CHECK(b.load(2).outstanding == 2);
+
+    std::size_t freed = held.front().index();
+    held.erase(held.begin());
+    CHECK(b.load(freed).outstanding + 1 == (freed == 2 ? 2u : 1u));
+    CHECK(*b.pick() == freed);
+}
+
+TEST_CASE("Balancer: tickets count in-flight requests until finished") {
+    Balancer b({1}, BalancePolicy::LeastOutstanding);
+    {
+        Balancer::Ticket t = b.start(0);
+        CHECK(t);
+        CHECK(b.load(0).outstanding == 1);
+        Balancer::Ticket moved = std::move(t);
+        CHECK_FALSE(t);
+        CHECK(b.load(0).outstanding == 1);
+        Balancer::Ticket other = b.start(0);
+        CHECK(b.load(0).outstanding == 2);
+        other = std::move(moved);  // finishes `other`'s own request
+        CHECK(b.load(0).outstanding == 1);
+        other.finish();
+        other.finish();
+        CHECK(b.load(0).outstanding == 0);
+    }
+    CHECK(b.load(0).outstanding == 0);
+}
+
+TEST_CASE("Balancer: EWMA decays toward recent samples") {
+    Balancer b({1}, BalancePolicy::PowerOfTwoEwma, 1000ms);
+    auto t0 = Balancer::Clock::now();
+    b.observe(0, 100ms, t0);
+    CHECK(b.load(0).ewma_us == 100000.0);  // first sample is taken as-is
+    b.observe(0, 0ms, t0 + 1ms);  // a quick follow-up barely moves it
+    CHECK(b.load(0).ewma_us > 99000.0);
+    b.observe(0, 1ms, t0 + 10s);  // after a long quiet spell the new sample dominates
+    CHECK(b.load(0).ewma_us < 2000.0);
+}
+
+TEST_CASE("Balancer: power-of-two steers away from a slow endpoint") {
+    Balancer b({1, 1, 1, 1}, BalancePolicy::PowerOfTwoEwma);
+    auto now = Balancer::Clock::now();
+    b.observe(0, 50ms, now);
+    for (std::size_t i = 1; i < 4; ++i) b.observe(i, 1ms, now);
+    for (int i = 0; i < 400; ++i) b.pick();
+    // The two candidates are distinct, so the slow endpoint always loses.
+    CHECK(b.load(0).picks == 0);
+    CHECK(b.load(1).picks > 60);
+    CHECK(b.load(2).picks > 60);
+    CHECK(b.load(3).picks > 60);
+}
+
+TEST_CASE("Balancer: consistent hashing keeps a key on its endpoint") {
+    Balancer b({1, 1, 1}, BalancePolicy::ConsistentHash, 10s, {"a:1", "b:1", "c:1"});
+    auto all = [](std::size_t) { return true; };
+    const std::uint64_t key = muses::stable_hash("/videos/42");
+    std::size_t home = *b.pick_for(key, all);
+    for (int i = 0; i < 10; ++i) CHECK(*b.pick_for(key, all) == home);
+    CHECK(b.load(home).picks == 11);
+
+    // Reordering the endpoints does not move the key: names decide.
+    Balancer r({1, 1, 1}, BalancePolicy::ConsistentHash, 10s, {"c:1", "a:1", "b:1"});
+    CHECK(*r.pick_for(key, all) == (home + 1) % 3);
+
+    // Its endpoint down: the key goes elsewhere, and comes back after.
+    auto p = b.pick_for(key, [home](std::size_t e) { return e != home; });
+    REQUIRE(p);
+    CHECK(*p != home);
+    CHECK(*b.pick_for(key, all) == home);
+
+    // Without a key it round-robins; other policies ignore the key.
+    CHECK(b.pick());
+    Balancer rr({1, 1}, BalancePolicy::RoundRobin);
+    CHECK(*rr.pick_for(key, all) != *rr.pick_for(key, all));
+}
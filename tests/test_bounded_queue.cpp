@@ -28,6 +28,23 @@ TEST_CASE("BoundedQueue: DropOldest evicts the front") {
     CHECK(q.try_pop(v)); CHECK(v == 3);
 }
 
+TEST_CASE("BoundedQueue: try_push never evicts, blocks, or counts a drop") {
+    for (auto policy : {muses::OverflowPolicy::DropNew, muses::OverflowPolicy::DropOldest,
+                        muses::OverflowPolicy::Block}) {
+        muses::BoundedQueue<std::vector<int>> q(2, policy);
+        std::vector<int> a{1}, b{2}, c{3};
+        CHECK(q.try_push(a));
+        CHECK(a.empty());           // moved from on success
+        CHECK(q.try_push(b));
+        CHECK_FALSE(q.try_push(c));
+        CHECK(c == std::vector<int>{3});  // left intact on failure
+        CHECK(q.dropped() == 0);
+        std::vector<int> out;
+        CHECK(q.try_pop(out));
+        CHECK(out == std::vector<int>{1});  // nothing was evicted
+    }
+}
+
 TEST_CASE("BoundedQueue: Block unblocks on consume") {
     muses::BoundedQueue<int> q(1, muses::OverflowPolicy::Block);
     CHECK(q.push(1));
@@ -0,0 +1,239 @@
+#include <doctest.h>
+
+#include "muses/net/channel.hpp"
+#include "muses/net/event_loop.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using namespace std::chrono_literals;
+using Channel = muses::AsyncChannel<int>;
+
+void run_until(muses::EventLoop& loop, const std::atomic<bool>& done) {
+    auto deadline = std::chrono::steady_clock::now() + 2s;
+    while (!done.load() && std::chrono::steady_clock::now() < deadline) {
+        loop.run_once(20, [](const muses::PollEvent&) {});
+    }
+}
+
+struct Drained {
+    std::vector<int> items;
+    bool saw_end = false;
+    std::atomic<bool> done{false};
+};
+
+muses::Task<void> drain(Channel& ch, Drained& out) {
+    while (auto v = co_await ch.pop()) out.items.push_back(*v);
+    out.saw_end = true;
+    out.done.store(true);
+}
+
+muses::Task<void> produce(Channel& ch, int from, int to, std::vector<bool>& accepted,
+                          std::atomic<bool>& done) {
+    for (int i = from; i < to; ++i) accepted.push_back(co_await ch.push(i));
+    done.store(true);
+}
+
+muses::Task<void> take_batch(Channel& ch, std::size_t max, std::vector<int>& out,
+                             std::atomic<bool>& done) {
+    out = co_await ch.pop_batch(max);
+    done.store(true);
+}
+
+muses::Task<void> pop_with_deadline(Channel& ch, std::optional<std::optional<int>>& out,
+                                    std::atomic<bool>& done) {
+    out = co_await muses::with_timeout(
+        [](Channel& c) -> muses::Task<std::optional<int>> { co_return co_await c.pop(); }(ch),
+        30ms);
+    done.store(true);
+}
+
+muses::Task<void> produce_n(Channel& ch, int from, int n, std::atomic<int>& finished) {
+    for (int i = from; i < from + n; ++i) co_await ch.push(i);
+    finished.fetch_add(1);
+}
+
+muses::Task<void> consume_all(Channel& ch, std::atomic<long>& sum, std::atomic<int>& count,
+                             std::atomic<int>& finished) {
+    while (true) {
+        auto batch = co_await ch.pop_batch(8);
+        if (batch.empty()) break;
+        for (int v : batch) sum.fetch_add(v);
+        count.fetch_add(static_cast<int>(batch.size()));
+    }
+    finished.fetch_add(1);
+}
+
+bool wait_for(const std::atomic<int>& counter, int target) {
+    auto deadline = std::chrono::steady_clock::now() + 5s;
+    while (counter.load() < target && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(1ms);
+    }
+    return counter.load() >= target;
+}
+
+}  // namespace
+
+TEST_CASE("AsyncChannel: try_push / try_pop apply the overflow policy") {
+    Channel block(2);
+    CHECK(block.try_push(1));
+    CHECK(block.try_push(2));
+    CHECK_FALSE(block.try_push(3));  // full Block channel rejects without waiting
+    CHECK(block.dropped() == 0);
+
+    Channel drop_new(2, muses::OverflowPolicy::DropNew);
+    drop_new.try_push(1);
+    drop_new.try_push(2);
+    CHECK_FALSE(drop_new.try_push(3));
+    CHECK(drop_new.dropped() == 1);
+
+    Channel drop_old(2, muses::OverflowPolicy::DropOldest);
+    drop_old.try_push(1);
+    drop_old.try_push(2);
+    CHECK(drop_old.try_push(3));
+    int v = 0;
+    REQUIRE(drop_old.try_pop(v));
+    CHECK(v == 2);
+    CHECK(drop_old.dropped() == 1);
+}
+
+TEST_CASE("AsyncChannel: pop suspends until a push, and close ends the stream") {
+    muses::EventLoop loop;
+    Channel ch(4);
+    Drained out;
+    muses::Task<void> t = drain(ch, out);
+    loop.post(t.handle());
+    loop.run_once(0, [](const muses::PollEvent&) {});
+    CHECK(out.items.empty());
+
+    CHECK(ch.try_push(7));
+    loop.run_once(0, [](const muses::PollEvent&) {});
+    CHECK(ch.try_push(8));
+    ch.close();
+    CHECK_FALSE(ch.try_push(9));
+    run_until(loop, out.done);
+
+    REQUIRE(out.done.load());
+    CHECK(out.items == std::vector<int>{7, 8});
+    CHECK(out.saw_end);
+}
+
+TEST_CASE("AsyncChannel: Block suspends the producer until space frees up") {
+    muses::EventLoop loop;
+    Channel ch(2);
+    std::vector<bool> accepted;
+    std::atomic<bool> done{false};
+    muses::Task<void> p = produce(ch, 0, 5, accepted, done);
+    loop.post(p.handle());
+    loop.run_once(0, [](const muses::PollEvent&) {});
+    CHECK_FALSE(done.load());
+    CHECK(accepted.size() == 2);  // parked on the third push
+
+    std::vector<int> got;
+    int v = 0;
+    auto deadline = std::chrono::steady_clock::now() + 2s;
+    while (got.size() < 5 && std::chrono::steady_clock::now() < deadline) {
+        if (ch.try_pop(v)) got.push_back(v);
+        loop.run_once(0, [](const muses::PollEvent&) {});
+    }
+    CHECK(done.load());
+    CHECK(got == std::vector<int>{0, 1, 2, 3, 4});
+    CHECK(accepted == std::vector<bool>(5, true));
+    CHECK(ch.dropped() == 0);
+}
+
+TEST_CASE("AsyncChannel: DropNew push completes at once and reports the drop") {
+    muses::EventLoop loop;
+    Channel ch(2, muses::OverflowPolicy::DropNew);
+    std::vector<bool> accepted;
+    std::atomic<bool> done{false};
+    muses::Task<void> p = produce(ch, 0, 4, accepted, done);
+    loop.post(p.handle());
+    run_until(loop, done);
+    CHECK(accepted == std::vector<bool>{true, true, false, false});
+    CHECK(ch.dropped() == 2);
+}
+
+TEST_CASE("AsyncChannel: pop_batch takes what is queued, up to max") {
+    muses::EventLoop loop;
+    Channel ch(8);
+    for (int i = 0; i < 5; ++i) ch.try_push(i);
+    std::vector<int> got;
+    std::atomic<bool> done{false};
+    muses::Task<void> t = take_batch(ch, 3, got, done);
+    loop.post(t.handle());
+    run_until(loop, done);
+    CHECK(got == std::vector<int>{0, 1, 2});
+    CHECK(ch.size() == 2);
+
+    // Empty channel: waits for the first item, then returns without waiting for more.
+    Channel empty(8);
+    std::vector<int> later;
+    std::atomic<bool> done2{false};
+    muses::Task<void> t2 = take_batch(empty, 4, later, done2);
+    loop.post(t2.handle());
+    loop.run_once(0, [](const muses::PollEvent&) {});
+    CHECK_FALSE(done2.load());
+    empty.try_push(42);
+    run_until(loop, done2);
+    CHECK(later == std::vector<int>{42});
+}
+
+TEST_CASE("AsyncChannel: a timed-out pop unregisters and does not eat the next item") {
+    muses::EventLoop loop;
+    Channel ch(4);
+    std::optional<std::optional<int>> out;
+    std::atomic<bool> done{false};
+    muses::Task<void> t = pop_with_deadline(ch, out, done);
+    loop.post(t.handle());
+    run_until(loop, done);
+    REQUIRE(done.load());
+    CHECK_FALSE(out.has_value());
+
+    CHECK(ch.try_push(5));
+    int v = 0;
+    CHECK(ch.try_pop(v));
+    CHECK(v == 5);
+}
+
+TEST_CASE("AsyncChannel: producers and consumers across event loop threads") {
+    Channel ch(16);
+    std::atomic<long> sum{0};
+    std::atomic<int> count{0}, producers_done{0}, consumers_done{0};
+    constexpr int kLoops = 4, kProducers = 4, kConsumers = 3, kEach = 2000;
+    std::vector<muses::Task<void>> tasks;  // outlive the loop threads
+    {
+        std::atomic<bool> stop{false};
+        std::vector<std::unique_ptr<muses::EventLoop>> loops;
+        std::vector<std::thread> threads;
+        for (int i = 0; i < kLoops; ++i) {
+            loops.push_back(std::make_unique<muses::EventLoop>());
+            threads.emplace_back([&stop, loop = loops.back().get()] {
+                while (!stop.load()) loop->run_once(5, [](const muses::PollEvent&) {});
+            });
+        }
+        for (int c = 0; c < kConsumers; ++c) {
+            tasks.push_back(consume_all(ch, sum, count, consumers_done));
+            loops[static_cast<std::size_t>(c) % kLoops]->post(tasks.back().handle());
+        }
+        for (int p = 0; p < kProducers; ++p) {
+            tasks.push_back(produce_n(ch, p * kEach, kEach, producers_done));
+            loops[static_cast<std::size_t>(p + 1) % kLoops]->post(tasks.back().handle());
+        }
+        CHECK(wait_for(producers_done, kProducers));
+        ch.close();
+        CHECK(wait_for(consumers_done, kConsumers));
+        stop.store(true);
+        for (auto& t : threads) t.join();
+    }
+    long n = static_cast<long>(kProducers) * kEach;
+    CHECK(count.load() == n);
+    CHECK(sum.load() == n * (n - 1) / 2);
+    CHECK(ch.dropped() == 0);
+}
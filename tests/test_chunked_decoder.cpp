@@ -0,0 +1,109 @@
+#include <doctest.h>
+
+#include "muses/net_components/chunked_decoder.hpp"
+
+#include <string>
+#include <string_view>
+
+namespace {
+
+using muses::ChunkedDecoder;
+
+// Feeds `wire` in pieces of `step` bytes; returns the de-chunked data and
+// the total bytes consumed.
+std::string dechunk(std::string_view wire, std::size_t step, ChunkedDecoder::Status& status,
+                    std::size_t& consumed) {
+    ChunkedDecoder dec(ChunkedDecoder::Mode::Dechunk);
+    std::string out;
+    consumed = 0;
+    status = ChunkedDecoder::Status::NeedMore;
+    for (std::size_t off = 0; off < wire.size() && status == ChunkedDecoder::Status::NeedMore;
+         off += step) {
+        auto piece = wire.substr(off, step);
+        auto r = dec.feed(piece, [&](std::string_view d) { out += d; });
+        consumed += r.consumed;
+        status = r.status;
+    }
+    return out;
+}
+
+ChunkedDecoder::Status framing(std::string_view wire) {
+    ChunkedDecoder dec;
+    return dec.feed(wire).status;
+}
+
+}  // namespace
+
+TEST_CASE("ChunkedDecoder: de-chunks data across every split point") {
+    const std::string wire =
+        "5;name=val\r\nhello\r\n"
+        "1A \r\nabcdefghijklmnopqrstuvwxyz\r\n"
+        "0\r\nExpires: never\r\nX-Check: 1\r\n\r\n";
+    for (std::size_t step : {1u, 2u, 3u, 7u, 64u}) {
+        ChunkedDecoder::Status status;
+        std::size_t consumed = 0;
+        std::string data = dechunk(wire, step, status, consumed);
+        CHECK(status == ChunkedDecoder::Status::Done);
+        CHECK(data == "helloabcdefghijklmnopqrstuvwxyz");
+        CHECK(consumed == wire.size());
+    }
+}
+
+TEST_CASE("ChunkedDecoder: a terminator-like sequence inside chunk data is just data") {
+    const std::string payload = "x\r\n0\r\n\r\ny";
+    const std::string wire = "9\r\n" + payload + "\r\n0\r\n\r\n";
+    ChunkedDecoder::Status status;
+    std::size_t consumed = 0;
+    CHECK(dechunk(wire, 4, status, consumed) == payload);
+    CHECK(status == ChunkedDecoder::Status::Done);
+    CHECK(consumed == wire.size());
+}
+
+TEST_CASE("ChunkedDecoder: stops at the end of the body and leaves the rest") {
+    ChunkedDecoder dec;
+    std::string wire = "3\r\nabc\r\n0\r\n\r\nGET /next HTTP/1.1\r\n";
+    auto r = dec.feed(wire);
+    CHECK(r.status == ChunkedDecoder::Status::Done);
+    CHECK(wire.substr(r.consumed) == "GET /next HTTP/1.1\r\n");
+    CHECK(dec.done());
+    CHECK(dec.decoded_bytes() == 3);
+    CHECK(dec.feed("more").consumed == 0);
+
+    dec.reset();
+    CHECK(dec.feed("0\r\n\r\n").status == ChunkedDecoder::Status::Done);
+}
+
+TEST_CASE("ChunkedDecoder: pass-through hands the sink the raw bytes") {
+    ChunkedDecoder dec(ChunkedDecoder::Mode::PassThrough);
+    std::string wire = "4\r\nwiki\r\n0\r\nT: v\r\n\r\n";
+    std::string seen;
+    std::size_t consumed = 0;
+    for (std::size_t off = 0; off < wire.size(); off += 5) {
+        consumed += dec.feed(std::string_view(wire).substr(off, 5),
+                             [&](std::string_view d) { seen += d; }).consumed;
+    }
+    CHECK(dec.done());
+    CHECK(consumed == wire.size());
+    CHECK(seen == wire);
+}
+
+TEST_CASE("ChunkedDecoder: rejects broken framing") {
+    CHECK(framing("g\r\n") == ChunkedDecoder::Status::Error);              // not hex
+    CHECK(framing(";ext\r\n") == ChunkedDecoder::Status::Error);           // no size
+    CHECK(framing("3\nabc\r\n") == ChunkedDecoder::Status::Error);         // bare LF
+    CHECK(framing("3\r\nabcX\r\n") == ChunkedDecoder::Status::Error);      // data overrun
+    CHECK(framing("0\r\nTrailer\n") == ChunkedDecoder::Status::Error);     // bare LF trailer
+    CHECK(framing("FFFFFFFFFFFFFFFFFF\r\n") == ChunkedDecoder::Status::Error);  // overflow
+    CHECK(framing("5 garbage\r\nhello\r\n") == ChunkedDecoder::Status::Error);  // not BWS;ext
+    CHECK(framing("5 \t x\r\nhello\r\n") == ChunkedDecoder::Status::Error);
+    CHECK(framing("5 \t ;x\r\nhello\r\n") == ChunkedDecoder::Status::NeedMore);  // BWS, then ext
+
+    ChunkedDecoder::Limits tight;
+    tight.max_chunk_size = 16;
+    tight.max_line = 8;
+    ChunkedDecoder small(ChunkedDecoder::Mode::PassThrough, tight);
+    CHECK(small.feed("11\r\n").status == ChunkedDecoder::Status::Error);
+    ChunkedDecoder long_line(ChunkedDecoder::Mode::PassThrough, tight);
+    CHECK(long_line.feed("1;aaaaaaaaaa\r\n").status == ChunkedDecoder::Status::Error);
+    CHECK(long_line.failed());
+}
@@ -0,0 +1,111 @@
+#include <doctest.h>
+
+#include "muses/net_components/concurrency_limiter.hpp"
+#include "muses/task.hpp"
+
+#include <chrono>
+
+using muses::ConcurrencyLimiter;
+using muses::ConcurrencyLimitOptions;
+using muses::LimitAlgorithm;
+using namespace std::chrono_literals;
+
+namespace {
+
+ConcurrencyLimitOptions fixed(unsigned limit, std::size_t queue) {
+    ConcurrencyLimitOptions o;
+    o.initial_limit = o.min_limit = o.max_limit = limit;
+    o.max_queue = queue;
+    return o;
+}
+
+muses::Task<void> queue_for(ConcurrencyLimiter& l, int& admitted) {
+    auto waiter = l.wait();
+    co_await waiter;
+    ++admitted;
+}
+
+}  // namespace
+
+TEST_CASE("ConcurrencyLimiter: slots up to the limit, then a FIFO queue") {
+    ConcurrencyLimiter l(fixed(2, 2));
+    CHECK(l.try_acquire());
+    CHECK(l.try_acquire());
+    CHECK_FALSE(l.try_acquire());
+    CHECK(l.inflight() == 2);
+
+    int admitted = 0;
+    auto a = queue_for(l, admitted);
+    auto b = queue_for(l, admitted);
+    CHECK_FALSE(a.resume());
+    CHECK_FALSE(b.resume());
+    CHECK(l.queued() == 2);
+    CHECK(l.queue_full());
+    CHECK_FALSE(l.admit_next());  // no free slot yet
+
+    l.finish(1ms, false);
+    auto h = l.admit_next();
+    REQUIRE(h);
+    h.resume();  // the first one in line
+    CHECK(admitted == 1);
+    CHECK(a.done());
+    CHECK(l.inflight() == 2);
+    CHECK(l.queued() == 1);
+
+    // A waiter torn down while queued (a timeout) leaves the queue.
+    b = muses::Task<void>{};
+    CHECK(l.queued() == 0);
+    l.release();
+    l.release();
+    CHECK(l.inflight() == 0);
+
+    ConcurrencyLimiter off;  // initial_limit zero: never limits
+    for (int i = 0; i < 100; ++i) CHECK(off.try_acquire());
+}
+
+TEST_CASE("ConcurrencyLimiter: AIMD grows while used and backs off on failure") {
+    ConcurrencyLimitOptions o;
+    o.algorithm = LimitAlgorithm::Aimd;
+    o.initial_limit = 10;
+    o.slow_rtt = 100ms;
+    ConcurrencyLimiter l(o);
+    for (int i = 0; i < 10; ++i) l.try_acquire();
+    l.finish(5ms, false);
+    CHECK(l.limit() == 11);
+    l.try_acquire();
+    l.finish(5ms, true);
+    CHECK(l.limit() == 9);  // 11 × 0.9
+    l.try_acquire();
+    l.finish(200ms, false);  // too slow counts as a drop
+    CHECK(l.limit() == 8);
+
+    // Hardly used: no evidence that more would help.
+    ConcurrencyLimiter idle(o);
+    idle.try_acquire();
+    idle.finish(5ms, false);
+    CHECK(idle.limit() == 10);
+}
+
+TEST_CASE("ConcurrencyLimiter: gradient shrinks as RTT climbs and recovers") {
+    ConcurrencyLimitOptions o;
+    o.algorithm = LimitAlgorithm::Gradient;
+    o.initial_limit = 50;
+    o.max_limit = 200;
+    ConcurrencyLimiter l(o);
+    auto saturated_sample = [&l](std::chrono::microseconds rtt) {
+        while (l.try_acquire()) {}
+        l.finish(rtt, false);
+        // Keep the limit fully used for the next sample.
+        while (l.inflight() > 0) l.release();
+    };
+    for (int i = 0; i < 50; ++i) saturated_sample(10ms);
+    unsigned steady = l.limit();
+    CHECK(steady > 50);  // stable RTT under load: probe upward
+
+    for (int i = 0; i < 30; ++i) saturated_sample(100ms);  // queueing upstream
+    CHECK(l.limit() < steady / 2);
+    unsigned low = l.limit();
+
+    for (int i = 0; i < 50; ++i) saturated_sample(10ms);
+    CHECK(l.limit() > low);
+}
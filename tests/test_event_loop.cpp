@@ -0,0 +1,307 @@
+#include <doctest.h>
+
+#include "muses/net/event_loop.hpp"
+#include "muses/thread_pool.hpp"
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <optional>
+#include <thread>
+
+namespace {
+
+// Drive `loop` on the calling thread until `done` or ~2s elapse.
+void run_until(muses::EventLoop& loop, const std::atomic<bool>& done) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+    while (!done.load() && std::chrono::steady_clock::now() < deadline) {
+        loop.run_once(50, [](const muses::PollEvent&) {});
+    }
+}
+
+struct HopLog {
+    std::thread::id before;
+    std::thread::id on_pool;
+    std::thread::id after;
+    std::atomic<bool> done{false};
+};
+
+// Kept out of TEST_CASE scope so the frame's references outlive the frame.
+muses::Task<void> hop_off_and_back(muses::EventLoop& loop, muses::ThreadPool& pool,
+                                   HopLog& log) {
+    log.before = std::this_thread::get_id();
+    co_await pool.schedule();
+    log.on_pool = std::this_thread::get_id();
+    co_await loop.resume_here();
+    log.after = std::this_thread::get_id();
+    log.done.store(true);
+}
+
+muses::Task<void> wait_for_post(muses::EventLoop& loop, std::atomic<bool>& done) {
+    co_await loop.resume_here();  // already on the loop: completes inline
+    done.store(true);
+}
+
+muses::Task<void> nap(std::chrono::milliseconds d, std::atomic<bool>& done) {
+    co_await muses::sleep_for(d);
+    done.store(true);
+}
+
+// Suspends on `fd` until readable, then returns 7.
+muses::Task<int> wait_readable(muses::EventLoop& loop, int fd) {
+    co_await muses::IoAwaiter{loop.poller(), fd, muses::EventMask::Readable};
+    co_return 7;
+}
+
+struct TimeoutLog {
+    std::optional<int> result{-1};
+    std::atomic<bool> done{false};
+};
+
+muses::Task<void> race(muses::EventLoop& loop, int fd, std::chrono::milliseconds limit,
+                       TimeoutLog& log) {
+    log.result = co_await muses::with_timeout(wait_readable(loop, fd), limit);
+    log.done.store(true);
+}
+
+struct ReadLog {
+    int bytes = 0;
+    bool timed_out = false;
+    std::chrono::steady_clock::time_point last_restart{};
+    std::chrono::steady_clock::time_point ended{};
+    std::atomic<bool> done{false};
+};
+
+// Reads `want` single bytes from the non-blocking `fd` under one Deadline,
+// restarted after each byte, or until it expires.
+muses::Task<void> read_bytes(int fd, int want, std::chrono::milliseconds window, ReadLog& log) {
+    muses::Deadline deadline(window);
+    log.last_restart = std::chrono::steady_clock::now();
+    while (log.bytes < want) {
+        char c;
+        if (::read(fd, &c, 1) == 1) {
+            ++log.bytes;
+            deadline.restart();
+            log.last_restart = std::chrono::steady_clock::now();
+            continue;
+        }
+        muses::TimedIoAwaiter aw{&deadline, fd, muses::EventMask::Readable};
+        if (!co_await aw) {
+            log.timed_out = true;
+            break;
+        }
+    }
+    log.ended = std::chrono::steady_clock::now();
+    log.done.store(true);
+}
+
+}  // namespace
+
+TEST_CASE("EventLoop: post from another thread resumes on the loop thread") {
+    muses::EventLoop loop;
+    REQUIRE(loop.valid());
+
+    std::atomic<bool> resumed{false};
+    std::thread::id resumed_on;
+    struct Flag {
+        std::atomic<bool>* resumed;
+        std::thread::id* on;
+    };
+    // A raw suspended coroutine to post.
+    auto make = [](Flag f) -> muses::Task<void> {
+        *f.on = std::this_thread::get_id();
+        f.resumed->store(true);
+        co_return;
+    };
+    muses::Task<void> t = make(Flag{&resumed, &resumed_on});
+
+    std::thread poster([&] { loop.post(t.handle()); });
+    poster.join();
+    run_until(loop, resumed);
+    CHECK(resumed.load());
+    CHECK(resumed_on == std::this_thread::get_id());
+    CHECK(t.done());
+}
+
+TEST_CASE("EventLoop: resume_here on the loop thread completes inline") {
+    muses::EventLoop loop;
+    std::atomic<bool> done{false};
+    muses::Task<void> t = wait_for_post(loop, done);
+    CHECK_FALSE(done.load());  // initial_suspend: not started yet
+    // Start it from inside the loop so resume_here sees the loop thread.
+    loop.post(t.handle());
+    run_until(loop, done);
+    CHECK(done.load());
+}
+
+TEST_CASE("EventLoop: schedule() onto a ThreadPool and resume_here() back") {
+    muses::EventLoop loop;
+    muses::ThreadPool pool(2);
+    HopLog log;
+
+    muses::Task<void> t = hop_off_and_back(loop, pool, log);
+    loop.post(t.handle());  // start it on the loop thread
+    run_until(loop, log.done);
+
+    REQUIRE(log.done.load());
+    CHECK(log.before == std::this_thread::get_id());
+    CHECK(log.on_pool != std::this_thread::get_id());
+    CHECK(log.after == std::this_thread::get_id());
+    CHECK(t.done());
+}
+
+TEST_CASE("ThreadPool: schedule() continues inline when the pool refuses") {
+    muses::ThreadPool pool(1);
+    pool.stop_pool();
+    HopLog log;
+    muses::EventLoop loop;
+    muses::Task<void> t = hop_off_and_back(loop, pool, log);
+    loop.post(t.handle());
+    run_until(loop, log.done);
+    CHECK(log.done.load());
+    CHECK(log.on_pool == std::this_thread::get_id());
+}
+
+TEST_CASE("ThreadPool: schedule() on a full Block pool continues inline") {
+    muses::ThreadPool pool(1, /*queue_capacity=*/1, muses::OverflowPolicy::Block);
+    std::promise<void> gate;
+    std::shared_future<void> open = gate.get_future().share();
+    pool.enqueue([open] { open.wait(); });
+    while (pool.size() != 0) std::this_thread::yield();
+    pool.enqueue([] {});  // the queue is full now
+    HopLog log;
+    muses::EventLoop loop;
+    muses::Task<void> t = hop_off_and_back(loop, pool, log);
+    loop.post(t.handle());
+    run_until(loop, log.done);  // would hang if schedule() waited for room
+    CHECK(log.done.load());
+    CHECK(log.on_pool == std::this_thread::get_id());
+    gate.set_value();
+    pool.wait_empty();
+}
+
+TEST_CASE("EventLoop: sleep_for resumes after the deadline, not before") {
+    muses::EventLoop loop;
+    std::atomic<bool> done{false};
+    muses::Task<void> t = nap(std::chrono::milliseconds(60), done);
+    auto start = std::chrono::steady_clock::now();
+    loop.post(t.handle());
+    run_until(loop, done);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    CHECK(done.load());
+    CHECK(elapsed >= std::chrono::milliseconds(60));
+    CHECK(elapsed < std::chrono::milliseconds(1000));
+    CHECK(loop.pending_timers() == 0);
+}
+
+TEST_CASE("EventLoop: destroying a sleeping coroutine cancels its timer") {
+    muses::EventLoop loop;
+    std::atomic<bool> done{false};
+    {
+        muses::Task<void> t = nap(std::chrono::milliseconds(20), done);
+        loop.post(t.handle());
+        loop.run_once(0, [](const muses::PollEvent&) {});
+        CHECK(loop.pending_timers() == 1);
+    }
+    CHECK(loop.pending_timers() == 0);
+    std::this_thread::sleep_for(std::chrono::milliseconds(40));
+    loop.run_once(0, [](const muses::PollEvent&) {});  // nothing left to resume
+    CHECK_FALSE(done.load());
+}
+
+TEST_CASE("EventLoop: with_timeout gives up on a stuck read and deregisters it") {
+    int sv[2];
+    REQUIRE(::socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+    muses::EventLoop loop;
+    TimeoutLog log;
+    muses::Task<void> t = race(loop, sv[0], std::chrono::milliseconds(50), log);
+    loop.post(t.handle());
+    run_until(loop, log.done);
+
+    REQUIRE(log.done.load());
+    CHECK_FALSE(log.result.has_value());
+    CHECK(loop.pending_timers() == 0);
+    // The IoAwaiter's registration is gone: the fd can be registered afresh.
+    CHECK(loop.poller()->add(sv[0], muses::EventMask::Readable, nullptr));
+    loop.poller()->del(sv[0]);
+    ::close(sv[0]);
+    ::close(sv[1]);
+}
+
+TEST_CASE("EventLoop: with_timeout returns the result and drops the timer") {
+    int sv[2];
+    REQUIRE(::socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+    muses::EventLoop loop;
+    TimeoutLog log;
+    muses::Task<void> t = race(loop, sv[0], std::chrono::seconds(5), log);
+    loop.post(t.handle());
+    loop.run_once(0, [](const muses::PollEvent&) {});
+    CHECK(loop.pending_timers() == 1);
+    REQUIRE(::write(sv[1], "x", 1) == 1);
+    run_until(loop, log.done);
+
+    REQUIRE(log.done.load());
+    REQUIRE(log.result.has_value());
+    CHECK(*log.result == 7);
+    CHECK(loop.pending_timers() == 0);
+    ::close(sv[0]);
+    ::close(sv[1]);
+}
+
+TEST_CASE("Deadline: one timer serves a run of waits") {
+    int sv[2];
+    REQUIRE(::socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+    ::fcntl(sv[0], F_SETFL, ::fcntl(sv[0], F_GETFL) | O_NONBLOCK);
+    muses::EventLoop loop;
+    ReadLog log;
+    muses::Task<void> t = read_bytes(sv[0], 3, std::chrono::seconds(5), log);
+    loop.post(t.handle());
+    loop.run_once(0, [](const muses::PollEvent&) {});
+    CHECK(loop.pending_timers() == 1);
+    for (int i = 0; i < 2; ++i) {
+        REQUIRE(::write(sv[1], "x", 1) == 1);
+        loop.run_once(50, [](const muses::PollEvent&) {});
+        CHECK(log.bytes == i + 1);
+        CHECK(loop.pending_timers() == 1);  // the same timer, still armed
+    }
+    REQUIRE(::write(sv[1], "x", 1) == 1);
+    run_until(loop, log.done);
+
+    REQUIRE(log.done.load());
+    CHECK(log.bytes == 3);
+    CHECK_FALSE(log.timed_out);
+    CHECK(loop.pending_timers() == 0);
+    ::close(sv[0]);
+    ::close(sv[1]);
+}
+
+TEST_CASE("Deadline: expires a window after the last restart and deregisters the fd") {
+    int sv[2];
+    REQUIRE(::socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+    ::fcntl(sv[0], F_SETFL, ::fcntl(sv[0], F_GETFL) | O_NONBLOCK);
+    muses::EventLoop loop;
+    ReadLog log;
+    const auto window = std::chrono::milliseconds(60);
+    muses::Task<void> t = read_bytes(sv[0], 2, window, log);
+    loop.post(t.handle());
+    loop.run_once(0, [](const muses::PollEvent&) {});
+    // Restarted halfway: the timer armed for the first window fires early
+    // and must carry on to the second one.
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    REQUIRE(::write(sv[1], "x", 1) == 1);
+    run_until(loop, log.done);
+
+    REQUIRE(log.done.load());
+    CHECK(log.bytes == 1);
+    CHECK(log.timed_out);
+    CHECK(log.ended - log.last_restart >= window);
+    CHECK(loop.pending_timers() == 0);
+    CHECK(loop.poller()->add(sv[0], muses::EventMask::Readable, nullptr));
+    loop.poller()->del(sv[0]);
+    ::close(sv[0]);
+    ::close(sv[1]);
+}
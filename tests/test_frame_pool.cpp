@@ -0,0 +1,72 @@
+#include <doctest.h>
+
+#include "muses/frame_pool.hpp"
+#include "muses/task.hpp"
+
+#include <thread>
+#include <vector>
+
+namespace {
+
+muses::Task<int> answer(int x) {
+    co_return x * 2;
+}
+
+}  // namespace
+
+TEST_CASE("FramePool: freed blocks are reused for the same size class") {
+    using muses::FramePool;
+
+    void* a = FramePool::allocate(100);
+    FramePool::deallocate(a, 100);
+    // 100 and 120 share the 128-byte class: the cached block comes back.
+    void* b = FramePool::allocate(120);
+    CHECK(b == a);
+    FramePool::deallocate(b, 120);
+
+    // Oversized frames bypass the cache but still round-trip.
+    void* big = FramePool::allocate(FramePool::kClassSizes[FramePool::kClassCount - 1] + 1);
+    CHECK(big != nullptr);
+    FramePool::deallocate(big, FramePool::kClassSizes[FramePool::kClassCount - 1] + 1);
+}
+
+TEST_CASE("FramePool: per-class cache is bounded") {
+    using muses::FramePool;
+
+    std::vector<void*> blocks;
+    for (std::size_t i = 0; i < FramePool::kMaxCachedPerClass * 2; ++i) {
+        blocks.push_back(FramePool::allocate(300));
+    }
+    // Half of these are returned to ::operator delete; nothing leaks (ASan).
+    for (void* p : blocks) FramePool::deallocate(p, 300);
+}
+
+TEST_CASE("FramePool: a block freed on another thread joins that thread's cache") {
+    using muses::FramePool;
+
+    void* p = FramePool::allocate(64);
+    void* reused = nullptr;
+    std::thread t([&] {
+        FramePool::deallocate(p, 64);
+        reused = FramePool::allocate(64);
+        FramePool::deallocate(reused, 64);
+    });
+    t.join();
+    CHECK(reused == p);
+}
+
+#if MUSES_TASK_FRAME_POOL
+TEST_CASE("FramePool: Task frames are recycled") {
+    void* first = nullptr;
+    {
+        auto t = answer(1);
+        first = t.handle().address();
+        t.resume();
+        CHECK(t.promise().value() == 2);
+    }
+    auto t = answer(2);
+    CHECK(t.handle().address() == first);
+    t.resume();
+    CHECK(t.promise().value() == 4);
+}
+#endif
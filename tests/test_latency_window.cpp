@@ -0,0 +1,46 @@
+#include <doctest.h>
+
+#include "muses/net_components/latency_window.hpp"
+
+#include <chrono>
+
+using muses::LatencyWindow;
+using namespace std::chrono_literals;
+
+TEST_CASE("LatencyWindow: percentiles within one bucket") {
+    LatencyWindow w(10s, 10);
+    auto now = LatencyWindow::Clock::now();
+    CHECK(w.percentile(0.99, now) == LatencyWindow::Clock::duration::zero());
+    for (int i = 0; i < 98; ++i) w.record(1ms, false, now);
+    w.record(100ms, false, now);
+    w.record(100ms, true, now);
+    CHECK(w.count(now) == 100);
+    CHECK(w.errors(now) == 1);
+    CHECK(w.error_rate(now) == 0.01);
+
+    auto p50 = w.percentile(0.5, now);
+    CHECK(p50 >= 1ms);
+    CHECK(p50 < 1200us);  // buckets are 2^(1/4) apart
+    auto p99 = w.percentile(0.99, now);
+    CHECK(p99 >= 100ms);
+    CHECK(p99 < 120ms);
+    CHECK(w.percentile(1.0, now) == p99);
+}
+
+TEST_CASE("LatencyWindow: old slices slide out of the window") {
+    LatencyWindow w(1000ms, 10);
+    auto t0 = LatencyWindow::Clock::now();
+    w.record(50ms, true, t0);
+    w.record(1ms, false, t0 + 500ms);
+    CHECK(w.count(t0 + 500ms) == 2);
+    CHECK(w.count(t0 + 1200ms) == 1);  // the first slice has expired
+    CHECK(w.errors(t0 + 1200ms) == 0);
+    CHECK(w.percentile(0.99, t0 + 1200ms) < 2ms);
+    CHECK(w.count(t0 + 3s) == 0);
+
+    // A slot reused for a later slice starts empty.
+    w.record(5ms, false, t0 + 10s);
+    CHECK(w.count(t0 + 10s) == 1);
+    w.clear();
+    CHECK(w.count(t0 + 10s) == 0);
+}
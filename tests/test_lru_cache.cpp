@@ -89,6 +89,27 @@ TEST_CASE("LruCache: capacity 0 caches nothing") {
     CHECK_FALSE(cache.contains(1));
 }
 
+TEST_CASE("LruCache: charge bound evicts least recently used") {
+    muses::LruCache<int, std::string> cache(100, /*max_charge=*/10);
+    cache.put(1, "aaaa", 4);
+    cache.put(2, "bbbb", 4);
+    CHECK(cache.charge() == 8);
+    cache.get(1);             // 2 is now LRU
+    cache.put(3, "ccc", 3);   // 11 > 10: evicts 2
+    CHECK(cache.contains(1));
+    CHECK_FALSE(cache.contains(2));
+    CHECK(cache.charge() == 7);
+    cache.put(1, "a", 1);     // update re-charges
+    CHECK(cache.charge() == 4);
+    cache.put(4, std::string(11, 'x'), 11);  // larger than the bound: not cached
+    CHECK_FALSE(cache.contains(4));
+    cache.put(1, std::string(11, 'x'), 11);  // and an oversize update drops the old value
+    CHECK_FALSE(cache.contains(1));
+    CHECK(cache.charge() == 3);
+    cache.erase(3);
+    CHECK(cache.charge() == 0);
+}
+
 TEST_CASE("LruCache: multithreaded stress, no corruption") {
     muses::LruCache<int, int> cache(64);
     constexpr int NTHREADS = 8;
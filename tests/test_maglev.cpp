@@ -0,0 +1,106 @@
+#include <doctest.h>
+
+#include "muses/net_components/maglev.hpp"
+
+#include <string>
+#include <vector>
+
+using muses::MaglevTable;
+using muses::stable_hash;
+
+namespace {
+
+std::vector<std::string> backends(int n) {
+    std::vector<std::string> v;
+    for (int i = 0; i < n; ++i) v.push_back("10.0.0." + std::to_string(i + 1) + ":8080");
+    return v;
+}
+
+// Share of table slots per backend.
+std::vector<double> shares(const MaglevTable& t) {
+    std::vector<double> s(t.backends(), 0.0);
+    for (std::size_t slot = 0; slot < t.size(); ++slot) s[t.lookup(slot)] += 1.0;
+    for (double& x : s) x /= static_cast<double>(t.size());
+    return s;
+}
+
+}  // namespace
+
+TEST_CASE("Maglev: stable_hash is deterministic and seed-dependent") {
+    CHECK(stable_hash("/a") == stable_hash("/a"));
+    CHECK(stable_hash("/a") != stable_hash("/b"));
+    CHECK(stable_hash("/a", 1) != stable_hash("/a", 2));
+}
+
+TEST_CASE("Maglev: table size is prime and slots are spread evenly") {
+    MaglevTable t(backends(5), {1, 1, 1, 1, 1}, 1000);
+    CHECK(t.size() == 1009);
+    for (double s : shares(t)) {
+        CHECK(s > 0.19);
+        CHECK(s < 0.21);
+    }
+    MaglevTable empty;
+    CHECK(empty.empty());
+    CHECK_FALSE(empty.lookup(42, [](std::size_t) { return true; }));
+}
+
+TEST_CASE("Maglev: weights scale a backend's share") {
+    MaglevTable t(backends(3), {2, 1, 1});
+    auto s = shares(t);
+    CHECK(s[0] > 0.49);
+    CHECK(s[0] < 0.51);
+    CHECK(s[1] > 0.24);
+    CHECK(s[2] > 0.24);
+}
+
+TEST_CASE("Maglev: adding or removing a backend remaps about 1/N of keys") {
+    const auto four = backends(4);
+    const auto five = backends(5);
+    MaglevTable t4(four, {1, 1, 1, 1});
+    MaglevTable t5(five, {1, 1, 1, 1, 1});
+    int moved = 0, moved_elsewhere = 0;
+    const int keys = 20000;
+    for (int k = 0; k < keys; ++k) {
+        std::uint64_t h = stable_hash("/object/" + std::to_string(k));
+        std::size_t a = t4.lookup(h), b = t5.lookup(h);
+        if (a != b) {
+            ++moved;
+            if (b != 4) ++moved_elsewhere;  // should have gone to the new backend
+        }
+    }
+    // Ideal is 1/5; Maglev trades a little extra churn for balance.
+    CHECK(moved > keys / 6);
+    CHECK(moved < keys * 3 / 10);
+    CHECK(moved_elsewhere < keys / 50);
+
+    // Removing backend 0: keys it did not own stay where they were.
+    std::vector<std::string> rest(four.begin() + 1, four.end());
+    MaglevTable t3(rest, {1, 1, 1});
+    int stayed_wrong = 0;
+    for (int k = 0; k < keys; ++k) {
+        std::uint64_t h = stable_hash("/object/" + std::to_string(k));
+        std::size_t a = t4.lookup(h);
+        if (a != 0 && t3.lookup(h) + 1 != a) ++stayed_wrong;
+    }
+    CHECK(stayed_wrong < keys / 50);
+}
+
+TEST_CASE("Maglev: a vetoed backend's keys move; everyone else's stay") {
+    MaglevTable t(backends(4), {1, 1, 1, 1});
+    auto not_two = [](std::size_t b) { return b != 2; };
+    int moved = 0;
+    for (int k = 0; k < 5000; ++k) {
+        std::uint64_t h = stable_hash(std::to_string(k));
+        std::size_t owner = t.lookup(h);
+        auto got = t.lookup(h, not_two);
+        REQUIRE(got);
+        CHECK(*got != 2);
+        if (owner != 2) {
+            CHECK(*got == owner);
+        } else {
+            ++moved;
+        }
+    }
+    CHECK(moved > 0);
+    CHECK_FALSE(t.lookup(7, [](std::size_t) { return false; }));
+}
@@ -0,0 +1,106 @@
+#include <doctest.h>
+
+#include "muses/net_components/outlier_detector.hpp"
+
+#include <chrono>
+#include <vector>
+
+using muses::CircuitState;
+using muses::OutlierDetector;
+using muses::OutlierOptions;
+using namespace std::chrono_literals;
+
+namespace {
+
+OutlierOptions options() {
+    OutlierOptions o;
+    o.interval = 1s;
+    o.min_requests = 10;
+    o.base_ejection = 5s;
+    o.half_open_requests = 2;
+    return o;
+}
+
+// `n` requests to `i` of `latency`, every `error_every`-th one failing.
+void feed(OutlierDetector& od, std::size_t i, int n, OutlierDetector::Clock::duration latency,
+          OutlierDetector::Clock::time_point now, int error_every = 0) {
+    for (int k = 0; k < n; ++k) {
+        od.record(i, latency, error_every > 0 && k % error_every == 0, now);
+    }
+}
+
+}  // namespace
+
+TEST_CASE("OutlierDetector: ejects the slow member, not a uniformly slow fleet") {
+    auto now = OutlierDetector::Clock::now();
+    OutlierDetector od(3, options());
+    feed(od, 0, 20, 2ms, now);
+    feed(od, 1, 20, 2ms, now);
+    feed(od, 2, 20, 40ms, now);  // 20× slower
+    CHECK(od.evaluate(now) == std::vector<std::size_t>{2});
+    CHECK(od.state(2) == CircuitState::Open);
+    CHECK_FALSE(od.usable(2, now));
+    CHECK(od.usable(0, now));
+
+    OutlierDetector slow(3, options());
+    for (std::size_t i = 0; i < 3; ++i) feed(slow, i, 20, 40ms, now);
+    CHECK(slow.evaluate(now).empty());
+
+    OutlierDetector off(2, OutlierOptions{});  // interval zero: disabled
+    feed(off, 1, 20, 1s, now);
+    CHECK(off.evaluate(now).empty());
+    CHECK(off.usable(1, now));
+}
+
+TEST_CASE("OutlierDetector: error rates and the ejection cap") {
+    auto now = OutlierDetector::Clock::now();
+    OutlierDetector od(4, options());  // at most 50%: two of four
+    feed(od, 0, 20, 1ms, now);
+    feed(od, 1, 20, 1ms, now, 2);   // 50% errors
+    feed(od, 2, 20, 1ms, now, 1);   // 100% errors
+    feed(od, 3, 20, 50ms, now, 2);  // slow and failing
+    feed(od, 3, 20, 1ms, now);
+    auto out = od.evaluate(now);
+    // All three failing ones are outliers; the worst two go, worst first.
+    CHECK(out == std::vector<std::size_t>{3, 2});
+    CHECK(od.ejected() == 2);
+    CHECK(od.state(1) == CircuitState::Closed);
+    CHECK(od.state(0) == CircuitState::Closed);
+
+    // Too few requests to judge.
+    OutlierDetector quiet(2, options());
+    feed(quiet, 0, 20, 1ms, now);
+    feed(quiet, 1, 5, 1s, now);
+    CHECK(quiet.evaluate(now).empty());
+}
+
+TEST_CASE("OutlierDetector: half-open admits a trickle and closes or re-opens") {
+    auto now = OutlierDetector::Clock::now();
+    OutlierDetector od(2, options());
+    feed(od, 0, 20, 2ms, now);
+    feed(od, 1, 20, 100ms, now);
+    REQUIRE(od.evaluate(now).size() == 1);
+    CHECK_FALSE(od.usable(1, now + 4s));
+
+    // After the ejection: two trials, then nothing until they report.
+    auto later = now + 5s;
+    REQUIRE(od.usable(1, later));
+    od.picked(1, later);
+    CHECK(od.state(1) == CircuitState::HalfOpen);
+    od.picked(1, later);
+    CHECK_FALSE(od.usable(1, later));
+
+    // A slow trial re-opens it, for twice as long this time.
+    od.record(1, 100ms, false, later);
+    CHECK(od.state(1) == CircuitState::Open);
+    CHECK_FALSE(od.usable(1, later + 9s));
+    auto again = later + 10s;
+    REQUIRE(od.usable(1, again));
+    od.picked(1, again);
+    od.picked(1, again);
+    od.record(1, 2ms, false, again);
+    CHECK(od.state(1) == CircuitState::HalfOpen);
+    od.record(1, 3ms, false, again);
+    CHECK(od.state(1) == CircuitState::Closed);
+    CHECK(od.usable(1, again));
+}
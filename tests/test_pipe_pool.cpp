@@ -0,0 +1,52 @@
+#include <doctest.h>
+
+#include "muses/net/pipe_pool.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+TEST_CASE("PipePool: released pairs are reused, dirty ones are closed") {
+    muses::PipePool pool(4);
+    muses::PipePair a = pool.acquire();
+    REQUIRE(a);
+    CHECK(::fcntl(a.read_fd, F_GETFL) & O_NONBLOCK);
+    pool.release(a, /*dirty=*/false);
+    CHECK(pool.idle() == 1);
+
+    muses::PipePair b = pool.acquire();
+    CHECK(b.read_fd == a.read_fd);
+    CHECK(pool.created() == 1);
+
+    REQUIRE(::write(b.write_fd, "x", 1) == 1);
+    pool.release(b, /*dirty=*/true);
+    CHECK(pool.idle() == 0);
+    CHECK(::fcntl(b.read_fd, F_GETFD) == -1);  // closed
+}
+
+TEST_CASE("PipePool: a lease returns its pair unless left dirty") {
+    muses::PipePool pool;
+    {
+        muses::PipePool::Lease lease(pool);
+        REQUIRE(lease);
+        lease.mark_dirty();
+        lease.mark_clean();
+    }
+    CHECK(pool.idle() == 1);
+    {
+        muses::PipePool::Lease lease(pool);
+        lease.mark_dirty();
+    }
+    CHECK(pool.idle() == 0);
+    CHECK(pool.created() == 1);
+}
+
+TEST_CASE("PipePool: idle pairs beyond max_idle are closed") {
+    muses::PipePool pool(1);
+    muses::PipePair a = pool.acquire();
+    muses::PipePair b = pool.acquire();
+    pool.release(a, false);
+    pool.release(b, false);
+    CHECK(pool.idle() == 1);
+    pool.clear();
+    CHECK(pool.idle() == 0);
+}
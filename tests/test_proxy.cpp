@@ -1,18 +1,21 @@
 #include <doctest.h>
 
-#include "muses/net/reactor.hpp"        // TCPListener for the proxy listen fd
+#include "muses/net/reactor.hpp"        // TCPListener/UnixListener for the proxy listen fd
 #include "muses/net_components/proxy.hpp"
 
 #include <arpa/inet.h>
 #include <netinet/in.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <atomic>
 #include <chrono>
 #include <cstring>
 #include <string>
 #include <thread>
+#include <vector>
 
 namespace {
 
@@ -25,19 +28,35 @@ struct MockUpstream {
     std::thread thr;
     std::atomic<bool> stop{false};
     std::string body = "upstream-ok";
+    std::string headers;  // extra response header lines, each ending in \r\n
+    std::string content_length;  // sent instead of the body's size if set
     bool keep_alive = true;
+    std::chrono::milliseconds delay{0};  // before each response
+    std::atomic<int> status{200};
+    std::atomic<int> requests{0};
+    bool hang_up = false;  // read the request, then close without answering
+    std::string unix_path;  // listen on this Unix-domain socket instead of 127.0.0.1
 
     void start() {
-        listen_fd = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
-        sockaddr_in a{}; a.sin_family = AF_INET;
-        a.sin_addr.s_addr = ::inet_addr("127.0.0.1");
-        a.sin_port = 0;
-        int opt = 1; ::setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
-        ::bind(listen_fd, reinterpret_cast<sockaddr*>(&a), sizeof(a));
-        ::listen(listen_fd, 8);
-        socklen_t l = sizeof(a);
-        ::getsockname(listen_fd, reinterpret_cast<sockaddr*>(&a), &l);
-        port = ntohs(a.sin_port);
+        if (!unix_path.empty()) {
+            listen_fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+            sockaddr_un u{}; u.sun_family = AF_UNIX;
+            std::strncpy(u.sun_path, unix_path.c_str(), sizeof(u.sun_path) - 1);
+            ::unlink(unix_path.c_str());
+            ::bind(listen_fd, reinterpret_cast<sockaddr*>(&u), sizeof(u));
+            ::listen(listen_fd, 8);
+        } else {
+            listen_fd = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+            sockaddr_in a{}; a.sin_family = AF_INET;
+            a.sin_addr.s_addr = ::inet_addr("127.0.0.1");
+            a.sin_port = 0;
+            int opt = 1; ::setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+            ::bind(listen_fd, reinterpret_cast<sockaddr*>(&a), sizeof(a));
+            ::listen(listen_fd, 8);
+            socklen_t l = sizeof(a);
+            ::getsockname(listen_fd, reinterpret_cast<sockaddr*>(&a), &l);
+            port = ntohs(a.sin_port);
+        }
         thr = std::thread([this] {
             while (!stop.load()) {
                 int c = ::accept(listen_fd, nullptr, nullptr);
@@ -50,10 +69,15 @@ struct MockUpstream {
                     if (r <= 0) break;
                     acc.append(buf, static_cast<std::size_t>(r));
                 }
+                requests.fetch_add(1);
+                if (hang_up) { ::close(c); continue; }
+                std::this_thread::sleep_for(delay);
                 std::string conn = keep_alive ? "keep-alive" : "close";
-                std::string resp = "HTTP/1.1 200 OK\r\nContent-Length: " +
-                    std::to_string(body.size()) + "\r\nConnection: " + conn +
-                    "\r\nX-Upstream: mock\r\n\r\n" + body;
+                std::string resp = "HTTP/1.1 " + std::to_string(status.load()) +
+                    " OK\r\nContent-Length: " +
+                    (content_length.empty() ? std::to_string(body.size()) : content_length) +
+                    "\r\nConnection: " + conn +
+                    "\r\nX-Upstream: mock\r\n" + headers + "\r\n" + body;
                 ::write(c, resp.data(), resp.size());
                 if (!keep_alive) { ::close(c); }
                 else {
@@ -70,9 +94,12 @@ struct MockUpstream {
         stop.store(true);
         if (listen_fd >= 0) { ::shutdown(listen_fd, SHUT_RDWR); ::close(listen_fd); }
         if (thr.joinable()) thr.join();
+        if (!unix_path.empty()) ::unlink(unix_path.c_str());
     }
 };
 
+std::string roundtrip_on(int fd, const std::string& req);
+
 // Open a client socket, send a request, read the full response (up to a
 // Content-Length body or EOF). Returns the response bytes.
 std::string proxy_roundtrip(unsigned short port, const std::string& req) {
@@ -83,6 +110,22 @@ std::string proxy_roundtrip(unsigned short port, const std::string& req) {
     if (::connect(fd, reinterpret_cast<sockaddr*>(&a), sizeof(a)) != 0) {
         ::close(fd); return "";
     }
+    return roundtrip_on(fd, req);
+}
+
+// proxy_roundtrip through the Unix-domain socket at `path`.
+std::string proxy_roundtrip_unix(const std::string& path, const std::string& req) {
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un u{}; u.sun_family = AF_UNIX;
+    std::strncpy(u.sun_path, path.c_str(), sizeof(u.sun_path) - 1);
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&u), sizeof(u)) != 0) {
+        ::close(fd); return "";
+    }
+    return roundtrip_on(fd, req);
+}
+
+// Send `req` on connected `fd`, read the response, close `fd`.
+std::string roundtrip_on(int fd, const std::string& req) {
     ::write(fd, req.data(), req.size());
     std::string out; char buf[4096];
     // Read until EOF (the requests use Connection: close) with a per-read
@@ -106,6 +149,107 @@ std::string proxy_roundtrip(unsigned short port, const std::string& req) {
     return out;
 }
 
+// A bound, listening loopback socket on an ephemeral port.
+int listen_loopback(unsigned short& port) {
+    int fd = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    sockaddr_in a{}; a.sin_family = AF_INET;
+    a.sin_addr.s_addr = ::inet_addr("127.0.0.1");
+    a.sin_port = 0;
+    int opt = 1; ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    ::bind(fd, reinterpret_cast<sockaddr*>(&a), sizeof(a));
+    ::listen(fd, 8);
+    socklen_t l = sizeof(a);
+    ::getsockname(fd, reinterpret_cast<sockaddr*>(&a), &l);
+    port = ntohs(a.sin_port);
+    return fd;
+}
+
+int connect_loopback(unsigned short port) {
+    int fd = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    sockaddr_in a{}; a.sin_family = AF_INET;
+    a.sin_addr.s_addr = ::inet_addr("127.0.0.1");
+    a.sin_port = htons(port);
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&a), sizeof(a)) != 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Upstream for one connection: reads the request head and its
+// Content-Length body, then hands the socket to `respond` with the head and
+// the number of body bytes received. Without a Content-Length, any body bytes
+// read with the head are left on the end of it.
+struct ScriptedUpstream {
+    int listen_fd = -1;
+    unsigned short port = 0;
+    std::thread thr;
+
+    template <typename F>
+    explicit ScriptedUpstream(F respond) {
+        listen_fd = listen_loopback(port);
+        thr = std::thread([this, respond] {
+            int c = ::accept(listen_fd, nullptr, nullptr);
+            if (c < 0) return;
+            std::string head;
+            char buf[65536];
+            std::size_t body = 0;
+            while (head.find("\r\n\r\n") == std::string::npos) {
+                ssize_t r = ::read(c, buf, sizeof(buf));
+                if (r <= 0) { ::close(c); return; }
+                head.append(buf, static_cast<std::size_t>(r));
+            }
+            std::size_t want = 0;
+            if (auto p = head.find("Content-Length: "); p != std::string::npos) {
+                want = std::stoul(head.substr(p + 16));
+                // Only a sized body is counted here; anything else stays in
+                // `head` for `respond` to parse.
+                std::size_t end = head.find("\r\n\r\n") + 4;
+                body = head.size() - end;
+                head.resize(end);
+            }
+            while (body < want) {
+                ssize_t r = ::read(c, buf, sizeof(buf));
+                if (r <= 0) break;
+                body += static_cast<std::size_t>(r);
+            }
+            respond(c, head, body);
+            ::close(c);
+        });
+    }
+
+    ~ScriptedUpstream() {
+        ::shutdown(listen_fd, SHUT_RDWR);
+        if (thr.joinable()) thr.join();
+        ::close(listen_fd);
+    }
+};
+
+void write_str(int fd, const std::string& s) {
+    std::size_t off = 0;
+    while (off < s.size()) {
+        ssize_t w = ::write(fd, s.data() + off, s.size() - off);
+        if (w <= 0) return;
+        off += static_cast<std::size_t>(w);
+    }
+}
+
+// Reads until `done(acc)` holds, EOF, or `limit` passes.
+template <typename Pred>
+std::string read_while(int fd, Pred done, std::chrono::milliseconds limit) {
+    std::string acc;
+    char buf[65536];
+    auto deadline = std::chrono::steady_clock::now() + limit;
+    timeval tv{0, 50 * 1000};
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    while (!done(acc) && std::chrono::steady_clock::now() < deadline) {
+        ssize_t r = ::read(fd, buf, sizeof(buf));
+        if (r == 0) break;
+        if (r > 0) acc.append(buf, static_cast<std::size_t>(r));
+    }
+    return acc;
+}
+
 }  // namespace
 
 TEST_CASE("Proxy: forwards a GET request to the upstream") {
@@ -222,3 +366,1116 @@ TEST_CASE("Proxy: prefix routing selects the right upstream") {
     proxy.stop();
     ::close(lfd);
 }
+
+TEST_CASE("Proxy: 504 when the upstream accepts but never answers") {
+    // Upstream that accepts (backlog) but never reads or writes.
+    int up = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    sockaddr_in ua{}; ua.sin_family = AF_INET;
+    ua.sin_addr.s_addr = ::inet_addr("127.0.0.1");
+    ua.sin_port = 0;
+    ::bind(up, reinterpret_cast<sockaddr*>(&ua), sizeof(ua));
+    ::listen(up, 8);
+    socklen_t ul = sizeof(ua);
+    ::getsockname(up, reinterpret_cast<sockaddr*>(&ua), &ul);
+
+    int lfd = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    sockaddr_in a{}; a.sin_family = AF_INET;
+    a.sin_addr.s_addr = ::inet_addr("127.0.0.1");
+    a.sin_port = 0;
+    int opt = 1; ::setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    ::bind(lfd, reinterpret_cast<sockaddr*>(&a), sizeof(a));
+    ::listen(lfd, 8);
+    socklen_t l = sizeof(a);
+    ::getsockname(lfd, reinterpret_cast<sockaddr*>(&a), &l);
+    unsigned short pport = ntohs(a.sin_port);
+
+    muses::ProxyOptions opts;
+    opts.max_retries = 0;
+    opts.upstream_timeout = std::chrono::milliseconds(300);
+    muses::ProxyServer proxy(lfd, {{"", "127.0.0.1", ntohs(ua.sin_port)}}, opts);
+    proxy.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    auto start = std::chrono::steady_clock::now();
+    std::string resp = proxy_roundtrip(pport,
+        "GET / HTTP/1.1\r\nHost: x\r\nConnection: close\r\n\r\n");
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    CHECK(resp.find("504") != std::string::npos);
+    CHECK(elapsed < std::chrono::seconds(3));
+
+    proxy.stop();
+    ::close(lfd);
+    ::close(up);
+}
+
+TEST_CASE("Proxy: an idle client connection is closed after client_timeout") {
+    int lfd = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    sockaddr_in a{}; a.sin_family = AF_INET;
+    a.sin_addr.s_addr = ::inet_addr("127.0.0.1");
+    a.sin_port = 0;
+    int opt = 1; ::setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    ::bind(lfd, reinterpret_cast<sockaddr*>(&a), sizeof(a));
+    ::listen(lfd, 8);
+    socklen_t l = sizeof(a);
+    ::getsockname(lfd, reinterpret_cast<sockaddr*>(&a), &l);
+
+    muses::ProxyOptions opts;
+    opts.client_timeout = std::chrono::milliseconds(200);
+    muses::ProxyServer proxy(lfd, {}, opts);
+    proxy.start();
+
+    int fd = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    REQUIRE(::connect(fd, reinterpret_cast<sockaddr*>(&a), sizeof(a)) == 0);
+    // Send nothing; the proxy should hang up on its own.
+    timeval tv{3, 0};
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    char c;
+    auto start = std::chrono::steady_clock::now();
+    ssize_t r = ::read(fd, &c, 1);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    CHECK(r == 0);  // EOF, not a receive timeout
+    CHECK(elapsed < std::chrono::seconds(2));
+    ::close(fd);
+
+    proxy.stop();
+    ::close(lfd);
+}
+
+TEST_CASE("Proxy: streams the response head before the body is complete") {
+    constexpr std::size_t kBody = 4 * 1024 * 1024;
+    ScriptedUpstream up([](int c, const std::string&, std::size_t) {
+        write_str(c, "HTTP/1.1 200 OK\r\nContent-Length: " + std::to_string(kBody) +
+                         "\r\n\r\n" + std::string(64 * 1024, 'a'));
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        write_str(c, std::string(kBody - 64 * 1024, 'b'));
+    });
+    unsigned short pport = 0;
+    int lfd = listen_loopback(pport);
+    muses::ProxyServer proxy(lfd, {{"", "127.0.0.1", up.port}}, /*retries=*/0);
+    proxy.start();
+
+    int fd = connect_loopback(pport);
+    REQUIRE(fd >= 0);
+    auto start = std::chrono::steady_clock::now();
+    write_str(fd, "GET /big HTTP/1.1\r\nHost: x\r\nConnection: close\r\n\r\n");
+    std::string first = read_while(fd, [](const std::string& acc) {
+        return acc.find("\r\n\r\n") != std::string::npos;
+    }, std::chrono::milliseconds(2000));
+    auto ttfb = std::chrono::steady_clock::now() - start;
+    REQUIRE(first.find("\r\n\r\n") != std::string::npos);
+    CHECK(ttfb < std::chrono::milliseconds(400));  // before the upstream finished
+
+    std::size_t hdr = first.find("\r\n\r\n") + 4;
+    std::string rest = read_while(fd, [&](const std::string& acc) {
+        return first.size() - hdr + acc.size() >= kBody;
+    }, std::chrono::milliseconds(5000));
+    std::string body = first.substr(hdr) + rest;
+    CHECK(body.size() == kBody);
+    CHECK(std::count(body.begin(), body.end(), 'a') == 64 * 1024);
+    ::close(fd);
+    proxy.stop();
+    ::close(lfd);
+}
+
+TEST_CASE("Proxy: relays a chunked body and ends at the last chunk") {
+    ScriptedUpstream up([](int c, const std::string&, std::size_t) {
+        write_str(c, "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n5\r\nhel");
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        write_str(c, "lo\r\n6\r\n world\r\n0\r");
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        write_str(c, "\n\r\n");
+        // Keep the connection open: only the terminator can end the body.
+        std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+    });
+    unsigned short pport = 0;
+    int lfd = listen_loopback(pport);
+    muses::ProxyServer proxy(lfd, {{"", "127.0.0.1", up.port}}, /*retries=*/0);
+    proxy.start();
+
+    int fd = connect_loopback(pport);
+    REQUIRE(fd >= 0);
+    auto start = std::chrono::steady_clock::now();
+    write_str(fd, "GET / HTTP/1.1\r\nHost: x\r\nConnection: close\r\n\r\n");
+    // Connection: close — the proxy hangs up once the response is complete.
+    std::string resp = read_while(fd, [](const std::string&) { return false; },
+                                  std::chrono::milliseconds(3000));
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    CHECK(resp.ends_with("5\r\nhello\r\n6\r\n world\r\n0\r\n\r\n"));
+    CHECK(elapsed < std::chrono::milliseconds(1000));
+    ::close(fd);
+    proxy.stop();
+    ::close(lfd);
+}
+
+TEST_CASE("Proxy: streams a large request body to the upstream") {
+    constexpr std::size_t kBody = 2 * 1024 * 1024;  // well past max_replay_body
+    ScriptedUpstream up([](int c, const std::string&, std::size_t got) {
+        std::string n = std::to_string(got);
+        write_str(c, "HTTP/1.1 200 OK\r\nContent-Length: " + std::to_string(n.size()) +
+                         "\r\n\r\n" + n);
+    });
+    unsigned short pport = 0;
+    int lfd = listen_loopback(pport);
+    muses::ProxyServer proxy(lfd, {{"", "127.0.0.1", up.port}}, /*retries=*/0);
+    proxy.start();
+
+    int fd = connect_loopback(pport);
+    REQUIRE(fd >= 0);
+    std::thread writer([fd] {
+        write_str(fd, "POST /upload HTTP/1.1\r\nHost: x\r\nConnection: close\r\n"
+                      "Content-Length: " + std::to_string(kBody) + "\r\n\r\n");
+        write_str(fd, std::string(kBody, 'z'));
+    });
+    std::string resp = read_while(fd, [](const std::string&) { return false; },
+                                  std::chrono::milliseconds(5000));
+    writer.join();
+    CHECK(resp.find("HTTP/1.1 200") != std::string::npos);
+    CHECK(resp.ends_with("\r\n\r\n" + std::to_string(kBody)));
+    ::close(fd);
+    proxy.stop();
+    ::close(lfd);
+}
+
+TEST_CASE("Proxy: a HEAD response with Content-Length has no body to wait for") {
+    ScriptedUpstream up([](int c, const std::string&, std::size_t) {
+        write_str(c, "HTTP/1.1 200 OK\r\nContent-Length: 1000\r\n\r\n");
+        std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+    });
+    unsigned short pport = 0;
+    int lfd = listen_loopback(pport);
+    muses::ProxyOptions opts;
+    opts.max_retries = 0;
+    opts.upstream_timeout = std::chrono::milliseconds(5000);
+    muses::ProxyServer proxy(lfd, {{"", "127.0.0.1", up.port}}, opts);
+    proxy.start();
+
+    int fd = connect_loopback(pport);
+    REQUIRE(fd >= 0);
+    auto start = std::chrono::steady_clock::now();
+    write_str(fd, "HEAD / HTTP/1.1\r\nHost: x\r\nConnection: close\r\n\r\n");
+    std::string resp = read_while(fd, [](const std::string&) { return false; },
+                                  std::chrono::milliseconds(3000));
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    CHECK(resp.ends_with("Content-Length: 1000\r\n\r\n"));
+    CHECK(elapsed < std::chrono::milliseconds(1000));
+    ::close(fd);
+    proxy.stop();
+    ::close(lfd);
+}
+
+TEST_CASE("Proxy: zero-copy and copying relays move the same bytes") {
+    constexpr std::size_t kBody = 3 * 1024 * 1024 + 17;
+    std::string pattern(kBody, '\0');
+    for (std::size_t i = 0; i < kBody; ++i) pattern[i] = static_cast<char>((i * 131) % 251);
+
+    for (bool zero_copy : {true, false}) {
+        ScriptedUpstream up([&pattern](int c, const std::string&, std::size_t got) {
+            std::string head = "HTTP/1.1 200 OK\r\nX-Got: " + std::to_string(got) +
+                               "\r\nContent-Length: " + std::to_string(kBody) + "\r\n\r\n";
+            write_str(c, head);
+            write_str(c, pattern);
+        });
+        unsigned short pport = 0;
+        int lfd = listen_loopback(pport);
+        muses::ProxyOptions opts;
+        opts.max_retries = 0;
+        opts.zero_copy = zero_copy;
+        muses::ProxyServer proxy(lfd, {{"", "127.0.0.1", up.port}}, opts);
+        proxy.start();
+
+        int fd = connect_loopback(pport);
+        REQUIRE(fd >= 0);
+        std::thread writer([fd, &pattern] {
+            write_str(fd, "PUT /blob HTTP/1.1\r\nHost: x\r\nConnection: close\r\n"
+                          "Content-Length: " + std::to_string(kBody) + "\r\n\r\n");
+            write_str(fd, pattern);
+        });
+        std::string resp = read_while(fd, [](const std::string&) { return false; },
+                                      std::chrono::milliseconds(8000));
+        writer.join();
+        std::size_t hdr = resp.find("\r\n\r\n");
+        REQUIRE(hdr != std::string::npos);
+        CHECK(resp.find("X-Got: " + std::to_string(kBody)) != std::string::npos);
+        CHECK(resp.substr(hdr + 4) == pattern);
+        ::close(fd);
+        proxy.stop();
+        ::close(lfd);
+    }
+}
+
+TEST_CASE("Proxy: chunk data that looks like the last chunk does not end the body") {
+    // 0x10 bytes of data containing "\r\n0\r\n\r\n", then a trailer.
+    const std::string data = "ab\r\n0\r\n\r\ncdefghi";
+    const std::string body = "10\r\n" + data + "\r\n0\r\nX-Trailer: t\r\n\r\n";
+    ScriptedUpstream up([&body](int c, const std::string&, std::size_t) {
+        write_str(c, "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n" + body.substr(0, 9));
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        write_str(c, body.substr(9));
+        std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+    });
+    unsigned short pport = 0;
+    int lfd = listen_loopback(pport);
+    muses::ProxyServer proxy(lfd, {{"", "127.0.0.1", up.port}}, /*retries=*/0);
+    proxy.start();
+
+    int fd = connect_loopback(pport);
+    REQUIRE(fd >= 0);
+    write_str(fd, "GET / HTTP/1.1\r\nHost: x\r\nConnection: close\r\n\r\n");
+    std::string resp = read_while(fd, [](const std::string&) { return false; },
+                                  std::chrono::milliseconds(3000));
+    CHECK(resp.ends_with(body));
+    ::close(fd);
+    proxy.stop();
+    ::close(lfd);
+}
+
+TEST_CASE("Proxy: a chunked upload streams through with its framing") {
+    std::string received;
+    ScriptedUpstream up([&received](int c, const std::string& head, std::size_t) {
+        received = head;
+        char buf[4096];
+        while (received.find("0\r\n\r\n") == std::string::npos) {
+            ssize_t r = ::read(c, buf, sizeof(buf));
+            if (r <= 0) break;
+            received.append(buf, static_cast<std::size_t>(r));
+        }
+        write_str(c, "HTTP/1.1 201 Created\r\nContent-Length: 0\r\n\r\n");
+    });
+    unsigned short pport = 0;
+    int lfd = listen_loopback(pport);
+    muses::ProxyServer proxy(lfd, {{"", "127.0.0.1", up.port}}, /*retries=*/0);
+    proxy.start();
+
+    int fd = connect_loopback(pport);
+    REQUIRE(fd >= 0);
+    write_str(fd, "POST /up HTTP/1.1\r\nHost: x\r\nConnection: close\r\n"
+                  "Transfer-Encoding: chunked\r\n\r\n4\r\nwiki\r\n");
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    write_str(fd, "5\r\npedia\r\n0\r\n\r\n");
+    std::string resp = read_while(fd, [](const std::string&) { return false; },
+                                  std::chrono::milliseconds(3000));
+    CHECK(resp.find("201 Created") != std::string::npos);
+    CHECK(received.find("Transfer-Encoding: chunked\r\n") != std::string::npos);
+    CHECK(received.ends_with("\r\n\r\n4\r\nwiki\r\n5\r\npedia\r\n0\r\n\r\n"));
+    ::close(fd);
+    proxy.stop();
+    ::close(lfd);
+}
+
+TEST_CASE("Proxy: forwards the client's header lines less hop-by-hop ones") {
+    std::string received;
+    std::size_t body_bytes = 0;
+    ScriptedUpstream up([&](int c, const std::string& head, std::size_t got) {
+        received = head;
+        body_bytes = got;
+        write_str(c, "HTTP/1.1 204 No Content\r\n\r\n");
+    });
+    unsigned short pport = 0;
+    int lfd = listen_loopback(pport);
+    muses::ProxyServer proxy(lfd, {{"", "127.0.0.1", up.port}}, /*retries=*/0);
+    proxy.start();
+
+    std::string resp = proxy_roundtrip(pport,
+        "PUT /doc?v=2 HTTP/1.1\r\nHost: x\r\nUpgrade: websocket\r\nX-Tag: one\r\n"
+        "KEEP-ALIVE: timeout=5\r\nX-Tag: two\r\nConnection: close\r\nTE: trailers\r\n"
+        "Proxy-Authorization: Basic abc\r\nContent-Length: 5\r\n"
+        "X-Tea: green\r\n\r\nhello");
+    CHECK(resp.find("204 No Content") != std::string::npos);
+    // Order, duplicates and case as the client sent them; the proxy's
+    // header goes last.
+    CHECK(received == "PUT /doc?v=2 HTTP/1.1\r\nHost: x\r\nX-Tag: one\r\nX-Tag: two\r\n"
+                      "Content-Length: 5\r\nX-Tea: green\r\nX-Forwarded-Proto: http\r\n\r\n");
+    CHECK(body_bytes == 5);
+    proxy.stop();
+    ::close(lfd);
+}
+
+TEST_CASE("Proxy: rejects a request with both Content-Length and chunked") {
+    unsigned short pport = 0;
+    int lfd = listen_loopback(pport);
+    muses::ProxyServer proxy(lfd, {{"", "127.0.0.1", 1}}, /*retries=*/0);
+    proxy.start();
+    std::string resp = proxy_roundtrip(pport,
+        "POST / HTTP/1.1\r\nHost: x\r\nContent-Length: 5\r\n"
+        "Transfer-Encoding: chunked\r\n\r\n0\r\n\r\n");
+    CHECK(resp.find("400") != std::string::npos);
+    proxy.stop();
+    ::close(lfd);
+}
+
+TEST_CASE("Proxy: rejects repeated or conflicting Content-Length lines") {
+    MockUpstream up;
+    up.start();
+    unsigned short pport = 0;
+    int lfd = listen_loopback(pport);
+    muses::ProxyServer proxy(lfd, {{"", "127.0.0.1", up.port}}, /*retries=*/0);
+    proxy.start();
+    for (const char* req : {
+             "POST / HTTP/1.1\r\nHost: x\r\nContent-Length: 3\r\n"
+             "Content-Length: 9\r\n\r\nabc",
+             "POST / HTTP/1.1\r\nHost: x\r\nContent-Length: 3\r\n"
+             "content-length: 3\r\n\r\nabc",
+             "POST / HTTP/1.1\r\nHost: x\r\nContent-Length: 3, 9\r\n\r\nabc",
+             // Digits, but more than 64 bits of them.
+             "POST / HTTP/1.1\r\nHost: x\r\nContent-Length: 99999999999999999999999\r\n\r\nabc",
+             // Whitespace between the name and the colon (RFC 9112 §5.1).
+             "POST / HTTP/1.1\r\nHost: x\r\nContent-Length : 3\r\n\r\nabc"}) {
+        CHECK(proxy_roundtrip(pport, req).find("400 Bad Request") != std::string::npos);
+    }
+    CHECK(up.requests.load() == 0);
+    proxy.stop();
+    ::close(lfd);
+}
+
+TEST_CASE("Proxy: rejects a request with a folded header line") {
+    MockUpstream up;
+    up.start();
+    unsigned short pport = 0;
+    int lfd = listen_loopback(pport);
+    muses::ProxyServer proxy(lfd, {{"", "127.0.0.1", up.port}}, /*retries=*/0);
+    proxy.start();
+    std::string resp = proxy_roundtrip(pport,
+        "GET / HTTP/1.1\r\nHost: x\r\nX-Note: one\r\n two\r\nConnection: close\r\n\r\n");
+    CHECK(resp.find("400 Bad Request") != std::string::npos);
+    CHECK(resp.find("folded") != std::string::npos);
+    CHECK(up.requests.load() == 0);
+    proxy.stop();
+    ::close(lfd);
+}
+
+TEST_CASE("Proxy: routes by longest prefix, Host and method") {
+    MockUpstream up_root;  up_root.body = "root-backend";   up_root.start();
+    MockUpstream up_api;   up_api.body = "api-backend";     up_api.start();
+    MockUpstream up_vhost; up_vhost.body = "vhost-backend"; up_vhost.start();
+
+    unsigned short pport = 0;
+    int lfd = listen_loopback(pport);
+    // Broader prefix declared first: it used to shadow /api/.
+    muses::ProxyServer proxy(lfd, {
+        {"/",     "127.0.0.1", up_root.port},
+        {"/api/", "127.0.0.1", up_api.port, "", {"GET"}},
+        {"/",     "127.0.0.1", up_vhost.port, "shop.example"},
+    }, /*retries=*/0);
+    proxy.start();
+
+    CHECK(proxy_roundtrip(pport, "GET /api/x HTTP/1.1\r\nHost: a\r\nConnection: close\r\n\r\n")
+              .find("api-backend") != std::string::npos);
+    CHECK(proxy_roundtrip(pport, "DELETE /api/x HTTP/1.1\r\nHost: a\r\nConnection: close\r\n\r\n")
+              .find("root-backend") != std::string::npos);
+    CHECK(proxy_roundtrip(pport,
+                          "GET /api/x HTTP/1.1\r\nHost: Shop.Example:80\r\nConnection: close\r\n\r\n")
+              .find("vhost-backend") != std::string::npos);
+
+    proxy.stop();
+    ::close(lfd);
+}
+
+
+TEST_CASE("Proxy: spreads a route over its endpoints and skips a dead one") {
+    MockUpstream up_a; up_a.body = "backend-a"; up_a.keep_alive = false; up_a.start();
+    MockUpstream up_b; up_b.body = "backend-b"; up_b.keep_alive = false; up_b.start();
+
+    unsigned short pport = 0;
+    int lfd = listen_loopback(pport);
+    muses::ProxyRoute route{"/", "", 0};
+    route.endpoints = {{"127.0.0.1", up_a.port}, {"127.0.0.1", up_b.port}, {"127.0.0.1", 1}};
+    muses::ProxyServer proxy(lfd, {route}, /*retries=*/1);
+    proxy.start();
+
+    // Round-robin across three; the first request routed to the closed port
+    // marks it unhealthy and retries elsewhere, so every request succeeds.
+    int a = 0, b = 0;
+    for (int i = 0; i < 6; ++i) {
+        std::string r = proxy_roundtrip(pport, "GET / HTTP/1.1\r\nHost: x\r\nConnection: close\r\n\r\n");
+        if (r.find("backend-a") != std::string::npos) ++a;
+        if (r.find("backend-b") != std::string::npos) ++b;
+    }
+    CHECK(a + b == 6);
+    CHECK(a >= 2);
+    CHECK(b >= 2);
+
+    proxy.stop();
+    ::close(lfd);
+}
+
+TEST_CASE("Proxy: consistent hashing pins a path to one endpoint") {
+    MockUpstream ups[3];
+    for (int i = 0; i < 3; ++i) {
+        ups[i].body = "backend-" + std::to_string(i);
+        ups[i].keep_alive = false;
+        ups[i].start();
+    }
+    unsigned short pport = 0;
+    int lfd = listen_loopback(pport);
+    muses::ProxyRoute by_path{"/", "", 0};
+    by_path.balance = muses::BalancePolicy::ConsistentHash;
+    for (auto& u : ups) by_path.endpoints.push_back({"127.0.0.1", u.port});
+    muses::ProxyRoute by_header = by_path;
+    by_header.prefix = "/h/";
+    by_header.hash_key = muses::HashKey::Header;
+    by_header.hash_header = "X-User";
+    muses::ProxyServer proxy(lfd, {by_path, by_header}, /*retries=*/0);
+    proxy.start();
+
+    auto backend_of = [&](const std::string& req) {
+        std::string r = proxy_roundtrip(pport, req);
+        std::size_t at = r.find("backend-");
+        return at == std::string::npos ? -1 : r[at + 8] - '0';
+    };
+    // The query string is not part of the key.
+    int first = backend_of("GET /img/cat.png?v=1 HTTP/1.1\r\nHost: x\r\nConnection: close\r\n\r\n");
+    REQUIRE(first >= 0);
+    for (int i = 0; i < 3; ++i) {
+        CHECK(backend_of("GET /img/cat.png?v=" + std::to_string(i + 2) +
+                         " HTTP/1.1\r\nHost: x\r\nConnection: close\r\n\r\n") == first);
+    }
+    int user = backend_of("GET /h/a HTTP/1.1\r\nHost: x\r\nX-User: 17\r\nConnection: close\r\n\r\n");
+    REQUIRE(user >= 0);
+    CHECK(backend_of("GET /h/b HTTP/1.1\r\nHost: x\r\nX-User: 17\r\nConnection: close\r\n\r\n") == user);
+
+    proxy.stop();
+    ::close(lfd);
+}
+
+TEST_CASE("Proxy: prewarms upstream connections ahead of demand") {
+    MockUpstream up;
+    up.start();
+    unsigned short pport = 0;
+    int lfd = listen_loopback(pport);
+    muses::ProxyOptions opts;
+    opts.min_idle_per_upstream = 1;
+    muses::ProxyServer proxy(lfd, {{"/", "127.0.0.1", up.port}}, opts);
+    proxy.start();
+
+    for (int i = 0; i < 50 && proxy.upstream_stats("127.0.0.1", up.port).idle == 0; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    CHECK(proxy.upstream_stats("127.0.0.1", up.port).idle == 1);
+    CHECK(proxy.upstream_stats("127.0.0.1", up.port).connects == 1);
+
+    const std::string req = "GET / HTTP/1.1\r\nHost: x\r\nConnection: close\r\n\r\n";
+    CHECK(proxy_roundtrip(pport, req).find("upstream-ok") != std::string::npos);
+    CHECK(proxy.upstream_stats("127.0.0.1", up.port).reused == 1);  // no connect on the request path
+    for (int i = 0; i < 50 && proxy.upstream_stats("127.0.0.1", up.port).connects < 2; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    CHECK(proxy.upstream_stats("127.0.0.1", up.port).connects == 2);  // replaced in the background
+    CHECK(proxy.upstream_stats("10.9.9.9", 1).connects == 0);
+
+    proxy.stop();
+    ::close(lfd);
+}
+
+TEST_CASE("Proxy: listens on and forwards to Unix-domain sockets") {
+    const std::string base = "/tmp/muses_proxy_" + std::to_string(::getpid());
+    MockUpstream up;
+    up.unix_path = base + "_up.sock";
+    up.body = "hello-over-uds";
+    up.start();
+    muses::UnixListener listener(base + "_in.sock");
+    auto lfd = listener.get_listener();
+    REQUIRE(lfd.has_value());
+
+    muses::ProxyOptions opts;
+    opts.max_retries = 0;
+    muses::ProxyServer proxy(*lfd, {{"/", "unix:" + up.unix_path, 0},
+                                    {"/gone/", "unix:" + base + "_missing.sock", 0}},
+                             opts);
+    proxy.start();
+
+    const std::string req = "GET / HTTP/1.1\r\nHost: x\r\nConnection: close\r\n\r\n";
+    std::string resp = proxy_roundtrip_unix(listener.path(), req);
+    CHECK(resp.find("HTTP/1.1 200") != std::string::npos);
+    CHECK(resp.find("hello-over-uds") != std::string::npos);
+    // The upstream connection went back to the pool under its socket name.
+    CHECK(proxy.upstream_stats("unix:" + up.unix_path, 0).connects == 1);
+    CHECK(proxy.upstream_stats("unix:" + up.unix_path, 0).idle == 1);
+    // Nothing listens at the other route's socket.
+    resp = proxy_roundtrip_unix(listener.path(),
+                                "GET /gone/x HTTP/1.1\r\nHost: x\r\nConnection: close\r\n\r\n");
+    CHECK(resp.find("HTTP/1.1 502") != std::string::npos);
+
+    proxy.stop();
+}
+
+TEST_CASE("Proxy: a full Unix-socket backlog is overload, not a dead upstream") {
+    const std::string base = "/tmp/muses_proxy_busy_" + std::to_string(::getpid());
+    const std::string up_path = base + "_up.sock";
+    // An upstream that stops accepting: listen with no backlog to spare.
+    int up_fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un u{}; u.sun_family = AF_UNIX;
+    std::strncpy(u.sun_path, up_path.c_str(), sizeof(u.sun_path) - 1);
+    ::unlink(up_path.c_str());
+    REQUIRE(::bind(up_fd, reinterpret_cast<sockaddr*>(&u), sizeof(u)) == 0);
+    REQUIRE(::listen(up_fd, 0) == 0);
+    std::vector<int> queued;
+    for (;;) {
+        int c = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        if (::connect(c, reinterpret_cast<sockaddr*>(&u), sizeof(u)) != 0) {
+            CHECK(errno == EAGAIN);
+            ::close(c);
+            break;
+        }
+        queued.push_back(c);
+    }
+
+    muses::UnixListener listener(base + "_in.sock");
+    auto lfd = listener.get_listener();
+    REQUIRE(lfd.has_value());
+    muses::ProxyOptions opts;
+    opts.max_retries = 0;
+    muses::ProxyServer proxy(*lfd, {{"/", "unix:" + up_path, 0}}, opts);
+    proxy.start();
+
+    const std::string req = "GET / HTTP/1.1\r\nHost: x\r\nConnection: close\r\n\r\n";
+    std::string resp = proxy_roundtrip_unix(listener.path(), req);
+    CHECK(resp.find("HTTP/1.1 503") != std::string::npos);
+
+    // Drain the backlog and answer the next connection: the endpoint was
+    // never taken out, so that request goes straight through.
+    for (int c : queued) {
+        ::close(::accept(up_fd, nullptr, nullptr));
+        ::close(c);
+    }
+    std::thread server([up_fd] {
+        int c = ::accept(up_fd, nullptr, nullptr);
+        char buf[4096];
+        std::string acc;
+        while (acc.find("\r\n\r\n") == std::string::npos) {
+            ssize_t r = ::read(c, buf, sizeof(buf));
+            if (r <= 0) break;
+            acc.append(buf, static_cast<std::size_t>(r));
+        }
+        const std::string ok = "HTTP/1.1 200 OK\r\nContent-Length: 2\r\nConnection: close\r\n\r\nok";
+        ::write(c, ok.data(), ok.size());
+        ::close(c);
+    });
+    resp = proxy_roundtrip_unix(listener.path(), req);
+    CHECK(resp.find("HTTP/1.1 200") != std::string::npos);
+    server.join();
+
+    proxy.stop();
+    ::close(up_fd);
+    ::unlink(up_path.c_str());
+}
+
+TEST_CASE("Proxy: an upstream Content-Length that does not parse is a 502") {
+    MockUpstream up;
+    up.content_length = "abc";
+    up.headers = "Cache-Control: max-age=60\r\n";
+    up.start();
+    unsigned short pport = 0;
+    int lfd = listen_loopback(pport);
+    muses::ProxyOptions opts;
+    opts.max_retries = 0;
+    opts.cache = std::make_shared<muses::ResponseCache>();
+    muses::ProxyServer proxy(lfd, {{"/", "127.0.0.1", up.port}}, opts);
+    proxy.start();
+
+    const std::string req = "GET / HTTP/1.1\r\nHost: x\r\nConnection: close\r\n\r\n";
+    std::string resp = proxy_roundtrip(pport, req);
+    CHECK(resp.find("HTTP/1.1 502") != std::string::npos);
+    CHECK(resp.find("malformed upstream response") != std::string::npos);
+    // Its body's end is unknown: the connection is not pooled, and nothing
+    // is cached, so the next request goes upstream again.
+    CHECK(proxy.upstream_stats("127.0.0.1", up.port).idle == 0);
+    CHECK(proxy_roundtrip(pport, req).find("HTTP/1.1 502") != std::string::npos);
+    CHECK(up.requests.load() == 2);
+
+    proxy.stop();
+    ::close(lfd);
+}
+
+TEST_CASE("Proxy: a pooled connection the upstream closed is not reused") {
+    MockUpstream up;  // answers keep-alive, then closes each connection after 200ms
+    up.start();
+    unsigned short pport = 0;
+    int lfd = listen_loopback(pport);
+    muses::ProxyOptions opts;
+    opts.max_retries = 0;  // a stale pooled fd would surface as a 502
+    muses::ProxyServer proxy(lfd, {{"/", "127.0.0.1", up.port}}, opts);
+    proxy.start();
+
+    const std::string req = "GET / HTTP/1.1\r\nHost: x\r\nConnection: close\r\n\r\n";
+    CHECK(proxy_roundtrip(pport, req).find("upstream-ok") != std::string::npos);
+    CHECK(proxy.upstream_stats("127.0.0.1", up.port).idle == 1);
+    std::this_thread::sleep_for(std::chrono::milliseconds(400));
+    CHECK(proxy_roundtrip(pport, req).find("upstream-ok") != std::string::npos);
+    CHECK(proxy.upstream_stats("127.0.0.1", up.port).stale_closed == 1);
+    CHECK(proxy.upstream_stats("127.0.0.1", up.port).connects == 2);
+
+    proxy.stop();
+    ::close(lfd);
+}
+
+TEST_CASE("HealthTable: down until the cooldown passes") {
+    muses::HealthTable h(2);
+    auto now = muses::HealthTable::Clock::now();
+    CHECK(h.healthy(0, now));
+    CHECK(h.mark_down(0, now + std::chrono::seconds(1), now));        // first to notice
+    CHECK_FALSE(h.mark_down(0, now + std::chrono::seconds(2), now));  // already down
+    CHECK_FALSE(h.healthy(0, now + std::chrono::milliseconds(1500)));
+    CHECK(h.healthy(0, now + std::chrono::seconds(2)));
+    CHECK(h.healthy(1, now));
+}
+
+TEST_CASE("HealthTable: probes take endpoints out and bring them back") {
+    muses::HealthTable h(1);
+    auto now = muses::HealthTable::Clock::now();
+    using V = muses::HealthTable::Verdict;
+    CHECK(h.probe_due(0, now));
+    CHECK(h.claim_probe(0, now, now + std::chrono::seconds(1)));
+    CHECK_FALSE(h.probe_due(0, now));
+    CHECK_FALSE(h.claim_probe(0, now, now + std::chrono::seconds(1)));  // not due again yet
+    CHECK(h.probe_due(0, now + std::chrono::seconds(1)));
+    CHECK(h.claim_probe(0, now + std::chrono::seconds(1), now + std::chrono::seconds(2)));
+
+    CHECK(h.record_probe(0, false, 2, 3, now) == V::Unchanged);
+    CHECK(h.record_probe(0, false, 2, 3, now) == V::Unchanged);
+    CHECK(h.record_probe(0, false, 2, 3, now) == V::Down);
+    CHECK_FALSE(h.healthy(0, now + std::chrono::hours(24)));  // no cooldown: probes decide
+    CHECK(h.record_probe(0, true, 2, 3, now) == V::Unchanged);
+    CHECK(h.record_probe(0, true, 2, 3, now) == V::Up);
+    CHECK(h.healthy(0, now));
+
+    // A passive failure restarts the streak: `rise` fresh passes to return.
+    h.record_probe(0, true, 2, 3, now);
+    h.mark_down(0, muses::HealthTable::Clock::time_point::max(), now);
+    CHECK(h.record_probe(0, true, 2, 3, now) == V::Unchanged);
+    CHECK(h.record_probe(0, true, 2, 3, now) == V::Up);
+}
+
+TEST_CASE("Proxy: active health checks route around a failing endpoint") {
+    MockUpstream up_a; up_a.body = "backend-a"; up_a.keep_alive = false; up_a.start();
+    MockUpstream up_b; up_b.body = "backend-b"; up_b.keep_alive = false; up_b.start();
+    up_a.status = 503;
+
+    unsigned short pport = 0;
+    int lfd = listen_loopback(pport);
+    muses::ProxyRoute route{"/", "", 0};
+    route.endpoints = {{"127.0.0.1", up_a.port}, {"127.0.0.1", up_b.port}};
+    muses::ProxyOptions opts;
+    opts.health_check.interval = std::chrono::milliseconds(50);
+    opts.health_check.jitter = std::chrono::milliseconds(10);
+    opts.health_check.rise = 2;
+    opts.health_check.fall = 2;
+    muses::ProxyServer proxy(lfd, {route}, opts);
+    proxy.start();
+
+    auto count_a = [&] {
+        int a = 0;
+        for (int i = 0; i < 6; ++i) {
+            std::string r = proxy_roundtrip(pport, "GET / HTTP/1.1\r\nHost: x\r\nConnection: close\r\n\r\n");
+            if (r.find("backend-a") != std::string::npos) ++a;
+        }
+        return a;
+    };
+    // Two failed probes take `a` out; no request has to find out first.
+    std::this_thread::sleep_for(std::chrono::milliseconds(400));
+    CHECK(count_a() == 0);
+
+    // Two passing probes bring it back.
+    up_a.status = 200;
+    std::this_thread::sleep_for(std::chrono::milliseconds(400));
+    CHECK(count_a() >= 2);
+
+    proxy.stop();
+    ::close(lfd);
+}
+
+TEST_CASE("Proxy: a slow endpoint is ejected as a latency outlier") {
+    MockUpstream fast; fast.body = "backend-fast"; fast.keep_alive = false; fast.start();
+    MockUpstream slow; slow.body = "backend-slow"; slow.keep_alive = false;
+    slow.delay = std::chrono::milliseconds(60);
+    slow.start();
+
+    unsigned short pport = 0;
+    int lfd = listen_loopback(pport);
+    muses::ProxyRoute route{"/", "", 0};
+    route.endpoints = {{"127.0.0.1", fast.port}, {"127.0.0.1", slow.port}};
+    muses::ProxyOptions opts;
+    opts.outlier_detection.interval = std::chrono::milliseconds(100);
+    opts.outlier_detection.min_requests = 4;
+    opts.outlier_detection.base_ejection = std::chrono::seconds(30);
+    muses::ProxyServer proxy(lfd, {route}, opts);
+    proxy.start();
+
+    const std::string get = "GET / HTTP/1.1\r\nHost: x\r\nConnection: close\r\n\r\n";
+    for (int i = 0; i < 10; ++i) proxy_roundtrip(pport, get);  // five each
+    std::this_thread::sleep_for(std::chrono::milliseconds(250));
+    int slow_hits = 0;
+    for (int i = 0; i < 6; ++i) {
+        if (proxy_roundtrip(pport, get).find("backend-slow") != std::string::npos) ++slow_hits;
+    }
+    CHECK(slow_hits == 0);
+
+    proxy.stop();
+    ::close(lfd);
+}
+
+TEST_CASE("Proxy: the concurrency limit queues or rejects excess requests") {
+    MockUpstream up;
+    up.keep_alive = false;
+    up.delay = std::chrono::milliseconds(200);
+    up.start();
+
+    auto run = [&up](std::size_t max_queue) {
+        unsigned short pport = 0;
+        int lfd = listen_loopback(pport);
+        muses::ProxyOptions opts;
+        opts.concurrency_limit.initial_limit = 1;
+        opts.concurrency_limit.max_limit = 1;
+        opts.concurrency_limit.max_queue = max_queue;
+        opts.concurrency_limit.queue_timeout = std::chrono::seconds(2);
+        muses::ProxyServer proxy(lfd, {{"/", "127.0.0.1", up.port}}, opts);
+        proxy.start();
+        // Two different URLs, so they are not coalesced into one.
+        int fds[2];
+        for (int i = 0; i < 2; ++i) {
+            fds[i] = connect_loopback(pport);
+            write_str(fds[i], "GET /" + std::to_string(i) +
+                                  " HTTP/1.1\r\nHost: x\r\nConnection: close\r\n\r\n");
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+        int ok = 0, rejected = 0;
+        for (int fd : fds) {
+            std::string r = read_while(fd, [](const std::string& acc) {
+                return acc.find("upstream-ok") != std::string::npos;
+            }, std::chrono::seconds(3));
+            if (r.find("200 OK") != std::string::npos) ++ok;
+            if (r.find("503") != std::string::npos) ++rejected;
+            ::close(fd);
+        }
+        proxy.stop();
+        ::close(lfd);
+        return std::pair{ok, rejected};
+    };
+
+    CHECK(run(0) == std::pair{1, 1});  // fail fast: one in flight, one 503
+    CHECK(run(4) == std::pair{2, 0});  // the second waits for the first's slot
+}
+
+TEST_CASE("Proxy: a request the first endpoint sits on is hedged to another") {
+    MockUpstream a; a.body = "backend-a"; a.keep_alive = false; a.start();
+    MockUpstream b; b.body = "backend-b"; b.keep_alive = false; b.start();
+
+    unsigned short pport = 0;
+    int lfd = listen_loopback(pport);
+    muses::ProxyRoute route{"/", "", 0};
+    route.endpoints = {{"127.0.0.1", a.port}, {"127.0.0.1", b.port}};
+    muses::ProxyOptions opts;
+    opts.hedge.enabled = true;
+    opts.hedge.min_samples = 4;
+    opts.hedge.budget_ratio = 1.0;
+    muses::ProxyServer proxy(lfd, {route}, opts);
+    proxy.start();
+
+    const std::string get = "GET / HTTP/1.1\r\nHost: x\r\nConnection: close\r\n\r\n";
+    for (int i = 0; i < 6; ++i) proxy_roundtrip(pport, get);  // learns the route's p95
+    a.delay = std::chrono::milliseconds(500);
+    const int asked_a = a.requests.load();
+    for (int i = 0; i < 4; ++i) {
+        auto t0 = std::chrono::steady_clock::now();
+        std::string r = proxy_roundtrip(pport, get);
+        auto took = std::chrono::steady_clock::now() - t0;
+        CHECK(r.find("backend-b") != std::string::npos);
+        CHECK(took < std::chrono::milliseconds(300));
+    }
+    CHECK(a.requests.load() > asked_a);  // `a` got its share first, and lost
+
+    proxy.stop();
+    ::close(lfd);
+}
+
+TEST_CASE("Proxy: retries spend a budget and resend only what is safe") {
+    MockUpstream a; a.hang_up = true; a.start();
+    MockUpstream b; b.hang_up = true; b.start();
+
+    unsigned short pport = 0;
+    int lfd = listen_loopback(pport);
+    muses::ProxyRoute route{"/", "", 0};
+    route.endpoints = {{"127.0.0.1", a.port}, {"127.0.0.1", b.port}};
+    muses::ProxyOptions opts;
+    opts.upstream_cooldown = std::chrono::seconds(0);  // failed endpoints stay in play
+    opts.max_retries = 3;
+    opts.retry.budget_ratio = 0.1;
+    opts.retry.min_per_second = 0.0;
+    opts.retry.budget_burst = 2.0;
+    opts.retry.backoff_base = std::chrono::milliseconds(1);
+    muses::ProxyServer proxy(lfd, {route}, opts);
+    proxy.start();
+    auto sent = [&] { return a.requests.load() + b.requests.load(); };
+
+    // The POST reached an upstream before it failed: it may have had effects.
+    CHECK(proxy_roundtrip(pport, "POST / HTTP/1.1\r\nHost: x\r\nContent-Length: 0\r\n"
+                                 "Connection: close\r\n\r\n")
+              .find("502") != std::string::npos);
+    CHECK(sent() == 1);
+
+    // GETs are retried, but 20 of them earn 2 retries on top of the 2 in
+    // reserve, rather than the 60 that max_retries alone would allow.
+    const std::string get = "GET / HTTP/1.1\r\nHost: x\r\nConnection: close\r\n\r\n";
+    for (int i = 0; i < 20; ++i) CHECK(proxy_roundtrip(pport, get).find("502") != std::string::npos);
+    CHECK(sent() - 1 > 20);
+    CHECK(sent() - 1 <= 25);
+
+    proxy.stop();
+    ::close(lfd);
+}
+
+TEST_CASE("ProxyPool: shards share one port and serve independently") {
+    MockUpstream up; up.keep_alive = false; up.start();
+    muses::ProxyPool pool("127.0.0.1", 0, {{"/", "127.0.0.1", up.port}}, muses::ProxyOptions{},
+                          /*shard_count=*/3, /*share_health=*/true);
+    REQUIRE(pool.shard_count() == 3);
+    REQUIRE(pool.port() != 0);
+    CHECK(pool.shard(0).health_table() == pool.shard(2).health_table());
+    pool.start();
+
+    for (int i = 0; i < 6; ++i) {
+        CHECK(proxy_roundtrip(pool.port(), "GET / HTTP/1.1\r\nHost: x\r\nConnection: close\r\n\r\n")
+                  .find("upstream-ok") != std::string::npos);
+    }
+    CHECK(pool.upstream_stats("127.0.0.1", up.port).connects == 6);
+    pool.stop();
+
+    muses::ProxyPool separate("127.0.0.1", 0, {{"/", "127.0.0.1", up.port}}, muses::ProxyOptions{}, 2);
+    CHECK(separate.shard(0).health_table() != separate.shard(1).health_table());
+}
+
+TEST_CASE("ProxyPool: one shard per runtime worker, connections go where a worker is free") {
+    MockUpstream up; up.keep_alive = false; up.start();
+    std::atomic<int> done{0};
+    {
+        muses::Runtime rt(3);
+        muses::ProxyPool pool(rt, "127.0.0.1", 0, {{"/", "127.0.0.1", up.port}},
+                              muses::ProxyOptions{}, /*share_health=*/true);
+        REQUIRE(pool.shard_count() == 3);
+        REQUIRE(pool.port() != 0);
+        pool.start();
+
+        std::vector<std::thread> clients;
+        for (int i = 0; i < 4; ++i) {
+            clients.emplace_back([&] {
+                for (int j = 0; j < 3; ++j) {
+                    std::string resp = proxy_roundtrip(
+                        pool.port(), "GET / HTTP/1.1\r\nHost: x\r\nConnection: close\r\n\r\n");
+                    if (resp.find("upstream-ok") != std::string::npos) done.fetch_add(1);
+                }
+            });
+        }
+        for (auto& c : clients) c.join();
+        CHECK(pool.upstream_stats("127.0.0.1", up.port).connects == 12);
+        pool.stop();
+        CHECK(rt.live() == 0);  // every shard's driver has shut down
+    }
+    CHECK(done.load() == 12);
+
+    // A pool on a runtime that stopped first shuts down without waiting.
+    muses::Runtime rt(1);
+    muses::ProxyPool pool(rt, "127.0.0.1", 0, {{"/", "127.0.0.1", up.port}}, muses::ProxyOptions{});
+    pool.start();
+    rt.stop();
+    pool.stop();
+}
+
+TEST_CASE("Proxy: serves cacheable responses from the cache") {
+    MockUpstream up;
+    up.keep_alive = false;
+    up.headers = "Cache-Control: max-age=60\r\n";
+    up.start();
+    unsigned short pport = 0;
+    int lfd = listen_loopback(pport);
+    muses::ProxyOptions opts;
+    opts.cache = std::make_shared<muses::ResponseCache>();
+    muses::ProxyServer proxy(lfd, {{"/", "127.0.0.1", up.port}}, opts);
+    proxy.start();
+
+    const std::string get = "GET /doc HTTP/1.1\r\nHost: x\r\nConnection: close\r\n\r\n";
+    std::string first = proxy_roundtrip(pport, get);
+    std::string second = proxy_roundtrip(pport, get);
+    CHECK(first.find("upstream-ok") != std::string::npos);
+    CHECK(second.find("upstream-ok") != std::string::npos);
+    CHECK(second.find("Age: ") != std::string::npos);
+    CHECK(second.find("Connection: close") != std::string::npos);
+    CHECK(up.requests.load() == 1);
+    CHECK(opts.cache->stats().hits == 1);
+
+    // The client can insist on the origin; a different URL is a different key.
+    proxy_roundtrip(pport, "GET /doc HTTP/1.1\r\nHost: x\r\nCache-Control: no-cache\r\n"
+                           "Connection: close\r\n\r\n");
+    CHECK(up.requests.load() == 2);
+    proxy_roundtrip(pport, "GET /other HTTP/1.1\r\nHost: x\r\nConnection: close\r\n\r\n");
+    CHECK(up.requests.load() == 3);
+
+    // A successful POST to the URL drops the entry.
+    proxy_roundtrip(pport, "POST /doc HTTP/1.1\r\nHost: x\r\nContent-Length: 1\r\n"
+                           "Connection: close\r\n\r\nx");
+    CHECK(up.requests.load() == 4);
+    proxy_roundtrip(pport, get);
+    CHECK(up.requests.load() == 5);
+
+    proxy.stop();
+    ::close(lfd);
+}
+
+TEST_CASE("Proxy: stale-while-revalidate answers stale and refreshes once") {
+    MockUpstream up;
+    up.keep_alive = false;
+    up.headers = "Cache-Control: max-age=1, stale-while-revalidate=60\r\n";
+    up.start();
+    unsigned short pport = 0;
+    int lfd = listen_loopback(pport);
+    muses::ProxyOptions opts;
+    opts.cache = std::make_shared<muses::ResponseCache>();
+    muses::ProxyServer proxy(lfd, {{"/", "127.0.0.1", up.port}}, opts);
+    proxy.start();
+
+    const std::string get = "GET /feed HTTP/1.1\r\nHost: x\r\nConnection: close\r\n\r\n";
+    proxy_roundtrip(pport, get);
+    CHECK(up.requests.load() == 1);
+    std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+
+    CHECK(proxy_roundtrip(pport, get).find("upstream-ok") != std::string::npos);  // stale
+    CHECK(proxy_roundtrip(pport, get).find("upstream-ok") != std::string::npos);  // still stale
+    for (int i = 0; i < 50 && up.requests.load() < 2; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    CHECK(up.requests.load() == 2);  // one background refresh for both
+    CHECK(opts.cache->stats().stale_hits >= 1);
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    CHECK(proxy_roundtrip(pport, get).find("Age: 0") != std::string::npos);
+    CHECK(up.requests.load() == 2);
+
+    proxy.stop();
+    ::close(lfd);
+}
+
+namespace {
+
+// Sends `reqs` on separate connections before any response can arrive,
+// then collects the responses.
+std::vector<std::string> concurrent_requests(unsigned short port,
+                                             const std::vector<std::string>& reqs) {
+    std::vector<int> fds;
+    for (const auto& req : reqs) {
+        int fd = connect_loopback(port);
+        if (fd >= 0) {
+            write_str(fd, req);
+            fds.push_back(fd);
+        }
+    }
+    std::vector<std::string> out;
+    for (int fd : fds) {
+        out.push_back(read_while(fd, [](const std::string& acc) {
+            return acc.find("upstream-ok") != std::string::npos;
+        }, std::chrono::seconds(3)));
+        ::close(fd);
+    }
+    return out;
+}
+
+std::vector<std::string> concurrent_gets(unsigned short port, const std::string& req, int n) {
+    return concurrent_requests(port, std::vector<std::string>(static_cast<std::size_t>(n), req));
+}
+
+}  // namespace
+
+TEST_CASE("Proxy: identical concurrent GETs share one upstream request") {
+    MockUpstream up;
+    up.keep_alive = false;
+    up.delay = std::chrono::milliseconds(300);
+    up.start();
+    unsigned short pport = 0;
+    int lfd = listen_loopback(pport);
+    muses::ProxyOptions opts;
+    opts.coalesce = true;
+    muses::ProxyServer proxy(lfd, {{"/", "127.0.0.1", up.port}}, opts);
+    proxy.start();
+
+    auto responses = concurrent_gets(
+        pport, "GET /hot HTTP/1.1\r\nHost: x\r\nConnection: close\r\n\r\n", 6);
+    REQUIRE(responses.size() == 6);
+    for (const auto& r : responses) {
+        CHECK(r.find("200 OK") != std::string::npos);
+        CHECK(r.find("upstream-ok") != std::string::npos);
+    }
+    CHECK(up.requests.load() == 1);
+
+    // Once it has landed, the next request is a flight of its own.
+    up.delay = std::chrono::milliseconds(0);
+    CHECK(proxy_roundtrip(pport, "GET /hot HTTP/1.1\r\nHost: x\r\nConnection: close\r\n\r\n")
+              .find("upstream-ok") != std::string::npos);
+    CHECK(up.requests.load() == 2);
+
+    proxy.stop();
+    ::close(lfd);
+}
+
+TEST_CASE("Proxy: a per-user response is not shared with waiting requests") {
+    MockUpstream up;
+    up.keep_alive = false;
+    up.delay = std::chrono::milliseconds(200);
+    up.headers = "Set-Cookie: session=1\r\n";
+    up.start();
+    unsigned short pport = 0;
+    int lfd = listen_loopback(pport);
+    muses::ProxyOptions opts;
+    opts.coalesce = true;
+    muses::ProxyServer proxy(lfd, {{"/", "127.0.0.1", up.port}}, opts);
+    proxy.start();
+
+    auto responses = concurrent_gets(
+        pport, "GET /me HTTP/1.1\r\nHost: x\r\nConnection: close\r\n\r\n", 3);
+    REQUIRE(responses.size() == 3);
+    for (const auto& r : responses) CHECK(r.find("upstream-ok") != std::string::npos);
+    CHECK(up.requests.load() == 3);
+
+    proxy.stop();
+    ::close(lfd);
+}
+
+TEST_CASE("Proxy: requests with different cookies do not share a flight") {
+    MockUpstream up;
+    up.keep_alive = false;
+    up.delay = std::chrono::milliseconds(200);
+    up.start();
+    unsigned short pport = 0;
+    int lfd = listen_loopback(pport);
+    muses::ProxyOptions opts;
+    opts.coalesce = true;
+    muses::ProxyServer proxy(lfd, {{"/", "127.0.0.1", up.port}}, opts);
+    proxy.start();
+
+    const std::string alice =
+        "GET /feed HTTP/1.1\r\nHost: x\r\nCookie: user=alice\r\nConnection: close\r\n\r\n";
+    const std::string bob =
+        "GET /feed HTTP/1.1\r\nHost: x\r\nCookie: user=bob\r\nConnection: close\r\n\r\n";
+    auto responses = concurrent_requests(pport, {alice, bob, alice});
+    REQUIRE(responses.size() == 3);
+    for (const auto& r : responses) CHECK(r.find("upstream-ok") != std::string::npos);
+    CHECK(up.requests.load() == 2);  // alice's pair shares one; bob has his own
+
+    proxy.stop();
+    ::close(lfd);
+}
+
+TEST_CASE("Proxy: coalescing is off by default") {
+    MockUpstream up;
+    up.keep_alive = false;
+    up.delay = std::chrono::milliseconds(100);
+    up.start();
+    unsigned short pport = 0;
+    int lfd = listen_loopback(pport);
+    muses::ProxyServer proxy(lfd, {{"/", "127.0.0.1", up.port}}, muses::ProxyOptions{});
+    proxy.start();
+
+    auto responses = concurrent_gets(
+        pport, "GET /hot HTTP/1.1\r\nHost: x\r\nConnection: close\r\n\r\n", 2);
+    REQUIRE(responses.size() == 2);
+    for (const auto& r : responses) CHECK(r.find("upstream-ok") != std::string::npos);
+    CHECK(up.requests.load() == 2);
+
+    proxy.stop();
+    ::close(lfd);
+}
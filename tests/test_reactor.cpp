@@ -8,6 +8,7 @@
 #include <netinet/in.h>
 #include <sys/socket.h>
 #include <sys/time.h>
+#include <sys/un.h>
 #include <unistd.h>
 
 #include <algorithm>
@@ -42,6 +43,8 @@ int make_listen_socket(unsigned short& port) {
     return fd;
 }
 
+std::string http_exchange(int fd, const std::string& req, std::chrono::milliseconds timeout);
+
 // Connect to 127.0.0.1:port and send `req`; read the full response with a
 // timeout. Returns "" if connect/read fails.
 std::string http_roundtrip(unsigned short port, const std::string& req,
@@ -55,6 +58,25 @@ std::string http_roundtrip(unsigned short port, const std::string& req,
     if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
         ::close(fd); return "";
     }
+    return http_exchange(fd, req, timeout);
+}
+
+// http_roundtrip through the Unix-domain socket at `path`.
+std::string http_roundtrip_unix(const std::string& path, const std::string& req,
+                                std::chrono::milliseconds timeout) {
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return "";
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+        ::close(fd); return "";
+    }
+    return http_exchange(fd, req, timeout);
+}
+
+// Send `req` on connected `fd` and read the response; closes `fd`.
+std::string http_exchange(int fd, const std::string& req, std::chrono::milliseconds timeout) {
     if (::write(fd, req.data(), req.size()) != static_cast<ssize_t>(req.size())) {
         ::close(fd); return "";
     }
@@ -455,3 +477,155 @@ TEST_CASE("Reactor: per-IP connection rate limit blacklists a flooder") {
     reactor.stop();
     ::close(lfd);
 }
+
+// A UnixListener's fd serves a ReactorPool like a TCP one. Its peers have no
+// IP address, so the per-IP rate limit leaves them alone however fast they
+// connect.
+TEST_CASE("Reactor: a ReactorPool serves a Unix-domain listener") {
+    std::ofstream f("./statics/rr_uds.html", std::ios::binary | std::ios::trunc);
+    f << "uds-ok";
+    f.close();
+
+    const std::string path = "/tmp/muses_reactor_" + std::to_string(::getpid()) + ".sock";
+    {
+        muses::UnixListener listener(path);
+        auto lfd = listener.get_listener();
+        REQUIRE(lfd.has_value());
+        CHECK(listener.get_listener() == lfd);  // created once
+        muses::UnixListener rival(path);
+        CHECK_FALSE(rival.get_listener().has_value());  // a live server keeps its socket
+
+        muses::ReactorPool pool(*lfd, [](const std::string& req) -> muses::HandlerResult {
+            auto hr = muses::HttpContext::handle_request(req);
+            return muses::HandlerResult{std::move(hr.response), hr.keep_alive};
+        }, 2, 1, 1024, std::chrono::seconds(0), /*max_connections=*/0, /*ip_rate=*/2);
+        pool.start();
+        std::this_thread::sleep_for(std::chrono::milliseconds(80));
+
+        int got = 0;
+        for (int i = 0; i < 8; ++i) {
+            std::string resp = http_roundtrip_unix(path,
+                "GET /rr_uds.html HTTP/1.1\r\nConnection: close\r\n\r\n",
+                std::chrono::milliseconds(2000));
+            if (resp.find("uds-ok") != std::string::npos) ++got;
+        }
+        CHECK(got == 8);
+        pool.stop();
+    }
+    CHECK(::access(path.c_str(), F_OK) != 0);  // the socket file went with the listener
+
+    // A socket file nobody listens on any more is replaced.
+    int stale = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un u{}; u.sun_family = AF_UNIX;
+    std::strncpy(u.sun_path, path.c_str(), sizeof(u.sun_path) - 1);
+    REQUIRE(::bind(stale, reinterpret_cast<sockaddr*>(&u), sizeof(u)) == 0);
+    ::close(stale);
+    {
+        muses::UnixListener listener(path);
+        CHECK(listener.get_listener().has_value());
+    }
+
+    muses::UnixListener too_long(std::string(200, 'x'));
+    CHECK_FALSE(too_long.get_listener().has_value());
+    std::remove("./statics/rr_uds.html");
+}
+
+// Bounded worker queue: with one worker busy and a one-slot queue (DropNew),
+// a third concurrent request is refused by the pool and answered with an
+// immediate 503 from the reactor instead of queueing behind the slow handler.
+TEST_CASE("Reactor: full worker queue answers 503 without waiting") {
+    unsigned short port = 0;
+    int lfd = make_listen_socket(port);
+    REQUIRE(lfd >= 0);
+
+    muses::Reactor reactor(lfd, [](const std::string&) -> muses::HandlerResult {
+        std::this_thread::sleep_for(std::chrono::milliseconds(400));
+        return muses::HandlerResult{
+            "HTTP/1.1 200 OK\r\nContent-Length: 4\r\nConnection: close\r\n\r\nslow", false};
+    }, /*workers=*/1, 1024, std::chrono::seconds(0), 0, 0,
+       /*worker_queue_capacity=*/1, muses::OverflowPolicy::DropNew);
+    reactor.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(80));
+
+    const std::string req = "GET / HTTP/1.1\r\nConnection: close\r\n\r\n";
+    std::string r1, r2;
+    std::thread t1([&] { r1 = http_roundtrip(port, req, std::chrono::milliseconds(3000)); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    std::thread t2([&] { r2 = http_roundtrip(port, req, std::chrono::milliseconds(3000)); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    auto start = std::chrono::steady_clock::now();
+    std::string r3 = http_roundtrip(port, req, std::chrono::milliseconds(3000));
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    CHECK(r3.rfind("HTTP/1.1 503", 0) == 0);
+    CHECK(elapsed < std::chrono::milliseconds(300));
+
+    t1.join();
+    t2.join();
+    CHECK(r1.find("slow") != std::string::npos);
+    CHECK(r2.find("slow") != std::string::npos);
+
+    reactor.stop();
+    ::close(lfd);
+}
+
+// Block would park the reactor thread on a full queue and CallerRuns would
+// run the handler on it; both take the 503 fast path instead.
+TEST_CASE("Reactor: worker overflow policies never hold up the reactor thread") {
+    using muses::OverflowPolicy;
+    CHECK(muses::Reactor::worker_overflow_policy(OverflowPolicy::DropNew) == OverflowPolicy::DropNew);
+    CHECK(muses::Reactor::worker_overflow_policy(OverflowPolicy::DropOldest) ==
+          OverflowPolicy::DropOldest);
+    CHECK(muses::Reactor::worker_overflow_policy(OverflowPolicy::Block) == OverflowPolicy::DropNew);
+    CHECK(muses::Reactor::worker_overflow_policy(OverflowPolicy::CallerRuns) ==
+          OverflowPolicy::DropNew);
+}
+
+// Priority hint: with the single worker busy and a slow request already
+// queued, a health check classified High jumps ahead of the queued request.
+TEST_CASE("Reactor: priority hint lets a health check skip the queue") {
+    unsigned short port = 0;
+    int lfd = make_listen_socket(port);
+    REQUIRE(lfd >= 0);
+
+    muses::Reactor reactor(lfd, [](const std::string& req) -> muses::HandlerResult {
+        bool health = req.rfind("GET /health", 0) == 0;
+        if (!health) std::this_thread::sleep_for(std::chrono::milliseconds(300));
+        std::string body = health ? "up" : "bulk";
+        return muses::HandlerResult{
+            "HTTP/1.1 200 OK\r\nContent-Length: " + std::to_string(body.size()) +
+            "\r\nConnection: close\r\n\r\n" + body, false};
+    }, /*workers=*/1, 1024, std::chrono::seconds(0));
+    // Default aging: the queued bulk request ages into the High lane while
+    // it waits, but behind the health check, not ahead of it.
+    reactor.configure_worker_lanes(muses::LaneScheduling::Strict);
+    reactor.set_priority_hint([](const std::string& req) {
+        return req.rfind("GET /health", 0) == 0 ? muses::TaskPriority::High
+                                                : muses::TaskPriority::Normal;
+    });
+    reactor.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(80));
+
+    const std::string bulk = "GET /export HTTP/1.1\r\nConnection: close\r\n\r\n";
+    std::string r1, r2;
+    std::thread t1([&] { r1 = http_roundtrip(port, bulk, std::chrono::milliseconds(3000)); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    std::thread t2([&] { r2 = http_roundtrip(port, bulk, std::chrono::milliseconds(3000)); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    auto start = std::chrono::steady_clock::now();
+    std::string health = http_roundtrip(port,
+        "GET /health HTTP/1.1\r\nConnection: close\r\n\r\n", std::chrono::milliseconds(3000));
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    CHECK(health.find("up") != std::string::npos);
+    // Waits only for the in-flight request, not for the queued one too.
+    CHECK(elapsed < std::chrono::milliseconds(500));
+
+    t1.join();
+    t2.join();
+    CHECK(r1.find("bulk") != std::string::npos);
+    CHECK(r2.find("bulk") != std::string::npos);
+
+    reactor.stop();
+    ::close(lfd);
+}
@@ -0,0 +1,55 @@
+#include <doctest.h>
+
+#include "muses/net_components/request_budget.hpp"
+
+#include <chrono>
+
+using muses::RequestBudget;
+using namespace std::chrono_literals;
+
+TEST_CASE("RequestBudget: extras stay within a fraction of requests") {
+    RequestBudget b(0.05, 0.0, 10.0);
+    auto now = RequestBudget::Clock::now();
+    CHECK_FALSE(b.withdraw(now));  // nothing earned yet
+    int extras = 0;
+    for (int i = 0; i < 1000; ++i) {
+        b.deposit(now);
+        if (b.withdraw(now)) ++extras;
+    }
+    CHECK(extras == 50);
+    CHECK(b.spent() == 50);
+    CHECK(b.refused() == 951);
+}
+
+TEST_CASE("RequestBudget: the balance is capped at the burst") {
+    RequestBudget b(0.5, 0.0, 3.0);
+    auto now = RequestBudget::Clock::now();
+    for (int i = 0; i < 100; ++i) b.deposit(now);
+    CHECK(b.balance() == 3.0);
+    CHECK(b.can_withdraw(now));
+    CHECK(b.withdraw(now));
+    CHECK(b.withdraw(now));
+    CHECK(b.withdraw(now));
+    CHECK_FALSE(b.can_withdraw(now));
+    CHECK(b.refused() == 0);  // asking is free
+}
+
+TEST_CASE("RequestBudget: a trickle refills a quiet route") {
+    RequestBudget b(0.0, 2.0, 5.0);
+    auto t0 = RequestBudget::Clock::now();
+    CHECK_FALSE(b.withdraw(t0));
+    CHECK_FALSE(b.withdraw(t0 + 400ms));
+    CHECK(b.withdraw(t0 + 600ms));   // 1.2 tokens after 600 ms
+    CHECK_FALSE(b.withdraw(t0 + 700ms));
+    CHECK(b.can_withdraw(t0 + 10s));
+    CHECK(b.balance() == 5.0);       // capped, however long it was quiet
+}
+
+TEST_CASE("RequestBudget: a reserve covers the first extras") {
+    RequestBudget b(0.0, 0.0, 4.0, 2.0);
+    auto now = RequestBudget::Clock::now();
+    CHECK(b.withdraw(now));
+    CHECK(b.withdraw(now));
+    CHECK_FALSE(b.withdraw(now));
+    CHECK(RequestBudget(0.0, 0.0, 4.0, 100.0).balance() == 4.0);  // no more than a burst
+}
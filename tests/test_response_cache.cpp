@@ -0,0 +1,156 @@
+#include <doctest.h>
+
+#include "muses/net_components/response_cache.hpp"
+
+#include <string>
+
+using muses::ResponseCache;
+using namespace std::chrono_literals;
+
+namespace {
+
+std::string head(const std::string& extra, int status = 200) {
+    return "HTTP/1.1 " + std::to_string(status) + " X\r\nContent-Length: 5\r\n" + extra + "\r\n";
+}
+
+const ResponseCache::Headers kNoHeaders;
+
+}  // namespace
+
+TEST_CASE("ResponseCache: keys and request cacheability") {
+    CHECK(ResponseCache::key("GET", "Example.COM", "/a?b") == "GET example.com/a?b");
+    CHECK(ResponseCache::cacheable_request("GET", {}));
+    CHECK(ResponseCache::cacheable_request("HEAD", {}));
+    CHECK_FALSE(ResponseCache::cacheable_request("POST", {}));
+    CHECK_FALSE(ResponseCache::cacheable_request("GET", {{"authorization", "Bearer x"}}));
+    CHECK_FALSE(ResponseCache::cacheable_request("GET", {{"Cache-Control", "no-store"}}));
+    CHECK(ResponseCache::wants_fresh({{"Cache-Control", "no-cache"}}));
+    CHECK(ResponseCache::wants_fresh({{"Cache-Control", "max-age=0"}}));
+    CHECK(ResponseCache::wants_fresh({{"Pragma", "no-cache"}}));
+    CHECK_FALSE(ResponseCache::wants_fresh({{"Cache-Control", "max-age=30"}}));
+}
+
+TEST_CASE("ResponseCache: stores only what the upstream allows") {
+    ResponseCache c;
+    auto now = ResponseCache::Clock::now();
+    CHECK(c.store("k1", kNoHeaders, head("Cache-Control: max-age=60\r\n"), "hello", now));
+    CHECK_FALSE(c.store("k2", kNoHeaders, head(""), "hello", now));  // no freshness info
+    CHECK_FALSE(c.store("k3", kNoHeaders, head("Cache-Control: no-store, max-age=60\r\n"), "x", now));
+    CHECK_FALSE(c.store("k4", kNoHeaders, head("Cache-Control: private, max-age=60\r\n"), "x", now));
+    CHECK_FALSE(c.store("k5", kNoHeaders, head("Cache-Control: max-age=60\r\nSet-Cookie: a=b\r\n"), "x", now));
+    CHECK_FALSE(c.store("k6", kNoHeaders, head("Cache-Control: max-age=60\r\n", 500), "x", now));
+    CHECK_FALSE(c.store("k7", kNoHeaders, head("Cache-Control: max-age=60\r\nVary: *\r\n"), "x", now));
+    CHECK(c.stats().stores == 1);
+}
+
+TEST_CASE("ResponseCache: fresh hits share one immutable response") {
+    ResponseCache c;
+    auto now = ResponseCache::Clock::now();
+    c.store("k", kNoHeaders,
+            head("Cache-Control: public, max-age=60\r\nConnection: keep-alive\r\nAge: 10\r\n"),
+            "hello", now);
+    auto a = c.lookup("k", kNoHeaders, now + 5s);
+    auto b = c.lookup("k", kNoHeaders, now + 6s);
+    REQUIRE(a);
+    REQUIRE(b);
+    CHECK(a->response == b->response);
+    CHECK(a->age == 15s);  // the upstream's Age counts
+    CHECK_FALSE(a->stale);
+    CHECK(a->response->body == "hello");
+    CHECK(a->response->head.find("Connection") == std::string::npos);
+    CHECK(a->response->head.find("Age:") == std::string::npos);
+    CHECK(a->response->head.ends_with("max-age=60\r\n"));
+    CHECK(ResponseCache::header(a->response->head, "cache-control") == "public, max-age=60");
+    CHECK_FALSE(c.lookup("k", kNoHeaders, now + 51s));  // expired, no stale window
+    CHECK(c.stats().hits == 2);
+    CHECK(c.stats().misses == 1);
+}
+
+TEST_CASE("ResponseCache: s-maxage wins over max-age") {
+    ResponseCache c;
+    auto now = ResponseCache::Clock::now();
+    c.store("k", kNoHeaders, head("Cache-Control: max-age=1, s-maxage=100\r\n"), "hello", now);
+    CHECK(c.lookup("k", kNoHeaders, now + 50s));
+}
+
+TEST_CASE("ResponseCache: stale-while-revalidate hands out one refresh") {
+    ResponseCache c;
+    auto now = ResponseCache::Clock::now();
+    c.store("k", kNoHeaders, head("Cache-Control: max-age=10, stale-while-revalidate=30\r\n"),
+            "old", now);
+    auto first = c.lookup("k", kNoHeaders, now + 15s);
+    auto second = c.lookup("k", kNoHeaders, now + 16s);
+    REQUIRE(first);
+    REQUIRE(second);
+    CHECK(first->stale);
+    CHECK(first->revalidate);
+    CHECK_FALSE(second->revalidate);
+    c.abandon_revalidation("k");  // the refresh failed: the next stale hit retries
+    CHECK(c.lookup("k", kNoHeaders, now + 17s)->revalidate);
+    c.store("k", kNoHeaders, head("Cache-Control: max-age=10, stale-while-revalidate=30\r\n"),
+            "new", now + 18s);
+    auto fresh = c.lookup("k", kNoHeaders, now + 19s);
+    REQUIRE(fresh);
+    CHECK_FALSE(fresh->stale);
+    CHECK(fresh->response->body == "new");
+    CHECK(first->response->body == "old");  // held responses are unaffected
+    CHECK_FALSE(c.lookup("k", kNoHeaders, now + 60s));
+}
+
+TEST_CASE("ResponseCache: Vary keeps one entry per variant") {
+    ResponseCache c;
+    auto now = ResponseCache::Clock::now();
+    ResponseCache::Headers gzip{{"Accept-Encoding", "gzip"}};
+    ResponseCache::Headers plain{{"accept-encoding", "identity"}};
+    c.store("k", gzip, head("Cache-Control: max-age=60\r\nVary: Accept-Encoding\r\n"), "zzzzz", now);
+    CHECK_FALSE(c.lookup("k", plain, now));
+    c.store("k", plain, head("Cache-Control: max-age=60\r\nVary: Accept-Encoding\r\n"), "plain", now);
+    CHECK(c.lookup("k", gzip, now)->response->body == "zzzzz");
+    CHECK(c.lookup("k", plain, now)->response->body == "plain");
+}
+
+TEST_CASE("ResponseCache: byte bound, object limit and invalidation") {
+    ResponseCache c(ResponseCache::Options{.max_bytes = 300, .max_object_bytes = 150});
+    auto now = ResponseCache::Clock::now();
+    const std::string h = head("Cache-Control: max-age=60\r\n");
+    CHECK_FALSE(c.store("big", kNoHeaders, h, std::string(200, 'x'), now));
+    c.store("GET h/a", kNoHeaders, h, std::string(60, 'a'), now);
+    c.store("GET h/b", kNoHeaders, h, std::string(60, 'b'), now);
+    c.store("GET h/c", kNoHeaders, h, std::string(60, 'c'), now);
+    CHECK(c.stats().bytes <= 300);
+    CHECK_FALSE(c.lookup("GET h/a", kNoHeaders, now));  // evicted, least recently used
+    CHECK(c.lookup("GET h/c", kNoHeaders, now));
+    c.invalidate("H", "/c");
+    CHECK_FALSE(c.lookup("GET h/c", kNoHeaders, now));
+}
+
+TEST_CASE("ResponseCache: frozen responses and what may be shared in flight") {
+    auto now = ResponseCache::Clock::now();
+    auto r = ResponseCache::freeze(head("Connection: close\r\nAge: 5\r\nX-A: 1\r\n"), "hello", now);
+    CHECK(r->status == 200);
+    CHECK(r->head.find("Connection") == std::string::npos);
+    CHECK(r->head.find("Age") == std::string::npos);
+    CHECK(r->head.find("X-A: 1\r\n") != std::string::npos);
+    CHECK(r->born == now - 5s);
+    CHECK(r->max_age == 0s);  // no freshness info: shareable, not storable
+
+    ResponseCache c;
+    CHECK_FALSE(c.store("k", kNoHeaders, r));
+    CHECK(c.store("k", kNoHeaders, ResponseCache::freeze(head("Cache-Control: max-age=9\r\n"), "x", now)));
+    CHECK(c.lookup("k", kNoHeaders, now)->response->max_age == 9s);
+
+    CHECK(ResponseCache::shareable(head("")));
+    CHECK(ResponseCache::shareable(head("Cache-Control: no-cache\r\n")));
+    CHECK_FALSE(ResponseCache::shareable(head("Cache-Control: private\r\n")));
+    CHECK_FALSE(ResponseCache::shareable(head("Cache-Control: no-store\r\n")));
+    CHECK_FALSE(ResponseCache::shareable(head("Set-Cookie: a=b\r\n")));
+    CHECK_FALSE(ResponseCache::shareable(head("Vary: *\r\n")));
+
+    ResponseCache::Headers gzip{{"Accept-Encoding", "gzip"}};
+    ResponseCache::Headers also_gzip{{"accept-encoding", "gzip"}};
+    ResponseCache::Headers plain{{"Accept-Encoding", "identity"}};
+    const std::string varies = head("Vary: Accept-Encoding\r\n");
+    CHECK(ResponseCache::same_variant(varies, gzip, also_gzip));
+    CHECK_FALSE(ResponseCache::same_variant(varies, gzip, plain));
+    CHECK(ResponseCache::same_variant(head(""), gzip, plain));
+}
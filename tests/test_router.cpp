@@ -0,0 +1,94 @@
+#include <doctest.h>
+
+#include "muses/net_components/router.hpp"
+
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using Router = muses::RadixRouter<int>;
+
+int lookup(const Router& r, std::string_view host, std::string_view path,
+           std::string_view method = "GET") {
+    const int* v = r.match(host, path, method);
+    return v ? *v : -1;
+}
+
+}  // namespace
+
+TEST_CASE("RadixRouter: longest prefix wins regardless of declaration order") {
+    Router r({{"", "/", {}, 1},
+              {"", "/api/", {}, 2},
+              {"", "/api/v2/", {}, 3},
+              {"", "/apiary", {}, 4}});
+    CHECK(lookup(r, "h", "/index.html") == 1);
+    CHECK(lookup(r, "h", "/api/users") == 2);
+    CHECK(lookup(r, "h", "/api/v2/users") == 3);
+    CHECK(lookup(r, "h", "/api/v") == 2);      // stops mid-edge: falls back to /api/
+    CHECK(lookup(r, "h", "/apiary/bees") == 4);
+    CHECK(lookup(r, "h", "/ap") == 1);
+    CHECK(lookup(r, "h", "") == -1);           // not even "/"
+}
+
+TEST_CASE("RadixRouter: no catch-all means no match") {
+    Router r({{"", "/api/", {}, 1}});
+    CHECK(lookup(r, "h", "/other") == -1);
+    Router empty;
+    CHECK(empty.match("h", "/", "GET") == nullptr);
+}
+
+TEST_CASE("RadixRouter: method constraints skip to a shorter prefix") {
+    Router r({{"", "/", {}, 1},
+              {"", "/admin", {"GET", "HEAD"}, 2},
+              {"", "/admin", {"POST"}, 3}});
+    CHECK(lookup(r, "h", "/admin/x", "GET") == 2);
+    CHECK(lookup(r, "h", "/admin/x", "HEAD") == 2);
+    CHECK(lookup(r, "h", "/admin/x", "POST") == 3);
+    CHECK(lookup(r, "h", "/admin/x", "DELETE") == 1);
+    CHECK(lookup(r, "h", "/admin/x", "BREW") == 1);  // non-standard: unconstrained only
+    CHECK_THROWS_AS(Router({{"", "/", {"GOT"}, 1}}), std::invalid_argument);
+}
+
+TEST_CASE("RadixRouter: host trees are tried before any-host routes") {
+    Router r({{"", "/", {}, 1},
+              {"Static.Example", "/", {}, 2},
+              {"static.example", "/img/", {}, 3},
+              {"[::1]", "/", {}, 4}});
+    CHECK(lookup(r, "static.example", "/a") == 2);
+    CHECK(lookup(r, "STATIC.example:8080", "/img/x.png") == 3);
+    CHECK(lookup(r, "other.example", "/img/x.png") == 1);
+    CHECK(lookup(r, "[::1]:80", "/") == 4);
+    CHECK(lookup(r, "", "/") == 1);
+    CHECK(lookup(r, std::string(300, 'a'), "/") == 1);
+}
+
+TEST_CASE("RadixRouter: same prefix keeps declaration order; edges compress") {
+    Router r({{"", "/svc/alpha", {}, 1},
+              {"", "/svc/alpha", {}, 2},
+              {"", "/svc/beta", {}, 3}});
+    CHECK(lookup(r, "h", "/svc/alpha/x") == 1);
+    CHECK(lookup(r, "h", "/svc/beta") == 3);
+    CHECK(r.size() == 3);
+    CHECK(r.node_count() == 4);  // root, "/svc/", "alpha", "beta"
+}
+
+TEST_CASE("RadixRouter: concurrent lookups on a shared table") {
+    std::vector<Router::Route> routes;
+    for (int i = 0; i < 500; ++i) routes.push_back({"", "/r" + std::to_string(i) + "/", {}, i});
+    const Router r(std::move(routes));
+    std::vector<std::thread> threads;
+    std::vector<int> wrong(4, 0);
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&r, &wrong, t] {
+            for (int i = 0; i < 20000; ++i) {
+                int k = (i * 7 + t) % 500;
+                if (lookup(r, "h", "/r" + std::to_string(k) + "/x") != k) ++wrong[t];
+            }
+        });
+    }
+    for (auto& th : threads) th.join();
+    CHECK(wrong == std::vector<int>(4, 0));
+}
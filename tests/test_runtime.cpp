@@ -0,0 +1,141 @@
+#include <doctest.h>
+
+#include "muses/net/runtime.hpp"
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <set>
+#include <thread>
+
+namespace {
+
+using namespace std::chrono_literals;
+
+bool wait_for(const std::atomic<int>& counter, int target,
+              std::chrono::milliseconds limit = 5000ms) {
+    auto deadline = std::chrono::steady_clock::now() + limit;
+    while (counter.load() < target && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(1ms);
+    }
+    return counter.load() >= target;
+}
+
+struct ThreadSet {
+    std::mutex mu;
+    std::set<std::thread::id> ids;
+    void add() {
+        std::lock_guard<std::mutex> lock(mu);
+        ids.insert(std::this_thread::get_id());
+    }
+    std::size_t size() {
+        std::lock_guard<std::mutex> lock(mu);
+        return ids.size();
+    }
+};
+
+muses::Task<void> spin_then_count(std::chrono::milliseconds busy, ThreadSet& threads,
+                                  std::atomic<int>& done) {
+    auto until = std::chrono::steady_clock::now() + busy;
+    while (std::chrono::steady_clock::now() < until) {}
+    threads.add();
+    done.fetch_add(1);
+    co_return;
+}
+
+// Spawns `n` busy children from inside a worker: they all land on this
+// worker's ring, so any other thread that runs one must have stolen it.
+muses::Task<void> fan_out(muses::Runtime& rt, int n, ThreadSet& threads,
+                          std::atomic<int>& done) {
+    for (int i = 0; i < n; ++i) rt.spawn(spin_then_count(5ms, threads, done));
+    co_return;
+}
+
+muses::Task<void> echo_once(int fd, std::atomic<int>& done) {
+    co_await muses::IoAwaiter{fd, muses::EventMask::Readable};
+    char buf[16];
+    ssize_t r = ::read(fd, buf, sizeof(buf));
+    if (r > 0) {
+        co_await muses::IoAwaiter{fd, muses::EventMask::Writable};
+        (void)::write(fd, buf, static_cast<std::size_t>(r));
+    }
+    done.fetch_add(1);
+}
+
+struct Sentinel {
+    std::atomic<int>* destroyed;
+    ~Sentinel() { destroyed->fetch_add(1); }
+};
+
+muses::Task<void> park_forever(int fd, std::atomic<int>& parked, std::atomic<int>& destroyed) {
+    Sentinel s{&destroyed};
+    parked.fetch_add(1);
+    co_await muses::IoAwaiter{fd, muses::EventMask::Readable};
+}
+
+muses::Task<void> yield_a_lot(int rounds, std::atomic<int>& done) {
+    for (int i = 0; i < rounds; ++i) co_await muses::Runtime::yield();
+    done.fetch_add(1);
+}
+
+}  // namespace
+
+TEST_CASE("Runtime: idle workers steal ready tasks from a busy one") {
+    muses::Runtime rt(4);
+    ThreadSet threads;
+    std::atomic<int> done{0};
+    REQUIRE(rt.spawn(fan_out(rt, 64, threads, done)));
+    REQUIRE(wait_for(done, 64));
+    CHECK(threads.size() > 1);
+    CHECK(rt.steals() > 0);
+}
+
+TEST_CASE("Runtime: IoAwaiter{fd, mask} uses the worker's own poller") {
+    muses::Runtime rt(2);
+    int sv[2];
+    REQUIRE(::socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+    std::atomic<int> done{0};
+    REQUIRE(rt.spawn(echo_once(sv[0], done)));
+    std::this_thread::sleep_for(20ms);
+    REQUIRE(::write(sv[1], "ping", 4) == 4);
+    char buf[8] = {};
+    timeval tv{2, 0};
+    ::setsockopt(sv[1], SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    CHECK(::read(sv[1], buf, sizeof(buf)) == 4);
+    CHECK(std::string(buf, 4) == "ping");
+    CHECK(wait_for(done, 1));
+    ::close(sv[0]);
+    ::close(sv[1]);
+}
+
+TEST_CASE("Runtime: yield keeps many tasks progressing and frees finished frames") {
+    muses::Runtime rt(3);
+    std::atomic<int> done{0};
+    for (int i = 0; i < 100; ++i) REQUIRE(rt.spawn(yield_a_lot(20, done)));
+    REQUIRE(wait_for(done, 100));
+    auto deadline = std::chrono::steady_clock::now() + 2s;
+    while (rt.live() != 0 && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(1ms);
+    }
+    CHECK(rt.live() == 0);
+}
+
+TEST_CASE("Runtime: stop destroys tasks still suspended on I/O") {
+    int sv[2];
+    REQUIRE(::socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+    std::atomic<int> parked{0}, destroyed{0};
+    {
+        muses::Runtime rt(2);
+        REQUIRE(rt.spawn(park_forever(sv[0], parked, destroyed)));
+        REQUIRE(wait_for(parked, 1));
+        CHECK(rt.live() == 1);
+        rt.stop();
+        CHECK(destroyed.load() == 1);
+        CHECK_FALSE(rt.spawn(park_forever(sv[0], parked, destroyed)));
+    }
+    ::close(sv[0]);
+    ::close(sv[1]);
+}
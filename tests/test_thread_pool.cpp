@@ -2,10 +2,15 @@
 
 #include "muses/thread_pool.hpp"
 
+#include <algorithm>
 #include <atomic>
+#include <chrono>
+#include <functional>
 #include <future>
+#include <mutex>
 #include <vector>
 #include <stdexcept>
+#include <thread>
 
 TEST_CASE("ThreadPool: tasks run and futures resolve") {
     muses::ThreadPool pool(4);
@@ -56,3 +61,159 @@ TEST_CASE("ThreadPool: exception in task does not kill the worker") {
     auto good = pool.enqueue([] { return 7; });
     CHECK(good.get() == 7);
 }
+
+TEST_CASE("ThreadPool: bounded DropNew rejects once the queue is full") {
+    muses::ThreadPool pool(1, /*queue_capacity=*/1, muses::OverflowPolicy::DropNew);
+    std::promise<void> gate;
+    std::shared_future<void> open = gate.get_future().share();
+    auto running = pool.enqueue([open] { open.wait(); });  // occupies the worker
+    while (pool.size() != 0) std::this_thread::yield();
+    auto queued = pool.enqueue([] { return 1; });
+    auto rejected = pool.enqueue([] { return 2; });
+    CHECK(queued.valid());
+    CHECK_FALSE(rejected.valid());
+    CHECK(pool.dropped() == 1);
+    gate.set_value();
+    CHECK(queued.get() == 1);
+}
+
+TEST_CASE("ThreadPool: bounded DropOldest evicts the longest-waiting task") {
+    muses::ThreadPool pool(1, /*queue_capacity=*/1, muses::OverflowPolicy::DropOldest);
+    std::promise<void> gate;
+    std::shared_future<void> open = gate.get_future().share();
+    auto running = pool.enqueue([open] { open.wait(); });
+    while (pool.size() != 0) std::this_thread::yield();
+    auto oldest = pool.enqueue([] { return 1; });
+    auto newest = pool.enqueue([] { return 2; });
+    REQUIRE(oldest.valid());
+    REQUIRE(newest.valid());
+    gate.set_value();
+    CHECK(newest.get() == 2);
+    CHECK_THROWS_AS(oldest.get(), std::future_error);
+    CHECK(pool.dropped() == 1);
+    pool.wait_empty();
+}
+
+TEST_CASE("ThreadPool: bounded CallerRuns executes on the submitting thread") {
+    muses::ThreadPool pool(1, /*queue_capacity=*/1, muses::OverflowPolicy::CallerRuns);
+    std::promise<void> gate;
+    std::shared_future<void> open = gate.get_future().share();
+    auto running = pool.enqueue([open] { open.wait(); });
+    while (pool.size() != 0) std::this_thread::yield();
+    auto queued = pool.enqueue([] { return std::this_thread::get_id(); });
+    auto inline_run = pool.enqueue([] { return std::this_thread::get_id(); });
+    // The overflow task already ran, on this thread, before enqueue returned.
+    REQUIRE(inline_run.wait_for(std::chrono::seconds(0)) == std::future_status::ready);
+    CHECK(inline_run.get() == std::this_thread::get_id());
+    gate.set_value();
+    CHECK(queued.get() != std::this_thread::get_id());
+}
+
+TEST_CASE("ThreadPool: bounded Block waits for a free slot") {
+    muses::ThreadPool pool(1, /*queue_capacity=*/1, muses::OverflowPolicy::Block);
+    std::promise<void> gate;
+    std::shared_future<void> open = gate.get_future().share();
+    auto running = pool.enqueue([open] { open.wait(); });
+    while (pool.size() != 0) std::this_thread::yield();
+    auto queued = pool.enqueue([] { return 1; });
+    std::atomic<bool> submitted{false};
+    std::thread producer([&] {
+        auto f = pool.enqueue([] { return 2; });
+        submitted.store(true);
+        CHECK(f.get() == 2);
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    CHECK_FALSE(submitted.load());  // still parked on the full queue
+    gate.set_value();
+    producer.join();
+    CHECK(submitted.load());
+    CHECK(queued.get() == 1);
+}
+
+TEST_CASE("ThreadPool: strict lanes run High before Normal before Background") {
+    muses::ThreadPool pool(1);
+    pool.configure_lanes(muses::LaneScheduling::Strict, {8, 4, 1},
+                         std::chrono::milliseconds(0));
+    std::promise<void> gate;
+    std::shared_future<void> open = gate.get_future().share();
+    pool.enqueue([open] { open.wait(); });
+    while (pool.size() != 0) std::this_thread::yield();
+
+    std::mutex mu;
+    std::vector<char> order;
+    auto record = [&](char c) { std::lock_guard<std::mutex> l(mu); order.push_back(c); };
+    pool.enqueue(muses::TaskPriority::Background, record, 'b');
+    pool.enqueue(muses::TaskPriority::Normal, record, 'n');
+    pool.enqueue(muses::TaskPriority::High, record, 'h');
+    CHECK(pool.size(muses::TaskPriority::High) == 1);
+    gate.set_value();
+    pool.wait_empty();
+    CHECK(order == std::vector<char>{'h', 'n', 'b'});
+}
+
+TEST_CASE("ThreadPool: weighted lanes share dispatches by weight") {
+    muses::ThreadPool pool(1);
+    pool.configure_lanes(muses::LaneScheduling::Weighted, {3, 1, 1},
+                         std::chrono::milliseconds(0));
+    std::promise<void> gate;
+    std::shared_future<void> open = gate.get_future().share();
+    pool.enqueue([open] { open.wait(); });
+    while (pool.size() != 0) std::this_thread::yield();
+
+    std::mutex mu;
+    std::vector<char> order;
+    auto record = [&](char c) { std::lock_guard<std::mutex> l(mu); order.push_back(c); };
+    for (int i = 0; i < 8; ++i) {
+        pool.enqueue(muses::TaskPriority::High, record, 'h');
+        pool.enqueue(muses::TaskPriority::Background, record, 'b');
+    }
+    gate.set_value();
+    pool.wait_empty();
+    REQUIRE(order.size() == 16);
+    // While both lanes are backlogged, High gets 3 of every 4 dispatches, yet
+    // Background still makes progress (no strict starvation).
+    int high_first8 = static_cast<int>(std::count(order.begin(), order.begin() + 8, 'h'));
+    CHECK(high_first8 == 6);
+}
+
+TEST_CASE("ThreadPool: aging promotes a starved Background task") {
+    muses::ThreadPool pool(1);
+    pool.configure_lanes(muses::LaneScheduling::Strict, {8, 4, 1},
+                         std::chrono::milliseconds(20));
+    // A High task that requeues itself keeps the High lane busy for up to
+    // 2 s; the Background task climbs one lane per 20 ms and runs anyway.
+    std::atomic<bool> ran{false};
+    std::atomic<int> highs{0};
+    std::function<void()> high = [&] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        if (!ran.load() && highs.fetch_add(1) < 400) pool.enqueue(muses::TaskPriority::High, high);
+    };
+    pool.enqueue(muses::TaskPriority::High, high);
+    pool.enqueue(muses::TaskPriority::Background, [&] { ran.store(true); });
+    pool.wait_empty();
+    CHECK(ran.load());
+    CHECK(highs.load() < 100);
+}
+
+TEST_CASE("ThreadPool: aging keeps lane order under a sustained backlog") {
+    muses::ThreadPool pool(1);
+    pool.configure_lanes(muses::LaneScheduling::Strict, {8, 4, 1},
+                         std::chrono::milliseconds(5));
+    std::promise<void> gate;
+    std::shared_future<void> open = gate.get_future().share();
+    pool.enqueue([open] { open.wait(); });
+    while (pool.size() != 0) std::this_thread::yield();
+
+    std::mutex mu;
+    std::vector<char> order;
+    auto record = [&](char c) { std::lock_guard<std::mutex> l(mu); order.push_back(c); };
+    for (int i = 0; i < 10; ++i) pool.enqueue(muses::TaskPriority::Normal, record, 'n');
+    for (int i = 0; i < 10; ++i) pool.enqueue(muses::TaskPriority::High, record, 'h');
+    // Every head is past the threshold now: one Normal task moves up, the
+    // rest wait their turn behind High instead of going first by age.
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    gate.set_value();
+    pool.wait_empty();
+    REQUIRE(order.size() == 20);
+    CHECK(std::count(order.begin(), order.begin() + 10, 'h') >= 9);
+}
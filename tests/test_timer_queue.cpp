@@ -0,0 +1,88 @@
+#include <doctest.h>
+
+#include "muses/net/timer_queue.hpp"
+
+#include <chrono>
+#include <coroutine>
+#include <cstdint>
+
+namespace {
+
+using Clock = muses::TimerQueue::Clock;
+
+// Distinct non-null handles to tell entries apart; never resumed.
+std::coroutine_handle<> fake(std::uintptr_t n) {
+    return std::coroutine_handle<>::from_address(reinterpret_cast<void*>(n * 16));
+}
+
+}  // namespace
+
+TEST_CASE("TimerQueue: pops expired nodes in deadline then FIFO order") {
+    muses::TimerQueue q;
+    muses::TimerQueue::Node n1, n2, n3, n4;
+    auto now = Clock::now();
+    q.add(n3, now + std::chrono::milliseconds(20), fake(3));
+    q.add(n1, now + std::chrono::milliseconds(10), fake(1));
+    q.add(n2, now + std::chrono::milliseconds(10), fake(2));
+    q.add(n4, now + std::chrono::seconds(10), fake(4));
+
+    auto later = now + std::chrono::milliseconds(30);
+    CHECK(q.pop_expired(later) == &n1);
+    CHECK(q.pop_expired(later) == &n2);
+    CHECK(q.pop_expired(later) == &n3);
+    CHECK(q.pop_expired(later) == nullptr);
+    CHECK(q.size() == 1);
+    CHECK(n3.handle == fake(3));
+    CHECK_FALSE(n1.armed());
+    CHECK(n4.armed());
+    CHECK(q.cancel(n4));
+}
+
+TEST_CASE("TimerQueue: cancel removes a timer; unarmed nodes are harmless") {
+    muses::TimerQueue q;
+    muses::TimerQueue::Node a, b, never;
+    auto now = Clock::now();
+    q.add(a, now, fake(1));
+    q.add(b, now, fake(2));
+    CHECK(q.cancel(a));
+    CHECK_FALSE(q.cancel(a));
+    CHECK_FALSE(q.cancel(never));
+    CHECK(q.pop_expired(now) == &b);
+    CHECK_FALSE(q.cancel(b));  // already fired
+    CHECK(q.empty());
+}
+
+TEST_CASE("TimerQueue: cancelling from the middle keeps the heap ordered") {
+    muses::TimerQueue q;
+    muses::TimerQueue::Node nodes[16];
+    auto now = Clock::now();
+    for (int i = 0; i < 16; ++i) {
+        // Deadlines out of order: 7, 14, 5, 12, 3, ...
+        auto ms = std::chrono::milliseconds((i * 7) % 16);
+        q.add(nodes[i], now + ms, fake(static_cast<std::uintptr_t>(i + 1)));
+    }
+    for (int i = 0; i < 16; i += 3) CHECK(q.cancel(nodes[i]));
+    auto last = now - std::chrono::milliseconds(1);
+    std::size_t popped = 0;
+    while (auto* n = q.pop_expired(now + std::chrono::seconds(1))) {
+        CHECK(n->deadline() >= last);
+        last = n->deadline();
+        ++popped;
+    }
+    CHECK(popped == 10);
+}
+
+TEST_CASE("TimerQueue: timeout_ms rounds up and respects the cap") {
+    muses::TimerQueue q;
+    muses::TimerQueue::Node n;
+    auto now = Clock::now();
+    CHECK(q.timeout_ms(100, now) == 100);
+    CHECK(q.timeout_ms(-1, now) == -1);
+
+    q.add(n, now + std::chrono::microseconds(1500), fake(1));
+    CHECK(q.timeout_ms(100, now) == 2);
+    CHECK(q.timeout_ms(-1, now) == 2);
+    CHECK(q.timeout_ms(1, now) == 1);
+    CHECK(q.timeout_ms(100, now + std::chrono::milliseconds(5)) == 0);
+    q.cancel(n);
+}
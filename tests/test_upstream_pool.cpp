@@ -0,0 +1,114 @@
+#include <doctest.h>
+
+#include "muses/net_components/upstream_pool.hpp"
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+
+using muses::UpstreamPool;
+using namespace std::chrono_literals;
+
+namespace {
+
+// A connected pair standing in for proxy ↔ upstream: [0] is pooled, [1] is
+// the "upstream" end.
+struct Pair {
+    int fd[2] = {-1, -1};
+    Pair() { ::socketpair(AF_UNIX, SOCK_STREAM, 0, fd); }
+    ~Pair() {
+        if (fd[1] >= 0) ::close(fd[1]);
+    }
+    void upstream_close() {
+        ::close(fd[1]);
+        fd[1] = -1;
+    }
+};
+
+}  // namespace
+
+TEST_CASE("UpstreamPool: endpoints are interned once") {
+    UpstreamPool pool;
+    auto a = pool.intern("127.0.0.1", 80);
+    auto b = pool.intern("127.0.0.1", 81);
+    CHECK(a != b);
+    CHECK(pool.intern("127.0.0.1", 80) == a);
+    CHECK(pool.size() == 2);
+    CHECK(pool.name(b) == "127.0.0.1:81");
+    CHECK(pool.port(a) == 80);
+}
+
+TEST_CASE("UpstreamPool: reuses the most recently parked connection") {
+    UpstreamPool pool;
+    auto id = pool.intern("h", 1);
+    Pair p1, p2;
+    CHECK(pool.take(id) == -1);
+    pool.put(id, p1.fd[0]);
+    pool.put(id, p2.fd[0]);
+    CHECK(pool.stats(id).idle == 2);
+    CHECK(pool.take(id) == p2.fd[0]);
+    CHECK(pool.take(id) == p1.fd[0]);
+    CHECK(pool.stats(id).reused == 2);
+    ::close(p1.fd[0]);
+    ::close(p2.fd[0]);
+}
+
+TEST_CASE("UpstreamPool: connections the upstream closed are never handed out") {
+    UpstreamPool pool;
+    auto id = pool.intern("h", 1);
+    Pair live, dead, chatty;
+    pool.put(id, live.fd[0]);
+    pool.put(id, dead.fd[0]);
+    pool.put(id, chatty.fd[0]);
+    dead.upstream_close();
+    ::write(chatty.fd[1], "x", 1);  // an unsolicited byte: out of sync
+    CHECK(pool.take(id) == live.fd[0]);
+    CHECK(pool.stats(id).stale_closed == 2);
+    CHECK(pool.stats(id).idle == 0);
+    ::close(live.fd[0]);
+}
+
+TEST_CASE("UpstreamPool: idle timeout and sweep") {
+    UpstreamPool pool(UpstreamPool::Options{.max_idle = 8, .idle_timeout = 1000ms});
+    auto id = pool.intern("h", 1);
+    auto t0 = UpstreamPool::Clock::now();
+    Pair old_one, fresh, dead;
+    pool.put(id, old_one.fd[0], t0);
+    pool.put(id, fresh.fd[0], t0 + 900ms);
+    CHECK(pool.take(id, t0 + 1500ms) == fresh.fd[0]);
+    CHECK(pool.take(id, t0 + 1500ms) == -1);  // the old one expired on the way
+    CHECK(pool.stats(id).expired_closed == 1);
+
+    pool.put(id, fresh.fd[0], t0 + 2000ms);
+    pool.put(id, dead.fd[0], t0 + 2000ms);
+    dead.upstream_close();
+    pool.sweep(t0 + 2100ms);  // drops the dead one only
+    CHECK(pool.stats(id).idle == 1);
+    CHECK(pool.stats(id).stale_closed == 1);
+    pool.sweep(t0 + 3000ms);  // and now the expired one
+    CHECK(pool.stats(id).idle == 0);
+    CHECK(pool.stats(id).expired_closed == 2);
+}
+
+TEST_CASE("UpstreamPool: depth cap and min-idle deficit") {
+    UpstreamPool pool(UpstreamPool::Options{.max_idle = 1, .min_idle = 3});
+    auto id = pool.intern("h", 1);
+    CHECK(pool.deficit(id) == 3);
+    pool.connect_started(id);
+    CHECK(pool.deficit(id) == 2);  // in-flight connects count
+    pool.connect_finished(id, true);
+    pool.connect_started(id);
+    pool.connect_finished(id, false);
+    CHECK(pool.stats(id).connects == 1);
+    CHECK(pool.stats(id).connect_failures == 1);
+
+    Pair a, b;
+    pool.put(id, a.fd[0]);
+    pool.put(id, b.fd[0]);  // over max_idle: closed
+    CHECK(pool.stats(id).idle == 1);
+    CHECK(pool.stats(id).overflow_closed == 1);
+    CHECK(pool.deficit(id) == 2);
+    pool.clear();
+    CHECK(pool.stats(id).idle == 0);
+}
@@ -0,0 +1,181 @@
+#include <doctest.h>
+
+#include "muses/net/event_loop.hpp"
+#include "muses/when.hpp"
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+namespace {
+
+using namespace std::chrono_literals;
+
+void run_until(muses::EventLoop& loop, const std::atomic<bool>& done) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(3);
+    while (!done.load() && std::chrono::steady_clock::now() < deadline) {
+        loop.run_once(50, [](const muses::PollEvent&) {});
+    }
+}
+
+muses::Task<int> after(std::chrono::milliseconds d, int v) {
+    co_await muses::sleep_for(d);
+    co_return v;
+}
+
+muses::Task<void> tick(std::chrono::milliseconds d, int& counter) {
+    co_await muses::sleep_for(d);
+    ++counter;
+}
+
+muses::Task<int> fail_after(std::chrono::milliseconds d) {
+    co_await muses::sleep_for(d);
+    throw std::runtime_error("boom");
+}
+
+muses::Task<int> read_one(muses::EventLoop& loop, int fd) {
+    co_await muses::IoAwaiter{loop.poller(), fd, muses::EventMask::Readable};
+    char c = 0;
+    co_return ::read(fd, &c, 1) == 1 ? c : -1;
+}
+
+// Runs `body` to completion on `loop`; returns false if it did not finish.
+template <typename Body>
+bool run_task(muses::EventLoop& loop, Body body) {
+    std::atomic<bool> done{false};
+    auto root = [](Body b, std::atomic<bool>& d) -> muses::Task<void> {
+        co_await b();
+        d.store(true);
+    }(std::move(body), done);
+    loop.post(root.handle());
+    run_until(loop, done);
+    return done.load();
+}
+
+}  // namespace
+
+TEST_CASE("when_all: children overlap, latency is the max not the sum") {
+    muses::EventLoop loop;
+    std::tuple<int, int, int> got{};
+    auto start = std::chrono::steady_clock::now();
+    REQUIRE(run_task(loop, [&]() -> muses::Task<void> {
+        got = co_await muses::when_all(after(80ms, 1), after(80ms, 2), after(80ms, 3));
+    }));
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    CHECK(got == std::make_tuple(1, 2, 3));
+    CHECK(elapsed < 200ms);
+}
+
+TEST_CASE("when_all: vector form keeps input order; void tasks all run") {
+    muses::EventLoop loop;
+    std::vector<int> got;
+    int ticks = 0;
+    REQUIRE(run_task(loop, [&]() -> muses::Task<void> {
+        std::vector<muses::Task<int>> tasks;
+        tasks.push_back(after(30ms, 10));
+        tasks.push_back(after(0ms, 20));  // finishes synchronously
+        tasks.push_back(after(10ms, 30));
+        got = co_await muses::when_all(std::move(tasks));
+
+        std::vector<muses::Task<void>> voids;
+        for (int i = 0; i < 4; ++i) voids.push_back(tick(5ms, ticks));
+        co_await muses::when_all(std::move(voids));
+    }));
+    CHECK(got == std::vector<int>{10, 20, 30});
+    CHECK(ticks == 4);
+}
+
+TEST_CASE("when_all: a child exception is rethrown after all finish") {
+    muses::EventLoop loop;
+    bool caught = false;
+    int ticks = 0;
+    REQUIRE(run_task(loop, [&]() -> muses::Task<void> {
+        try {
+            co_await muses::when_all(fail_after(5ms), after(20ms, 1));
+        } catch (const std::runtime_error&) {
+            caught = true;
+        }
+        co_await tick(0ms, ticks);
+    }));
+    CHECK(caught);
+    CHECK(loop.pending_timers() == 0);
+}
+
+TEST_CASE("when_any: first result wins and losers are cancelled") {
+    muses::EventLoop loop;
+    int sv[2];
+    REQUIRE(::socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+    muses::WhenAnyResult<int> got{99, 0};
+    auto start = std::chrono::steady_clock::now();
+    REQUIRE(run_task(loop, [&]() -> muses::Task<void> {
+        std::vector<muses::Task<int>> tasks;
+        tasks.push_back(after(2s, 1));
+        tasks.push_back(read_one(loop, sv[0]));  // never becomes readable
+        tasks.push_back(after(30ms, 3));
+        got = co_await muses::when_any(std::move(tasks));
+    }));
+    CHECK(std::chrono::steady_clock::now() - start < 1s);
+    CHECK(got.index == 2);
+    CHECK(got.value == 3);
+    CHECK(loop.pending_timers() == 0);
+    // The cancelled reader no longer holds a registration on sv[0].
+    CHECK(loop.poller()->add(sv[0], muses::EventMask::Readable, nullptr));
+    loop.poller()->del(sv[0]);
+    ::close(sv[0]);
+    ::close(sv[1]);
+}
+
+TEST_CASE("when_any: predicate skips unacceptable results; failures fall through") {
+    muses::EventLoop loop;
+    muses::WhenAnyResult<int> got{99, 0};
+    REQUIRE(run_task(loop, [&]() -> muses::Task<void> {
+        std::vector<muses::Task<int>> tasks;
+        tasks.push_back(after(5ms, -1));      // "bad answer"
+        tasks.push_back(fail_after(10ms));   // error
+        tasks.push_back(after(40ms, 7));
+        got = co_await muses::when_any(std::move(tasks), [](int v) { return v >= 0; });
+    }));
+    CHECK(got.index == 2);
+    CHECK(got.value == 7);
+
+    bool caught = false;
+    REQUIRE(run_task(loop, [&]() -> muses::Task<void> {
+        try {
+            co_await muses::when_any(fail_after(5ms), fail_after(10ms));
+        } catch (const std::runtime_error&) {
+            caught = true;
+        }
+    }));
+    CHECK(caught);
+}
+
+TEST_CASE("when_any: a reader that wins in the same poll batch as a loser") {
+    // Both sockets readable before the loop polls: the first reader's win
+    // destroys the second while its readiness is still in the event batch.
+    muses::EventLoop loop;
+    int a[2], b[2];
+    REQUIRE(::socketpair(AF_UNIX, SOCK_STREAM, 0, a) == 0);
+    REQUIRE(::socketpair(AF_UNIX, SOCK_STREAM, 0, b) == 0);
+    muses::WhenAnyResult<int> got{99, 0};
+    std::atomic<bool> done{false};
+    auto root = [](muses::EventLoop& l, int fa, int fb, muses::WhenAnyResult<int>& g,
+                   std::atomic<bool>& d) -> muses::Task<void> {
+        g = co_await muses::when_any(read_one(l, fa), read_one(l, fb));
+        d.store(true);
+    }(loop, a[0], b[0], got, done);
+    loop.post(root.handle());
+    loop.run_once(0, [](const muses::PollEvent&) {});  // both readers now suspended
+    REQUIRE(::write(a[1], "x", 1) == 1);
+    REQUIRE(::write(b[1], "y", 1) == 1);
+    run_until(loop, done);
+    REQUIRE(done.load());
+    CHECK((got.value == 'x' || got.value == 'y'));
+    for (int fd : {a[0], a[1], b[0], b[1]}) ::close(fd);
+}